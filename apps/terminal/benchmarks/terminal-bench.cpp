@@ -0,0 +1,357 @@
+// Replays recorded PTY output through the terminal and reports parser and
+// screen throughput, allocations and frame latency. See ../README.md.
+
+#include "TerminalEngine.h"
+#include "TerminalEngineWorker.h"
+#include "TerminalFrame.h"
+#include "TerminalParser.h"
+#include "TerminalRenderer.h"
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QQuickWindow>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Allocation counting. On glibc every malloc is counted, which includes
+// the Qt containers; elsewhere only operator new is.
+static std::atomic<quint64> g_allocations{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+static const char *const AllocationScope = "malloc";
+#else
+void *operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+static const char *const AllocationScope = "new";
+#endif
+
+namespace {
+
+struct Input {
+    QString name;
+    QByteArray data;
+};
+
+struct Result {
+    double parseMBps = 0;
+    double screenMBps = 0;
+    qint64 cells = 0;
+    double cellsPerSecond = 0;
+    double allocationsPerMB = 0;
+    double frameP50 = 0; // Milliseconds
+    double frameP99 = 0;
+    int frames = 0;
+};
+
+// Counts printed cells without touching a screen, for the parser figure
+class CountingHandler : public TerminalParser::Handler {
+public:
+    qint64 cells = 0;
+
+    void print(const char *data, int length) override
+    {
+        for (int i = 0; i < length; ++i) {
+            if ((uchar(data[i]) & 0xC0) != 0x80) cells++;
+        }
+    }
+    void execute(uint8_t) override {}
+    void csiDispatch(const TerminalParser &, char) override {}
+    void escDispatch(const TerminalParser &, char) override {}
+    void oscDispatch(const QByteArray &) override {}
+};
+
+// asciicast v2: a JSON header line, then [time, type, data] events
+QByteArray readAsciicast(QFile &file)
+{
+    QByteArray output;
+    file.readLine(); // Header
+    while (!file.atEnd()) {
+        const QJsonArray event = QJsonDocument::fromJson(file.readLine()).array();
+        if (event.size() >= 3 && event.at(1).toString() == QLatin1String("o")) {
+            output.append(event.at(2).toString().toUtf8());
+        }
+    }
+    return output;
+}
+
+// Deterministic synthetic streams, so runs compare across machines
+QByteArray generate(const QString &kind, qint64 bytes)
+{
+    QByteArray out;
+    out.reserve(bytes + 256);
+    quint32 seed = 0x12345678;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    if (kind == QLatin1String("cat")) {
+        // Plain text lines of varying length, like `cat` of a source tree
+        while (out.size() < bytes) {
+            const int length = 20 + next() % 100;
+            for (int i = 0; i < length; ++i) out.append(char(' ' + next() % 95));
+            out.append("\r\n");
+        }
+    } else if (kind == QLatin1String("sgr")) {
+        // A truecolor escape before every character
+        while (out.size() < bytes) {
+            for (int i = 0; i < 80; ++i) {
+                out.append("\x1b[38;2;");
+                out.append(QByteArray::number(next() % 256)).append(';');
+                out.append(QByteArray::number(next() % 256)).append(';');
+                out.append(QByteArray::number(next() % 256)).append('m');
+                out.append(char('A' + next() % 26));
+            }
+            out.append("\x1b[0m\r\n");
+        }
+    } else if (kind == QLatin1String("cjk")) {
+        // Mixed wide and narrow text that wraps at odd columns
+        const QByteArray samples[] = { "\xe4\xb8\xad", "\xe6\x96\x87", "\xe3\x81\x82", "a", "b", " " };
+        while (out.size() < bytes) {
+            const int length = 10 + next() % 120;
+            for (int i = 0; i < length; ++i) out.append(samples[next() % 6]);
+            out.append("\r\n");
+        }
+    }
+    return out;
+}
+
+double percentile(QVector<qint64> samples, double fraction)
+{
+    if (samples.isEmpty()) return 0;
+    const int index = std::min<int>(samples.size() - 1, int(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples.at(index) / 1e6;
+}
+
+void runParser(const Input &input, Result *result)
+{
+    CountingHandler handler;
+    TerminalParser parser(&handler);
+    QElapsedTimer timer;
+    timer.start();
+    parser.parse(input.data.constData(), input.data.size());
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    result->parseMBps = input.data.size() / 1e6 / seconds;
+    result->cells = handler.cells;
+}
+
+// Parser + screen + frame snapshots on this thread, one frame per read
+void runHeadless(const Input &input, int cols, int rows, int chunkSize, Result *result)
+{
+    TerminalFrameQueue frames;
+    TerminalEngineWorker worker(&frames);
+    worker.setPresentation(TerminalEngine::Immediate, 0);
+    worker.resize(cols, rows);
+
+    QVector<qint64> frameTimes;
+    frameTimes.reserve(input.data.size() / chunkSize + 1);
+    const QByteArray &data = input.data;
+
+    const quint64 allocationsBefore = g_allocations.load();
+    QElapsedTimer total;
+    total.start();
+    for (qsizetype offset = 0; offset < data.size(); offset += chunkSize) {
+        // fromRawData: the chunk itself is not an allocation of the terminal
+        const QByteArray chunk = QByteArray::fromRawData(data.constData() + offset,
+                                                         std::min<qsizetype>(chunkSize, data.size() - offset));
+        QElapsedTimer frame;
+        frame.start();
+        worker.replay(chunk);
+        frames.acquire();
+        frameTimes.append(frame.nsecsElapsed());
+    }
+    const double seconds = total.nsecsElapsed() / 1e9;
+    const quint64 allocations = g_allocations.load() - allocationsBefore;
+
+    result->screenMBps = data.size() / 1e6 / seconds;
+    result->cellsPerSecond = result->cells / seconds;
+    result->allocationsPerMB = allocations / (data.size() / 1e6);
+    result->frameP50 = percentile(frameTimes, 0.50);
+    result->frameP99 = percentile(frameTimes, 0.99);
+    result->frames = frameTimes.size();
+}
+
+// Full pipeline into a TerminalRenderer window. Output is fed a frame's
+// worth at a time, as the PTY would under backpressure; frame time is
+// scene graph sync (updatePaintNode) plus render.
+void runRendered(const Input &input, int cols, int rows, int frameBytes, Result *result)
+{
+    QQuickWindow window;
+    TerminalEngine engine;
+    auto *renderer = new TerminalRenderer(window.contentItem());
+    renderer->setTerminal(&engine);
+    engine.resize(cols, rows);
+    renderer->setSize(QSizeF(cols * renderer->charWidth(), rows * renderer->charHeight()));
+    window.resize(renderer->size().toSize());
+
+    // Written on the render thread
+    QMutex frameMutex;
+    QVector<qint64> frameTimes;
+    QElapsedTimer frameTimer;
+    QObject::connect(&window, &QQuickWindow::beforeSynchronizing, &window,
+                     [&frameTimer]() { frameTimer.start(); }, Qt::DirectConnection);
+    QObject::connect(&window, &QQuickWindow::afterRendering, &window, [&]() {
+        QMutexLocker locker(&frameMutex);
+        frameTimes.append(frameTimer.nsecsElapsed());
+    }, Qt::DirectConnection);
+
+    const QByteArray &data = input.data;
+    qsizetype offset = 0;
+    QEventLoop loop;
+    auto feed = [&]() {
+        if (offset >= data.size()) {
+            loop.quit();
+            return;
+        }
+        const qsizetype length = std::min<qsizetype>(frameBytes, data.size() - offset);
+        engine.replay(QByteArray::fromRawData(data.constData() + offset, length));
+        offset += length;
+    };
+
+    // Frames drive the feed; the timer keeps it going if a chunk produced
+    // no visible change (and therefore no frame)
+    QTimer idle;
+    idle.setInterval(50);
+    QObject::connect(&window, &QQuickWindow::frameSwapped, &loop, [&]() {
+        feed();
+        idle.start();
+    }, Qt::QueuedConnection);
+    QObject::connect(&idle, &QTimer::timeout, &loop, feed);
+
+    const quint64 allocationsBefore = g_allocations.load();
+    QElapsedTimer total;
+    total.start();
+    window.show();
+    feed();
+    idle.start();
+    loop.exec();
+    const double seconds = total.nsecsElapsed() / 1e9;
+    const quint64 allocations = g_allocations.load() - allocationsBefore;
+    window.hide();
+
+    QMutexLocker locker(&frameMutex);
+    result->screenMBps = data.size() / 1e6 / seconds;
+    result->cellsPerSecond = result->cells / seconds;
+    result->allocationsPerMB = allocations / (data.size() / 1e6);
+    result->frameP50 = percentile(frameTimes, 0.50);
+    result->frameP99 = percentile(frameTimes, 0.99);
+    result->frames = frameTimes.size();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setApplicationName("terminal-bench");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Replays PTY output through the Marathon terminal.");
+    options.addHelpOption();
+    options.addPositionalArgument("inputs", "Recorded streams: asciicast v2 (.cast) or raw bytes "
+                                            "(vttest traces, cat dumps).", "[files...]");
+    QCommandLineOption generateOption("generate", "Synthetic stream: cat, sgr or cjk (repeatable). "
+                                                  "All three when no files are given.", "kind");
+    QCommandLineOption sizeOption("size", "Size of synthetic streams in MB.", "mb", "32");
+    QCommandLineOption renderOption("render", "Render through TerminalRenderer in a window "
+                                              "(use -platform offscreen where supported).");
+    QCommandLineOption colsOption("cols", "Terminal width.", "cols", "80");
+    QCommandLineOption rowsOption("rows", "Terminal height.", "rows", "24");
+    QCommandLineOption chunkOption("chunk", "Bytes per simulated read (headless).", "bytes", "4096");
+    QCommandLineOption frameOption("frame-bytes", "Bytes fed per frame (--render).", "bytes", "1048576");
+    options.addOptions({ generateOption, sizeOption, renderOption, colsOption, rowsOption,
+                         chunkOption, frameOption });
+    options.process(app);
+
+    const int cols = std::max(1, options.value(colsOption).toInt());
+    const int rows = std::max(1, options.value(rowsOption).toInt());
+    const int chunk = std::max(1, options.value(chunkOption).toInt());
+    const int frameBytes = std::max(1, options.value(frameOption).toInt());
+    const qint64 syntheticBytes = options.value(sizeOption).toLongLong() * 1000 * 1000;
+
+    QVector<Input> inputs;
+    for (const QString &path : options.positionalArguments()) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+            return 1;
+        }
+        const bool cast = path.endsWith(QLatin1String(".cast"));
+        inputs.append({ QFileInfo(path).fileName(), cast ? readAsciicast(file) : file.readAll() });
+    }
+
+    QStringList kinds = options.values(generateOption);
+    if (kinds.isEmpty() && inputs.isEmpty()) kinds = { "cat", "sgr", "cjk" };
+    for (const QString &kind : kinds) {
+        const QByteArray data = generate(kind, syntheticBytes);
+        if (data.isEmpty()) {
+            fprintf(stderr, "Unknown stream kind %s\n", qPrintable(kind));
+            return 1;
+        }
+        inputs.append({ kind, data });
+    }
+
+    printf("%-20s %8s %11s %11s %10s %10s %8s %8s %7s\n", "input", "MB", "parse MB/s",
+           options.isSet(renderOption) ? "e2e MB/s" : "screen MB/s", "Mcells/s",
+           qPrintable(QString("%1/MB").arg(AllocationScope)), "p50 ms", "p99 ms", "frames");
+
+    for (const Input &input : inputs) {
+        if (input.data.isEmpty()) continue;
+
+        Result result;
+        runParser(input, &result);
+        if (options.isSet(renderOption)) {
+            runRendered(input, cols, rows, frameBytes, &result);
+        } else {
+            runHeadless(input, cols, rows, chunk, &result);
+        }
+
+        printf("%-20s %8.1f %11.1f %11.1f %10.2f %10.1f %8.3f %8.3f %7d\n", qPrintable(input.name),
+               input.data.size() / 1e6, result.parseMBps, result.screenMBps,
+               result.cellsPerSecond / 1e6, result.allocationsPerMB, result.frameP50,
+               result.frameP99, result.frames);
+    }
+    return 0;
+}
@@ -29,6 +29,9 @@ Item {
     TerminalEngine {
         id: terminalEngine
         
+        // Background tabs keep running but skip rendering
+        visible: root.visible
+        
         onFinished: {
             root.sessionFinished()
         }
@@ -0,0 +1,19 @@
+#version 440
+
+layout(location = 0) in vec2 sampleCoord;
+layout(location = 1) in vec4 color;
+
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 matrix;
+    float opacity;
+};
+
+layout(binding = 1) uniform sampler2D glyphTexture;
+
+// Glyphs are rasterized white into the atlas; only coverage is sampled
+void main()
+{
+    fragColor = color * texture(glyphTexture, sampleCoord).a;
+}
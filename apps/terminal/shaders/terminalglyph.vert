@@ -0,0 +1,22 @@
+#version 440
+
+layout(location = 0) in vec4 vertexCoord;
+layout(location = 1) in vec2 textureCoord;
+layout(location = 2) in vec4 vertexColor;
+
+layout(location = 0) out vec2 sampleCoord;
+layout(location = 1) out vec4 color;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 matrix;
+    float opacity;
+};
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+    sampleCoord = textureCoord;
+    color = vertexColor * opacity;
+    gl_Position = matrix * vertexCoord;
+}
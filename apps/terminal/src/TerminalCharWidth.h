@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of grid cells a code point occupies: 0 for combining marks and
+// format characters, 2 for East Asian Wide/Fullwidth (CJK, most emoji),
+// 1 otherwise. Backed by a two-stage table generated by
+// scripts/gen-terminal-charwidth.py.
+namespace TerminalCharWidth {
+
+constexpr int BlockBits = 7;
+constexpr int BlockSize = 1 << BlockBits;
+constexpr char32_t TableLimit = 0x20000;
+
+extern const uint8_t stage1[TableLimit >> BlockBits];
+extern const uint8_t stage2[][BlockSize / 4];
+
+inline int width(char32_t codePoint)
+{
+    // Latin, Greek and Cyrillic letters are never wide or zero-width
+    if (codePoint < 0x300) return 1;
+
+    if (codePoint < TableLimit) {
+        const uint8_t block = stage1[codePoint >> BlockBits];
+        const uint32_t offset = codePoint & (BlockSize - 1);
+        return (stage2[block][offset >> 2] >> ((offset & 3) * 2)) & 0x03;
+    }
+
+    if (codePoint >= 0x20000 && codePoint <= 0x3FFFD) return 2; // CJK Ext. B+
+    if (codePoint >= 0xE0000 && codePoint <= 0xE0FFF) return 0; // Tags, variation selectors
+    return 1;
+}
+
+} // namespace TerminalCharWidth
@@ -1,8 +1,11 @@
 #include "TerminalEngine.h"
-#include "TerminalScreen.h"
+#include "TerminalEngineWorker.h"
+#include "TerminalSearch.h"
+#include "TerminalSessionManager.h"
 #include <QDebug>
-#include <QSocketNotifier>
 #include <QCoreApplication>
+#include <QThread>
+#include <algorithm>
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -24,17 +27,48 @@ TerminalEngine::TerminalEngine(QObject *parent)
     : QObject(parent)
     , m_masterFd(-1)
     , m_pid(-1)
-    , m_notifier(nullptr)
     , m_title("Terminal")
-    , m_screen(new TerminalScreen(this))
-    , m_state(Normal)
+    , m_visible(true)
+    , m_cols(80)
+    , m_rows(24)
+    , m_presentationMode(FramePaced)
+    , m_frameByteBudget(1024 * 1024)
+    , m_scrollbackLines(100000)
+    , m_scrollbackMemoryBudget(8 * 1024 * 1024)
+    , m_sessions(TerminalSessionManager::instance())
+    , m_worker(new TerminalEngineWorker(&m_frames, m_sessions->reactor()))
+    , m_searchWorker(new TerminalSearchWorker)
+    , m_searchId(0)
 {
+    m_worker->setSearchWorker(m_searchWorker);
+    
+    connect(m_worker, &TerminalEngineWorker::frameReady, this, &TerminalEngine::frameReady);
+    connect(m_worker, &TerminalEngineWorker::titleChanged, this, &TerminalEngine::onTitleChanged);
+    connect(m_worker, &TerminalEngineWorker::hangup, this, &TerminalEngine::terminate);
+    connect(m_worker, &TerminalEngineWorker::searchFinished, this, &TerminalEngine::onSearchFinished);
+    connect(m_searchWorker, &TerminalSearchWorker::matchesFound, this, &TerminalEngine::onSearchMatches);
+    connect(m_searchWorker, &TerminalSearchWorker::finished, this, &TerminalEngine::onSearchFinished);
+    
+    // Configured before the move: nothing on the shared threads knows
+    // about these workers yet
+    m_worker->setPresentation(m_presentationMode, m_frameByteBudget);
+    m_worker->setScrollback(m_scrollbackLines, m_scrollbackMemoryBudget);
+    m_worker->moveToThread(m_sessions->ioThread());
+    m_searchWorker->moveToThread(m_sessions->searchThread());
     qDebug() << "[TerminalEngine] Created";
 }
 
 TerminalEngine::~TerminalEngine()
 {
     terminate();
+    
+    // The worker publishes into m_frames, so it has to be gone before they
+    // are; the shared thread keeps running for the other sessions
+    TerminalEngineWorker *worker = m_worker;
+    QMetaObject::invokeMethod(worker, [worker]() { delete worker; }, Qt::BlockingQueuedConnection);
+    
+    m_searchWorker->setCurrentSearch(0);
+    m_searchWorker->deleteLater();
 }
 
 void TerminalEngine::start(const QString &shell)
@@ -48,8 +82,8 @@ void TerminalEngine::start(const QString &shell)
     }
     
     struct winsize winp;
-    winp.ws_col = m_screen->cols();
-    winp.ws_row = m_screen->rows();
+    winp.ws_col = m_cols;
+    winp.ws_row = m_rows;
     winp.ws_xpixel = 0;
     winp.ws_ypixel = 0;
     
@@ -72,174 +106,117 @@ void TerminalEngine::start(const QString &shell)
         int flags = fcntl(m_masterFd, F_GETFL);
         fcntl(m_masterFd, F_SETFL, flags | O_NONBLOCK);
         
-        m_notifier = new QSocketNotifier(m_masterFd, QSocketNotifier::Read, this);
-        connect(m_notifier, &QSocketNotifier::activated, this, &TerminalEngine::onReadActivated);
+        QMetaObject::invokeMethod(m_worker, "attach", Qt::QueuedConnection, Q_ARG(int, m_masterFd));
         
         emit runningChanged();
     }
 }
 
-void TerminalEngine::onReadActivated()
+void TerminalEngine::setVisible(bool visible)
 {
-    char buffer[4096];
-    ssize_t bytesRead = read(m_masterFd, buffer, sizeof(buffer));
-    
-    if (bytesRead > 0) {
-        processOutput(QByteArray(buffer, bytesRead));
-    } else if (bytesRead <= 0 && errno != EAGAIN) {
-        terminate();
-    }
+    if (m_visible == visible) return;
+    m_visible = visible;
+    QMetaObject::invokeMethod(m_worker, "setVisible", Qt::QueuedConnection, Q_ARG(bool, m_visible));
+    emit visibleChanged();
 }
 
-void TerminalEngine::processOutput(const QByteArray &data)
+void TerminalEngine::setPresentationMode(PresentationMode mode)
 {
-    for (char ch : data) {
-        if (m_state == Normal) {
-            if (ch == '\x1b') {
-                m_state = Escape;
-            } else if (ch == '\r') {
-                m_screen->setCursorX(0);
-            } else if (ch == '\n') {
-                m_screen->newLine();
-            } else if (ch == '\b') {
-                m_screen->backspace();
-            } else if (ch == '\t') {
-                // Simple tab handling (every 8 chars)
-                int x = m_screen->cursorX();
-                int nextTab = (x / 8 + 1) * 8;
-                m_screen->setCursorX(nextTab);
-            } else if (ch == '\a') {
-                // Bell - ignore
-            } else if (static_cast<unsigned char>(ch) >= 32) {
-                m_screen->putChar(ch);
-            }
-        } else {
-            parseEscapeSequence(ch);
-        }
-    }
+    if (m_presentationMode == mode) return;
+    m_presentationMode = mode;
+    QMetaObject::invokeMethod(m_worker, "setPresentation", Qt::QueuedConnection,
+                              Q_ARG(int, m_presentationMode),
+                              Q_ARG(int, m_frameByteBudget));
+    emit presentationModeChanged();
 }
 
-void TerminalEngine::parseEscapeSequence(char ch)
+void TerminalEngine::setFrameByteBudget(int bytes)
 {
-    if (m_state == Escape) {
-        if (ch == '[') {
-            m_state = CSI;
-            m_sequenceBuffer.clear();
-            m_params.clear();
-        } else if (ch == ']') {
-            m_state = OSC;
-            m_sequenceBuffer.clear();
-        } else if (ch == '(' || ch == ')') {
-            m_state = Charset;
-        } else {
-            // Unknown escape sequence, reset
-            m_state = Normal;
-        }
-    } else if (m_state == CSI) {
-        if (isdigit(ch)) {
-            m_sequenceBuffer.append(ch);
-        } else if (ch == ';') {
-            m_params.append(m_sequenceBuffer.toInt());
-            m_sequenceBuffer.clear();
-        } else if (ch >= 0x40 && ch <= 0x7E) {
-            // Final byte
-            m_params.append(m_sequenceBuffer.toInt());
-            handleCSI(QString(ch));
-            m_state = Normal;
-        }
-    } else if (m_state == OSC) {
-        if (ch == '\a' || ch == '\x9c') { // BEL or ST
-            handleOSC(m_sequenceBuffer);
-            m_state = Normal;
-        } else {
-            m_sequenceBuffer.append(ch);
-        }
-    } else if (m_state == Charset) {
-        // Ignore charset selection
-        m_state = Normal;
-    }
+    bytes = std::max(0, bytes);
+    if (m_frameByteBudget == bytes) return;
+    m_frameByteBudget = bytes;
+    QMetaObject::invokeMethod(m_worker, "setPresentation", Qt::QueuedConnection,
+                              Q_ARG(int, m_presentationMode),
+                              Q_ARG(int, m_frameByteBudget));
+    emit frameByteBudgetChanged();
 }
 
-void TerminalEngine::handleCSI(const QString &seq)
+void TerminalEngine::setScrollbackLines(int lines)
 {
-    int p1 = m_params.value(0, 0);
-    int p2 = m_params.value(1, 0);
-    
-    if (seq == "m") { // SGR - Select Graphic Rendition
-        if (m_params.isEmpty()) {
-            m_screen->resetStyle();
-        } else {
-            for (int param : m_params) {
-                if (param == 0) m_screen->resetStyle();
-                else if (param == 1) m_screen->setBold(true);
-                else if (param == 7) m_screen->setInverse(true);
-                else if (param == 22) m_screen->setBold(false);
-                else if (param == 27) m_screen->setInverse(false);
-                else if (param >= 30 && param <= 37) {
-                    // Standard FG
-                    const uint32_t colors[] = {
-                        0xFF000000, 0xFFCC0000, 0xFF4E9A06, 0xFFC4A000,
-                        0xFF3465A4, 0xFF75507B, 0xFF06989A, 0xFFD3D7CF
-                    };
-                    m_screen->setFgColor(colors[param - 30]);
-                } else if (param >= 40 && param <= 47) {
-                    // Standard BG
-                    const uint32_t colors[] = {
-                        0xFF000000, 0xFFCC0000, 0xFF4E9A06, 0xFFC4A000,
-                        0xFF3465A4, 0xFF75507B, 0xFF06989A, 0xFFD3D7CF
-                    };
-                    m_screen->setBgColor(colors[param - 40]);
-                } else if (param == 39) m_screen->setFgColor(0xFFFFFFFF); // Default FG
-                else if (param == 49) m_screen->setBgColor(0xFF000000); // Default BG
-                else if (param >= 90 && param <= 97) {
-                    // Bright FG
-                    const uint32_t colors[] = {
-                        0xFF555753, 0xFFEF2929, 0xFF8AE234, 0xFFFCE94F,
-                        0xFF729FCF, 0xFFAD7FA8, 0xFF34E2E2, 0xFFEEEEEC
-                    };
-                    m_screen->setFgColor(colors[param - 90]);
-                }
-            }
-        }
-    } else if (seq == "A") { // Cursor Up
-        m_screen->moveCursorRelative(0, -std::max(1, p1));
-    } else if (seq == "B") { // Cursor Down
-        m_screen->moveCursorRelative(0, std::max(1, p1));
-    } else if (seq == "C") { // Cursor Forward
-        m_screen->moveCursorRelative(std::max(1, p1), 0);
-    } else if (seq == "D") { // Cursor Back
-        m_screen->moveCursorRelative(-std::max(1, p1), 0);
-    } else if (seq == "H" || seq == "f") { // Cursor Position
-        int row = std::max(1, p1) - 1;
-        int col = std::max(1, p2) - 1;
-        m_screen->moveCursor(col, row);
-    } else if (seq == "J") { // Erase in Display
-        m_screen->clearScreen(p1);
-    } else if (seq == "K") { // Erase in Line
-        m_screen->clearLine(p1);
-    } else if (seq == "P") { // Delete Characters
-        m_screen->deleteChars(std::max(1, p1));
-    } else if (seq == "@") { // Insert Characters
-        m_screen->insertChars(std::max(1, p1));
-    }
+    lines = std::max(0, lines);
+    if (m_scrollbackLines == lines) return;
+    m_scrollbackLines = lines;
+    QMetaObject::invokeMethod(m_worker, "setScrollback", Qt::QueuedConnection,
+                              Q_ARG(int, m_scrollbackLines),
+                              Q_ARG(int, m_scrollbackMemoryBudget));
+    emit scrollbackLinesChanged();
 }
 
-void TerminalEngine::handleOSC(const QString &seq)
+void TerminalEngine::setScrollbackMemoryBudget(int bytes)
 {
-    if (seq.startsWith("0;") || seq.startsWith("2;")) {
-        int semi = seq.indexOf(';');
-        if (semi != -1) {
-            m_title = seq.mid(semi + 1);
-            emit titleChanged();
-        }
+    bytes = std::max(0, bytes);
+    if (m_scrollbackMemoryBudget == bytes) return;
+    m_scrollbackMemoryBudget = bytes;
+    QMetaObject::invokeMethod(m_worker, "setScrollback", Qt::QueuedConnection,
+                              Q_ARG(int, m_scrollbackLines),
+                              Q_ARG(int, m_scrollbackMemoryBudget));
+    emit scrollbackMemoryBudgetChanged();
+}
+
+void TerminalEngine::frameConsumed()
+{
+    // Cheap on every frame: only wakes the worker if it deferred a frame
+    if (m_worker->takeWaitingForConsumer()) {
+        QMetaObject::invokeMethod(m_worker, "onFrameConsumed", Qt::QueuedConnection);
     }
 }
 
+void TerminalEngine::replay(const QByteArray &data)
+{
+    QMetaObject::invokeMethod(m_worker, "replay", Qt::QueuedConnection, Q_ARG(QByteArray, data));
+}
+
+int TerminalEngine::find(const QString &text, bool regex, bool caseSensitive)
+{
+    const int searchId = ++m_searchId;
+    m_searchWorker->setCurrentSearch(searchId);
+    QMetaObject::invokeMethod(m_worker, "find", Qt::QueuedConnection,
+                              Q_ARG(int, searchId),
+                              Q_ARG(QString, text),
+                              Q_ARG(bool, regex),
+                              Q_ARG(bool, caseSensitive));
+    return searchId;
+}
+
+void TerminalEngine::cancelFind()
+{
+    // Results still in flight carry the old id and are dropped
+    ++m_searchId;
+    m_searchWorker->setCurrentSearch(0);
+}
+
+void TerminalEngine::onSearchMatches(int searchId, const QVariantList &matches)
+{
+    if (searchId == m_searchId) emit searchMatches(searchId, matches);
+}
+
+void TerminalEngine::onSearchFinished(int searchId, int matchCount)
+{
+    if (searchId == m_searchId) emit searchFinished(searchId, matchCount);
+}
+
+void TerminalEngine::onTitleChanged(const QString &title)
+{
+    if (m_title == title) return;
+    m_title = title;
+    emit titleChanged();
+}
+
 void TerminalEngine::sendInput(const QString &text)
 {
+    // The worker owns every write to the PTY, replies included
     if (m_masterFd != -1) {
-        QByteArray data = text.toUtf8();
-        write(m_masterFd, data.constData(), data.size());
+        QMetaObject::invokeMethod(m_worker, "write", Qt::QueuedConnection, Q_ARG(QByteArray, text.toUtf8()));
     }
 }
 
@@ -272,18 +249,15 @@ void TerminalEngine::sendKey(int key, const QString &text, int modifiers)
     }
     
     if (!data.isEmpty()) {
-        write(m_masterFd, data.constData(), data.size());
+        QMetaObject::invokeMethod(m_worker, "write", Qt::QueuedConnection, Q_ARG(QByteArray, data));
     }
 }
 
 void TerminalEngine::terminate()
 {
     if (m_pid > 0) {
-        if (m_notifier) {
-            m_notifier->setEnabled(false);
-            delete m_notifier;
-            m_notifier = nullptr;
-        }
+        // Stop the reader before the fd number can be reused
+        QMetaObject::invokeMethod(m_worker, "detach", Qt::BlockingQueuedConnection);
         if (m_masterFd != -1) {
             close(m_masterFd);
             m_masterFd = -1;
@@ -298,6 +272,9 @@ void TerminalEngine::terminate()
 
 void TerminalEngine::resize(int cols, int rows)
 {
+    m_cols = cols;
+    m_rows = rows;
+    
     if (m_masterFd != -1) {
         struct winsize winp;
         winp.ws_col = cols;
@@ -305,9 +282,31 @@ void TerminalEngine::resize(int cols, int rows)
         winp.ws_xpixel = 0;
         winp.ws_ypixel = 0;
         ioctl(m_masterFd, TIOCSWINSZ, &winp);
-        
-        m_screen->resize(cols, rows);
     }
+    
+    QMetaObject::invokeMethod(m_worker, "resize", Qt::QueuedConnection,
+                              Q_ARG(int, cols), Q_ARG(int, rows));
+}
+
+void TerminalEngine::setSelection(int startX, int startY, int endX, int endY)
+{
+    QMetaObject::invokeMethod(m_worker, "setSelection", Qt::QueuedConnection,
+                              Q_ARG(int, startX), Q_ARG(int, startY),
+                              Q_ARG(int, endX), Q_ARG(int, endY));
+}
+
+void TerminalEngine::clearSelection()
+{
+    QMetaObject::invokeMethod(m_worker, "clearSelection", Qt::QueuedConnection);
+}
+
+QString TerminalEngine::selectedText() const
+{
+    // Queued behind any pending selection change, so the text matches it
+    QString text;
+    QMetaObject::invokeMethod(m_worker, "selectedText", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(QString, text));
+    return text;
 }
 
 void TerminalEngine::sendSignal(int signal)
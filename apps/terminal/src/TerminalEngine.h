@@ -3,26 +3,72 @@
 #include <QObject>
 #include <QProcess>
 #include <QString>
+#include <QVariantList>
 #include <QtQmlIntegration>
-#include "TerminalScreen.h"
+#include <memory>
+#include "TerminalFrame.h"
 
-class QSocketNotifier;
+class TerminalEngineWorker;
+class TerminalSearchWorker;
+class TerminalSessionManager;
 
+/**
+ * QML-facing terminal session: spawns the shell on a PTY and forwards
+ * input to it. Output is read and parsed by a TerminalEngineWorker on the
+ * I/O thread all sessions share (TerminalSessionManager); the renderer
+ * consumes the resulting frames through frames() without taking any lock.
+ */
 class TerminalEngine : public QObject {
     Q_OBJECT
     QML_ELEMENT
     
     Q_PROPERTY(bool running READ running NOTIFY runningChanged)
     Q_PROPERTY(QString title READ title NOTIFY titleChanged)
-    Q_PROPERTY(TerminalScreen* screen READ screen CONSTANT)
+    Q_PROPERTY(bool visible READ isVisible WRITE setVisible NOTIFY visibleChanged)
+    Q_PROPERTY(PresentationMode presentationMode READ presentationMode WRITE setPresentationMode NOTIFY presentationModeChanged)
+    Q_PROPERTY(int frameByteBudget READ frameByteBudget WRITE setFrameByteBudget NOTIFY frameByteBudgetChanged)
+    Q_PROPERTY(int scrollbackLines READ scrollbackLines WRITE setScrollbackLines NOTIFY scrollbackLinesChanged)
+    Q_PROPERTY(int scrollbackMemoryBudget READ scrollbackMemoryBudget WRITE setScrollbackMemoryBudget NOTIFY scrollbackMemoryBudgetChanged)
     
 public:
+    // How parsed output turns into frames for the renderer
+    enum PresentationMode {
+        Immediate, // Snapshot after every PTY read
+        FramePaced // Snapshot only when the renderer took the last frame
+    };
+    Q_ENUM(PresentationMode)
+    
     explicit TerminalEngine(QObject *parent = nullptr);
     ~TerminalEngine() override;
     
     bool running() const { return m_pid > 0; }
     QString title() const { return m_title; }
-    TerminalScreen* screen() const { return m_screen; }
+    
+    // Hidden sessions (background tabs) keep parsing output but build no
+    // frames; showing one presents everything that changed meanwhile
+    bool isVisible() const { return m_visible; }
+    void setVisible(bool visible);
+    
+    PresentationMode presentationMode() const { return m_presentationMode; }
+    void setPresentationMode(PresentationMode mode);
+    
+    // FramePaced only: bytes parsed per presented frame before reading
+    // stops until the renderer catches up (0 = never throttle)
+    int frameByteBudget() const { return m_frameByteBudget; }
+    void setFrameByteBudget(int bytes);
+    
+    // Scrollback limits; the oldest lines are dropped past either one.
+    // Lines are logical lines, however many rows they wrap to.
+    // The memory budget (bytes) counts the compressed line storage.
+    int scrollbackLines() const { return m_scrollbackLines; }
+    void setScrollbackLines(int lines);
+    int scrollbackMemoryBudget() const { return m_scrollbackMemoryBudget; }
+    void setScrollbackMemoryBudget(int bytes);
+    
+    // Frames published by the I/O thread, consumed by TerminalRenderer.
+    // The renderer calls frameConsumed() after each acquire (any thread).
+    TerminalFrameQueue *frames() { return &m_frames; }
+    void frameConsumed();
     
     Q_INVOKABLE void start(const QString &shell = "");
     Q_INVOKABLE void sendInput(const QString &text);
@@ -31,6 +77,21 @@ public:
     Q_INVOKABLE void resize(int cols, int rows);
     Q_INVOKABLE void sendSignal(int signal);
     
+    // Feeds recorded output (e.g. an asciicast) through the terminal as if
+    // the child had written it
+    void replay(const QByteArray &data);
+    
+    // Selection, applied on the I/O thread
+    void setSelection(int startX, int startY, int endX, int endY);
+    void clearSelection();
+    QString selectedText() const;
+    
+    // Search over scrollback and screen. Matches arrive through
+    // searchMatches() in batches followed by searchFinished();
+    // a new search or cancelFind() drops anything still pending.
+    Q_INVOKABLE int find(const QString &text, bool regex = false, bool caseSensitive = false);
+    Q_INVOKABLE void cancelFind();
+    
     // Mouse handling
     Q_INVOKABLE void sendMousePress(int x, int y, int button);
     Q_INVOKABLE void sendMouseRelease(int x, int y, int button);
@@ -39,34 +100,40 @@ public:
 signals:
     void runningChanged();
     void titleChanged();
+    void visibleChanged();
+    void presentationModeChanged();
+    void frameByteBudgetChanged();
+    void scrollbackLinesChanged();
+    void scrollbackMemoryBudgetChanged();
     void finished(int exitCode);
+    // A new frame is available in frames()
+    void frameReady();
+    // {startX, startY, endX, endY} ranges. Rows are absolute: less the
+    // historyOffset of the frame shown, they are screen rows (negative
+    // rows are scrollback), however much output arrived since find()
+    void searchMatches(int searchId, const QVariantList &matches);
+    void searchFinished(int searchId, int matchCount);
     
 private slots:
-    void onReadActivated();
+    void onTitleChanged(const QString &title);
+    void onSearchMatches(int searchId, const QVariantList &matches);
+    void onSearchFinished(int searchId, int matchCount);
     
 private:
-    void processOutput(const QByteArray &data);
-    void parseEscapeSequence(char ch);
-    void handleCSI(const QString &seq);
-    void handleOSC(const QString &seq);
-    
     int m_masterFd;
     pid_t m_pid;
-    QSocketNotifier *m_notifier;
     QString m_title;
-    TerminalScreen *m_screen;
-    
-    // ANSI parser state
-    enum State {
-        Normal,
-        Escape,
-        CSI, // Control Sequence Introducer [
-        OSC, // Operating System Command ]
-        Charset // ( or )
-    };
+    bool m_visible;
+    int m_cols;
+    int m_rows;
+    PresentationMode m_presentationMode;
+    int m_frameByteBudget;
+    int m_scrollbackLines;
+    int m_scrollbackMemoryBudget;
     
-    State m_state;
-    QString m_sequenceBuffer;
-    QVector<int> m_params;
+    std::shared_ptr<TerminalSessionManager> m_sessions;
+    TerminalFrameQueue m_frames;
+    TerminalEngineWorker *m_worker;
+    TerminalSearchWorker *m_searchWorker;
+    int m_searchId; // Latest find(), 0 = none
 };
-
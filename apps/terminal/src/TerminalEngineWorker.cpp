@@ -0,0 +1,531 @@
+#include "TerminalEngineWorker.h"
+#include "TerminalEngine.h"
+#include "TerminalFrame.h"
+#include "TerminalScreen.h"
+#include "TerminalScrollback.h"
+#include "TerminalSearch.h"
+#include <QDebug>
+#include <QTimer>
+#include <algorithm>
+#include <memory>
+
+#include <errno.h>
+#include <unistd.h>
+
+TerminalEngineWorker::TerminalEngineWorker(TerminalFrameQueue *frames, TerminalReactor *reactor,
+                                           QObject *parent)
+    : QObject(parent)
+    , m_frames(frames)
+    , m_screen(new TerminalScreen(this))
+    , m_searchWorker(nullptr)
+    , m_reactor(reactor)
+    , m_masterFd(-1)
+    , m_reading(false)
+    , m_readBuffer(ReadBufferSize, Qt::Uninitialized)
+    , m_visible(true)
+    , m_presentationMode(TerminalEngine::FramePaced)
+    , m_frameByteBudget(0)
+    , m_bytesSinceFrame(0)
+    , m_throttled(false)
+    , m_waitingForConsumer(false)
+    , m_syncTimer(new QTimer(this))
+    , m_parser(this)
+{
+    m_syncTimer->setSingleShot(true);
+    m_syncTimer->setInterval(SynchronizedUpdateTimeout);
+    connect(m_syncTimer, &QTimer::timeout, this, &TerminalEngineWorker::onSyncTimeout);
+
+    // The renderer starts from a valid (blank) frame
+    m_screen->snapshot(m_frames->backFrame());
+    m_frames->publish();
+}
+
+TerminalEngineWorker::~TerminalEngineWorker()
+{
+    detach();
+}
+
+void TerminalEngineWorker::setPresentation(int mode, int frameByteBudget)
+{
+    m_presentationMode = mode;
+    m_frameByteBudget = frameByteBudget;
+    onFrameConsumed(); // Flush anything held back under the old settings
+}
+
+void TerminalEngineWorker::setScrollback(int lines, int memoryBudget)
+{
+    m_screen->setScrollbackLimits(lines, memoryBudget);
+}
+
+void TerminalEngineWorker::setVisible(bool visible)
+{
+    m_visible = visible;
+    m_screen->setVisible(visible);
+    // Publishes what changed while hidden, or lifts a throttle that no
+    // renderer is going to lift now
+    onFrameConsumed();
+}
+
+void TerminalEngineWorker::attach(int masterFd)
+{
+    detach();
+    if (!m_reactor) return;
+
+    // Joined here, on the I/O thread, where the pool lives
+    m_screen->setScrollbackPool(m_reactor->scrollbackPool());
+
+    m_masterFd = masterFd;
+    m_reactor->add(m_masterFd, this);
+    m_reading = true;
+}
+
+void TerminalEngineWorker::detach()
+{
+    if (m_reading) {
+        m_reactor->remove(m_masterFd);
+        m_reading = false;
+    }
+    if (!m_pendingWrite.isEmpty()) {
+        m_reactor->unwatchWritable(m_masterFd);
+        m_pendingWrite.clear();
+    }
+    m_masterFd = -1;
+    m_throttled = false;
+}
+
+void TerminalEngineWorker::readReady()
+{
+    // Drain everything the child has written so far, so one wake-up and
+    // one frame cover a whole burst instead of 4 KB slices of it
+    const bool paced = m_presentationMode == TerminalEngine::FramePaced;
+    qsizetype total = 0;
+    while (total < MaxBytesPerDrain) {
+        const ssize_t bytesRead = read(m_masterFd, m_readBuffer.data(), m_readBuffer.size());
+        if (bytesRead > 0) {
+            processOutput(m_readBuffer.constData(), bytesRead);
+            total += bytesRead;
+            m_bytesSinceFrame += bytesRead;
+
+            if (!paced) {
+                publishFrame();
+            } else if (m_frameByteBudget > 0 && m_bytesSinceFrame >= m_frameByteBudget) {
+                publishFrame();
+                if (m_bytesSinceFrame > 0) {
+                    // The renderer still holds the last frame: leave the rest
+                    // in the kernel buffer so the child blocks in write()
+                    // until onFrameConsumed() resumes reading
+                    m_reactor->remove(m_masterFd);
+                    m_reading = false;
+                    m_throttled = true;
+                    return;
+                }
+            }
+            continue;
+        }
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead < 0 && errno == EAGAIN) break;
+
+        // EOF, or EIO once the child side is closed. A hung-up fd stays
+        // readable, so stop watching it until the engine closes it.
+        m_reactor->remove(m_masterFd);
+        m_reading = false;
+        publishFrame();
+        emit hangup();
+        return;
+    }
+
+    publishFrame();
+}
+
+void TerminalEngineWorker::replay(const QByteArray &data)
+{
+    processOutput(data.constData(), data.size());
+    m_bytesSinceFrame += data.size();
+    publishFrame();
+    if (m_reactor) m_reactor->scrollbackPool()->enforce();
+}
+
+void TerminalEngineWorker::processOutput(const char *data, qsizetype length)
+{
+    m_parser.parse(data, length);
+}
+
+void TerminalEngineWorker::publishFrame()
+{
+    // Hidden sessions and synchronized updates hold frames back: damage
+    // keeps accumulating in the screen and goes out in one frame once the
+    // session is shown or the update committed. Neither throttles reading.
+    if (!m_visible || m_screen->inBatch() || !m_screen->hasPendingDamage()) {
+        m_bytesSinceFrame = 0;
+        return;
+    }
+
+    if (m_presentationMode == TerminalEngine::FramePaced) {
+        // Hold the frame back while the renderer has not presented the
+        // previous one; damage keeps accumulating in the screen. The flag
+        // is raised before checking so a concurrent acquire cannot miss it.
+        m_waitingForConsumer.store(true);
+        if (m_frames->hasPendingFrame()) return;
+        m_waitingForConsumer.store(false);
+    }
+
+    m_screen->snapshot(m_frames->backFrame());
+    m_bytesSinceFrame = 0;
+    if (m_frames->publish()) {
+        emit frameReady();
+    }
+}
+
+void TerminalEngineWorker::onFrameConsumed()
+{
+    publishFrame();
+    if (m_throttled && m_bytesSinceFrame == 0) {
+        m_throttled = false;
+        if (m_masterFd != -1) {
+            m_reactor->add(m_masterFd, this);
+            m_reading = true;
+        }
+    }
+}
+
+void TerminalEngineWorker::onSyncTimeout()
+{
+    // The application never ended its update; show what it has drawn
+    m_screen->endBatch();
+    publishFrame();
+}
+
+void TerminalEngineWorker::beginSynchronizedUpdate()
+{
+    // Repeated begins do not restart the timer, so an application that
+    // never ends its update cannot freeze the display
+    if (!m_screen->inBatch()) m_syncTimer->start();
+    m_screen->beginBatch();
+}
+
+void TerminalEngineWorker::endSynchronizedUpdate()
+{
+    if (!m_screen->inBatch()) return;
+    m_syncTimer->stop();
+    m_screen->endBatch();
+    // Commit right away: the next update may begin later in this same read
+    publishFrame();
+}
+
+void TerminalEngineWorker::write(const QByteArray &data)
+{
+    if (m_masterFd == -1) return;
+
+    // Input queues behind any the PTY had no room for, to keep its order
+    const bool queued = !m_pendingWrite.isEmpty();
+    if (m_pendingWrite.size() + data.size() > MaxPendingWrite) {
+        qWarning() << "[TerminalEngineWorker] Child is not reading its input, input dropped";
+        return;
+    }
+    m_pendingWrite.append(data);
+    if (queued) return;
+
+    if (!flushWrites()) {
+        m_reactor->watchWritable(m_masterFd, this);
+    }
+}
+
+bool TerminalEngineWorker::flushWrites()
+{
+    // Returns false if the PTY is full and the rest has to wait
+    qsizetype written = 0;
+    while (written < m_pendingWrite.size()) {
+        const ssize_t n = ::write(m_masterFd, m_pendingWrite.constData() + written,
+                                m_pendingWrite.size() - written);
+        if (n > 0) {
+            written += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) {
+            m_pendingWrite.remove(0, written);
+            return false;
+        }
+
+        // The child side is gone; readReady() reports the hangup
+        break;
+    }
+    m_pendingWrite.clear();
+    return true;
+}
+
+void TerminalEngineWorker::writeReady()
+{
+    if (flushWrites()) {
+        m_reactor->unwatchWritable(m_masterFd);
+    }
+}
+
+void TerminalEngineWorker::resize(int cols, int rows)
+{
+    m_screen->resize(cols, rows);
+    publishFrame();
+}
+
+void TerminalEngineWorker::setSelection(int startX, int startY, int endX, int endY)
+{
+    m_screen->setSelection(startX, startY, endX, endY);
+    publishFrame();
+}
+
+void TerminalEngineWorker::clearSelection()
+{
+    m_screen->clearSelection();
+    publishFrame();
+}
+
+QString TerminalEngineWorker::selectedText() const
+{
+    return m_screen->getSelectedText();
+}
+
+void TerminalEngineWorker::find(int searchId, const QString &text, bool regex, bool caseSensitive)
+{
+    if (!m_searchWorker) {
+        qWarning() << "[TerminalEngineWorker] No search worker, search dropped";
+        emit searchFinished(searchId, 0);
+        return;
+    }
+
+    // Searches run on a copy: output keeps streaming into the real screen
+    qint64 firstRow = 0;
+    auto snapshot = std::make_shared<const TerminalScrollback>(m_screen->searchSnapshot(&firstRow));
+    TerminalSearchWorker *searcher = m_searchWorker;
+
+    if (!regex) {
+        const Qt::CaseSensitivity sensitivity = caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+        QMetaObject::invokeMethod(searcher, [searcher, searchId, snapshot, text, sensitivity, firstRow]() {
+            searcher->findText(searchId, snapshot, text, sensitivity, firstRow);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    const QRegularExpression expression(text, caseSensitive ? QRegularExpression::NoPatternOption
+                                                            : QRegularExpression::CaseInsensitiveOption);
+    if (!expression.isValid()) {
+        qWarning() << "[TerminalEngineWorker] Invalid search pattern:" << expression.errorString();
+        emit searchFinished(searchId, 0);
+        return;
+    }
+
+    QMetaObject::invokeMethod(searcher, [searcher, searchId, snapshot, expression, firstRow]() {
+        searcher->scan(searchId, snapshot, expression, firstRow);
+    }, Qt::QueuedConnection);
+}
+
+void TerminalEngineWorker::print(const char *data, int length)
+{
+    // ASCII goes to the grid byte for byte; the rest is decoded in bulk.
+    // A sequence split by read() stays pending in the decoder.
+    const int ascii = m_decoder.hasPendingInput() ? 0 : TerminalUtf8Decoder::asciiPrefix(data, length);
+    if (ascii > 0) {
+        m_screen->putRun(data, ascii);
+        if (ascii == length) return;
+    }
+
+    const int remaining = length - ascii;
+    if (m_decoded.size() < remaining + 1) {
+        m_decoded.resize(remaining + 1);
+    }
+    const int count = m_decoder.decode(data + ascii, remaining, m_decoded.data());
+    if (count > 0) {
+        m_screen->putRun(m_decoded.constData(), count);
+    }
+}
+
+void TerminalEngineWorker::interruptText()
+{
+    // A control in the middle of a multi-byte sequence truncates it
+    if (m_decoder.interrupt()) {
+        const char32_t replacement = TerminalUtf8Decoder::ReplacementCharacter;
+        m_screen->putRun(&replacement, 1);
+    }
+}
+
+void TerminalEngineWorker::execute(uint8_t control)
+{
+    interruptText();
+
+    switch (control) {
+    case '\r':
+        m_screen->setCursorX(0);
+        break;
+    case '\n':
+    case '\v':
+    case '\f':
+        m_screen->newLine();
+        break;
+    case '\b':
+        m_screen->backspace();
+        break;
+    case '\t': {
+        // Simple tab handling (every 8 chars)
+        int x = m_screen->cursorX();
+        int nextTab = (x / 8 + 1) * 8;
+        m_screen->setCursorX(nextTab);
+        break;
+    }
+    default:
+        // Bell and the remaining C0 controls are ignored
+        break;
+    }
+}
+
+void TerminalEngineWorker::escDispatch(const TerminalParser &parser, char final)
+{
+    // Charset designation (ESC ( B etc.) and other escapes are ignored
+    interruptText();
+    Q_UNUSED(parser);
+    Q_UNUSED(final);
+}
+
+void TerminalEngineWorker::csiDispatch(const TerminalParser &parser, char final)
+{
+    interruptText();
+
+    if (parser.privateMarker() == '?') {
+        decPrivateMode(parser, final);
+        return;
+    }
+
+    // Other private forms and sequences with intermediates are not
+    // supported yet; make sure they are not mistaken for the plain form
+    if (parser.intermediateCount() > 0) return;
+
+    const int p1 = parser.param(0);
+    const int p2 = parser.param(1);
+
+    switch (final) {
+    case 'm': // SGR - Select Graphic Rendition
+        selectGraphicRendition(parser);
+        break;
+    case 'A': // Cursor Up
+        m_screen->moveCursorRelative(0, -std::max(1, p1));
+        break;
+    case 'B': // Cursor Down
+        m_screen->moveCursorRelative(0, std::max(1, p1));
+        break;
+    case 'C': // Cursor Forward
+        m_screen->moveCursorRelative(std::max(1, p1), 0);
+        break;
+    case 'D': // Cursor Back
+        m_screen->moveCursorRelative(-std::max(1, p1), 0);
+        break;
+    case 'H':
+    case 'f': { // Cursor Position
+        int row = std::max(1, p1) - 1;
+        int col = std::max(1, p2) - 1;
+        m_screen->moveCursor(col, row);
+        break;
+    }
+    case 'J': // Erase in Display
+        m_screen->clearScreen(p1);
+        break;
+    case 'K': // Erase in Line
+        m_screen->clearLine(p1);
+        break;
+    case 'P': // Delete Characters
+        m_screen->deleteChars(std::max(1, p1));
+        break;
+    case '@': // Insert Characters
+        m_screen->insertChars(std::max(1, p1));
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalEngineWorker::decPrivateMode(const TerminalParser &parser, char final)
+{
+    const char intermediate = parser.intermediate(1);
+
+    if (final == 'p' && intermediate == '$') {
+        // DECRQM: report a mode as set (1), reset (2) or not recognized (0)
+        const int mode = parser.param(0);
+        int state = 0;
+        if (mode == SynchronizedUpdateMode) state = m_screen->inBatch() ? 1 : 2;
+        write("\x1b[?" + QByteArray::number(mode) + ';' + QByteArray::number(state) + "$y");
+        return;
+    }
+
+    // DECSET / DECRST
+    if (intermediate || (final != 'h' && final != 'l')) return;
+    const bool set = final == 'h';
+    for (int i = 0; i < parser.paramCount(); ++i) {
+        switch (parser.param(i)) {
+        case SynchronizedUpdateMode:
+            if (set) beginSynchronizedUpdate();
+            else endSynchronizedUpdate();
+            break;
+        default:
+            // Cursor keys, alternate screen etc. are not supported yet
+            break;
+        }
+    }
+}
+
+void TerminalEngineWorker::selectGraphicRendition(const TerminalParser &parser)
+{
+    static const uint32_t normalColors[] = {
+        0xFF000000, 0xFFCC0000, 0xFF4E9A06, 0xFFC4A000,
+        0xFF3465A4, 0xFF75507B, 0xFF06989A, 0xFFD3D7CF
+    };
+    static const uint32_t brightColors[] = {
+        0xFF555753, 0xFFEF2929, 0xFF8AE234, 0xFFFCE94F,
+        0xFF729FCF, 0xFFAD7FA8, 0xFF34E2E2, 0xFFEEEEEC
+    };
+    // The xterm 256-color palette: the 16 above, a 6x6x6 cube and 24 grays
+    auto paletteColor = [](uint32_t index) -> uint32_t {
+        if (index < 8) return normalColors[index];
+        if (index < 16) return brightColors[index - 8];
+        if (index < 232) {
+            auto level = [](uint32_t step) { return step ? 55 + step * 40 : 0; };
+            index -= 16;
+            return 0xFF000000u | level(index / 36) << 16 | level(index / 6 % 6) << 8 | level(index % 6);
+        }
+        const uint32_t gray = 8 + (index - 232) * 10;
+        return 0xFF000000u | gray << 16 | gray << 8 | gray;
+    };
+
+    // CSI m is the same as CSI 0 m
+    const int count = std::max(1, parser.paramCount());
+    for (int i = 0; i < count; ++i) {
+        const int param = parser.param(i);
+        if (parser.isSubParam(i)) continue;  // Of an attribute not supported
+        if (param == 38 || param == 48 || param == 58) {
+            uint32_t color;
+            bool indexed;
+            if (!parser.extendedColor(&i, &color, &indexed)) continue;
+            if (indexed) color = paletteColor(color);
+            if (param == 38) m_screen->setFgColor(color);
+            else if (param == 48) m_screen->setBgColor(color);
+            // 58, the underline color, is not drawn
+            continue;
+        }
+        if (param == 0) m_screen->resetStyle();
+        else if (param == 1) m_screen->setBold(true);
+        else if (param == 7) m_screen->setInverse(true);
+        else if (param == 22) m_screen->setBold(false);
+        else if (param == 27) m_screen->setInverse(false);
+        else if (param >= 30 && param <= 37) m_screen->setFgColor(normalColors[param - 30]);
+        else if (param >= 40 && param <= 47) m_screen->setBgColor(normalColors[param - 40]);
+        else if (param == 39) m_screen->setFgColor(0xFFFFFFFF); // Default FG
+        else if (param == 49) m_screen->setBgColor(0xFF000000); // Default BG
+        else if (param >= 90 && param <= 97) m_screen->setFgColor(brightColors[param - 90]);
+    }
+}
+
+void TerminalEngineWorker::oscDispatch(const QByteArray &payload)
+{
+    interruptText();
+
+    // OSC 0 / OSC 2: set window title
+    if (payload.startsWith("0;") || payload.startsWith("2;")) {
+        emit titleChanged(QString::fromUtf8(payload.constData() + 2, payload.size() - 2));
+    }
+}
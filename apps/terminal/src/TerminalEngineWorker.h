@@ -0,0 +1,131 @@
+#pragma once
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+#include <atomic>
+#include "TerminalParser.h"
+#include "TerminalReactor.h"
+#include "TerminalUtf8Decoder.h"
+
+class QTimer;
+class TerminalFrameQueue;
+class TerminalScreen;
+class TerminalSearchWorker;
+
+/**
+ * PTY reader, parser and screen owner for one TerminalEngine.
+ *
+ * Lives on the shared terminal I/O thread. When the reactor reports the
+ * PTY master readable, drains it until EAGAIN, feeds the parser, and
+ * publishes a frame snapshot to the renderer after each batch. All screen
+ * state is confined to this thread; the GUI side reaches it only through
+ * queued slot calls.
+ *
+ * A hidden session keeps reading and parsing at full speed but publishes
+ * no frames until it is shown again.
+ */
+class TerminalEngineWorker : public QObject, private TerminalParser::Handler,
+                             private TerminalReactor::Handler {
+    Q_OBJECT
+
+public:
+    // Without a reactor the worker only parses replayed output
+    explicit TerminalEngineWorker(TerminalFrameQueue *frames, TerminalReactor *reactor = nullptr,
+                                  QObject *parent = nullptr);
+    ~TerminalEngineWorker() override;
+
+    // Thread-safe: true (once) if a frame was held back because the
+    // renderer had not taken the previous one
+    bool takeWaitingForConsumer() { return m_waitingForConsumer.exchange(false); }
+
+    // Searches are handed to this worker (set before the thread runs)
+    void setSearchWorker(TerminalSearchWorker *worker) { m_searchWorker = worker; }
+
+public slots:
+    void setPresentation(int mode, int frameByteBudget); // TerminalEngine::PresentationMode
+    void setScrollback(int lines, int memoryBudget);
+    void setVisible(bool visible);
+    void attach(int masterFd);
+    void detach();
+    // Input for the child, from the user or replies to its queries. The
+    // one queue keeps them in order; the PTY is written on this thread only.
+    void write(const QByteArray &data);
+    void resize(int cols, int rows);
+    void setSelection(int startX, int startY, int endX, int endY);
+    void clearSelection();
+    QString selectedText() const;
+    void find(int searchId, const QString &text, bool regex, bool caseSensitive);
+    // Parses recorded output as if it had been read from the PTY
+    void replay(const QByteArray &data);
+
+signals:
+    // A new frame was published while the renderer had none pending
+    void frameReady();
+    void titleChanged(const QString &title);
+    // The child closed the PTY (exited or hung up)
+    void hangup();
+    // A search that could not be started
+    void searchFinished(int searchId, int matchCount);
+
+private slots:
+    void onFrameConsumed();
+    void onSyncTimeout();
+
+private:
+    static constexpr int ReadBufferSize = 64 * 1024;
+    // Upper bound per wake-up so other sessions, queued calls (resize,
+    // selection) and frames still get through while a child floods the PTY
+    static constexpr int MaxBytesPerDrain = 1024 * 1024;
+    // DEC private mode for synchronized updates, and how long (ms) one may
+    // hold back presentation before it is committed anyway
+    static constexpr int SynchronizedUpdateMode = 2026;
+    static constexpr int SynchronizedUpdateTimeout = 150;
+    // Input the child has not read yet is dropped beyond this
+    static constexpr int MaxPendingWrite = 64 * 1024;
+
+    void processOutput(const char *data, qsizetype length);
+    void publishFrame();
+
+    // TerminalReactor::Handler
+    void readReady() override;
+    void writeReady() override;
+
+    // TerminalParser::Handler
+    void print(const char *data, int length) override;
+    void execute(uint8_t control) override;
+    void csiDispatch(const TerminalParser &parser, char final) override;
+    void escDispatch(const TerminalParser &parser, char final) override;
+    void oscDispatch(const QByteArray &payload) override;
+
+    void selectGraphicRendition(const TerminalParser &parser);
+    void decPrivateMode(const TerminalParser &parser, char final);
+    void beginSynchronizedUpdate();
+    void endSynchronizedUpdate();
+    bool flushWrites();
+    void interruptText();
+
+    TerminalFrameQueue *m_frames;
+    TerminalScreen *m_screen;
+    TerminalSearchWorker *m_searchWorker;
+    TerminalReactor *m_reactor;
+    int m_masterFd;
+    bool m_reading; // Registered with the reactor
+    QByteArray m_readBuffer;
+    QByteArray m_pendingWrite; // Written once the PTY has room again
+    bool m_visible;
+
+    // Frame pacing and backpressure
+    int m_presentationMode;
+    int m_frameByteBudget;
+    qint64 m_bytesSinceFrame; // Parsed since the last snapshot
+    bool m_throttled; // Reading paused until the renderer catches up
+    std::atomic<bool> m_waitingForConsumer;
+    QTimer *m_syncTimer; // Bounds a synchronized update
+
+    TerminalParser m_parser;
+    TerminalUtf8Decoder m_decoder;
+    QVector<char32_t> m_decoded; // Scratch buffer for decoded runs
+};
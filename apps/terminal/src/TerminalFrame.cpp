@@ -0,0 +1,28 @@
+#include "TerminalFrame.h"
+
+TerminalFrameQueue::TerminalFrameQueue()
+    : m_ready(1)
+    , m_back(0)
+    , m_front(2)
+    , m_sequence(0)
+{
+}
+
+bool TerminalFrameQueue::publish()
+{
+    m_frames[m_back].sequence = ++m_sequence;
+
+    // Makes the frame contents visible before its index. Sequentially
+    // consistent, as paced publishing pairs it with a second flag.
+    const int previous = m_ready.exchange(m_back | FreshBit);
+    m_back = previous & IndexMask;
+    return !(previous & FreshBit);
+}
+
+const TerminalFrame *TerminalFrameQueue::acquire()
+{
+    if (m_ready.load() & FreshBit) {
+        m_front = m_ready.exchange(m_front) & IndexMask;
+    }
+    return &m_frames[m_front];
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "TerminalScreen.h"
+#include <QVector>
+#include <atomic>
+
+// Immutable copy of the visible screen handed from the I/O thread to the
+// renderer. `damage` is relative to the frame with the previous sequence
+// number; a consumer that skipped frames must redraw everything.
+struct TerminalFrame {
+    quint64 sequence = 0;
+    int cols = 0;
+    int rows = 0;
+    QVector<TerminalCell> cells; // rows * cols, row-major
+    QVector<TerminalStyle> styles;
+    int cursorX = 0;
+    int cursorY = 0;
+    qint64 historyOffset = 0; // Absolute row of screen row 0
+    TerminalSelection selection;
+    TerminalDamage damage;
+
+    const TerminalCell &cell(int x, int y) const { return cells.at(y * cols + x); }
+    const TerminalStyle &style(uint16_t index) const { return styles.at(index); }
+};
+
+/**
+ * Single-producer, single-consumer triple buffer of frames.
+ *
+ * The I/O thread fills the back frame and publishes it with one atomic
+ * exchange; the renderer picks up the newest published frame the same
+ * way. Neither side ever blocks or waits for the other, and frames the
+ * renderer did not get to in time are simply replaced.
+ */
+class TerminalFrameQueue {
+public:
+    TerminalFrameQueue();
+
+    // Producer: the frame to fill next, then publish it. publish() returns
+    // false when the previous frame has not been picked up yet, in which
+    // case the consumer already has a wake-up pending.
+    TerminalFrame *backFrame() { return &m_frames[m_back]; }
+    bool publish();
+
+    // Consumer: newest published frame (or the current one if nothing new)
+    const TerminalFrame *acquire();
+    const TerminalFrame *current() const { return &m_frames[m_front]; }
+
+    // True while a published frame has not been acquired yet
+    bool hasPendingFrame() const { return m_ready.load() & FreshBit; }
+
+private:
+    static constexpr int FreshBit = 0x4;
+    static constexpr int IndexMask = 0x3;
+
+    TerminalFrame m_frames[3];
+    std::atomic<int> m_ready;
+    int m_back; // Producer only
+    int m_front; // Consumer only
+    quint64 m_sequence; // Producer only
+};
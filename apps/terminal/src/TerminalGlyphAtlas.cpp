@@ -0,0 +1,225 @@
+#include "TerminalGlyphAtlas.h"
+#include <QDebug>
+#include <QPainter>
+#include <QSGTexture>
+#include <QVarLengthArray>
+#include <QtMath>
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 6, 0)
+#include <rhi/qrhi.h>
+#else
+#include <QtGui/private/qrhi_p.h>
+#endif
+
+// The atlas as one texture for its whole life. Rasterizing a glyph only
+// queues its shelf for upload; the texture is recreated, and the image
+// uploaded whole, only when the atlas has grown.
+class TerminalGlyphTexture : public QSGTexture {
+public:
+    explicit TerminalGlyphTexture(TerminalGlyphAtlas *atlas)
+        : m_atlas(atlas)
+        , m_texture(nullptr)
+    {
+    }
+
+    ~TerminalGlyphTexture() override
+    {
+        // May still be used by a frame in flight
+        if (m_texture) m_texture->deleteLater();
+    }
+
+    qint64 comparisonKey() const override { return qint64(reinterpret_cast<quintptr>(this)); }
+    QRhiTexture *rhiTexture() const override { return m_texture; }
+    QSize textureSize() const override { return m_atlas->m_image.size(); }
+    bool hasAlphaChannel() const override { return true; }
+    bool hasMipmaps() const override { return false; }
+
+    void commitTextureOperations(QRhi *rhi, QRhiResourceUpdateBatch *resourceUpdates) override
+    {
+        const QImage &image = m_atlas->m_image;
+        if (!m_texture || m_texture->pixelSize() != image.size()) {
+            if (m_texture) m_texture->deleteLater();
+            m_texture = rhi->newTexture(QRhiTexture::RGBA8, image.size());
+            if (!m_texture->create()) {
+                qWarning() << "[TerminalGlyphAtlas] Cannot create atlas texture" << image.size();
+                delete m_texture;
+                m_texture = nullptr;
+                return;
+            }
+            m_atlas->m_uploadAll = true;
+        }
+
+        QVarLengthArray<QRhiTextureUploadEntry, 4> entries;
+        if (m_atlas->m_uploadAll) {
+            entries.append(QRhiTextureUploadEntry(0, 0, QRhiTextureSubresourceUploadDescription(image)));
+        } else {
+            for (const QRect &rect : std::as_const(m_atlas->m_dirtyRects)) {
+                QRhiTextureSubresourceUploadDescription description(image);
+                description.setSourceTopLeft(rect.topLeft());
+                description.setSourceSize(rect.size());
+                description.setDestinationTopLeft(rect.topLeft());
+                entries.append(QRhiTextureUploadEntry(0, 0, description));
+            }
+        }
+        if (!entries.isEmpty()) {
+            QRhiTextureUploadDescription upload;
+            upload.setEntries(entries.cbegin(), entries.cend());
+            resourceUpdates->uploadTexture(m_texture, upload);
+        }
+        m_atlas->m_dirtyRects.clear();
+        m_atlas->m_uploadAll = false;
+    }
+
+private:
+    TerminalGlyphAtlas *m_atlas;
+    QRhiTexture *m_texture;
+};
+
+TerminalGlyphAtlas::TerminalGlyphAtlas(const QFont &font, qreal cellWidth, qreal cellHeight,
+                                       qreal ascent, qreal devicePixelRatio)
+    : m_font(font)
+    , m_cellWidth(cellWidth)
+    , m_cellHeight(cellHeight)
+    , m_ascent(ascent)
+    , m_devicePixelRatio(devicePixelRatio)
+    , m_full(false)
+    , m_geometryChanged(false)
+    , m_uploadAll(true)
+    , m_texture(nullptr)
+{
+    m_slotSize = QSize(qCeil(cellWidth * devicePixelRatio) + 2 * Padding,
+                       qCeil(cellHeight * devicePixelRatio) + 2 * Padding);
+
+    // Byte order of an RGBA8 texture, so shelves upload without conversion
+    m_image = QImage(AtlasWidth, qMax(256, m_slotSize.height()), QImage::Format_RGBA8888_Premultiplied);
+    m_image.fill(Qt::transparent);
+
+    // Warm up printable ASCII so a fresh session never uploads per glyph
+    for (char32_t cp = 0x21; cp < 0x7F; ++cp) {
+        glyph(cp, Regular);
+        glyph(cp, Bold);
+    }
+    m_geometryChanged = false;
+}
+
+TerminalGlyphAtlas::~TerminalGlyphAtlas()
+{
+    delete m_texture;
+}
+
+QRect TerminalGlyphAtlas::allocateSlot(int width)
+{
+    if (m_nextSlot.x() + width > m_image.width()) {
+        m_nextSlot = QPoint(0, m_nextSlot.y() + m_slotSize.height());
+    }
+
+    if (m_nextSlot.y() + m_slotSize.height() > m_image.height()) {
+        if (m_image.height() * 2 > MaxAtlasHeight) {
+            m_full = true;
+            return QRect();
+        }
+
+        // Grow downwards; existing slots keep their pixel position but
+        // normalized texture coordinates change
+        QImage grown(m_image.width(), m_image.height() * 2, QImage::Format_RGBA8888_Premultiplied);
+        grown.fill(Qt::transparent);
+        QPainter painter(&grown);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(0, 0, m_image);
+        painter.end();
+        m_image = grown;
+        m_geometryChanged = true;
+        m_uploadAll = true;
+    }
+
+    QRect slot(m_nextSlot, QSize(width, m_slotSize.height()));
+    m_nextSlot.rx() += width;
+    return slot;
+}
+
+void TerminalGlyphAtlas::rasterize(const QRect &slot, char32_t codePoint, uint8_t style)
+{
+    QFont font = m_font;
+    font.setBold(style & Bold);
+    font.setItalic(style & Italic);
+
+    QPainter painter(&m_image);
+    painter.setClipRect(slot);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(slot, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setRenderHint(QPainter::TextAntialiasing, true);
+    painter.translate(slot.x() + Padding, slot.y() + Padding);
+    painter.scale(m_devicePixelRatio, m_devicePixelRatio);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    painter.drawText(QPointF(0, m_ascent), QString::fromUcs4(&codePoint, 1));
+}
+
+QRect TerminalGlyphAtlas::glyph(char32_t codePoint, uint8_t style, bool wide)
+{
+    style &= (Bold | Italic);
+
+    QRect *entry = nullptr;
+    if (codePoint < 128 && !wide) {
+        entry = &m_ascii[style][codePoint];
+    } else {
+        const quint64 key = (quint64(wide) << 40) | (quint64(style) << 32) | codePoint;
+        entry = &m_glyphs[key];
+    }
+
+    if (entry->isNull()) {
+        // A wide slot covers two cells but keeps a single padding margin
+        const int width = wide ? 2 * m_slotSize.width() - 2 * Padding : m_slotSize.width();
+        QRect slot = allocateSlot(width);
+        if (slot.isNull()) return QRect();
+        rasterize(slot, codePoint, style);
+        markDirty(slot);
+        *entry = slot;
+    }
+    return *entry;
+}
+
+void TerminalGlyphAtlas::markDirty(const QRect &slot)
+{
+    if (m_uploadAll) return;
+
+    // Slots fill a shelf left to right, so a shelf's new glyphs make one rect
+    if (!m_dirtyRects.isEmpty() && m_dirtyRects.last().top() == slot.top()) {
+        m_dirtyRects.last() |= slot;
+    } else {
+        m_dirtyRects.append(slot);
+    }
+}
+
+QSGTexture *TerminalGlyphAtlas::texture()
+{
+    if (!m_texture) {
+        m_texture = new TerminalGlyphTexture(this);
+        m_texture->setFiltering(QSGTexture::Nearest);
+    }
+    return m_texture;
+}
+
+bool TerminalGlyphAtlas::takeGeometryChanged()
+{
+    bool changed = m_geometryChanged;
+    m_geometryChanged = false;
+    return changed;
+}
+
+void TerminalGlyphAtlas::reset()
+{
+    qDebug() << "[TerminalGlyphAtlas] Atlas full, evicting" << m_glyphs.size() << "glyphs";
+
+    for (auto &styleTable : m_ascii) {
+        for (QRect &rect : styleTable) rect = QRect();
+    }
+    m_glyphs.clear();
+    m_image.fill(Qt::transparent);
+    m_nextSlot = QPoint();
+    m_full = false;
+    m_dirtyRects.clear();
+    m_uploadAll = true;
+    m_geometryChanged = true;
+}
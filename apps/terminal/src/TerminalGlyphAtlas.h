@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+class QSGTexture;
+class TerminalGlyphTexture;
+
+/**
+ * Texture atlas of rasterized monospace glyphs for one font and scale.
+ *
+ * Glyphs are drawn white (coverage in alpha) into fixed-size slots of
+ * one cell; the glyph material tints them per vertex. Lives on the
+ * scene graph render thread, owned by the renderer's root node.
+ */
+class TerminalGlyphAtlas {
+public:
+    enum GlyphStyle : uint8_t {
+        Regular = 0x00,
+        Bold = 0x01,
+        Italic = 0x02
+    };
+
+    TerminalGlyphAtlas(const QFont &font, qreal cellWidth, qreal cellHeight,
+                       qreal ascent, qreal devicePixelRatio);
+    ~TerminalGlyphAtlas();
+
+    // Pixel rect of the glyph slot in the atlas, rasterizing on first use.
+    // Wide glyphs get a slot two cells wide. Returns an empty rect when
+    // the atlas is full (see isFull()).
+    QRect glyph(char32_t codePoint, uint8_t style, bool wide = false);
+
+    // The atlas texture. It lives as long as the atlas; glyphs added since
+    // the last frame are uploaded when the material commits it, the whole
+    // image only after the atlas grew or was reset.
+    QSGTexture *texture();
+
+    // Single-cell slot size in device pixels, and the margin around the
+    // cell inside it
+    QSize slotSize() const { return m_slotSize; }
+    int padding() const { return Padding; }
+    QSize imageSize() const { return m_image.size(); }
+
+    // Set when the atlas ran out of space or changed size, which
+    // invalidates every texture coordinate handed out so far
+    bool isFull() const { return m_full; }
+    bool takeGeometryChanged();
+    void reset();
+
+    bool matches(const QFont &font, qreal devicePixelRatio) const {
+        return m_font == font && m_devicePixelRatio == devicePixelRatio;
+    }
+
+private:
+    friend class TerminalGlyphTexture;
+
+    static constexpr int Padding = 2;
+    static constexpr int AtlasWidth = 1024;
+    static constexpr int MaxAtlasHeight = 2048;
+
+    QRect allocateSlot(int width);
+    void rasterize(const QRect &slot, char32_t codePoint, uint8_t style);
+    void markDirty(const QRect &slot);
+
+    QFont m_font;
+    qreal m_cellWidth;
+    qreal m_cellHeight;
+    qreal m_ascent;
+    qreal m_devicePixelRatio;
+    QSize m_slotSize;
+
+    QImage m_image;
+    QPoint m_nextSlot;
+    bool m_full;
+    bool m_geometryChanged;
+
+    // Pixels not uploaded yet: one rect per shelf of slots, or everything
+    QVector<QRect> m_dirtyRects;
+    bool m_uploadAll;
+
+    // Printable ASCII is looked up directly, everything else by hash
+    QRect m_ascii[4][128];
+    QHash<quint64, QRect> m_glyphs;
+
+    TerminalGlyphTexture *m_texture;
+};
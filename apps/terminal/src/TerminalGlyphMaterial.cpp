@@ -0,0 +1,82 @@
+#include "TerminalGlyphMaterial.h"
+#include <QSGTexture>
+#include <cstring>
+
+TerminalGlyphMaterial::TerminalGlyphMaterial()
+    : m_texture(nullptr)
+{
+    setFlag(Blending, true);
+}
+
+const QSGGeometry::AttributeSet &TerminalGlyphMaterial::attributes()
+{
+    static const QSGGeometry::Attribute data[] = {
+        QSGGeometry::Attribute::createWithAttributeType(0, 2, QSGGeometry::FloatType, QSGGeometry::PositionAttribute),
+        QSGGeometry::Attribute::createWithAttributeType(1, 2, QSGGeometry::FloatType, QSGGeometry::TexCoordAttribute),
+        QSGGeometry::Attribute::createWithAttributeType(2, 4, QSGGeometry::UnsignedByteType, QSGGeometry::ColorAttribute)
+    };
+    static const QSGGeometry::AttributeSet set = { 3, sizeof(TerminalGlyphVertex), data };
+    return set;
+}
+
+QSGMaterialType *TerminalGlyphMaterial::type() const
+{
+    static QSGMaterialType type;
+    return &type;
+}
+
+QSGMaterialShader *TerminalGlyphMaterial::createShader(QSGRendererInterface::RenderMode renderMode) const
+{
+    Q_UNUSED(renderMode);
+    return new TerminalGlyphShader;
+}
+
+int TerminalGlyphMaterial::compare(const QSGMaterial *other) const
+{
+    const auto *o = static_cast<const TerminalGlyphMaterial *>(other);
+    if (m_texture == o->m_texture) return 0;
+    return m_texture < o->m_texture ? -1 : 1;
+}
+
+TerminalGlyphShader::TerminalGlyphShader()
+{
+    setShaderFileName(VertexStage, QStringLiteral(":/terminal/shaders/terminalglyph.vert.qsb"));
+    setShaderFileName(FragmentStage, QStringLiteral(":/terminal/shaders/terminalglyph.frag.qsb"));
+}
+
+bool TerminalGlyphShader::updateUniformData(RenderState &state, QSGMaterial *newMaterial,
+                                            QSGMaterial *oldMaterial)
+{
+    Q_UNUSED(newMaterial);
+    Q_UNUSED(oldMaterial);
+
+    bool changed = false;
+    QByteArray *buf = state.uniformData();
+
+    if (state.isMatrixDirty()) {
+        const QMatrix4x4 matrix = state.combinedMatrix();
+        std::memcpy(buf->data(), matrix.constData(), 64);
+        changed = true;
+    }
+
+    if (state.isOpacityDirty()) {
+        const float opacity = state.opacity();
+        std::memcpy(buf->data() + 64, &opacity, 4);
+        changed = true;
+    }
+
+    return changed;
+}
+
+void TerminalGlyphShader::updateSampledImage(RenderState &state, int binding, QSGTexture **texture,
+                                             QSGMaterial *newMaterial, QSGMaterial *oldMaterial)
+{
+    Q_UNUSED(oldMaterial);
+    if (binding != 1) return;
+
+    auto *material = static_cast<TerminalGlyphMaterial *>(newMaterial);
+    if (material->texture()) {
+        material->texture()->commitTextureOperations(state.rhi(), state.resourceUpdateBatch());
+    }
+    *texture = material->texture();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QSGGeometry>
+#include <QSGMaterial>
+#include <QSGMaterialShader>
+
+class QSGTexture;
+
+// Vertex layout of the glyph quads: position, atlas coordinate and a
+// premultiplied RGBA tint per vertex
+struct TerminalGlyphVertex {
+    float x, y;
+    float tx, ty;
+    unsigned char r, g, b, a;
+
+    void set(float nx, float ny, float ntx, float nty, const unsigned char color[4]) {
+        x = nx; y = ny; tx = ntx; ty = nty;
+        r = color[0]; g = color[1]; b = color[2]; a = color[3];
+    }
+};
+
+/**
+ * Material for terminal text: samples glyph coverage from the atlas
+ * texture and multiplies it with the per-vertex foreground color, so a
+ * whole row of differently colored glyphs is a single draw.
+ */
+class TerminalGlyphMaterial : public QSGMaterial {
+public:
+    TerminalGlyphMaterial();
+
+    static const QSGGeometry::AttributeSet &attributes();
+
+    QSGMaterialType *type() const override;
+    QSGMaterialShader *createShader(QSGRendererInterface::RenderMode renderMode) const override;
+    int compare(const QSGMaterial *other) const override;
+
+    QSGTexture *texture() const { return m_texture; }
+    void setTexture(QSGTexture *texture) { m_texture = texture; }
+
+private:
+    QSGTexture *m_texture;
+};
+
+class TerminalGlyphShader : public QSGMaterialShader {
+public:
+    TerminalGlyphShader();
+
+    bool updateUniformData(RenderState &state, QSGMaterial *newMaterial,
+                           QSGMaterial *oldMaterial) override;
+    void updateSampledImage(RenderState &state, int binding, QSGTexture **texture,
+                            QSGMaterial *newMaterial, QSGMaterial *oldMaterial) override;
+};
@@ -0,0 +1,340 @@
+#include "TerminalParser.h"
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+using State = TerminalParser::State;
+using Action = TerminalParser::Action;
+
+// Table entries pack the action in the high nibble and the next state in
+// the low nibble; NoTransition keeps the current state without running
+// exit/entry actions
+constexpr uint8_t NoTransition = 0x0F;
+static_assert(TerminalParser::StateCount < NoTransition, "state does not fit in a nibble");
+
+struct TransitionTable {
+    uint8_t entries[TerminalParser::StateCount][256];
+};
+
+constexpr void setRange(TransitionTable &table, State state, int from, int to, Action action,
+                        uint8_t next = NoTransition)
+{
+    for (int byte = from; byte <= to; ++byte) {
+        table.entries[state][byte] = uint8_t((action << 4) | next);
+    }
+}
+
+// C0 controls other than CAN, SUB and ESC, which are handled everywhere
+constexpr void setControls(TransitionTable &table, State state, Action action)
+{
+    setRange(table, state, 0x00, 0x17, action);
+    setRange(table, state, 0x19, 0x19, action);
+    setRange(table, state, 0x1C, 0x1F, action);
+}
+
+constexpr TransitionTable buildTransitionTable()
+{
+    TransitionTable table{};
+
+    for (int s = 0; s < TerminalParser::StateCount; ++s) {
+        const State state = State(s);
+        setRange(table, state, 0x00, 0xFF, TerminalParser::Ignore);
+        setRange(table, state, 0x18, 0x18, TerminalParser::Execute, TerminalParser::Ground);
+        setRange(table, state, 0x1A, 0x1A, TerminalParser::Execute, TerminalParser::Ground);
+        setRange(table, state, 0x1B, 0x1B, TerminalParser::None, TerminalParser::Escape);
+    }
+
+    // Ground: UTF-8 environment, so 0x80-0xFF is text rather than C1
+    setControls(table, TerminalParser::Ground, TerminalParser::Execute);
+    setRange(table, TerminalParser::Ground, 0x20, 0x7E, TerminalParser::Print);
+    setRange(table, TerminalParser::Ground, 0x80, 0xFF, TerminalParser::Print);
+
+    setControls(table, TerminalParser::Escape, TerminalParser::Execute);
+    setRange(table, TerminalParser::Escape, 0x20, 0x2F, TerminalParser::Collect, TerminalParser::EscapeIntermediate);
+    setRange(table, TerminalParser::Escape, 0x30, 0x7E, TerminalParser::EscDispatch, TerminalParser::Ground);
+    setRange(table, TerminalParser::Escape, 0x50, 0x50, TerminalParser::None, TerminalParser::DcsEntry);
+    setRange(table, TerminalParser::Escape, 0x58, 0x58, TerminalParser::None, TerminalParser::SosPmApcString);
+    setRange(table, TerminalParser::Escape, 0x5B, 0x5B, TerminalParser::None, TerminalParser::CsiEntry);
+    setRange(table, TerminalParser::Escape, 0x5D, 0x5D, TerminalParser::None, TerminalParser::OscString);
+    setRange(table, TerminalParser::Escape, 0x5E, 0x5F, TerminalParser::None, TerminalParser::SosPmApcString);
+
+    setControls(table, TerminalParser::EscapeIntermediate, TerminalParser::Execute);
+    setRange(table, TerminalParser::EscapeIntermediate, 0x20, 0x2F, TerminalParser::Collect);
+    setRange(table, TerminalParser::EscapeIntermediate, 0x30, 0x7E, TerminalParser::EscDispatch, TerminalParser::Ground);
+
+    // ':' separates sub-parameters (SGR 38:2:r:g:b); they are collected like
+    // parameters and marked as sub-parameters
+    setControls(table, TerminalParser::CsiEntry, TerminalParser::Execute);
+    setRange(table, TerminalParser::CsiEntry, 0x20, 0x2F, TerminalParser::Collect, TerminalParser::CsiIntermediate);
+    setRange(table, TerminalParser::CsiEntry, 0x30, 0x3B, TerminalParser::Param, TerminalParser::CsiParam);
+    setRange(table, TerminalParser::CsiEntry, 0x3C, 0x3F, TerminalParser::Collect, TerminalParser::CsiParam);
+    setRange(table, TerminalParser::CsiEntry, 0x40, 0x7E, TerminalParser::CsiDispatch, TerminalParser::Ground);
+
+    setControls(table, TerminalParser::CsiParam, TerminalParser::Execute);
+    setRange(table, TerminalParser::CsiParam, 0x20, 0x2F, TerminalParser::Collect, TerminalParser::CsiIntermediate);
+    setRange(table, TerminalParser::CsiParam, 0x30, 0x3B, TerminalParser::Param);
+    setRange(table, TerminalParser::CsiParam, 0x3C, 0x3F, TerminalParser::None, TerminalParser::CsiIgnore);
+    setRange(table, TerminalParser::CsiParam, 0x40, 0x7E, TerminalParser::CsiDispatch, TerminalParser::Ground);
+
+    setControls(table, TerminalParser::CsiIntermediate, TerminalParser::Execute);
+    setRange(table, TerminalParser::CsiIntermediate, 0x20, 0x2F, TerminalParser::Collect);
+    setRange(table, TerminalParser::CsiIntermediate, 0x30, 0x3F, TerminalParser::None, TerminalParser::CsiIgnore);
+    setRange(table, TerminalParser::CsiIntermediate, 0x40, 0x7E, TerminalParser::CsiDispatch, TerminalParser::Ground);
+
+    setControls(table, TerminalParser::CsiIgnore, TerminalParser::Execute);
+    setRange(table, TerminalParser::CsiIgnore, 0x40, 0x7E, TerminalParser::None, TerminalParser::Ground);
+
+    // Device control strings are parsed for correct termination but dropped
+    setRange(table, TerminalParser::DcsEntry, 0x20, 0x2F, TerminalParser::Collect, TerminalParser::DcsIntermediate);
+    setRange(table, TerminalParser::DcsEntry, 0x30, 0x3B, TerminalParser::Param, TerminalParser::DcsParam);
+    setRange(table, TerminalParser::DcsEntry, 0x3C, 0x3F, TerminalParser::Collect, TerminalParser::DcsParam);
+    setRange(table, TerminalParser::DcsEntry, 0x40, 0x7E, TerminalParser::None, TerminalParser::DcsPassthrough);
+
+    setRange(table, TerminalParser::DcsParam, 0x20, 0x2F, TerminalParser::Collect, TerminalParser::DcsIntermediate);
+    setRange(table, TerminalParser::DcsParam, 0x30, 0x3B, TerminalParser::Param);
+    setRange(table, TerminalParser::DcsParam, 0x3C, 0x3F, TerminalParser::None, TerminalParser::DcsIgnore);
+    setRange(table, TerminalParser::DcsParam, 0x40, 0x7E, TerminalParser::None, TerminalParser::DcsPassthrough);
+
+    setRange(table, TerminalParser::DcsIntermediate, 0x20, 0x2F, TerminalParser::Collect);
+    setRange(table, TerminalParser::DcsIntermediate, 0x30, 0x3F, TerminalParser::None, TerminalParser::DcsIgnore);
+    setRange(table, TerminalParser::DcsIntermediate, 0x40, 0x7E, TerminalParser::None, TerminalParser::DcsPassthrough);
+
+    setControls(table, TerminalParser::DcsPassthrough, TerminalParser::Put);
+    setRange(table, TerminalParser::DcsPassthrough, 0x20, 0x7E, TerminalParser::Put);
+    setRange(table, TerminalParser::DcsPassthrough, 0x80, 0xFF, TerminalParser::Put);
+
+    // OSC is terminated by ST (ESC \) or, as xterm allows, by BEL
+    setRange(table, TerminalParser::OscString, 0x07, 0x07, TerminalParser::None, TerminalParser::Ground);
+    setRange(table, TerminalParser::OscString, 0x20, 0x7F, TerminalParser::OscPut);
+    setRange(table, TerminalParser::OscString, 0x80, 0xFF, TerminalParser::OscPut);
+
+    return table;
+}
+
+constexpr TransitionTable kTransitions = buildTransitionTable();
+
+inline bool isPrintable(uint8_t byte)
+{
+    return byte >= 0x20 && byte != 0x7F;
+}
+
+} // namespace
+
+TerminalParser::TerminalParser(Handler *handler)
+    : m_handler(handler)
+    , m_state(Ground)
+    , m_params{}
+    , m_paramCount(0)
+    , m_subParams(0)
+    , m_intermediates{}
+    , m_intermediateCount(0)
+    , m_oscEscaped(false)
+{
+}
+
+void TerminalParser::reset()
+{
+    m_state = Ground;
+    m_paramCount = 0;
+    m_subParams = 0;
+    m_intermediateCount = 0;
+    m_osc.clear();
+    m_oscEscaped = false;
+}
+
+bool TerminalParser::extendedColor(int *index, uint32_t *color, bool *indexed) const
+{
+    const int start = *index;
+    int kind;
+    int first;  // Of the palette index or of r, g, b
+    int values;
+    const bool subParams = isSubParam(start + 1);
+    if (subParams) {
+        // 38:5:n, 38:2:r:g:b, or 38:2:id:r:g:b as T.416 has it
+        int end = start + 2;
+        while (isSubParam(end)) ++end;
+        *index = end - 1;
+        kind = param(start + 1);
+        first = start + 2;
+        values = end - first;
+        if (kind == 2 && values >= 4) {
+            ++first;
+            --values;
+        }
+    } else {
+        kind = param(start + 1);
+        first = start + 2;
+        values = m_paramCount - first;
+        *index = start + (kind == 5 ? 2 : 4);
+    }
+
+    if (kind == 5 && values >= 1) {
+        *color = uint32_t(std::min(param(first), 255));
+        *indexed = true;
+        return true;
+    }
+    if (kind == 2 && values >= 3) {
+        *color = 0xFF000000u | uint32_t(std::min(param(first), 255)) << 16
+                 | uint32_t(std::min(param(first + 1), 255)) << 8 | uint32_t(std::min(param(first + 2), 255));
+        *indexed = false;
+        return true;
+    }
+
+    // Unknown or cut short: after a ';' form, what follows cannot be told
+    // from its values
+    if (!subParams) *index = m_paramCount - 1;
+    return false;
+}
+
+qsizetype TerminalParser::scanPrintable(const char *data, qsizetype length)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    qsizetype i = 0;
+
+#if defined(__SSE2__)
+    const __m128i controlMax = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= length; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        // Unsigned byte <= 0x1F, via min(), since SSE2 only compares signed
+        const __m128i isControl = _mm_cmpeq_epi8(_mm_min_epu8(chunk, controlMax), chunk);
+        const __m128i isDel = _mm_cmpeq_epi8(chunk, del);
+        const int mask = _mm_movemask_epi8(_mm_or_si128(isControl, isDel));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t controlLimit = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7F);
+    for (; i + 16 <= length; i += 16) {
+        const uint8x16_t chunk = vld1q_u8(bytes + i);
+        const uint8x16_t stop = vorrq_u8(vcltq_u8(chunk, controlLimit), vceqq_u8(chunk, del));
+        // Narrow each byte lane to a nibble to get a 64-bit mask
+        const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(stop), 4);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (mask) return i + (__builtin_ctzll(mask) >> 2);
+    }
+#endif
+
+    while (i < length && isPrintable(bytes[i])) ++i;
+    return i;
+}
+
+void TerminalParser::parse(const char *data, qsizetype length)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = p + length;
+
+    while (p < end) {
+        if (m_state == Ground) {
+            const qsizetype run = scanPrintable(reinterpret_cast<const char *>(p), end - p);
+            if (run > 0) {
+                m_handler->print(reinterpret_cast<const char *>(p), int(run));
+                p += run;
+                if (p == end) break;
+            }
+        }
+
+        const uint8_t byte = *p++;
+        const uint8_t entry = kTransitions.entries[m_state][byte];
+        const Action action = Action(entry >> 4);
+        const uint8_t next = entry & 0x0F;
+
+        if (next == NoTransition) {
+            perform(action, byte);
+        } else {
+            exitState(m_state, byte);
+            perform(action, byte);
+            m_state = State(next);
+            enterState(m_state);
+        }
+    }
+}
+
+void TerminalParser::perform(Action action, uint8_t byte)
+{
+    switch (action) {
+    case None:
+    case Ignore:
+    case Put:
+        break;
+    case Print:
+        m_handler->print(reinterpret_cast<const char *>(&byte), 1);
+        break;
+    case Execute:
+        m_handler->execute(byte);
+        break;
+    case Collect:
+        if (m_intermediateCount < MaxIntermediates) {
+            m_intermediates[m_intermediateCount++] = char(byte);
+        }
+        break;
+    case Param:
+        if (byte == ';' || byte == ':') {
+            if (m_paramCount == 0) m_params[m_paramCount++] = 0;
+            if (m_paramCount < MaxParams) {
+                if (byte == ':') m_subParams |= 1u << m_paramCount;
+                m_params[m_paramCount++] = 0;
+            }
+        } else {
+            if (m_paramCount == 0) m_params[m_paramCount++] = 0;
+            int &value = m_params[m_paramCount - 1];
+            value = std::min(value * 10 + (byte - '0'), 0xFFFF);
+        }
+        break;
+    case EscDispatch:
+        m_handler->escDispatch(*this, char(byte));
+        break;
+    case CsiDispatch:
+        m_handler->csiDispatch(*this, char(byte));
+        break;
+    case OscPut:
+        if (m_osc.size() < MaxOscLength) m_osc.append(char(byte));
+        break;
+    }
+}
+
+void TerminalParser::enterState(State state)
+{
+    switch (state) {
+    case Escape:
+    case CsiEntry:
+    case DcsEntry:
+        m_paramCount = 0;
+        m_subParams = 0;
+        m_intermediateCount = 0;
+        break;
+    case OscString:
+        m_osc.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalParser::exitState(State state, uint8_t byte)
+{
+    switch (state) {
+    case OscString:
+        // BEL ends the string, ESC may start ST, CAN and SUB abort it
+        if (byte == 0x07) {
+            m_handler->oscDispatch(m_osc);
+        } else {
+            m_oscEscaped = (byte == 0x1B);
+        }
+        break;
+    case Escape:
+        if (m_oscEscaped) {
+            m_oscEscaped = false;
+            if (byte == '\\') m_handler->oscDispatch(m_osc);
+        }
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QByteArray>
+#include <cstdint>
+
+/**
+ * DEC/ECMA-48 escape sequence parser.
+ *
+ * A state machine after Paul Williams' VT500 parser, driven by a
+ * compile-time [state][byte] table. Parameters are collected into a fixed
+ * array, so parsing never allocates; runs of printable bytes in the ground
+ * state are found with a vectorized scan and handed to the handler in one
+ * call. Bytes >= 0x80 are treated as printable text (UTF-8), not as C1
+ * controls.
+ */
+class TerminalParser {
+public:
+    static constexpr int MaxParams = 16;
+    static constexpr int MaxIntermediates = 2;
+    static constexpr int MaxOscLength = 4096;
+
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        // A run of printable bytes (no C0 controls, no DEL)
+        virtual void print(const char *data, int length) = 0;
+        // C0 control character
+        virtual void execute(uint8_t control) = 0;
+        // Final byte of a CSI / ESC sequence; parameters via the parser
+        virtual void csiDispatch(const TerminalParser &parser, char final) = 0;
+        virtual void escDispatch(const TerminalParser &parser, char final) = 0;
+        // Complete OSC payload (without the introducer and terminator)
+        virtual void oscDispatch(const QByteArray &payload) = 0;
+    };
+
+    explicit TerminalParser(Handler *handler);
+
+    void parse(const char *data, qsizetype length);
+    void reset();
+
+    // Current sequence, valid inside the dispatch callbacks
+    int paramCount() const { return m_paramCount; }
+    int param(int index, int defaultValue = 0) const {
+        return (index < m_paramCount && m_params[index] > 0) ? m_params[index] : defaultValue;
+    }
+    // Whether a parameter was separated from the one before it by ':',
+    // making it a sub-parameter (ITU T.416) rather than a parameter
+    bool isSubParam(int index) const {
+        return index > 0 && index < m_paramCount && (m_subParams >> index) & 1;
+    }
+    // Reads the color an SGR 38, 48 or 58 at *index selects, in either the
+    // ";5;n" / ";2;r;g;b" form or the ':' form with or without a color
+    // space id. The color is 0xFFRRGGBB, or a palette index with *indexed
+    // set. *index is left on the last parameter the color took; returns
+    // false when there is no color, a ';' form then taking the rest of the
+    // sequence.
+    bool extendedColor(int *index, uint32_t *color, bool *indexed) const;
+    int intermediateCount() const { return m_intermediateCount; }
+    char intermediate(int index) const { return index < m_intermediateCount ? m_intermediates[index] : 0; }
+    // Private marker of a CSI sequence ('?', '>', '<', '=') or 0
+    char privateMarker() const {
+        return (m_intermediateCount > 0 && m_intermediates[0] >= 0x3C) ? m_intermediates[0] : 0;
+    }
+
+    // Length of the leading run of printable bytes (SSE2/NEON accelerated)
+    static qsizetype scanPrintable(const char *data, qsizetype length);
+
+    enum State : uint8_t {
+        Ground,
+        Escape,
+        EscapeIntermediate,
+        CsiEntry,
+        CsiParam,
+        CsiIntermediate,
+        CsiIgnore,
+        DcsEntry,
+        DcsParam,
+        DcsIntermediate,
+        DcsPassthrough,
+        DcsIgnore,
+        OscString,
+        SosPmApcString,
+        StateCount
+    };
+
+    enum Action : uint8_t {
+        None,
+        Ignore,
+        Print,
+        Execute,
+        Collect,
+        Param,
+        EscDispatch,
+        CsiDispatch,
+        Put,
+        OscPut
+    };
+
+    State state() const { return m_state; }
+
+private:
+    void perform(Action action, uint8_t byte);
+    void enterState(State state);
+    void exitState(State state, uint8_t byte);
+
+    Handler *m_handler;
+    State m_state;
+
+    int m_params[MaxParams];
+    int m_paramCount;
+    uint32_t m_subParams;  // Bit i: parameter i followed a ':'
+    char m_intermediates[MaxIntermediates];
+    int m_intermediateCount;
+    QByteArray m_osc;
+    bool m_oscEscaped;  // OSC string ended by ESC; dispatched if ST follows
+};
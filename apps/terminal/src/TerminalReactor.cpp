@@ -0,0 +1,165 @@
+#include "TerminalReactor.h"
+#include <QDebug>
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#endif
+
+TerminalReactor::TerminalReactor(QObject *parent)
+    : QObject(parent)
+#ifdef Q_OS_LINUX
+    , m_epollFd(epoll_create1(EPOLL_CLOEXEC))
+    , m_notifier(nullptr)
+#endif
+{
+#ifdef Q_OS_LINUX
+    if (m_epollFd < 0) {
+        qCritical() << "[TerminalReactor] epoll_create1 failed:" << strerror(errno);
+    }
+#endif
+}
+
+TerminalReactor::~TerminalReactor()
+{
+#ifdef Q_OS_LINUX
+    delete m_notifier;
+    if (m_epollFd >= 0) close(m_epollFd);
+#else
+    qDeleteAll(m_notifiers);
+    qDeleteAll(m_writeNotifiers);
+#endif
+}
+
+void TerminalReactor::add(int fd, Handler *handler)
+{
+    Watch watch = m_watches.value(fd);
+    watch.handler = handler;
+    watch.read = true;
+    update(fd, watch);
+}
+
+void TerminalReactor::remove(int fd)
+{
+    Watch watch = m_watches.value(fd);
+    watch.read = false;
+    update(fd, watch);
+}
+
+void TerminalReactor::watchWritable(int fd, Handler *handler)
+{
+    Watch watch = m_watches.value(fd);
+    watch.handler = handler;
+    watch.write = true;
+    update(fd, watch);
+}
+
+void TerminalReactor::unwatchWritable(int fd)
+{
+    Watch watch = m_watches.value(fd);
+    watch.write = false;
+    update(fd, watch);
+}
+
+void TerminalReactor::update(int fd, const Watch &watch)
+{
+    const Watch old = m_watches.value(fd);
+    const bool watched = old.read || old.write;
+    if (watch.read == old.read && watch.write == old.write) {
+        if (watched) m_watches.insert(fd, watch);
+        return;
+    }
+
+    if (watch.read || watch.write) {
+        m_watches.insert(fd, watch);
+    } else {
+        m_watches.remove(fd);
+    }
+
+#ifdef Q_OS_LINUX
+    // Level-triggered: a handler that stops at its read budget is simply
+    // reported again on the next round
+    epoll_event event = {};
+    event.events = (watch.read ? EPOLLIN : 0) | (watch.write ? EPOLLOUT : 0);
+    event.data.fd = fd;
+    if (!event.events) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        return;
+    }
+    if (epoll_ctl(m_epollFd, watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) < 0) {
+        qWarning() << "[TerminalReactor] Cannot watch fd" << fd << strerror(errno);
+        if (watched) {
+            m_watches.insert(fd, old);
+        } else {
+            m_watches.remove(fd);
+        }
+        return;
+    }
+    if (!m_notifier) {
+        m_notifier = new QSocketNotifier(m_epollFd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &TerminalReactor::onActivated);
+    }
+#else
+    if (watch.read && !old.read) {
+        QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(notifier, &QSocketNotifier::activated, this, [this, fd]() {
+            const Watch current = m_watches.value(fd);
+            if (current.read) current.handler->readReady();
+            m_scrollbackPool.enforce();
+        });
+        m_notifiers.insert(fd, notifier);
+    } else if (!watch.read && old.read) {
+        QSocketNotifier *notifier = m_notifiers.take(fd);
+        notifier->setEnabled(false);
+        notifier->deleteLater(); // May be the one being dispatched
+    }
+
+    if (watch.write && !old.write) {
+        QSocketNotifier *notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        connect(notifier, &QSocketNotifier::activated, this, [this, fd]() {
+            const Watch current = m_watches.value(fd);
+            if (current.write) current.handler->writeReady();
+        });
+        m_writeNotifiers.insert(fd, notifier);
+    } else if (!watch.write && old.write) {
+        QSocketNotifier *notifier = m_writeNotifiers.take(fd);
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+    }
+#endif
+}
+
+void TerminalReactor::setScrollbackBudget(qint64 bytes)
+{
+    m_scrollbackPool.setBudget(bytes);
+}
+
+void TerminalReactor::onActivated()
+{
+#ifdef Q_OS_LINUX
+    epoll_event events[MaxEvents];
+    int count;
+    do {
+        count = epoll_wait(m_epollFd, events, MaxEvents, 0);
+    } while (count < 0 && errno == EINTR);
+
+    for (int i = 0; i < count; ++i) {
+        // A handler earlier in this round, or readReady() just before,
+        // may have removed its fd
+        const int fd = events[i].data.fd;
+        const uint32_t ready = events[i].events;
+        if ((ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) && m_watches.value(fd).read) {
+            m_watches.value(fd).handler->readReady();
+        }
+        if ((ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && m_watches.value(fd).write) {
+            m_watches.value(fd).handler->writeReady();
+        }
+    }
+
+    m_scrollbackPool.enforce();
+#endif
+}
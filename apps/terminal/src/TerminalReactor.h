@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include "TerminalScrollback.h"
+
+class QSocketNotifier;
+
+/**
+ * Readiness dispatcher shared by every terminal session's PTY.
+ *
+ * On Linux all master fds are registered with one epoll instance, and
+ * only the epoll fd is watched by the thread's event loop: a wake-up
+ * costs one epoll_wait() however many sessions are open, and idle
+ * sessions cost nothing. Elsewhere it falls back to a QSocketNotifier
+ * per fd.
+ *
+ * The reactor also owns the scrollback pool of the sessions on its
+ * thread and enforces it after each round of reads.
+ *
+ * Not thread-safe: the reactor is only used on its own thread.
+ */
+class TerminalReactor : public QObject {
+    Q_OBJECT
+
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // The fd is readable or was hung up. Read until EAGAIN, or stop
+        // early and the reactor calls again (level-triggered).
+        virtual void readReady() = 0;
+        // The fd is writable again, or failed, after watchWritable()
+        virtual void writeReady() {}
+    };
+
+    explicit TerminalReactor(QObject *parent = nullptr);
+    ~TerminalReactor() override;
+
+    // Watches `fd` for input until remove(). The fd must be non-blocking.
+    void add(int fd, Handler *handler);
+    void remove(int fd);
+
+    // Watches `fd` for room to write, independently of input, until
+    // unwatchWritable(). Used to finish writes that hit EAGAIN.
+    void watchWritable(int fd, Handler *handler);
+    void unwatchWritable(int fd);
+
+    TerminalScrollbackPool *scrollbackPool() { return &m_scrollbackPool; }
+
+public slots:
+    void setScrollbackBudget(qint64 bytes);
+
+private slots:
+    void onActivated();
+
+private:
+    static constexpr int MaxEvents = 32;
+
+    struct Watch {
+        Handler *handler = nullptr;
+        bool read = false;
+        bool write = false;
+    };
+
+    void update(int fd, const Watch &watch);
+
+    QHash<int, Watch> m_watches;
+#ifdef Q_OS_LINUX
+    int m_epollFd;
+    QSocketNotifier *m_notifier; // On m_epollFd, created on first add()
+#else
+    QHash<int, QSocketNotifier *> m_notifiers;
+    QHash<int, QSocketNotifier *> m_writeNotifiers;
+#endif
+    TerminalScrollbackPool m_scrollbackPool;
+};
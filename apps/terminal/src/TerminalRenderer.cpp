@@ -1,19 +1,257 @@
 #include "TerminalRenderer.h"
 #include "TerminalEngine.h"
-#include "TerminalScreen.h"
-#include <QPainter>
-#include <QTimer>
+#include "TerminalFrame.h"
+#include "TerminalGlyphAtlas.h"
+#include "TerminalGlyphMaterial.h"
+#include <QHash>
+#include <QQuickWindow>
+#include <QSGSimpleRectNode>
+#include <QSGVertexColorMaterial>
+#include <QVarLengthArray>
+#include <QtMath>
+#include <algorithm>
+#include <list>
+
+namespace {
+
+// One screen row: background/selection/cursor quads plus glyph quads,
+// positioned by the transform so rows can be moved on scroll without
+// rebuilding their geometry.
+class TerminalRowNode : public QSGTransformNode {
+public:
+    TerminalRowNode(QSGMaterial *backgroundMaterial, QSGMaterial *glyphMaterial)
+        : background(new QSGGeometryNode)
+        , glyphs(new QSGGeometryNode)
+    {
+        auto *bgGeometry = new QSGGeometry(QSGGeometry::defaultAttributes_ColoredPoint2D(), 0);
+        bgGeometry->setDrawingMode(QSGGeometry::DrawTriangles);
+        background->setGeometry(bgGeometry);
+        background->setFlag(QSGNode::OwnsGeometry);
+        background->setMaterial(backgroundMaterial);
+        appendChildNode(background);
+
+        auto *glyphGeometry = new QSGGeometry(TerminalGlyphMaterial::attributes(), 0, 0,
+                                              QSGGeometry::UnsignedShortType);
+        glyphGeometry->setDrawingMode(QSGGeometry::DrawTriangles);
+        glyphs->setGeometry(glyphGeometry);
+        glyphs->setFlag(QSGNode::OwnsGeometry);
+        glyphs->setMaterial(glyphMaterial);
+        appendChildNode(glyphs);
+    }
+
+    void setY(qreal y) {
+        if (m_y == y) return;
+        m_y = y;
+        QMatrix4x4 m;
+        m.translate(0, y);
+        setMatrix(m);
+    }
+
+    QSGGeometryNode *background;
+    QSGGeometryNode *glyphs;
+
+private:
+    qreal m_y = -1;
+};
+
+void writeQuadIndices(quint16 *indices, int quads)
+{
+    for (int i = 0; i < quads; ++i) {
+        const quint16 base = i * 4;
+        indices[0] = base;
+        indices[1] = base + 1;
+        indices[2] = base + 2;
+        indices[3] = base + 1;
+        indices[4] = base + 3;
+        indices[5] = base + 2;
+        indices += 6;
+    }
+}
+
+// What row `y` shows, written to `content`: its cells with their resolved
+// styles (style indices are reused once free), its selected span and the
+// cursor. Geometry is row-local, so equal contents mean identical
+// vertices. Returns a hash of the content.
+quint64 rowKey(const TerminalFrame &frame, int y, QVector<quint32> *content)
+{
+    content->clear();
+    content->append(frame.cols);
+    
+    // A style follows the first cell of each run, marked in its flags word
+    static constexpr quint32 StyleFollows = 0x10000;
+    int lastStyle = -1;
+    for (int x = 0; x < frame.cols; ++x) {
+        const TerminalCell &cell = frame.cell(x, y);
+        content->append(cell.codePoint);
+        if (cell.style == lastStyle) {
+            content->append(cell.flags);
+            continue;
+        }
+        lastStyle = cell.style;
+        const TerminalStyle &style = frame.style(cell.style);
+        content->append(cell.flags | StyleFollows);
+        content->append(style.fgColor);
+        content->append(style.bgColor);
+        content->append(style.attributes);
+    }
+    
+    const TerminalSelection &selection = frame.selection;
+    if (selection.active && y >= selection.startY && y <= selection.endY) {
+        content->append((y == selection.startY ? selection.startX : 0) + 1);
+        content->append((y == selection.endY ? selection.endX : frame.cols - 1) + 1);
+    } else {
+        content->append(0);
+        content->append(0);
+    }
+    content->append(y == frame.cursorY ? frame.cursorX + 1 : 0);
+    
+    quint64 h = 0;
+    for (quint32 word : std::as_const(*content)) {
+        h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// Geometry of recently built rows by rowKey(). A damaged row that shows
+// something it (or any row) showed before, such as a prompt the cursor
+// returns to, lines a TUI repaints unchanged, or output scrolled back and
+// forth, is copied instead of rebuilt. Least recently used rows are
+// evicted past Budget bytes. Entries are found by hash but only used when
+// their content matches. Vertices hold atlas coordinates, so the cache is
+// cleared whenever the atlas or the renderer's look changes.
+class TerminalRowCache {
+public:
+    static constexpr qint64 Budget = 4 * 1024 * 1024;
+    
+    bool restore(quint64 key, const QVector<quint32> &content, TerminalRowNode *row)
+    {
+        const auto found = m_index.constFind(key);
+        if (found == m_index.constEnd() || found.value()->content != content) return false;
+        m_entries.splice(m_entries.begin(), m_entries, found.value());
+        const Entry &entry = m_entries.front();
+        
+        QSGGeometry *bgGeometry = row->background->geometry();
+        bgGeometry->allocate(entry.background.size());
+        std::copy(entry.background.cbegin(), entry.background.cend(),
+                  bgGeometry->vertexDataAsColoredPoint2D());
+        row->background->markDirty(QSGNode::DirtyGeometry);
+        
+        const int quads = entry.glyphs.size() / 4;
+        QSGGeometry *glyphGeometry = row->glyphs->geometry();
+        glyphGeometry->allocate(quads * 4, quads * 6);
+        std::copy(entry.glyphs.cbegin(), entry.glyphs.cend(),
+                  static_cast<TerminalGlyphVertex *>(glyphGeometry->vertexData()));
+        writeQuadIndices(glyphGeometry->indexDataAsUShort(), quads);
+        row->glyphs->markDirty(QSGNode::DirtyGeometry);
+        return true;
+    }
+    
+    void insert(quint64 key, const QVector<quint32> &content, const TerminalRowNode *row)
+    {
+        // A different row with the same hash gives way to the newer one
+        const auto found = m_index.constFind(key);
+        if (found != m_index.constEnd()) {
+            m_bytes -= found.value()->bytes();
+            m_entries.erase(found.value());
+            m_index.erase(found);
+        }
+        
+        const QSGGeometry *bgGeometry = row->background->geometry();
+        const auto *bg = bgGeometry->vertexDataAsColoredPoint2D();
+        const QSGGeometry *glyphGeometry = row->glyphs->geometry();
+        const auto *glyphs = static_cast<const TerminalGlyphVertex *>(glyphGeometry->vertexData());
+        
+        Entry entry;
+        entry.key = key;
+        entry.content = content;
+        entry.background = QVector<QSGGeometry::ColoredPoint2D>(bg, bg + bgGeometry->vertexCount());
+        entry.glyphs = QVector<TerminalGlyphVertex>(glyphs, glyphs + glyphGeometry->vertexCount());
+        m_bytes += entry.bytes();
+        m_entries.push_front(std::move(entry));
+        m_index.insert(key, m_entries.begin());
+        
+        while (m_bytes > Budget && m_entries.size() > 1) {
+            m_bytes -= m_entries.back().bytes();
+            m_index.remove(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+    
+    void clear()
+    {
+        m_entries.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+    
+private:
+    struct Entry {
+        quint64 key = 0;
+        QVector<quint32> content;
+        QVector<QSGGeometry::ColoredPoint2D> background;
+        QVector<TerminalGlyphVertex> glyphs;
+        
+        qint64 bytes() const {
+            return sizeof(Entry) + content.size() * sizeof(quint32)
+                   + background.size() * sizeof(QSGGeometry::ColoredPoint2D)
+                   + glyphs.size() * sizeof(TerminalGlyphVertex);
+        }
+    };
+    
+    std::list<Entry> m_entries; // Most recently used first
+    QHash<quint64, std::list<Entry>::iterator> m_index;
+    qint64 m_bytes = 0;
+};
+
+// Root of the renderer's subtree. Owns the glyph atlas and the materials
+// shared by every row, so all rows batch into a couple of draw calls.
+class TerminalRootNode : public QSGNode {
+public:
+    TerminalRootNode()
+        : backdrop(new QSGSimpleRectNode)
+    {
+        appendChildNode(backdrop);
+    }
+
+    ~TerminalRootNode() override { delete atlas; }
+
+    QSGSimpleRectNode *backdrop;
+    TerminalGlyphAtlas *atlas = nullptr;
+    TerminalGlyphMaterial glyphMaterial;
+    QSGVertexColorMaterial backgroundMaterial;
+    QVector<TerminalRowNode *> rows;
+    TerminalRowCache rowCache;
+    QVector<quint32> rowContent; // Scratch for rowKey()
+    int cols = 0;
+};
+
+struct ColoredRect {
+    QRectF rect;
+    QColor color;
+};
+
+void premultiplied(const QColor &color, unsigned char out[4])
+{
+    const int a = color.alpha();
+    out[0] = static_cast<unsigned char>(color.red() * a / 255);
+    out[1] = static_cast<unsigned char>(color.green() * a / 255);
+    out[2] = static_cast<unsigned char>(color.blue() * a / 255);
+    out[3] = static_cast<unsigned char>(a);
+}
+
+} // namespace
 
 TerminalRenderer::TerminalRenderer(QQuickItem *parent)
-    : QQuickPaintedItem(parent)
+    : QQuickItem(parent)
     , m_terminal(nullptr)
-    , m_screen(nullptr)
     , m_charWidth(10)
     , m_charHeight(20)
     , m_ascent(15)
+    , m_fullRedraw(true)
+    , m_frameSequence(0)
 {
     setFlag(ItemHasContents, true);
-    setAntialiasing(true);
     
     // Default font - try to find a good monospace font
     QStringList fonts = {"Cascadia Code", "Fira Code", "Roboto Mono", "Courier New", "Monospace"};
@@ -41,21 +279,17 @@ void TerminalRenderer::setTerminal(TerminalEngine *terminal)
     
     if (m_terminal) {
         disconnect(m_terminal, nullptr, this, nullptr);
-        if (m_screen) {
-            disconnect(m_screen, nullptr, this, nullptr);
-        }
     }
     
     m_terminal = terminal;
-    m_screen = m_terminal ? m_terminal->screen() : nullptr;
     
-    if (m_terminal && m_screen) {
-        // Connect screen updates to QQuickItem::update()
-        // This schedules a repaint for the next VSync
-        connect(m_screen, &TerminalScreen::screenChanged, this, &QQuickItem::update);
-        connect(m_screen, &TerminalScreen::cursorChanged, this, &QQuickItem::update);
+    if (m_terminal) {
+        // Only sent when the previous frame was picked up, so a flood of
+        // output costs at most one pending repaint
+        connect(m_terminal, &TerminalEngine::frameReady, this, &QQuickItem::update);
     }
     
+    m_fullRedraw = true;
     emit terminalChanged();
     update();
 }
@@ -65,6 +299,7 @@ void TerminalRenderer::setFont(const QFont &font)
     if (m_font == font) return;
     m_font = font;
     updateCharSize();
+    m_fullRedraw = true;
     emit fontChanged();
     update();
 }
@@ -73,6 +308,7 @@ void TerminalRenderer::setTextColor(const QColor &color)
 {
     if (m_textColor == color) return;
     m_textColor = color;
+    m_fullRedraw = true;
     emit textColorChanged();
     update();
 }
@@ -81,6 +317,7 @@ void TerminalRenderer::setBackgroundColor(const QColor &color)
 {
     if (m_backgroundColor == color) return;
     m_backgroundColor = color;
+    m_fullRedraw = true;
     emit backgroundColorChanged();
     update();
 }
@@ -89,6 +326,7 @@ void TerminalRenderer::setSelectionColor(const QColor &color)
 {
     if (m_selectionColor == color) return;
     m_selectionColor = color;
+    m_fullRedraw = true;
     emit selectionColorChanged();
     update();
 }
@@ -97,39 +335,30 @@ void TerminalRenderer::updateCharSize()
 {
     QFontMetricsF fm(m_font);
     m_charWidth = fm.horizontalAdvance('W');
-    m_charHeight = fm.height();
+    // Whole-pixel rows so rendered rows can be shifted on scroll
+    m_charHeight = qCeil(fm.height());
     m_ascent = fm.ascent();
     emit charSizeChanged();
 }
 
-void TerminalRenderer::onScreenChanged()
-{
-    update();
-}
-
-void TerminalRenderer::onCursorChanged()
-{
-    update();
-}
-
 void TerminalRenderer::select(int startX, int startY, int endX, int endY)
 {
-    if (m_screen) {
-        m_screen->setSelection(startX, startY, endX, endY);
+    if (m_terminal) {
+        m_terminal->setSelection(startX, startY, endX, endY);
     }
 }
 
 void TerminalRenderer::clearSelection()
 {
-    if (m_screen) {
-        m_screen->clearSelection();
+    if (m_terminal) {
+        m_terminal->clearSelection();
     }
 }
 
 QString TerminalRenderer::selectedText() const
 {
-    if (m_screen) {
-        return m_screen->getSelectedText();
+    if (m_terminal) {
+        return m_terminal->selectedText();
     }
     return QString();
 }
@@ -149,128 +378,253 @@ QPoint TerminalRenderer::positionToGrid(qreal x, qreal y)
     return QPoint(col, row);
 }
 
-void TerminalRenderer::paint(QPainter *painter)
+void TerminalRenderer::geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry)
 {
-    if (!m_screen) return;
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        update();
+    }
+}
+
+QColor TerminalRenderer::foregroundFor(const TerminalStyle &style) const
+{
+    if (style.inverse()) {
+        // Inverse: Use BG as FG
+        return (style.bgColor == 0xFF000000) ? m_backgroundColor : QColor::fromRgba(style.bgColor);
+    }
+    return (style.fgColor == 0xFFFFFFFF) ? m_textColor : QColor::fromRgba(style.fgColor);
+}
+
+QSGNode *TerminalRenderer::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    auto *root = static_cast<TerminalRootNode *>(oldNode);
     
-    painter->setFont(m_font);
+    if (!m_terminal || width() <= 0 || height() <= 0) {
+        delete root;
+        return nullptr;
+    }
     
-    // Lock the screen while we read from it
-    QMutexLocker locker(m_screen->mutex());
+    // Always take the newest frame, even if nothing is rebuilt from it,
+    // so the engine keeps signalling new ones. In FramePaced mode this is
+    // also what lets the I/O thread snapshot the next frame, so at most
+    // one frame is produced per presented (vsync-aligned) frame.
+    const TerminalFrame &frame = *m_terminal->frames()->acquire();
+    m_terminal->frameConsumed();
     
-    int cols = m_screen->cols();
-    int rows = m_screen->rows();
+    if (!root) {
+        root = new TerminalRootNode;
+        m_fullRedraw = true;
+    }
     
-    // Draw background
-    painter->fillRect(boundingRect(), m_backgroundColor);
+    root->backdrop->setRect(boundingRect());
+    root->backdrop->setColor(m_backgroundColor);
     
-    // Batch drawing variables
-    QString lineBuffer;
-    lineBuffer.reserve(cols);
+    const qreal dpr = window()->effectiveDevicePixelRatio();
+    if (!root->atlas || !root->atlas->matches(m_font, dpr)) {
+        delete root->atlas;
+        root->atlas = new TerminalGlyphAtlas(m_font, m_charWidth, m_charHeight, m_ascent, dpr);
+        m_fullRedraw = true;
+    }
     
-    for (int y = 0; y < rows; ++y) {
-        // Optimization: Skip rows outside view
-        if (y * m_charHeight > height()) break;
-        
-        int x = 0;
-        while (x < cols) {
-            const TerminalCell &startCell = m_screen->cell(x, y);
-            
-            // 1. Draw Background (if not default)
-            // We can batch background too, but for now let's do per-cell or small runs
-            // Actually, let's find a run of identical styles
-            int runEnd = x + 1;
-            while (runEnd < cols) {
-                const TerminalCell &next = m_screen->cell(runEnd, y);
-                if (next != startCell) break;
-                runEnd++;
-            }
-            
-            // Draw BG for the run
-            if (startCell.bgColor != 0xFF000000 || startCell.inverse) {
-                QColor bg;
-                if (startCell.inverse) {
-                    // Inverse: Use FG as BG
-                    bg = (startCell.fgColor == 0xFFFFFFFF) ? m_textColor : QColor(startCell.fgColor);
-                } else {
-                    // Normal: Use BG
-                    bg = QColor(startCell.bgColor);
-                }
-                
-                QRectF bgRect(x * m_charWidth, y * m_charHeight, (runEnd - x) * m_charWidth, m_charHeight);
-                painter->fillRect(bgRect, bg);
-            }
-            
-            // Draw Selection Overlay
-            // We need to check each cell in the run for selection
-            // Optimization: Check if the whole run is selected or not
-            // But selection boundaries might be in the middle of a style run.
-            // So we iterate.
-            if (m_screen->hasSelection()) {
-                int selStart = x;
-                while (selStart < runEnd) {
-                    if (m_screen->isSelected(selStart, y)) {
-                        int selEnd = selStart + 1;
-                        while (selEnd < runEnd && m_screen->isSelected(selEnd, y)) {
-                            selEnd++;
-                        }
-                        // Draw selection rect
-                        QRectF selRect(selStart * m_charWidth, y * m_charHeight, (selEnd - selStart) * m_charWidth, m_charHeight);
-                        painter->fillRect(selRect, m_selectionColor);
-                        selStart = selEnd;
-                    } else {
-                        selStart++;
-                    }
+    // Damage is relative to the previous frame; after skipped frames only
+    // a full rebuild is correct
+    const bool newFrame = frame.sequence != m_frameSequence;
+    const bool consecutive = frame.sequence == m_frameSequence + 1;
+    m_frameSequence = frame.sequence;
+    
+    const TerminalDamage noDamage;
+    const TerminalDamage &damage = newFrame ? frame.damage : noDamage;
+    const int rows = frame.rows;
+    bool full = m_fullRedraw || (newFrame && (!consecutive || damage.full))
+                || root->rows.size() != rows || root->cols != frame.cols;
+    if (m_fullRedraw) root->rowCache.clear();
+    m_fullRedraw = false;
+    
+    // Rows that scrolled off the top are recycled as the new bottom rows;
+    // everything in between only moves.
+    if (!full && damage.scrolled > 0) {
+        std::rotate(root->rows.begin(), root->rows.begin() + damage.scrolled, root->rows.end());
+    }
+    
+    while (root->rows.size() < rows) {
+        auto *row = new TerminalRowNode(&root->backgroundMaterial, &root->glyphMaterial);
+        root->appendChildNode(row);
+        root->rows.append(row);
+    }
+    while (root->rows.size() > rows) {
+        delete root->rows.takeLast();
+    }
+    root->cols = frame.cols;
+    
+    // A second pass is needed when the atlas had to grow or be flushed
+    // while building, since earlier rows hold stale texture coordinates.
+    for (int pass = 0; pass < 4; ++pass) {
+        for (int y = 0; y < rows; ++y) {
+            TerminalRowNode *row = root->rows[y];
+            row->setY(y * m_charHeight);
+            if (full || damage.isRowDirty(y)) {
+                // Damage says which rows may have changed; the cache skips
+                // the ones that changed back to something already built
+                const quint64 key = rowKey(frame, y, &root->rowContent);
+                if (!root->rowCache.restore(key, root->rowContent, row)) {
+                    buildRow(row, frame, y, root->atlas, dpr);
+                    root->rowCache.insert(key, root->rowContent, row);
                 }
             }
-            
-            // Draw Cursor (if in this run)
-            if (y == m_screen->cursorY() && m_screen->cursorX() >= x && m_screen->cursorX() < runEnd) {
-                QRectF cursorRect(m_screen->cursorX() * m_charWidth, y * m_charHeight, m_charWidth, m_charHeight);
-                // Cursor color is inverse of text color or a specific cursor color
-                // For now, let's use semi-transparent inverse of background
-                QColor cursorColor = (m_backgroundColor.lightness() > 128) ? QColor(0, 0, 0, 128) : QColor(255, 255, 255, 128);
-                painter->fillRect(cursorRect, cursorColor);
+        }
+        
+        if (root->atlas->isFull()) {
+            root->atlas->reset();
+        } else if (!root->atlas->takeGeometryChanged()) {
+            break;
+        }
+        root->atlas->takeGeometryChanged();
+        root->rowCache.clear();
+        full = true;
+    }
+    
+    QSGTexture *texture = root->atlas->texture();
+    if (root->glyphMaterial.texture() != texture) {
+        root->glyphMaterial.setTexture(texture);
+        for (TerminalRowNode *row : std::as_const(root->rows)) {
+            row->glyphs->markDirty(QSGNode::DirtyMaterial);
+        }
+    }
+    
+    return root;
+}
+
+void TerminalRenderer::buildRow(QSGNode *node, const TerminalFrame &frame, int y,
+                                TerminalGlyphAtlas *atlas, qreal dpr)
+{
+    auto *row = static_cast<TerminalRowNode *>(node);
+    const int cols = frame.cols;
+    
+    // 1. Backgrounds, selection and cursor as flat colored quads
+    QVarLengthArray<ColoredRect, 32> rects;
+    
+    int x = 0;
+    while (x < cols) {
+        const uint16_t styleIndex = frame.cell(x, y).style;
+        int runEnd = x + 1;
+        while (runEnd < cols && frame.cell(runEnd, y).style == styleIndex) {
+            runEnd++;
+        }
+        
+        const TerminalStyle &style = frame.style(styleIndex);
+        if (style.bgColor != 0xFF000000 || style.inverse()) {
+            QColor bg;
+            if (style.inverse()) {
+                // Inverse: Use FG as BG
+                bg = (style.fgColor == 0xFFFFFFFF) ? m_textColor : QColor::fromRgba(style.fgColor);
+            } else {
+                bg = QColor::fromRgba(style.bgColor);
             }
-            
-            // 2. Draw Text Batch
-            // Collect characters for this run
-            lineBuffer.clear();
-            bool hasText = false;
-            for (int i = x; i < runEnd; ++i) {
-                uint32_t cp = m_screen->cell(i, y).codePoint;
-                if (cp && cp != ' ') {
-                    lineBuffer.append(QChar(cp));
-                    hasText = true;
-                } else {
-                    lineBuffer.append(' ');
-                }
+            rects.append({QRectF(x * m_charWidth, 0, (runEnd - x) * m_charWidth, m_charHeight), bg});
+        }
+        if (style.underline()) {
+            rects.append({QRectF(x * m_charWidth, m_ascent + 1, (runEnd - x) * m_charWidth, 1),
+                          foregroundFor(style)});
+        }
+        x = runEnd;
+    }
+    
+    if (frame.selection.active) {
+        int selStart = 0;
+        while (selStart < cols) {
+            if (!frame.selection.contains(selStart, y)) {
+                selStart++;
+                continue;
             }
-            
-            if (hasText) {
-                QColor fg;
-                if (startCell.inverse) {
-                    // Inverse: Use BG as FG
-                    fg = (startCell.bgColor == 0xFF000000) ? m_backgroundColor : QColor(startCell.bgColor);
-                } else {
-                    // Normal: Use FG
-                    fg = (startCell.fgColor == 0xFFFFFFFF) ? m_textColor : QColor(startCell.fgColor);
-                }
-                
-                painter->setPen(fg);
-                
-                if (startCell.bold) {
-                    QFont f = m_font;
-                    f.setBold(true);
-                    painter->setFont(f);
-                } else {
-                    painter->setFont(m_font);
-                }
-                
-                painter->drawText(QPointF(x * m_charWidth, y * m_charHeight + m_ascent), lineBuffer);
+            int selEnd = selStart + 1;
+            while (selEnd < cols && frame.selection.contains(selEnd, y)) {
+                selEnd++;
             }
-            
-            x = runEnd;
+            rects.append({QRectF(selStart * m_charWidth, 0, (selEnd - selStart) * m_charWidth, m_charHeight),
+                          m_selectionColor});
+            selStart = selEnd;
         }
     }
+    
+    if (y == frame.cursorY && frame.cursorX < cols) {
+        // Semi-transparent inverse of the background
+        QColor cursorColor = (m_backgroundColor.lightness() > 128) ? QColor(0, 0, 0, 128) : QColor(255, 255, 255, 128);
+        const bool wide = frame.cell(frame.cursorX, y).flags & TerminalCell::WideChar;
+        rects.append({QRectF(frame.cursorX * m_charWidth, 0, (wide ? 2 : 1) * m_charWidth, m_charHeight),
+                      cursorColor});
+    }
+    
+    QSGGeometry *bgGeometry = row->background->geometry();
+    bgGeometry->allocate(rects.size() * 6);
+    QSGGeometry::ColoredPoint2D *v = bgGeometry->vertexDataAsColoredPoint2D();
+    for (const ColoredRect &r : rects) {
+        unsigned char c[4];
+        premultiplied(r.color, c);
+        const float l = r.rect.left(), t = r.rect.top(), rt = r.rect.right(), b = r.rect.bottom();
+        v[0].set(l, t, c[0], c[1], c[2], c[3]);
+        v[1].set(rt, t, c[0], c[1], c[2], c[3]);
+        v[2].set(l, b, c[0], c[1], c[2], c[3]);
+        v[3].set(rt, t, c[0], c[1], c[2], c[3]);
+        v[4].set(rt, b, c[0], c[1], c[2], c[3]);
+        v[5].set(l, b, c[0], c[1], c[2], c[3]);
+        v += 6;
+    }
+    row->background->markDirty(QSGNode::DirtyGeometry);
+    
+    // 2. Glyphs: one textured quad per visible cell, tinted per vertex
+    int glyphCount = 0;
+    for (int i = 0; i < cols; ++i) {
+        uint32_t cp = frame.cell(i, y).codePoint;
+        if (cp && cp != ' ') glyphCount++;
+    }
+    
+    QSGGeometry *glyphGeometry = row->glyphs->geometry();
+    glyphGeometry->allocate(glyphCount * 4, glyphCount * 6);
+    auto *gv = static_cast<TerminalGlyphVertex *>(glyphGeometry->vertexData());
+    quint16 *indices = glyphGeometry->indexDataAsUShort();
+    
+    const QSize atlasSize = atlas->imageSize();
+    const float pad = atlas->padding() / dpr;
+    const float slotH = atlas->slotSize().height() / dpr;
+    
+    int emitted = 0;
+    for (int i = 0; i < cols; ++i) {
+        const TerminalCell &cell = frame.cell(i, y);
+        if (!cell.codePoint || cell.codePoint == ' ') continue;
+        
+        const TerminalStyle &style = frame.style(cell.style);
+        uint8_t glyphStyle = TerminalGlyphAtlas::Regular;
+        if (style.bold()) glyphStyle |= TerminalGlyphAtlas::Bold;
+        if (style.italic()) glyphStyle |= TerminalGlyphAtlas::Italic;
+        
+        const QRect slot = atlas->glyph(cell.codePoint, glyphStyle, cell.flags & TerminalCell::WideChar);
+        if (slot.isNull()) continue; // Atlas full, row is rebuilt after a reset
+        
+        unsigned char c[4];
+        premultiplied(foregroundFor(style), c);
+        
+        // Snap to device pixels so glyphs sample the atlas 1:1
+        const float l = qRound(i * m_charWidth * dpr) / dpr - pad;
+        const float t = -pad;
+        const float tl = float(slot.left()) / atlasSize.width();
+        const float tt = float(slot.top()) / atlasSize.height();
+        const float tr = float(slot.left() + slot.width()) / atlasSize.width();
+        const float tb = float(slot.top() + slot.height()) / atlasSize.height();
+        const float slotW = slot.width() / dpr;
+        
+        gv[0].set(l, t, tl, tt, c);
+        gv[1].set(l + slotW, t, tr, tt, c);
+        gv[2].set(l, t + slotH, tl, tb, c);
+        gv[3].set(l + slotW, t + slotH, tr, tb, c);
+        gv += 4;
+        emitted++;
+    }
+    
+    // Glyphs skipped because the atlas was full become degenerate quads
+    for (int i = emitted; i < glyphCount; ++i) {
+        std::fill_n(reinterpret_cast<char *>(gv), 4 * sizeof(TerminalGlyphVertex), 0);
+        gv += 4;
+    }
+    writeQuadIndices(indices, glyphCount);
+    row->glyphs->markDirty(QSGNode::DirtyGeometry);
 }
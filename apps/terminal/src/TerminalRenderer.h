@@ -1,13 +1,26 @@
 #pragma once
 
-#include <QQuickPaintedItem>
+#include <QQuickItem>
+#include <QColor>
 #include <QFont>
 #include <QFontMetrics>
 
-class TerminalScreen;
 class TerminalEngine;
+class TerminalGlyphAtlas;
+struct TerminalFrame;
+struct TerminalStyle;
 
-class TerminalRenderer : public QQuickPaintedItem {
+/**
+ * Scene graph renderer for a TerminalEngine.
+ *
+ * Each screen row is a transform node holding one background geometry
+ * and one glyph geometry that samples a shared glyph atlas. Frames are
+ * taken from the engine's lock-free frame queue; only rows the frame
+ * reports damaged are rebuilt, scrolled rows are moved. Rebuilt rows that
+ * show something drawn recently are copied from an LRU cache of row
+ * geometry keyed by row content.
+ */
+class TerminalRenderer : public QQuickItem {
     Q_OBJECT
     QML_ELEMENT
     
@@ -54,17 +67,15 @@ signals:
     void selectionColorChanged();
 
 protected:
-    void paint(QPainter *painter) override;
-    
-private slots:
-    void onScreenChanged();
-    void onCursorChanged();
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void geometryChange(const QRectF &newGeometry, const QRectF &oldGeometry) override;
     
 private:
     void updateCharSize();
+    void buildRow(QSGNode *rowNode, const TerminalFrame &frame, int y, TerminalGlyphAtlas *atlas, qreal dpr);
+    QColor foregroundFor(const TerminalStyle &style) const;
     
     TerminalEngine *m_terminal;
-    TerminalScreen *m_screen;
     QFont m_font;
     QColor m_textColor;
     QColor m_backgroundColor;
@@ -72,4 +83,8 @@ private:
     qreal m_charWidth;
     qreal m_charHeight;
     qreal m_ascent;
+    
+    // Set when every row node must be rebuilt (font, colors, terminal)
+    bool m_fullRedraw;
+    quint64 m_frameSequence; // Last frame turned into nodes
 };
@@ -1,6 +1,11 @@
 #include "TerminalScreen.h"
+#include "TerminalCharWidth.h"
+#include "TerminalFrame.h"
+#include "TerminalScrollback.h"
 #include <QDebug>
 #include <algorithm>
+#include <cstring>
+#include <limits>
 
 TerminalScreen::TerminalScreen(QObject *parent)
     : QObject(parent)
@@ -9,138 +14,423 @@ TerminalScreen::TerminalScreen(QObject *parent)
     , m_cursorX(0)
     , m_cursorY(0)
     , m_topRow(0)
-    , m_historySize(1000) // 1000 lines of history
-    , m_currentFg(0xFFFFFFFF)
-    , m_currentBg(0xFF000000)
-    , m_currentBold(false)
-    , m_currentInverse(false)
-    , m_hasSelection(false)
-    , m_selStartX(0), m_selStartY(0)
-    , m_selEndX(0), m_selEndY(0)
+    , m_stride(80)
+    , m_penIndex(0)
+    , m_penDirty(false)
+    , m_scrollback(new TerminalScrollback)
+    , m_scrollbackPool(nullptr)
+    , m_historyOffset(0)
+    , m_visible(true)
+    , m_damagePending(false)
+    , m_inBatch(false)
 {
-    // Initialize grid with history capacity
-    m_grid.resize(m_historySize);
-    for (int i = 0; i < m_historySize; ++i) {
-        m_grid[i].resize(m_cols);
+    // Style 0 is the default rendition
+    m_styles.append(TerminalStyle());
+    m_styleLookup.insert(TerminalStyle(), 0);
+
+    // One contiguous block for the screen rows; default cells are all-zero
+    m_cells.resize(m_rows * m_stride);
+    m_rowFlags.resize(m_rows);
+
+    m_damage.rows.resize((m_rows + 63) / 64);
+    m_damage.full = true;
+}
+
+TerminalScreen::~TerminalScreen()
+{
+    if (m_scrollbackPool) m_scrollbackPool->remove(m_scrollback);
+    delete m_scrollback;
+}
+
+int TerminalScreen::historyCount() const
+{
+    return m_scrollback->rowCount();
+}
+
+void TerminalScreen::setScrollbackLimits(int lines, qint64 memoryBudget)
+{
+    m_scrollback->setLineLimit(lines);
+    m_scrollback->setMemoryBudget(memoryBudget);
+}
+
+qint64 TerminalScreen::scrollbackMemoryUsage() const
+{
+    return m_scrollback->memoryUsage();
+}
+
+void TerminalScreen::setScrollbackPool(TerminalScrollbackPool *pool)
+{
+    if (m_scrollbackPool == pool) return;
+    if (m_scrollbackPool) m_scrollbackPool->remove(m_scrollback);
+    m_scrollbackPool = pool;
+    if (m_scrollbackPool) {
+        m_scrollbackPool->add(m_scrollback);
+        m_scrollbackPool->setVisible(m_scrollback, m_visible);
+    }
+}
+
+void TerminalScreen::setVisible(bool visible)
+{
+    m_visible = visible;
+    if (m_scrollbackPool) m_scrollbackPool->setVisible(m_scrollback, visible);
+}
+
+TerminalScrollback TerminalScreen::searchSnapshot(qint64 *firstRow) const
+{
+    *firstRow = m_historyOffset - m_scrollback->rowCount();
+
+    TerminalScrollback snapshot(*m_scrollback);
+    snapshot.setLineLimit(std::numeric_limits<int>::max());
+    snapshot.setMemoryBudget(std::numeric_limits<qint64>::max());
+    for (int y = 0; y < m_rows; ++y) {
+        uint8_t flags = m_rowFlags[bufferRow(y)];
+        if (y == m_rows - 1) flags &= ~RowWrapped;
+        snapshot.push(rowData(y), m_cols, flags);
+    }
+    return snapshot;
+}
+
+void TerminalScreen::pushToScrollback(int y)
+{
+    m_scrollback->push(rowData(y), m_cols, m_rowFlags[bufferRow(y)]);
+    m_historyOffset++;
+}
+
+void TerminalScreen::markRowDirty(int y)
+{
+    m_damage.rows[y >> 6] |= quint64(1) << (y & 63);
+    m_damagePending = true;
+}
+
+void TerminalScreen::markAllDirty()
+{
+    m_damage.full = true;
+    m_damagePending = true;
+}
+
+void TerminalScreen::snapshot(TerminalFrame *frame)
+{
+    frame->cols = m_cols;
+    frame->rows = m_rows;
+    frame->cells.resize(m_cols * m_rows);
+
+    // Rows are contiguous in the ring but strided; copy the visible width
+    TerminalCell *dst = frame->cells.data();
+    for (int y = 0; y < m_rows; ++y) {
+        std::memcpy(static_cast<void *>(dst + y * m_cols), rowData(y), m_cols * sizeof(TerminalCell));
+    }
+
+    // Implicitly shared; only detaches when the next new style is interned
+    frame->styles = m_styles;
+    frame->cursorX = m_cursorX;
+    frame->cursorY = m_cursorY;
+    frame->historyOffset = m_historyOffset;
+    frame->selection = m_selection;
+
+    // Swap rather than copy so the bitmaps are recycled, not reallocated
+    std::swap(frame->damage, m_damage);
+    m_damage.scrolled = 0;
+    m_damage.full = false;
+    m_damage.rows.fill(0, (m_rows + 63) / 64);
+    m_damagePending = false;
+}
+
+void TerminalScreen::fillBlank(TerminalCell *dst, int count) const
+{
+    if (count <= 0) return;
+
+    if (m_blank == TerminalCell()) {
+        std::memset(static_cast<void *>(dst), 0, count * sizeof(TerminalCell));
+    } else {
+        std::fill_n(dst, count, m_blank);
     }
 }
 
-TerminalCell& TerminalScreen::cellAt(int x, int y)
+void TerminalScreen::blankBufferRow(int bufferIndex)
 {
-    // y is visual row (0..m_rows-1)
-    // map to buffer row
-    int bufferRow = (m_topRow + y) % m_historySize;
-    return m_grid[bufferRow][x];
+    fillBlank(m_cells.data() + bufferIndex * m_stride, m_stride);
+    m_rowFlags[bufferIndex] = 0;
 }
 
 void TerminalScreen::resize(int cols, int rows)
 {
-    QMutexLocker locker(&m_mutex);
-    
     if (cols < 1) cols = 1;
     if (rows < 1) rows = 1;
-    
+
     if (cols == m_cols && rows == m_rows) return;
-    
-    // Resizing a ring buffer is complex. 
-    // For simplicity in this version, we'll clear history on resize or do a naive copy.
-    // Let's do a naive copy to a new grid to keep it clean.
-    
-    QVector<QVector<TerminalCell>> newGrid(m_historySize);
-    for (int i = 0; i < m_historySize; ++i) {
-        newGrid[i].resize(cols);
-    }
-    
-    // Copy visible portion
-    int copyRows = std::min(rows, m_rows);
-    int copyCols = std::min(cols, m_cols);
-    
-    for (int y = 0; y < copyRows; ++y) {
-        for (int x = 0; x < copyCols; ++x) {
-            int oldRow = (m_topRow + y) % m_historySize;
-            newGrid[y][x] = m_grid[oldRow][x];
+
+    // Only a screen filled to the bottom may take lines back from history;
+    // anything else (say, right after `clear`) keeps its blank rows
+    const bool atBottom = m_cursorY == m_rows - 1;
+    const int historyRows = m_scrollback->rowCount();
+
+    // Join the screen rows into logical lines. A line that started in the
+    // scrollback and wrapped onto the screen is pulled back to be joined.
+    QVector<QVector<TerminalCell>> lines;
+    QVector<uint8_t> lineFlags;
+    QVector<TerminalCell> current;
+    m_scrollback->takeOpenLine(&current);
+
+    int cursorLine = 0;
+    int cursorOffset = 0;
+    for (int y = 0; y < m_rows; ++y) {
+        const TerminalCell *row = rowData(y);
+        const uint8_t flags = m_rowFlags[bufferRow(y)];
+        const bool wrapped = (flags & RowWrapped) && y + 1 < m_rows;
+
+        if (y == m_cursorY) {
+            cursorLine = lines.size();
+            cursorOffset = current.size() + m_cursorX;
+        }
+
+        int count = m_cols;
+        if (wrapped) {
+            if (row[count - 1].flags & TerminalCell::WrapPadding) count--;
+        } else {
+            // Only default blanks are padding; a styled one (a colored
+            // background, say) is part of the line
+            while (count > 0 && row[count - 1] == TerminalCell()) count--;
+        }
+
+        const int at = current.size();
+        current.resize(at + count);
+        std::copy_n(row, count, current.begin() + at);
+
+        if (!wrapped) {
+            lines.append(current);
+            lineFlags.append(flags);
+            current.clear();
         }
     }
-    
-    m_grid = newGrid;
+
+    // Empty lines below the cursor would only push content into history
+    while (lines.size() > cursorLine + 1 && lines.last().isEmpty()) {
+        lines.removeLast();
+        lineFlags.removeLast();
+    }
+
+    QVector<int> lineRows(lines.size());
+    int total = 0;
+    for (int i = 0; i < lines.size(); ++i) {
+        lineRows[i] = TerminalScrollback::wrap(lines[i].constData(), lines[i].size(), cols);
+        total += lineRows[i];
+    }
+
+    // With room to spare, whole lines come back from the scrollback, so
+    // rotating back and forth restores the original screen
+    m_scrollback->setWidth(cols);
+    while (atBottom && total < rows) {
+        QVector<TerminalCell> line;
+        uint8_t flags = 0;
+        if (!m_scrollback->takeLast(&line, &flags)) break;
+
+        const int count = TerminalScrollback::wrap(line.constData(), line.size(), cols);
+        if (total + count > rows) {
+            m_scrollback->push(line.constData(), line.size(), flags);
+            break;
+        }
+        lines.prepend(line);
+        lineFlags.prepend(flags);
+        lineRows.prepend(count);
+        total += count;
+        cursorLine++;
+    }
+
+    int cursorRow = 0;
+    for (int i = 0; i < cursorLine; ++i) cursorRow += lineRows[i];
+
+    // Rows that no longer fit above the screen go to the scrollback; the
+    // cursor row always stays visible
+    const int shift = std::min(std::max(0, total - rows), cursorRow);
+
+    m_cells.fill(TerminalCell(), rows * cols);
+    m_rowFlags.fill(0, rows);
+    m_stride = cols;
+    m_topRow = 0;
     m_cols = cols;
     m_rows = rows;
-    m_topRow = 0; // Reset top to 0 after resize
-    
-    // Clamp cursor
-    if (m_cursorX >= m_cols) m_cursorX = m_cols - 1;
-    if (m_cursorY >= m_rows) m_cursorY = m_rows - 1;
-    
-    emit screenChanged();
+
+    QVector<int> starts;
+    int y = -shift;
+    for (int i = 0; i < lines.size() && y < rows; ++i) {
+        const QVector<TerminalCell> &line = lines[i];
+        const int count = TerminalScrollback::wrap(line.constData(), line.size(), cols, &starts);
+
+        if (i == cursorLine) {
+            int segment = count - 1;
+            while (segment > 0 && starts[segment] > cursorOffset) segment--;
+            m_cursorY = y + segment;
+            m_cursorX = std::min(cursorOffset - starts[segment], cols - 1);
+        }
+
+        for (int r = 0; r < count && y < rows; ++r, ++y) {
+            const int start = starts[r];
+            const int end = r + 1 < count ? starts[r + 1] : line.size();
+            const uint8_t flags = r + 1 < count ? uint8_t(RowWrapped) : lineFlags[i];
+            if (y < 0) {
+                m_scrollback->push(line.constData() + start, end - start, flags);
+                continue;
+            }
+
+            TerminalCell *dst = rowData(y);
+            std::copy(line.constData() + start, line.constData() + end, dst);
+            fillBlank(dst + (end - start), cols - (end - start));
+            m_rowFlags[y] = flags;
+        }
+    }
+    m_cursorY = std::clamp(m_cursorY, 0, m_rows - 1);
+
+    // Rows rewrap, so absolute rows from before are only kept in line
+    // with the newest history row
+    m_historyOffset += m_scrollback->rowCount() - historyRows;
+
+    // Selection coordinates do not survive rewrapping
+    m_selection.active = false;
+
+    m_damage.rows.fill(0, (m_rows + 63) / 64);
+    m_damage.scrolled = 0;
+    markAllDirty();
 }
 
 void TerminalScreen::clear()
 {
-    QMutexLocker locker(&m_mutex);
+    m_scrollback->closeOpenLine(); // The screen no longer continues it
     for (int y = 0; y < m_rows; ++y) {
-        for (int x = 0; x < m_cols; ++x) {
-            cellAt(x, y) = TerminalCell();
-            cellAt(x, y).bgColor = m_currentBg;
-        }
+        blankBufferRow(bufferRow(y));
     }
     m_cursorX = 0;
     m_cursorY = 0;
-    emit screenChanged();
+    markAllDirty();
 }
 
-void TerminalScreen::putChar(uint32_t codePoint)
+void TerminalScreen::wrapLine()
 {
-    QMutexLocker locker(&m_mutex);
-    
-    if (m_cursorX >= m_cols) {
-        m_cursorX = 0;
-        if (m_cursorY < m_rows - 1) {
-            m_cursorY++;
-        } else {
-            scrollUp();
+    m_rowFlags[bufferRow(m_cursorY)] |= RowWrapped;
+    m_cursorX = 0;
+    if (m_cursorY < m_rows - 1) {
+        m_cursorY++;
+    } else {
+        scrollUp();
+    }
+}
+
+void TerminalScreen::splitWide(TerminalCell *row, int x, int width)
+{
+    // Overwriting either half of a wide glyph leaves the other half blank
+    if ((row[x].flags & TerminalCell::WideContinuation) && x > 0) {
+        row[x - 1].codePoint = 0;
+        row[x - 1].flags = 0;
+    }
+    const int last = x + width - 1;
+    if ((row[last].flags & TerminalCell::WideChar) && last + 1 < m_cols) {
+        row[last + 1].codePoint = 0;
+        row[last + 1].flags = 0;
+    }
+}
+
+void TerminalScreen::putCodePoint(char32_t codePoint, uint16_t style)
+{
+    int width = TerminalCharWidth::width(codePoint);
+    if (width == 0) return; // Combining marks are not composed into cells
+    if (width > m_cols) width = 1;
+
+    // A wide glyph that does not fit in the last column wraps as a whole
+    if (m_cursorX + width > m_cols) {
+        if (m_cursorX < m_cols) {
+            TerminalCell *row = rowData(m_cursorY);
+            splitWide(row, m_cursorX, 1);
+            fillBlank(row + m_cursorX, m_cols - m_cursorX);
+            row[m_cols - 1].flags = TerminalCell::WrapPadding;
         }
+        wrapLine();
     }
-    
-    TerminalCell &cell = cellAt(m_cursorX, m_cursorY);
+
+    TerminalCell *row = rowData(m_cursorY);
+    splitWide(row, m_cursorX, width);
+
+    TerminalCell &cell = row[m_cursorX];
     cell.codePoint = codePoint;
-    cell.fgColor = m_currentFg;
-    cell.bgColor = m_currentBg;
-    cell.bold = m_currentBold;
-    cell.inverse = m_currentInverse;
-    
-    m_cursorX++;
-    emit screenChanged();
+    cell.style = style;
+    cell.flags = 0;
+    if (width == 2) {
+        cell.flags = TerminalCell::WideChar;
+        TerminalCell &continuation = row[m_cursorX + 1];
+        continuation.codePoint = 0;
+        continuation.style = style;
+        continuation.flags = TerminalCell::WideContinuation;
+    }
+
+    m_cursorX += width;
+    markRowDirty(m_cursorY);
+}
+
+void TerminalScreen::putChar(uint32_t codePoint)
+{
+    putCodePoint(codePoint, currentStyle());
+}
+
+void TerminalScreen::putRun(const char *data, int length)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    const uint16_t style = currentStyle();
+
+    // Fill the run row segment by row segment; each row is damaged once
+    while (length > 0) {
+        if (m_cursorX >= m_cols) wrapLine();
+
+        const int count = std::min(length, m_cols - m_cursorX);
+        TerminalCell *row = rowData(m_cursorY);
+        splitWide(row, m_cursorX, count);
+
+        TerminalCell *dst = row + m_cursorX;
+        for (int i = 0; i < count; ++i) {
+            dst[i].codePoint = bytes[i];
+            dst[i].style = style;
+            dst[i].flags = 0;
+        }
+
+        markRowDirty(m_cursorY);
+        m_cursorX += count;
+        bytes += count;
+        length -= count;
+    }
+}
+
+void TerminalScreen::putRun(const char32_t *codePoints, int length)
+{
+    const uint16_t style = currentStyle();
+    for (int i = 0; i < length; ++i) {
+        putCodePoint(codePoints[i], style);
+    }
 }
 
 void TerminalScreen::newLine()
 {
-    QMutexLocker locker(&m_mutex);
+    // The cursor is drawn on its row, so the row it leaves is damaged too
+    markRowDirty(m_cursorY);
     if (m_cursorY < m_rows - 1) {
         m_cursorY++;
     } else {
         scrollUp();
     }
-    emit cursorChanged();
+    markRowDirty(m_cursorY);
 }
 
 void TerminalScreen::backspace()
 {
-    QMutexLocker locker(&m_mutex);
     if (m_cursorX > 0) {
-        m_cursorX--;
+        moveCursor(m_cursorX - 1, m_cursorY);
     } else if (m_cursorY > 0) {
-        m_cursorY--;
-        m_cursorX = m_cols - 1;
+        moveCursor(m_cols - 1, m_cursorY - 1);
     }
-    emit cursorChanged();
 }
 
 void TerminalScreen::moveCursor(int x, int y)
 {
-    QMutexLocker locker(&m_mutex);
+    markRowDirty(m_cursorY);
     m_cursorX = std::clamp(x, 0, m_cols - 1);
     m_cursorY = std::clamp(y, 0, m_rows - 1);
-    emit cursorChanged();
+    markRowDirty(m_cursorY);
 }
 
 void TerminalScreen::moveCursorRelative(int dx, int dy)
@@ -160,30 +450,26 @@ void TerminalScreen::setCursorY(int y)
 
 void TerminalScreen::clearLine(int mode)
 {
-    QMutexLocker locker(&m_mutex);
-    int start = 0;
-    int end = m_cols;
-    
+    TerminalCell *row = rowData(m_cursorY);
+    int cursorX = std::min(m_cursorX, m_cols - 1);
+
     if (mode == 0) { // Cursor to end
-        start = m_cursorX;
+        fillBlank(row + cursorX, m_cols - cursorX);
+        m_rowFlags[bufferRow(m_cursorY)] &= ~RowWrapped;
     } else if (mode == 1) { // Start to cursor
-        end = m_cursorX + 1;
+        fillBlank(row, cursorX + 1);
+    } else { // All
+        fillBlank(row, m_cols);
+        m_rowFlags[bufferRow(m_cursorY)] = 0;
     }
-    
-    for (int x = start; x < end; ++x) {
-        TerminalCell &cell = cellAt(x, m_cursorY);
-        cell = TerminalCell();
-        cell.bgColor = m_currentBg;
-    }
-    emit screenChanged();
+    markRowDirty(m_cursorY);
 }
 
 void TerminalScreen::clearScreen(int mode)
 {
-    QMutexLocker locker(&m_mutex);
     int startRow = 0;
     int endRow = m_rows;
-    
+
     if (mode == 0) { // Cursor to end
         clearLine(0);
         startRow = m_cursorY + 1;
@@ -193,174 +479,272 @@ void TerminalScreen::clearScreen(int mode)
     } else if (mode == 2) { // All
         startRow = 0;
         endRow = m_rows;
-        m_cursorX = 0;
-        m_cursorY = 0;
+        moveCursor(0, 0);
+        m_scrollback->closeOpenLine();
+    } else if (mode == 3) { // Scrollback only
+        m_scrollback->clear();
+        return;
     }
-    
+
     for (int y = startRow; y < endRow; ++y) {
-        for (int x = 0; x < m_cols; ++x) {
-            TerminalCell &cell = cellAt(x, y);
-            cell = TerminalCell();
-            cell.bgColor = m_currentBg;
-        }
+        fillBlank(rowData(y), m_cols);
+        m_rowFlags[bufferRow(y)] = 0;
+        markRowDirty(y);
     }
-    emit screenChanged();
 }
 
 void TerminalScreen::deleteChars(int count)
 {
-    QMutexLocker locker(&m_mutex);
-    int remaining = m_cols - m_cursorX;
-    int toDelete = std::min(count, remaining);
-    
-    for (int x = m_cursorX; x < m_cols - toDelete; ++x) {
-        cellAt(x, m_cursorY) = cellAt(x + toDelete, m_cursorY);
-    }
-    
-    for (int x = m_cols - toDelete; x < m_cols; ++x) {
-        TerminalCell &cell = cellAt(x, m_cursorY);
-        cell = TerminalCell();
-        cell.bgColor = m_currentBg;
-    }
-    emit screenChanged();
+    int cursorX = std::min(m_cursorX, m_cols - 1);
+    int remaining = m_cols - cursorX;
+    int toDelete = std::clamp(count, 0, remaining);
+
+    TerminalCell *row = rowData(m_cursorY);
+    std::memmove(static_cast<void *>(row + cursorX), row + cursorX + toDelete,
+                 (remaining - toDelete) * sizeof(TerminalCell));
+    fillBlank(row + m_cols - toDelete, toDelete);
+    markRowDirty(m_cursorY);
 }
 
 void TerminalScreen::insertChars(int count)
 {
-    QMutexLocker locker(&m_mutex);
-    for (int x = m_cols - 1; x >= m_cursorX + count; --x) {
-        cellAt(x, m_cursorY) = cellAt(x - count, m_cursorY);
-    }
-    
-    for (int x = m_cursorX; x < std::min(m_cursorX + count, m_cols); ++x) {
-        TerminalCell &cell = cellAt(x, m_cursorY);
-        cell = TerminalCell();
-        cell.bgColor = m_currentBg;
-    }
-    emit screenChanged();
+    int cursorX = std::min(m_cursorX, m_cols - 1);
+    int remaining = m_cols - cursorX;
+    int toInsert = std::clamp(count, 0, remaining);
+
+    TerminalCell *row = rowData(m_cursorY);
+    std::memmove(static_cast<void *>(row + cursorX + toInsert), row + cursorX,
+                 (remaining - toInsert) * sizeof(TerminalCell));
+    fillBlank(row + cursorX, toInsert);
+    markRowDirty(m_cursorY);
 }
 
 void TerminalScreen::setFgColor(uint32_t color)
 {
-    m_currentFg = color;
+    m_pen.fgColor = color;
+    m_penDirty = true;
 }
 
 void TerminalScreen::setBgColor(uint32_t color)
 {
-    m_currentBg = color;
+    m_pen.bgColor = color;
+    m_penDirty = true;
+    updateBlank();
 }
 
 void TerminalScreen::setBold(bool bold)
 {
-    m_currentBold = bold;
+    if (bold) m_pen.attributes |= TerminalStyle::Bold;
+    else m_pen.attributes &= ~TerminalStyle::Bold;
+    m_penDirty = true;
 }
 
 void TerminalScreen::setInverse(bool inverse)
 {
-    m_currentInverse = inverse;
+    if (inverse) m_pen.attributes |= TerminalStyle::Inverse;
+    else m_pen.attributes &= ~TerminalStyle::Inverse;
+    m_penDirty = true;
 }
 
 void TerminalScreen::resetStyle()
 {
-    m_currentFg = 0xFFFFFFFF;
-    m_currentBg = 0xFF000000;
-    m_currentBold = false;
-    m_currentInverse = false;
+    m_pen = TerminalStyle();
+    m_penIndex = 0;
+    m_penDirty = false;
+    updateBlank();
+}
+
+void TerminalScreen::updateBlank()
+{
+    // Erased cells take the current background (BCE) but no other attributes
+    TerminalStyle blankStyle;
+    blankStyle.bgColor = m_pen.bgColor;
+    m_blank = TerminalCell();
+    m_blank.style = internStyle(blankStyle);
+}
+
+uint16_t TerminalScreen::currentStyle()
+{
+    if (m_penDirty) {
+        m_penIndex = internStyle(m_pen);
+        m_penDirty = false;
+    }
+    return m_penIndex;
+}
+
+uint16_t TerminalScreen::internStyle(const TerminalStyle &style)
+{
+    auto it = m_styleLookup.constFind(style);
+    if (it != m_styleLookup.constEnd()) return it.value();
+
+    if (m_freeStyles.isEmpty() && m_styles.size() > 0xFFFF) {
+        compactStyles();
+    }
+
+    uint16_t index;
+    if (!m_freeStyles.isEmpty()) {
+        index = m_freeStyles.takeLast();
+        m_styles[index] = style;
+    } else if (m_styles.size() <= 0xFFFF) {
+        index = static_cast<uint16_t>(m_styles.size());
+        m_styles.append(style);
+    } else {
+        qWarning() << "[TerminalScreen] Style table full, using default style";
+        return 0;
+    }
+
+    m_styleLookup.insert(style, index);
+    return index;
+}
+
+void TerminalScreen::compactStyles()
+{
+    // Release styles no longer referenced by the screen or the scrollback
+    // (e.g. after a long truecolor gradient scrolled away) for reuse.
+    // Indices are never renumbered, as the scrollback stores them.
+    QVector<bool> used(m_styles.size(), false);
+    used[0] = true;
+    used[m_blank.style] = true;
+    if (!m_penDirty) used[m_penIndex] = true;
+
+    for (int y = 0; y < m_rows; ++y) {
+        const TerminalCell *row = rowData(y);
+        for (int x = 0; x < m_cols; ++x) {
+            used[row[x].style] = true;
+        }
+    }
+    m_scrollback->collectStyles(used);
+
+    for (int i = 1; i < m_styles.size(); ++i) {
+        if (used[i]) continue;
+        auto it = m_styleLookup.find(m_styles[i]);
+        if (it != m_styleLookup.end() && it.value() == i) {
+            m_styleLookup.erase(it);
+        }
+        m_freeStyles.append(static_cast<uint16_t>(i));
+    }
 }
 
 const TerminalCell& TerminalScreen::cell(int x, int y) const
 {
     static TerminalCell empty;
-    if (y >= 0 && y < m_rows && x >= 0 && x < m_cols) {
-        // Const cast to call helper, but we know we are reading
-        return const_cast<TerminalScreen*>(this)->cellAt(x, y);
+    if (x < 0) return empty;
+
+    if (y >= 0 && y < m_rows) {
+        return x < m_cols ? rowData(y)[x] : empty;
+    }
+
+    // Negative rows address scrollback (-1 is the row just above the screen)
+    const int history = m_scrollback->rowCount();
+    if (y < 0 && y >= -history) {
+        int width = 0;
+        const TerminalCell *row = m_scrollback->row(history + y, &width);
+        if (x < width) return row[x];
     }
     return empty;
 }
 
+uint8_t TerminalScreen::rowFlags(int y) const
+{
+    if (y >= 0 && y < m_rows) {
+        return m_rowFlags.at(bufferRow(y));
+    }
+
+    const int history = m_scrollback->rowCount();
+    if (y < 0 && y >= -history) {
+        int width = 0;
+        uint8_t flags = 0;
+        m_scrollback->row(history + y, &width, &flags);
+        return flags;
+    }
+    return 0;
+}
+
 void TerminalScreen::scrollUp()
 {
-    // Ring buffer scroll: just increment top pointer
-    m_topRow = (m_topRow + 1) % m_historySize;
-    
+    // The top row moves to the scrollback, then the ring rotates
+    pushToScrollback(0);
+    m_topRow = (m_topRow + 1) % m_rows;
+
     // Clear the new bottom row (which was the old top row)
-    // The bottom row is at visual index m_rows - 1
-    int bottomRowIndex = (m_topRow + m_rows - 1) % m_historySize;
-    
-    for (int x = 0; x < m_cols; ++x) {
-        m_grid[bottomRowIndex][x] = TerminalCell();
-        m_grid[bottomRowIndex][x].bgColor = m_currentBg;
+    blankBufferRow(bufferRow(m_rows - 1));
+
+    // Rows already marked dirty moved up with the content
+    QVector<quint64> &bits = m_damage.rows;
+    for (int i = 0; i < bits.size(); ++i) {
+        bits[i] >>= 1;
+        if (i + 1 < bits.size()) bits[i] |= bits[i + 1] << 63;
+    }
+    m_damage.scrolled++;
+    if (m_damage.scrolled >= m_rows) m_damage.full = true;
+    markRowDirty(m_rows - 1);
+}
+
+bool TerminalSelection::contains(int x, int y) const
+{
+    if (!active) return false;
+
+    if (y < startY || y > endY) return false;
+
+    if (y == startY && y == endY) {
+        return x >= startX && x <= endX;
     }
-    
-    emit screenChanged();
+
+    if (y == startY) return x >= startX;
+    if (y == endY) return x <= endX;
+
+    return true; // In between rows
 }
 
 void TerminalScreen::setSelection(int startX, int startY, int endX, int endY)
 {
-    QMutexLocker locker(&m_mutex);
-    m_hasSelection = true;
-    
+    m_selection.active = true;
+
     // Normalize coordinates (start should be before end)
     if (startY > endY || (startY == endY && startX > endX)) {
         std::swap(startX, endX);
         std::swap(startY, endY);
     }
-    
-    m_selStartX = std::clamp(startX, 0, m_cols - 1);
-    m_selStartY = std::clamp(startY, 0, m_rows - 1);
-    m_selEndX = std::clamp(endX, 0, m_cols - 1);
-    m_selEndY = std::clamp(endY, 0, m_rows - 1);
-    
-    emit screenChanged();
-}
 
-void TerminalScreen::clearSelection()
-{
-    QMutexLocker locker(&m_mutex);
-    if (m_hasSelection) {
-        m_hasSelection = false;
-        emit screenChanged();
-    }
+    // Negative rows select into the scrollback
+    const int top = -m_scrollback->rowCount();
+    m_selection.startX = std::clamp(startX, 0, m_cols - 1);
+    m_selection.startY = std::clamp(startY, top, m_rows - 1);
+    m_selection.endX = std::clamp(endX, 0, m_cols - 1);
+    m_selection.endY = std::clamp(endY, top, m_rows - 1);
+
+    markAllDirty();
 }
 
-bool TerminalScreen::isSelected(int x, int y) const
+void TerminalScreen::clearSelection()
 {
-    if (!m_hasSelection) return false;
-    
-    if (y < m_selStartY || y > m_selEndY) return false;
-    
-    if (y == m_selStartY && y == m_selEndY) {
-        return x >= m_selStartX && x <= m_selEndX;
+    if (m_selection.active) {
+        m_selection.active = false;
+        markAllDirty();
     }
-    
-    if (y == m_selStartY) return x >= m_selStartX;
-    if (y == m_selEndY) return x <= m_selEndX;
-    
-    return true; // In between rows
 }
 
 QString TerminalScreen::getSelectedText() const
 {
-    if (!m_hasSelection) return QString();
-    
-    // Note: We can't easily lock here if this is called from GUI thread while worker is writing
-    // Ideally, caller locks mutex()
-    
+    if (!m_selection.active) return QString();
+
     QString text;
-    for (int y = m_selStartY; y <= m_selEndY; ++y) {
-        int startX = (y == m_selStartY) ? m_selStartX : 0;
-        int endX = (y == m_selEndY) ? m_selEndX : m_cols - 1;
-        
+    for (int y = m_selection.startY; y <= m_selection.endY; ++y) {
+        int startX = (y == m_selection.startY) ? m_selection.startX : 0;
+        int endX = (y == m_selection.endY) ? m_selection.endX : m_cols - 1;
+
         for (int x = startX; x <= endX; ++x) {
-            const TerminalCell& c = cell(x, y);
-            if (c.codePoint) {
-                text.append(QChar(c.codePoint));
+            const TerminalCell &c = cell(x, y);
+            if (c.flags & TerminalCell::WideContinuation) continue;
+            char32_t cp = c.codePoint;
+            if (cp) {
+                text.append(QString::fromUcs4(&cp, 1));
             } else {
                 text.append(' '); // Empty cells are spaces
             }
         }
-        
-        if (y < m_selEndY) {
+
+        if (y < m_selection.endY) {
             text.append('\n');
         }
     }
@@ -2,115 +2,254 @@
 
 #include <QObject>
 #include <QVector>
+#include <QHash>
 #include <QColor>
-#include <QMutex>
 
-struct TerminalCell {
-    uint32_t codePoint = ' ';
+// Rendition shared by many cells. Cells only store an index into the
+// screen's style table, so the grid stays compact.
+struct TerminalStyle {
+    enum Attribute : uint8_t {
+        Bold = 0x01,
+        Italic = 0x02,
+        Underline = 0x04,
+        Inverse = 0x08
+    };
+
     uint32_t fgColor = 0xFFFFFFFF; // ARGB
     uint32_t bgColor = 0xFF000000; // ARGB
-    bool bold = false;
-    bool italic = false;
-    bool underline = false;
-    bool inverse = false;
-    
+    uint8_t attributes = 0;
+
+    bool bold() const { return attributes & Bold; }
+    bool italic() const { return attributes & Italic; }
+    bool underline() const { return attributes & Underline; }
+    bool inverse() const { return attributes & Inverse; }
+
+    bool operator==(const TerminalStyle &other) const {
+        return fgColor == other.fgColor &&
+               bgColor == other.bgColor &&
+               attributes == other.attributes;
+    }
+
+    bool operator!=(const TerminalStyle &other) const {
+        return !(*this == other);
+    }
+};
+
+inline size_t qHash(const TerminalStyle &style, size_t seed = 0)
+{
+    return qHashMulti(seed, style.fgColor, style.bgColor, style.attributes);
+}
+
+// Packed grid cell (8 bytes). A zero codePoint is an empty cell, which
+// lets blank rows with the default style be cleared with memset.
+struct TerminalCell {
+    enum Flag : uint16_t {
+        WideChar = 0x01, // First half of a two-cell glyph
+        WideContinuation = 0x02, // Second half; codePoint is 0
+        WrapPadding = 0x04 // Blank left in the last column by a wrapped wide glyph
+    };
+
+    uint32_t codePoint = 0;
+    uint16_t style = 0; // Index into TerminalScreen::style()
+    uint16_t flags = 0;
+
     bool operator==(const TerminalCell &other) const {
         return codePoint == other.codePoint &&
-               fgColor == other.fgColor &&
-               bgColor == other.bgColor &&
-               bold == other.bold &&
-               italic == other.italic &&
-               underline == other.underline &&
-               inverse == other.inverse;
+               style == other.style &&
+               flags == other.flags;
     }
-    
+
     bool operator!=(const TerminalCell &other) const {
         return !(*this == other);
     }
 };
 
+static_assert(sizeof(TerminalCell) == 8, "TerminalCell must stay packed");
+Q_DECLARE_TYPEINFO(TerminalCell, Q_PRIMITIVE_TYPE);
+
+// Changes accumulated since the renderer last picked them up.
+// Consumers first shift their rendered rows up by `scrolled`, then
+// redraw every row whose bit is set (or everything when `full`).
+struct TerminalDamage {
+    QVector<quint64> rows; // Bitmap, bit y => screen row y changed
+    int scrolled = 0;
+    bool full = false;
+
+    bool isRowDirty(int y) const {
+        int word = y >> 6;
+        return full || (word >= 0 && word < rows.size() && (rows[word] >> (y & 63)) & 1);
+    }
+
+    bool isEmpty() const {
+        if (full || scrolled) return false;
+        for (quint64 word : rows) {
+            if (word) return false;
+        }
+        return true;
+    }
+};
+
+// Selected range in screen coordinates, start <= end in reading order
+struct TerminalSelection {
+    bool active = false;
+    int startX = 0;
+    int startY = 0;
+    int endX = 0;
+    int endY = 0;
+
+    bool contains(int x, int y) const;
+};
+
+struct TerminalFrame;
+class TerminalScrollback;
+class TerminalScrollbackPool;
+
+/**
+ * Terminal grid state: cells, cursor, style table, selection and damage.
+ *
+ * Not thread-safe. The screen belongs to the engine's I/O thread; other
+ * threads only ever see it through TerminalFrame snapshots.
+ */
 class TerminalScreen : public QObject {
     Q_OBJECT
-    
+
 public:
+    // Per-row metadata, stored beside the cell buffer
+    enum RowFlag : uint8_t {
+        RowWrapped = 0x01 // Row continues on the next row (soft wrap)
+    };
+
     explicit TerminalScreen(QObject *parent = nullptr);
-    
+    ~TerminalScreen() override;
+
     void resize(int cols, int rows);
     void clear();
-    
+
     // Character manipulation
     void putChar(uint32_t codePoint);
+    void putRun(const char *data, int length); // ASCII, one cell per byte
+    void putRun(const char32_t *codePoints, int length); // Decoded text, wide aware
     void newLine();
     void backspace();
-    
+
     // Cursor movement
     void moveCursor(int x, int y); // Absolute
     void moveCursorRelative(int dx, int dy);
     void setCursorX(int x);
     void setCursorY(int y);
-    
+
     // Editing
     void clearLine(int mode); // 0=end, 1=start, 2=all
-    void clearScreen(int mode); // 0=end, 1=start, 2=all
+    void clearScreen(int mode); // 0=end, 1=start, 2=all, 3=scrollback
     void deleteChars(int count);
     void insertChars(int count);
-    
+
     // Style
     void setFgColor(uint32_t color);
     void setBgColor(uint32_t color);
     void setBold(bool bold);
     void setInverse(bool inverse);
     void resetStyle();
-    
+
     // Accessors for Renderer
     int cols() const { return m_cols; }
     int rows() const { return m_rows; }
     int cursorX() const { return m_cursorX; }
     int cursorY() const { return m_cursorY; }
+    // Scrollback rows at the current width; y < 0 reads them, down to
+    // -historyCount()
+    int historyCount() const;
+    // Rows scrolled into history so far, dropped ones included: screen
+    // row y is absolute row historyOffset() + y
+    qint64 historyOffset() const { return m_historyOffset; }
     const TerminalCell& cell(int x, int y) const;
-    
+    const TerminalStyle& style(uint16_t index) const { return m_styles.at(index); }
+    uint8_t rowFlags(int y) const;
+
+    // Scrollback size: oldest lines are dropped past either limit
+    void setScrollbackLimits(int lines, qint64 memoryBudget);
+    qint64 scrollbackMemoryUsage() const;
+    // Shares a memory budget with the scrollback of other screens on this
+    // thread (nullptr to leave it). Hidden screens give up lines first.
+    void setScrollbackPool(TerminalScrollbackPool *pool);
+    void setVisible(bool visible);
+
+    // Copy of the scrollback with the screen's lines appended, for search.
+    // `firstRow` receives the absolute row of the copy's row 0.
+    TerminalScrollback searchSnapshot(qint64 *firstRow) const;
+
     // Selection
     void setSelection(int startX, int startY, int endX, int endY);
     void clearSelection();
-    bool hasSelection() const { return m_hasSelection; }
-    bool isSelected(int x, int y) const;
+    bool hasSelection() const { return m_selection.active; }
+    bool isSelected(int x, int y) const { return m_selection.contains(x, y); }
     QString getSelectedText() const;
-    
-    // Thread safety
-    QMutex* mutex() { return &m_mutex; }
-    
-signals:
-    void screenChanged();
-    void cursorChanged();
-    
+
+    // Damage tracking. snapshot() copies the visible state into a frame
+    // together with the damage accumulated since the previous snapshot.
+    bool hasPendingDamage() const { return m_damagePending; }
+    void snapshot(TerminalFrame *frame);
+
+    // Synchronized update (DEC private mode 2026): between beginBatch()
+    // and endBatch() the application is halfway through a redraw, and the
+    // screen should not be presented. Batches do not nest.
+    void beginBatch() { m_inBatch = true; }
+    void endBatch() { m_inBatch = false; }
+    bool inBatch() const { return m_inBatch; }
+
 private:
     void scrollUp();
-    TerminalCell& cellAt(int x, int y);
-    
+    void wrapLine();
+    void putCodePoint(char32_t codePoint, uint16_t style);
+    void splitWide(TerminalCell *row, int x, int width);
+    void markRowDirty(int y);
+    void markAllDirty();
+    void pushToScrollback(int y);
+    int bufferRow(int y) const { return (m_topRow + y) % m_rows; }
+    TerminalCell* rowData(int y) { return m_cells.data() + bufferRow(y) * m_stride; }
+    const TerminalCell* rowData(int y) const { return m_cells.constData() + bufferRow(y) * m_stride; }
+    void fillBlank(TerminalCell *dst, int count) const;
+    void blankBufferRow(int bufferIndex);
+
+    uint16_t currentStyle();
+    uint16_t internStyle(const TerminalStyle &style);
+    void compactStyles();
+    void updateBlank();
+
     int m_cols;
     int m_rows;
     int m_cursorX;
     int m_cursorY;
-    
+
     // Ring Buffer State
     int m_topRow; // Index of the visual top row in the buffer
-    int m_historySize; // Total rows in buffer (screen + history)
-    
+    int m_stride; // Cells per row in m_cells
+
     // Style state
-    uint32_t m_currentFg;
-    uint32_t m_currentBg;
-    bool m_currentBold;
-    bool m_currentInverse;
-    
-    // Selection State
-    bool m_hasSelection;
-    int m_selStartX, m_selStartY;
-    int m_selEndX, m_selEndY;
-    
-    // Grid: [row][col]
-    // We use a flat vector for better cache locality? Or vector of vectors?
-    // Vector of vectors is easier for resizing.
-    QVector<QVector<TerminalCell>> m_grid;
-    
-    QMutex m_mutex;
+    TerminalStyle m_pen;
+    uint16_t m_penIndex;
+    bool m_penDirty;
+    TerminalCell m_blank; // Erase cell (current background color)
+
+    // Style table: index 0 is always the default style
+    QVector<TerminalStyle> m_styles;
+    QHash<TerminalStyle, uint16_t> m_styleLookup;
+    QVector<uint16_t> m_freeStyles; // Released by compactStyles()
+
+    TerminalSelection m_selection;
+
+    // Grid: one contiguous allocation of m_rows rows * m_stride cells,
+    // used as a ring of rows. Row flags live beside it; lines scrolled
+    // off the top go to m_scrollback.
+    QVector<TerminalCell> m_cells;
+    QVector<uint8_t> m_rowFlags;
+    TerminalScrollback *m_scrollback;
+    TerminalScrollbackPool *m_scrollbackPool;
+    qint64 m_historyOffset;
+    bool m_visible;
+
+    // Damage state
+    TerminalDamage m_damage;
+    bool m_damagePending; // Damage recorded since the last snapshot()
+    bool m_inBatch;
 };
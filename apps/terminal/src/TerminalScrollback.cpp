@@ -0,0 +1,824 @@
+#include "TerminalScrollback.h"
+#include "TerminalCharWidth.h"
+#include <QChar>
+#include <QDebug>
+#include <algorithm>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace {
+
+void appendVarint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+quint32 readVarint(const uchar *&p)
+{
+    quint32 value = 0;
+    int shift = 0;
+    for (;;) {
+        const uchar byte = *p++;
+        value |= quint32(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+        shift += 7;
+    }
+}
+
+// Empty cells are stored as NUL, which never reaches the grid as text
+void appendUtf8(QByteArray &out, char32_t cp)
+{
+    if (cp < 0x80) {
+        out.append(char(cp));
+    } else if (cp < 0x800) {
+        out.append(char(0xC0 | (cp >> 6)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.append(char(0xE0 | (cp >> 12)));
+        out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    } else {
+        out.append(char(0xF0 | (cp >> 18)));
+        out.append(char(0x80 | ((cp >> 12) & 0x3F)));
+        out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Input was produced by appendUtf8(), so it is known to be well-formed
+char32_t readUtf8(const uchar *&p)
+{
+    const uchar lead = *p++;
+    if (lead < 0x80) return lead;
+    if (lead < 0xE0) return (char32_t(lead & 0x1F) << 6) | (*p++ & 0x3F);
+    if (lead < 0xF0) {
+        char32_t cp = char32_t(lead & 0x0F) << 12;
+        cp |= char32_t(*p++ & 0x3F) << 6;
+        return cp | (*p++ & 0x3F);
+    }
+    char32_t cp = char32_t(lead & 0x07) << 18;
+    cp |= char32_t(*p++ & 0x3F) << 12;
+    cp |= char32_t(*p++ & 0x3F) << 6;
+    return cp | (*p++ & 0x3F);
+}
+
+} // namespace
+
+TerminalScrollback::TerminalScrollback()
+    : m_firstLine(0)
+    , m_lineCount(0)
+    , m_droppedLines(0)
+    , m_nextSerial(1)
+    , m_hasOpenLine(false)
+    , m_lineLimit(100000)
+    , m_memoryBudget(8 * 1024 * 1024)
+    , m_memoryUsage(0)
+    , m_width(80)
+    , m_rowCount(0)
+    , m_rowsValid(true)
+    , m_openRows(0)
+    , m_rowCacheIndex(-1)
+    , m_rowCacheLine(0)
+    , m_rowCacheStart(0)
+    , m_rowCacheWidth(0)
+    , m_rowCacheFlags(0)
+    , m_firstRowLine(-1)
+    , m_firstRowRow(0)
+    , m_cacheNext(0)
+    , m_inflatedSerial(0)
+{
+}
+
+int TerminalScrollback::wrap(const TerminalCell *cells, int count, int width, QVector<int> *starts)
+{
+    if (starts) {
+        starts->clear();
+        starts->append(0);
+    }
+
+    int rows = 1;
+    int col = 0;
+    for (int x = 0; x < count; ++x) {
+        const uint16_t flags = cells[x].flags;
+        const bool full = col >= width || ((flags & TerminalCell::WideChar) && col + 2 > width);
+        if (col > 0 && full && !(flags & TerminalCell::WideContinuation)) {
+            rows++;
+            col = 0;
+            if (starts) starts->append(x);
+        }
+        col++;
+    }
+    return rows;
+}
+
+char32_t TerminalScrollback::foldCase(char32_t codePoint)
+{
+    if (codePoint < 0x80) {
+        return (codePoint >= 'A' && codePoint <= 'Z') ? codePoint + 32 : codePoint;
+    }
+    return QChar::toCaseFolded(codePoint);
+}
+
+// Characters and bigrams are hashed as trigrams with leading zeros, which
+// never occur in text
+quint32 TerminalScrollback::gramBit(char32_t a, char32_t b, char32_t c)
+{
+    const quint32 hash = (a * 0x9E3779B1u) ^ (b * 0x85EBCA77u) ^ (c * 0xC2B2AE3Du);
+    return (hash ^ (hash >> 15)) & ((1u << IndexBits) - 1);
+}
+
+void TerminalScrollback::indexLine(Block &block, const TerminalCell *cells, int count)
+{
+    // Empty cells read as spaces, like they do when selected
+    quint64 *bits = block.trigrams.data();
+    char32_t a = 0;
+    char32_t b = 0;
+    int seen = 0;
+    for (int x = 0; x < count; ++x) {
+        if (cells[x].flags & TerminalCell::WideContinuation) continue;
+        const char32_t c = cells[x].codePoint ? foldCase(cells[x].codePoint) : U' ';
+        ++seen;
+        for (int n = 1; n <= std::min(seen, 3); ++n) {
+            const quint32 bit = gramBit(n == 3 ? a : 0, n >= 2 ? b : 0, c);
+            bits[bit >> 6] |= quint64(1) << (bit & 63);
+        }
+        a = b;
+        b = c;
+    }
+}
+
+QList<QPair<int, int>> TerminalScrollback::candidateLines(const QVector<char32_t> &needle) const
+{
+    QList<QPair<int, int>> ranges;
+    QVector<quint32> wanted;
+    if (needle.size() == 1) {
+        wanted.append(gramBit(0, 0, needle[0]));
+    } else if (needle.size() == 2) {
+        wanted.append(gramBit(0, needle[0], needle[1]));
+    }
+    for (int i = 2; i < needle.size(); ++i) {
+        wanted.append(gramBit(needle[i - 2], needle[i - 1], needle[i]));
+    }
+
+    int first = 0;
+    for (int b = 0; b < m_blocks.size(); ++b) {
+        const Block &block = m_blocks.at(b);
+        const int count = block.offsets.size() - ((b == 0) ? m_firstLine : 0);
+
+        bool candidate = true;
+        for (quint32 bit : wanted) {
+            if (!(block.trigrams.at(bit >> 6) & (quint64(1) << (bit & 63)))) {
+                candidate = false;
+                break;
+            }
+        }
+
+        if (candidate) {
+            if (!ranges.isEmpty() && ranges.last().first + ranges.last().second == first) {
+                ranges.last().second += count;
+            } else {
+                ranges.append(qMakePair(first, count));
+            }
+        }
+        first += count;
+    }
+
+    // The open line is not indexed yet
+    if (m_hasOpenLine) ranges.append(qMakePair(m_lineCount, 1));
+    return ranges;
+}
+
+int TerminalScrollback::firstRow(int index) const
+{
+    rowCount(); // Brings the block row counts up to date
+    if (index >= m_lineCount) return m_rowCount; // Open line
+
+    int line = 0;
+    int row = 0;
+    if (m_firstRowLine >= 0 && m_firstRowLine <= index) {
+        line = m_firstRowLine;
+        row = m_firstRowRow;
+    }
+
+    // Whole blocks are skipped by their row count
+    while (line < index) {
+        const int position = m_firstLine + line;
+        const int b = position / LinesPerBlock;
+        const int l = position % LinesPerBlock;
+        const int blockStart = (b == 0) ? m_firstLine : 0;
+        const int blockLines = m_blocks.at(b).offsets.size() - blockStart;
+        if (l == blockStart && line + blockLines <= index) {
+            row += m_blocks.at(b).rows;
+            line += blockLines;
+        } else {
+            row += lineRows(b, l);
+            line++;
+        }
+    }
+
+    m_firstRowLine = index;
+    m_firstRowRow = row;
+    return row;
+}
+
+void TerminalScrollback::setLineLimit(int lines)
+{
+    m_lineLimit = std::max(0, lines);
+    trim();
+}
+
+void TerminalScrollback::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = std::max<qint64>(0, bytes);
+    trim();
+}
+
+void TerminalScrollback::setWidth(int cols)
+{
+    cols = std::max(1, cols);
+    if (cols == m_width) return;
+
+    // Blocks recount their rows lazily, the next time rows are asked for
+    m_width = cols;
+    m_rowsValid = false;
+    m_openRows = -1;
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+}
+
+void TerminalScrollback::clear()
+{
+    m_droppedLines += m_lineCount;
+    m_blocks.clear();
+    m_firstLine = 0;
+    m_lineCount = 0;
+    m_openLine.clear();
+    m_hasOpenLine = false;
+    m_memoryUsage = 0;
+    m_rowCount = 0;
+    m_rowsValid = true;
+    m_openRows = 0;
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+    for (CachedLine &cached : m_cache) cached.line = -1;
+    m_inflated.clear();
+    m_inflatedSerial = 0;
+}
+
+void TerminalScrollback::push(const TerminalCell *cells, int count, uint8_t rowFlags)
+{
+    if (m_lineLimit == 0) return;
+
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+    m_openRows = -1;
+
+    if (rowFlags & TerminalScreen::RowWrapped) {
+        // The blank a wide glyph left behind when it wrapped is not text
+        if (count > 0 && (cells[count - 1].flags & TerminalCell::WrapPadding)) count--;
+
+        const int at = m_openLine.size();
+        m_openLine.resize(at + count);
+        std::copy_n(cells, count, m_openLine.begin() + at);
+        m_hasOpenLine = true;
+
+        // Output without newlines must not grow one line forever; the
+        // split is recorded as a soft wrap so selection still joins it
+        if (m_openLine.size() >= MaxLineLength) {
+            append(m_openLine.constData(), m_openLine.size(), TerminalScreen::RowWrapped);
+            m_openLine.clear();
+            m_hasOpenLine = false;
+        }
+        return;
+    }
+
+    // Trailing blank cells with the default style are implied by the width
+    while (count > 0 && cells[count - 1].codePoint == 0 && cells[count - 1].style == 0
+           && !(cells[count - 1].flags & TerminalCell::WideContinuation)) {
+        count--;
+    }
+
+    if (m_hasOpenLine) {
+        const int at = m_openLine.size();
+        m_openLine.resize(at + count);
+        std::copy_n(cells, count, m_openLine.begin() + at);
+        append(m_openLine.constData(), m_openLine.size(), rowFlags);
+        m_openLine.clear();
+        m_hasOpenLine = false;
+    } else {
+        append(cells, count, rowFlags);
+    }
+}
+
+void TerminalScrollback::append(const TerminalCell *cells, int width, uint8_t rowFlags)
+{
+    // Line record: flags, width, style runs, then the text up to the next
+    // record. Wide continuation cells have no text of their own.
+    QByteArray &out = m_encodeBuffer;
+    out.clear();
+    out.append(char(rowFlags));
+    appendVarint(out, quint32(width));
+
+    int runCount = 0;
+    for (int x = 0; x < width; ++x) {
+        if (x == 0 || cells[x].style != cells[x - 1].style) runCount++;
+    }
+    appendVarint(out, quint32(runCount));
+    for (int x = 0; x < width;) {
+        int end = x + 1;
+        while (end < width && cells[end].style == cells[x].style) end++;
+        appendVarint(out, quint32(end - x));
+        appendVarint(out, cells[x].style);
+        x = end;
+    }
+
+    bool wide = false;
+    for (int x = 0; x < width; ++x) {
+        if (cells[x].flags & TerminalCell::WideContinuation) continue;
+        if (cells[x].flags & TerminalCell::WideChar) wide = true;
+        appendUtf8(out, cells[x].codePoint);
+    }
+
+    if (m_blocks.isEmpty() || m_blocks.last().offsets.size() >= LinesPerBlock) {
+        if (!m_blocks.isEmpty()) {
+            Block &sealed = m_blocks.last();
+            m_memoryUsage -= sealed.data.capacity();
+            sealed.data.squeeze();
+            m_memoryUsage += sealed.data.capacity();
+        }
+
+        Block block;
+        block.serial = m_nextSerial++;
+        block.offsets.reserve(LinesPerBlock);
+        block.cellCounts.reserve(LinesPerBlock);
+        block.trigrams.resize((1 << IndexBits) / 64);
+        block.rowsWidth = m_width;
+        m_blocks.append(block);
+        m_memoryUsage += BlockOverhead;
+
+        // Blocks leaving the hot set are rarely read again
+        const int cold = m_blocks.size() - 1 - HotBlocks;
+        if (cold >= 0) compress(m_blocks[cold]);
+    }
+
+    Block &block = m_blocks.last();
+    m_memoryUsage -= block.data.capacity();
+    block.offsets.append(quint32(block.rawSize));
+    block.cellCounts.append(quint32(width) | (wide ? HasWideBit : 0));
+    block.data.append(out);
+    block.rawSize += out.size();
+    m_memoryUsage += block.data.capacity();
+    indexLine(block, cells, width);
+
+    if (block.rowsWidth == m_width) {
+        const int rows = wide ? wrap(cells, width, m_width) : plainRows(width);
+        block.rows += rows;
+        if (m_rowsValid) m_rowCount += rows;
+    }
+
+    m_lineCount++;
+    trim();
+}
+
+bool TerminalScrollback::takeOpenLine(QVector<TerminalCell> *cells)
+{
+    if (!m_hasOpenLine) return false;
+
+    cells->swap(m_openLine);
+    m_openLine.clear();
+    m_hasOpenLine = false;
+    m_openRows = 0;
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+    return true;
+}
+
+void TerminalScrollback::closeOpenLine()
+{
+    if (!m_hasOpenLine) return;
+
+    append(m_openLine.constData(), m_openLine.size(), 0);
+    m_openLine.clear();
+    m_hasOpenLine = false;
+    m_openRows = -1;
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+}
+
+bool TerminalScrollback::takeLast(QVector<TerminalCell> *cells, uint8_t *rowFlags)
+{
+    if (takeOpenLine(cells)) {
+        *rowFlags = TerminalScreen::RowWrapped;
+        return true;
+    }
+    if (m_lineCount == 0) return false;
+
+    const int b = m_blocks.size() - 1;
+    Block &block = m_blocks[b];
+    const int l = block.offsets.size() - 1;
+    decompress(block);
+
+    CachedLine decoded;
+    decodeLine(block, l, decoded);
+    cells->swap(decoded.cells);
+    *rowFlags = decoded.flags;
+
+    if (block.rowsWidth == m_width) {
+        const int rows = lineRows(b, l);
+        block.rows -= rows;
+        if (m_rowsValid) m_rowCount -= rows;
+    }
+
+    m_memoryUsage -= block.data.capacity();
+    block.rawSize = int(block.offsets.at(l));
+    block.data.truncate(block.rawSize);
+    block.offsets.removeLast();
+    block.cellCounts.removeLast();
+    m_memoryUsage += block.data.capacity();
+
+    m_lineCount--;
+    invalidateCache(m_droppedLines + m_lineCount); // Its number gets reused
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+
+    if (m_lineCount == 0 || block.offsets.isEmpty()) {
+        m_memoryUsage -= block.data.capacity() + BlockOverhead;
+        m_blocks.removeLast();
+        if (m_blocks.isEmpty()) m_firstLine = 0;
+    }
+    return true;
+}
+
+void TerminalScrollback::compress(Block &block)
+{
+#ifdef HAVE_LZ4
+    if (block.compressed || block.rawSize == 0) return;
+
+    QByteArray packed(LZ4_compressBound(block.rawSize), Qt::Uninitialized);
+    const int size = LZ4_compress_default(block.data.constData(), packed.data(),
+                                          block.rawSize, packed.size());
+    if (size <= 0 || size >= block.rawSize) return; // Not worth it
+
+    packed.resize(size);
+    packed.squeeze();
+    m_memoryUsage -= block.data.capacity();
+    block.data = packed;
+    block.compressed = true;
+    m_memoryUsage += block.data.capacity();
+    if (m_inflatedSerial == block.serial) m_inflatedSerial = 0;
+#else
+    Q_UNUSED(block);
+#endif
+}
+
+void TerminalScrollback::decompress(Block &block)
+{
+    if (!block.compressed) return;
+
+    const QByteArray raw = blockData(block);
+    m_memoryUsage -= block.data.capacity();
+    block.data = raw;
+    block.compressed = false;
+    m_memoryUsage += block.data.capacity();
+    m_inflatedSerial = 0;
+}
+
+const QByteArray &TerminalScrollback::blockData(const Block &block) const
+{
+    if (!block.compressed) return block.data;
+
+#ifdef HAVE_LZ4
+    if (m_inflatedSerial != block.serial) {
+        m_inflated.resize(block.rawSize);
+        const int size = LZ4_decompress_safe(block.data.constData(), m_inflated.data(),
+                                             block.data.size(), block.rawSize);
+        if (size != block.rawSize) {
+            qWarning() << "[TerminalScrollback] Corrupt scrollback block" << block.serial;
+            m_inflated.fill('\0');
+        }
+        m_inflatedSerial = block.serial;
+    }
+#endif
+    return m_inflated;
+}
+
+void TerminalScrollback::dropOldestLine()
+{
+    Block &first = m_blocks.first();
+    if (first.rowsWidth == m_width) {
+        const int rows = lineRows(0, m_firstLine);
+        first.rows -= rows;
+        if (m_rowsValid) m_rowCount -= rows;
+    }
+
+    m_firstLine++;
+    m_lineCount--;
+    m_droppedLines++;
+    m_rowCacheIndex = -1;
+    m_firstRowLine = -1;
+
+    if (m_firstLine >= first.offsets.size()) {
+        m_memoryUsage -= first.data.capacity() + BlockOverhead;
+        m_blocks.removeFirst();
+        m_firstLine = 0;
+    }
+}
+
+void TerminalScrollback::trim()
+{
+    while (m_lineCount > m_lineLimit) {
+        dropOldestLine();
+    }
+
+    // Memory is only returned a whole block at a time
+    while (m_memoryUsage > m_memoryBudget && releaseOldestBlock()) {
+    }
+}
+
+bool TerminalScrollback::releaseOldestBlock()
+{
+    if (m_blocks.size() <= 1) return false;
+
+    const int remaining = m_blocks.first().offsets.size() - m_firstLine;
+    for (int i = 0; i < remaining; ++i) {
+        dropOldestLine();
+    }
+    return true;
+}
+
+void TerminalScrollback::invalidateCache(qint64 absoluteLine)
+{
+    for (CachedLine &cached : m_cache) {
+        if (cached.line == absoluteLine) cached.line = -1;
+    }
+}
+
+void TerminalScrollback::decodeLine(const Block &block, int lineInBlock, CachedLine &out) const
+{
+    const QByteArray &data = blockData(block);
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + block.offsets.at(lineInBlock);
+    const quint32 end = lineInBlock + 1 < block.offsets.size() ? block.offsets.at(lineInBlock + 1)
+                                                               : quint32(block.rawSize);
+    const uchar *stop = reinterpret_cast<const uchar *>(data.constData()) + end;
+
+    out.flags = *p++;
+
+    const int cellCount = int(readVarint(p));
+    out.cells.resize(cellCount);
+    TerminalCell *cells = out.cells.data();
+
+    const int runCount = int(readVarint(p));
+    int x = 0;
+    for (int run = 0; run < runCount; ++run) {
+        const int length = int(readVarint(p));
+        const uint16_t style = uint16_t(readVarint(p));
+        for (int end = std::min(cellCount, x + length); x < end; ++x) {
+            cells[x].style = style;
+        }
+    }
+
+    x = 0;
+    while (x < cellCount && p < stop) {
+        const char32_t cp = readUtf8(p);
+        cells[x].codePoint = cp;
+        cells[x].flags = 0;
+        if (cp && x + 1 < cellCount && TerminalCharWidth::width(cp) == 2) {
+            cells[x].flags = TerminalCell::WideChar;
+            cells[x + 1].codePoint = 0;
+            cells[x + 1].flags = TerminalCell::WideContinuation;
+            x += 2;
+        } else {
+            x++;
+        }
+    }
+}
+
+const TerminalCell *TerminalScrollback::line(int index, int *width, uint8_t *rowFlags) const
+{
+    if (index == m_lineCount && m_hasOpenLine) {
+        *width = m_openLine.size();
+        if (rowFlags) *rowFlags = TerminalScreen::RowWrapped;
+        return m_openLine.constData();
+    }
+
+    if (index < 0 || index >= m_lineCount) {
+        *width = 0;
+        if (rowFlags) *rowFlags = 0;
+        return nullptr;
+    }
+
+    const qint64 absolute = m_droppedLines + index;
+    for (const CachedLine &cached : m_cache) {
+        if (cached.line == absolute) {
+            *width = cached.cells.size();
+            if (rowFlags) *rowFlags = cached.flags;
+            return cached.cells.constData();
+        }
+    }
+
+    const int position = m_firstLine + index;
+    CachedLine &cached = m_cache[m_cacheNext];
+    m_cacheNext = (m_cacheNext + 1) % LineCacheSize;
+    decodeLine(m_blocks.at(position / LinesPerBlock), position % LinesPerBlock, cached);
+    cached.line = absolute;
+
+    *width = cached.cells.size();
+    if (rowFlags) *rowFlags = cached.flags;
+    return cached.cells.constData();
+}
+
+int TerminalScrollback::lineRows(int block, int lineInBlock) const
+{
+    const Block &b = m_blocks.at(block);
+    const quint32 count = b.cellCounts.at(lineInBlock);
+    if (!(count & HasWideBit)) return plainRows(int(count));
+
+    // Only lines with wide glyphs need their text to be wrapped
+    decodeLine(b, lineInBlock, m_scratch);
+    return wrap(m_scratch.cells.constData(), m_scratch.cells.size(), m_width);
+}
+
+int TerminalScrollback::rowCount() const
+{
+    if (!m_rowsValid) {
+        m_rowCount = 0;
+        for (int b = 0; b < m_blocks.size(); ++b) {
+            const Block &block = m_blocks.at(b);
+            if (block.rowsWidth != m_width) {
+                block.rows = 0;
+                for (int l = (b == 0) ? m_firstLine : 0; l < block.offsets.size(); ++l) {
+                    block.rows += lineRows(b, l);
+                }
+                block.rowsWidth = m_width;
+            }
+            m_rowCount += block.rows;
+        }
+        m_rowsValid = true;
+    }
+
+    if (m_openRows < 0) {
+        m_openRows = m_hasOpenLine ? wrap(m_openLine.constData(), m_openLine.size(), m_width) : 0;
+    }
+    return m_rowCount + m_openRows;
+}
+
+const TerminalCell *TerminalScrollback::row(int index, int *width, uint8_t *rowFlags) const
+{
+    if (index < 0 || index >= rowCount()) {
+        *width = 0;
+        if (rowFlags) *rowFlags = 0;
+        return nullptr;
+    }
+
+    // Consecutive cell reads usually stay on one row
+    if (index != m_rowCacheIndex) {
+        int lineIndex;
+        int rowInLine;
+        if (index >= m_rowCount) {
+            lineIndex = m_lineCount; // Open line
+            rowInLine = index - m_rowCount;
+        } else {
+            // Find the block from whichever end is closer, then the line
+            int b;
+            int base;
+            if (index < m_rowCount / 2) {
+                b = 0;
+                base = 0;
+                while (base + m_blocks.at(b).rows <= index) base += m_blocks.at(b++).rows;
+            } else {
+                b = m_blocks.size();
+                base = m_rowCount;
+                do {
+                    base -= m_blocks.at(--b).rows;
+                } while (base > index);
+            }
+
+            int l = (b == 0) ? m_firstLine : 0;
+            for (;; ++l) {
+                const int rows = lineRows(b, l);
+                if (base + rows > index) break;
+                base += rows;
+            }
+            lineIndex = b * LinesPerBlock + l - m_firstLine;
+            rowInLine = index - base;
+        }
+
+        int count = 0;
+        uint8_t flags = 0;
+        const TerminalCell *cells = line(lineIndex, &count, &flags);
+        const int rows = wrap(cells, count, m_width, &m_wrapStarts);
+        const bool last = rowInLine + 1 >= rows;
+
+        m_rowCacheIndex = index;
+        m_rowCacheLine = lineIndex;
+        m_rowCacheStart = m_wrapStarts.at(std::min(rowInLine, rows - 1));
+        m_rowCacheWidth = (last ? count : m_wrapStarts.at(rowInLine + 1)) - m_rowCacheStart;
+        m_rowCacheFlags = last ? flags : uint8_t(TerminalScreen::RowWrapped);
+    }
+
+    int count = 0;
+    const TerminalCell *cells = line(m_rowCacheLine, &count);
+    *width = m_rowCacheWidth;
+    if (rowFlags) *rowFlags = m_rowCacheFlags;
+    return cells + m_rowCacheStart;
+}
+
+void TerminalScrollback::collectStyles(QVector<bool> &used) const
+{
+    for (const TerminalCell &cell : m_openLine) {
+        used[cell.style] = true;
+    }
+
+    for (int b = 0; b < m_blocks.size(); ++b) {
+        const Block &block = m_blocks.at(b);
+        const QByteArray &data = blockData(block);
+        const int firstLine = (b == 0) ? m_firstLine : 0;
+
+        for (int l = firstLine; l < block.offsets.size(); ++l) {
+            const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + block.offsets.at(l);
+            p++; // Row flags
+            readVarint(p); // Width
+            const int runCount = int(readVarint(p));
+            for (int run = 0; run < runCount; ++run) {
+                readVarint(p);
+                const quint32 style = readVarint(p);
+                if (style < quint32(used.size())) used[style] = true;
+            }
+        }
+    }
+}
+
+TerminalScrollbackPool::TerminalScrollbackPool(qint64 budget)
+    : m_budget(std::max<qint64>(0, budget))
+{
+}
+
+void TerminalScrollbackPool::setBudget(qint64 bytes)
+{
+    m_budget = std::max<qint64>(0, bytes);
+    enforce();
+}
+
+qint64 TerminalScrollbackPool::memoryUsage() const
+{
+    qint64 total = 0;
+    for (const Member &member : m_members) {
+        total += member.scrollback->memoryUsage();
+    }
+    return total;
+}
+
+void TerminalScrollbackPool::add(TerminalScrollback *scrollback)
+{
+    Member member;
+    member.scrollback = scrollback;
+    m_members.append(member);
+    enforce();
+}
+
+void TerminalScrollbackPool::remove(TerminalScrollback *scrollback)
+{
+    for (int i = 0; i < m_members.size(); ++i) {
+        if (m_members.at(i).scrollback == scrollback) {
+            m_members.removeAt(i);
+            return;
+        }
+    }
+}
+
+void TerminalScrollbackPool::setVisible(TerminalScrollback *scrollback, bool visible)
+{
+    for (Member &member : m_members) {
+        if (member.scrollback == scrollback) member.visible = visible;
+    }
+}
+
+void TerminalScrollbackPool::enforce()
+{
+    if (m_budget <= 0) return;
+
+    qint64 usage = memoryUsage();
+    while (usage > m_budget) {
+        // Largest hidden store first; visible ones only once none is left
+        Member *victim = nullptr;
+        for (Member &member : m_members) {
+            if (member.scrollback->blockCount() <= 1) continue;
+            if (!victim || (!member.visible && victim->visible)
+                || (member.visible == victim->visible
+                    && member.scrollback->memoryUsage() > victim->scrollback->memoryUsage())) {
+                victim = &member;
+            }
+        }
+        if (!victim) return; // Only the newest blocks are left
+
+        const qint64 before = victim->scrollback->memoryUsage();
+        victim->scrollback->releaseOldestBlock();
+        usage -= before - victim->scrollback->memoryUsage();
+    }
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QVector>
+#include "TerminalScreen.h"
+
+/**
+ * Compact store for lines that scrolled off the top of the screen.
+ *
+ * Soft-wrapped rows are joined as they arrive, so the store holds logical
+ * lines and rewrapping to a new width costs nothing up front: physical
+ * rows are derived from per-line cell counts the first time they are
+ * needed after a width change.
+ *
+ * Lines are encoded as UTF-8 text (one code point per cell, trailing
+ * blanks trimmed) plus run-length style spans, and appended to blocks of
+ * LinesPerBlock lines. Blocks that are no longer among the newest few are
+ * LZ4-compressed when built with LZ4. The oldest lines are dropped to stay
+ * within a line limit and a memory budget.
+ *
+ * Reading decodes whole lines into a small cache, so cell access stays
+ * cheap for the sequential patterns of selection and rendering.
+ *
+ * Each block also keeps a Bloom filter of the case-folded characters,
+ * bigrams and trigrams of its lines, updated as lines are appended, so a
+ * text search only decodes the blocks that can contain the needle.
+ *
+ * Copies are cheap (the block data is implicitly shared) and can be
+ * searched on another thread.
+ */
+class TerminalScrollback {
+public:
+    static constexpr int LinesPerBlock = 256;
+    static constexpr int MaxLineLength = 65536; // Longer lines are split
+
+    TerminalScrollback();
+
+    void setLineLimit(int lines);
+    void setMemoryBudget(qint64 bytes);
+    int lineLimit() const { return m_lineLimit; }
+    qint64 memoryBudget() const { return m_memoryBudget; }
+
+    // Appends the newest screen row. Rows flagged RowWrapped are held
+    // until the row that ends their logical line arrives.
+    void push(const TerminalCell *cells, int count, uint8_t rowFlags);
+    void clear();
+
+    // Removes the newest logical line, for pulling it back on screen.
+    // Returns false (leaving `cells` untouched) when the store is empty.
+    bool takeLast(QVector<TerminalCell> *cells, uint8_t *rowFlags);
+    // Like takeLast(), but only for a line still waiting for its end
+    bool takeOpenLine(QVector<TerminalCell> *cells);
+    // Stores a line still waiting for its end as it is
+    void closeOpenLine();
+
+    int lineCount() const { return m_lineCount + (m_hasOpenLine ? 1 : 0); }
+    qint64 memoryUsage() const { return m_memoryUsage; }
+    int blockCount() const { return m_blocks.size(); }
+
+    // Drops the lines of the oldest block, returning its memory. The
+    // newest block is never released; returns false if nothing was.
+    bool releaseOldestBlock();
+
+    // Logical line `index` (0 = oldest), decoded. `width` receives the
+    // number of stored cells; cells past it are blank. The pointer stays
+    // valid until the store is modified or LineCacheSize other lines were
+    // decoded.
+    const TerminalCell *line(int index, int *width, uint8_t *rowFlags = nullptr) const;
+
+    // Physical rows at the current width (0 = oldest row)
+    void setWidth(int cols);
+    int rowCount() const;
+    const TerminalCell *row(int index, int *width, uint8_t *rowFlags = nullptr) const;
+
+    // Marks every style index referenced by a stored line
+    void collectStyles(QVector<bool> &used) const;
+
+    // Ranges of lines (first index, count) that may contain `needle`, a
+    // sequence of case-folded code points
+    QList<QPair<int, int>> candidateLines(const QVector<char32_t> &needle) const;
+    // First physical row of line `index`. A lookup continues from the
+    // previous one when that was for an earlier line, so visiting lines
+    // front to back costs a single pass.
+    int firstRow(int index) const;
+    int width() const { return m_width; }
+
+    // Simple case folding, as used by the trigram index
+    static char32_t foldCase(char32_t codePoint);
+
+    // Splits a logical line into rows of at most `width` cells. A wide
+    // glyph that would straddle the edge starts the next row. Returns the
+    // row count; `starts` receives the first cell of each row.
+    static int wrap(const TerminalCell *cells, int count, int width, QVector<int> *starts = nullptr);
+
+private:
+    static constexpr int LineCacheSize = 8;
+    static constexpr int HotBlocks = 2; // Newest blocks kept uncompressed
+    static constexpr quint32 HasWideBit = 0x80000000u;
+    static constexpr int IndexBits = 14; // Trigram filter size (2^14 bits per block)
+    // Per-block bookkeeping counted against the memory budget
+    static constexpr int BlockOverhead = LinesPerBlock * 2 * sizeof(quint32) + (1 << IndexBits) / 8;
+
+    struct Block {
+        QByteArray data; // Encoded lines, LZ4 frame when `compressed`
+        QVector<quint32> offsets; // Line starts in the uncompressed data
+        QVector<quint32> cellCounts; // Cells per line, HasWideBit if any are wide
+        QVector<quint64> trigrams; // Bloom filter over the lines' trigrams
+        int rawSize = 0;
+        bool compressed = false;
+        quint64 serial = 0;
+        mutable int rows = 0; // Physical rows at `rowsWidth`
+        mutable int rowsWidth = 0;
+    };
+
+    struct CachedLine {
+        qint64 line = -1; // Absolute line number, -1 = empty slot
+        QVector<TerminalCell> cells;
+        uint8_t flags = 0;
+    };
+
+    void append(const TerminalCell *cells, int count, uint8_t rowFlags);
+    void dropOldestLine();
+    void compress(Block &block);
+    void decompress(Block &block);
+    const QByteArray &blockData(const Block &block) const;
+    void decodeLine(const Block &block, int lineInBlock, CachedLine &out) const;
+    int lineRows(int block, int lineInBlock) const;
+    int plainRows(int cells) const { return cells ? (cells + m_width - 1) / m_width : 1; }
+    void invalidateCache(qint64 absoluteLine);
+    static quint32 gramBit(char32_t a, char32_t b, char32_t c);
+    static void indexLine(Block &block, const TerminalCell *cells, int count);
+    void trim();
+
+    QList<Block> m_blocks;
+    int m_firstLine; // Lines already dropped from the first block
+    int m_lineCount; // Encoded lines, excluding the open line
+    qint64 m_droppedLines; // Total lines dropped, for absolute numbering
+    quint64 m_nextSerial;
+
+    // Newest logical line while its rows are still soft-wrapped
+    QVector<TerminalCell> m_openLine;
+    bool m_hasOpenLine;
+
+    int m_lineLimit;
+    qint64 m_memoryBudget;
+    qint64 m_memoryUsage;
+
+    // Row geometry. m_rowCount is only meaningful while m_rowsValid; any
+    // block with a stale rowsWidth clears it.
+    int m_width;
+    mutable int m_rowCount;
+    mutable bool m_rowsValid;
+    mutable int m_openRows; // -1 = not counted yet
+
+    // Last row() lookup
+    mutable int m_rowCacheIndex; // -1 = none
+    mutable int m_rowCacheLine;
+    mutable int m_rowCacheStart;
+    mutable int m_rowCacheWidth;
+    mutable uint8_t m_rowCacheFlags;
+
+    // Last firstRow() lookup
+    mutable int m_firstRowLine; // -1 = none
+    mutable int m_firstRowRow;
+
+    // Decoding caches
+    mutable CachedLine m_cache[LineCacheSize];
+    mutable int m_cacheNext;
+    mutable QByteArray m_inflated;
+    mutable quint64 m_inflatedSerial;
+    mutable QVector<int> m_wrapStarts;
+    mutable CachedLine m_scratch;
+    QByteArray m_encodeBuffer;
+};
+
+/**
+ * Memory budget shared by the scrollback of several screens.
+ *
+ * Each store keeps its own limits; the pool additionally caps their sum,
+ * so many idle sessions cannot each fill a full budget. Over the cap,
+ * enforce() releases the oldest blocks of the largest hidden store first
+ * and only then touches visible ones.
+ *
+ * Not thread-safe: the pool and its members belong to one thread.
+ */
+class TerminalScrollbackPool {
+public:
+    explicit TerminalScrollbackPool(qint64 budget = 0);
+
+    // Total for all members in bytes, 0 = unlimited
+    void setBudget(qint64 bytes);
+    qint64 budget() const { return m_budget; }
+    qint64 memoryUsage() const;
+
+    void add(TerminalScrollback *scrollback);
+    void remove(TerminalScrollback *scrollback);
+    void setVisible(TerminalScrollback *scrollback, bool visible);
+
+    void enforce();
+
+private:
+    struct Member {
+        TerminalScrollback *scrollback = nullptr;
+        bool visible = true;
+    };
+
+    QVector<Member> m_members;
+    qint64 m_budget;
+};
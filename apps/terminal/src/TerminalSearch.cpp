@@ -0,0 +1,156 @@
+#include "TerminalSearch.h"
+#include "TerminalScrollback.h"
+#include <QDebug>
+#include <QVariantMap>
+
+namespace {
+
+// Matches (first cell, last cell) of one line, left to right
+using CellRanges = QVector<QPair<int, int>>;
+
+void appendMatches(const TerminalScrollback &lines, int line, const TerminalCell *cells, int count,
+                   const CellRanges &ranges, qint64 rowOffset, QVector<TerminalSearchMatch> *out)
+{
+    QVector<int> starts;
+    TerminalScrollback::wrap(cells, count, lines.width(), &starts);
+    const qint64 firstRow = lines.firstRow(line) + rowOffset;
+
+    // Cells only move right, so the wrapped row they are on does too
+    int segment = 0;
+    auto place = [&](int cell, int *x, qint64 *y) {
+        while (segment + 1 < starts.size() && starts.at(segment + 1) <= cell) segment++;
+        *x = cell - starts.at(segment);
+        *y = firstRow + segment;
+    };
+
+    for (const QPair<int, int> &range : ranges) {
+        TerminalSearchMatch match;
+        place(range.first, &match.startX, &match.startY);
+        place(range.second, &match.endX, &match.endY);
+        out->append(match);
+    }
+}
+
+} // namespace
+
+void TerminalSearch::lineText(const TerminalCell *cells, int count, QString *text,
+                              QVector<int> *cellOfUnit)
+{
+    text->clear();
+    cellOfUnit->clear();
+    for (int x = 0; x < count; ++x) {
+        if (cells[x].flags & TerminalCell::WideContinuation) continue;
+
+        const char32_t cp = cells[x].codePoint ? cells[x].codePoint : U' ';
+        if (QChar::requiresSurrogates(cp)) {
+            text->append(QChar(QChar::highSurrogate(cp)));
+            text->append(QChar(QChar::lowSurrogate(cp)));
+            cellOfUnit->append(x);
+            cellOfUnit->append(x);
+        } else {
+            text->append(QChar(char16_t(cp)));
+            cellOfUnit->append(x);
+        }
+    }
+    cellOfUnit->append(count);
+}
+
+QVariantList TerminalSearch::toVariantList(const QVector<TerminalSearchMatch> &matches)
+{
+    QVariantList list;
+    list.reserve(matches.size());
+    for (const TerminalSearchMatch &match : matches) {
+        QVariantMap map;
+        map["startX"] = match.startX;
+        map["startY"] = match.startY;
+        map["endX"] = match.endX;
+        map["endY"] = match.endY;
+        list.append(map);
+    }
+    return list;
+}
+
+TerminalSearchWorker::TerminalSearchWorker(QObject *parent)
+    : QObject(parent)
+    , m_currentSearch(0)
+{
+}
+
+template <typename Matcher>
+void TerminalSearchWorker::scanLines(int searchId, const TerminalScrollback &lines,
+                                     const QList<QPair<int, int>> &ranges, qint64 rowOffset,
+                                     Matcher match)
+{
+    QVector<TerminalSearchMatch> batch;
+    QString text;
+    QVector<int> cellOfUnit;
+    CellRanges found;
+    int matchCount = 0;
+    int scanned = 0;
+
+    for (int r = 0; r < ranges.size(); ++r) {
+        const int end = ranges.at(r).first + ranges.at(r).second;
+        for (int line = ranges.at(r).first; line < end; ++line) {
+            if (m_currentSearch.load() != searchId) return; // Superseded or cancelled
+
+            int count = 0;
+            const TerminalCell *cells = lines.line(line, &count);
+            TerminalSearch::lineText(cells, count, &text, &cellOfUnit);
+
+            found.clear();
+            match(text, cellOfUnit, &found);
+            if (!found.isEmpty()) {
+                appendMatches(lines, line, cells, count, found, rowOffset, &batch);
+            }
+
+            scanned++;
+            const bool last = r + 1 == ranges.size() && line + 1 == end;
+            if (!batch.isEmpty() && (scanned % LinesPerBatch == 0 || last)) {
+                matchCount += batch.size();
+                emit matchesFound(searchId, TerminalSearch::toVariantList(batch));
+                batch.clear();
+            }
+        }
+    }
+
+    emit finished(searchId, matchCount);
+}
+
+void TerminalSearchWorker::findText(int searchId, std::shared_ptr<const TerminalScrollback> lines,
+                                    const QString &needle, Qt::CaseSensitivity sensitivity,
+                                    qint64 rowOffset)
+{
+    // The index is case-folded whatever the search asks for
+    QVector<char32_t> folded;
+    for (char32_t cp : needle.toUcs4()) {
+        folded.append(TerminalScrollback::foldCase(cp));
+    }
+
+    const QList<QPair<int, int>> candidates = needle.isEmpty() ? QList<QPair<int, int>>()
+                                                               : lines->candidateLines(folded);
+    scanLines(searchId, *lines, candidates, rowOffset, [&](const QString &text,
+                                                          const QVector<int> &cellOfUnit,
+                                                          CellRanges *found) {
+        for (int at = text.indexOf(needle, 0, sensitivity); at >= 0;
+             at = text.indexOf(needle, at + needle.size(), sensitivity)) {
+            found->append(qMakePair(cellOfUnit.at(at), cellOfUnit.at(at + needle.size()) - 1));
+        }
+    });
+}
+
+void TerminalSearchWorker::scan(int searchId, std::shared_ptr<const TerminalScrollback> lines,
+                                const QRegularExpression &expression, qint64 rowOffset)
+{
+    const QList<QPair<int, int>> everything{qMakePair(0, lines->lineCount())};
+    scanLines(searchId, *lines, everything, rowOffset, [&](const QString &text,
+                                                          const QVector<int> &cellOfUnit,
+                                                          CellRanges *found) {
+        QRegularExpressionMatchIterator it = expression.globalMatch(text);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            if (match.capturedLength() == 0) continue;
+            found->append(qMakePair(cellOfUnit.at(match.capturedStart()),
+                                    cellOfUnit.at(match.capturedEnd()) - 1));
+        }
+    });
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QRegularExpression>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "TerminalScreen.h"
+
+class TerminalScrollback;
+
+// Matched range, inclusive like TerminalSelection. Rows are absolute
+// (TerminalScreen::historyOffset()), so they stay put as output scrolls.
+// A match never spans logical lines but may span the rows a long line
+// wraps to.
+struct TerminalSearchMatch {
+    int startX = 0;
+    qint64 startY = 0;
+    int endX = 0;
+    qint64 endY = 0;
+};
+
+namespace TerminalSearch {
+
+// Text of a logical line (empty cells read as spaces) and, for each UTF-16
+// unit plus one past the end, the cell it came from
+void lineText(const TerminalCell *cells, int count, QString *text, QVector<int> *cellOfUnit);
+
+// {startX, startY, endX, endY} maps, for QML
+QVariantList toVariantList(const QVector<TerminalSearchMatch> &matches);
+
+} // namespace TerminalSearch
+
+/**
+ * Search over a scrollback snapshot.
+ *
+ * Literal searches only decode the blocks the trigram index allows;
+ * regexes cannot use the index and scan every line. Both run on a thread
+ * of their own and report matches in batches as they go, leaving the I/O
+ * thread free to keep parsing output.
+ */
+class TerminalSearchWorker : public QObject {
+    Q_OBJECT
+
+public:
+    explicit TerminalSearchWorker(QObject *parent = nullptr);
+
+    // Thread-safe: scans for any other search id stop at the next line
+    void setCurrentSearch(int searchId) { m_currentSearch.store(searchId); }
+
+    // Run on the worker thread. `rowOffset` turns row numbers of `lines`
+    // into absolute rows.
+    void findText(int searchId, std::shared_ptr<const TerminalScrollback> lines,
+                  const QString &needle, Qt::CaseSensitivity sensitivity, qint64 rowOffset);
+    void scan(int searchId, std::shared_ptr<const TerminalScrollback> lines,
+              const QRegularExpression &expression, qint64 rowOffset);
+
+signals:
+    void matchesFound(int searchId, const QVariantList &matches);
+    void finished(int searchId, int matchCount);
+
+private:
+    static constexpr int LinesPerBatch = 1024;
+
+    // Runs `match` over the lines of `ranges` (first line, count)
+    template <typename Matcher>
+    void scanLines(int searchId, const TerminalScrollback &lines,
+                   const QList<QPair<int, int>> &ranges, qint64 rowOffset, Matcher match);
+
+    std::atomic<int> m_currentSearch;
+};
@@ -0,0 +1,56 @@
+#include "TerminalSessionManager.h"
+#include "TerminalReactor.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+
+std::shared_ptr<TerminalSessionManager> TerminalSessionManager::instance()
+{
+    static std::weak_ptr<TerminalSessionManager> current;
+
+    std::shared_ptr<TerminalSessionManager> manager = current.lock();
+    if (!manager) {
+        manager.reset(new TerminalSessionManager);
+        current = manager;
+    }
+    return manager;
+}
+
+TerminalSessionManager::TerminalSessionManager()
+    : m_ioThread(new QThread)
+    , m_searchThread(new QThread)
+    , m_reactor(new TerminalReactor)
+    , m_scrollbackPoolBudget(DefaultScrollbackPoolBudget)
+{
+    m_reactor->scrollbackPool()->setBudget(m_scrollbackPoolBudget);
+
+    m_ioThread->setObjectName("TerminalIO");
+    m_reactor->moveToThread(m_ioThread);
+    QObject::connect(m_ioThread, &QThread::finished, m_reactor, &QObject::deleteLater);
+
+    m_searchThread->setObjectName("TerminalSearch");
+
+    m_ioThread->start();
+    m_searchThread->start();
+    qDebug() << "[TerminalSessionManager] Started shared I/O thread";
+}
+
+TerminalSessionManager::~TerminalSessionManager()
+{
+    // Every engine, and so every worker on these threads, is gone by now
+    m_ioThread->quit();
+    m_ioThread->wait();
+    m_searchThread->quit();
+    m_searchThread->wait();
+    delete m_ioThread;
+    delete m_searchThread;
+}
+
+void TerminalSessionManager::setScrollbackPoolBudget(qint64 bytes)
+{
+    bytes = std::max<qint64>(0, bytes);
+    if (m_scrollbackPoolBudget == bytes) return;
+    m_scrollbackPoolBudget = bytes;
+    QMetaObject::invokeMethod(m_reactor, "setScrollbackBudget", Qt::QueuedConnection,
+                              Q_ARG(qint64, m_scrollbackPoolBudget));
+}
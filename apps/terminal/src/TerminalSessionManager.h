@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QtGlobal>
+#include <memory>
+
+class QThread;
+class TerminalReactor;
+
+/**
+ * Threads and reactor shared by every terminal session in the process.
+ *
+ * Each TerminalEngine holds a reference from instance(); the first one
+ * creates the manager and the last one tears it down. All sessions read
+ * and parse on one I/O thread driven by a TerminalReactor, and run regex
+ * searches on one search thread, so another tab or pane costs a screen
+ * and its scrollback rather than two more threads.
+ *
+ * Used from the GUI thread only.
+ */
+class TerminalSessionManager {
+public:
+    static std::shared_ptr<TerminalSessionManager> instance();
+    ~TerminalSessionManager();
+
+    TerminalSessionManager(const TerminalSessionManager &) = delete;
+    TerminalSessionManager &operator=(const TerminalSessionManager &) = delete;
+
+    QThread *ioThread() const { return m_ioThread; }
+    QThread *searchThread() const { return m_searchThread; }
+    // Lives on ioThread()
+    TerminalReactor *reactor() const { return m_reactor; }
+
+    // Cap on the scrollback memory of all sessions together, on top of
+    // each session's own budget (bytes, 0 = unlimited)
+    void setScrollbackPoolBudget(qint64 bytes);
+    qint64 scrollbackPoolBudget() const { return m_scrollbackPoolBudget; }
+
+private:
+    static constexpr qint64 DefaultScrollbackPoolBudget = 32 * 1024 * 1024;
+
+    TerminalSessionManager();
+
+    QThread *m_ioThread;
+    QThread *m_searchThread;
+    TerminalReactor *m_reactor;
+    qint64 m_scrollbackPoolBudget;
+};
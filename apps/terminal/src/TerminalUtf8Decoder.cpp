@@ -0,0 +1,97 @@
+#include "TerminalUtf8Decoder.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+int TerminalUtf8Decoder::asciiPrefix(const char *data, int length)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    int i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+        const int mask = _mm_movemask_epi8(chunk); // High bit of each byte
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= length; i += 16) {
+        const uint8x16_t chunk = vld1q_u8(bytes + i);
+        const uint8x16_t high = vcgeq_u8(chunk, vdupq_n_u8(0x80));
+        const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(high), 4);
+        const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (mask) return i + (__builtin_ctzll(mask) >> 2);
+    }
+#endif
+
+    while (i < length && bytes[i] < 0x80) ++i;
+    return i;
+}
+
+bool TerminalUtf8Decoder::interrupt()
+{
+    if (!m_needed) return false;
+    m_needed = 0;
+    return true;
+}
+
+int TerminalUtf8Decoder::decode(const char *data, int length, char32_t *out)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    char32_t *start = out;
+    int i = 0;
+
+    while (i < length) {
+        if (m_needed == 0) {
+            // Bulk-copy ASCII; typical output is mostly ASCII with the odd
+            // multi-byte character in between
+            const int ascii = asciiPrefix(data + i, length - i);
+            for (int k = 0; k < ascii; ++k) *out++ = bytes[i + k];
+            i += ascii;
+            if (i == length) break;
+
+            const uint8_t lead = bytes[i++];
+            m_lower = 0x80;
+            m_upper = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                m_codePoint = lead & 0x1F;
+                m_needed = 1;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                if (lead == 0xE0) m_lower = 0xA0; // Overlong
+                if (lead == 0xED) m_upper = 0x9F; // Surrogates
+                m_codePoint = lead & 0x0F;
+                m_needed = 2;
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                if (lead == 0xF0) m_lower = 0x90; // Overlong
+                if (lead == 0xF4) m_upper = 0x8F; // Past U+10FFFF
+                m_codePoint = lead & 0x07;
+                m_needed = 3;
+            } else {
+                // Stray continuation byte, C0/C1 overlong lead or F5..FF
+                *out++ = ReplacementCharacter;
+            }
+            continue;
+        }
+
+        const uint8_t byte = bytes[i];
+        if (byte < m_lower || byte > m_upper) {
+            // Truncated sequence: replace it and resync on this byte
+            *out++ = ReplacementCharacter;
+            m_needed = 0;
+            continue;
+        }
+
+        ++i;
+        m_codePoint = (m_codePoint << 6) | (byte & 0x3F);
+        m_lower = 0x80;
+        m_upper = 0xBF;
+        if (--m_needed == 0) {
+            *out++ = m_codePoint;
+        }
+    }
+
+    return int(out - start);
+}
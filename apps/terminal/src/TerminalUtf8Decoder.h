@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Streaming UTF-8 decoder for PTY output.
+ *
+ * Keeps the state of a sequence split across read() boundaries, validates
+ * per Unicode 3.9 (no overlongs, surrogates or values past U+10FFFF) and
+ * substitutes U+FFFD for malformed input. ASCII is copied through in bulk
+ * with SSE2/NEON.
+ */
+class TerminalUtf8Decoder {
+public:
+    static constexpr char32_t ReplacementCharacter = 0xFFFD;
+
+    // Decodes `length` bytes into `out`, which must have room for
+    // length + 1 code points. An incomplete trailing sequence is kept for
+    // the next call. Returns the number of code points written.
+    int decode(const char *data, int length, char32_t *out);
+
+    // Drops a pending partial sequence (the stream was interrupted by a
+    // control sequence). Returns true if a replacement character is due.
+    bool interrupt();
+
+    bool hasPendingInput() const { return m_needed > 0; }
+
+    // Length of the leading all-ASCII prefix of `data`
+    static int asciiPrefix(const char *data, int length);
+
+private:
+    char32_t m_codePoint = 0;
+    int m_needed = 0; // Continuation bytes still expected
+    uint8_t m_lower = 0x80; // Valid range of the next continuation byte
+    uint8_t m_upper = 0xBF;
+};
@@ -0,0 +1,77 @@
+#include "marathonlatencyhistogram.h"
+#include <algorithm>
+#include <cmath>
+
+int MarathonLatencyHistogram::bucketIndex(quint64 micros)
+{
+    micros = std::min<quint64>(micros, (quint64(1) << MaxValueBits) - 1);
+
+    // Below 2 * SubBucketCount every value has its own bucket
+    if (micros < 2 * SubBucketCount) {
+        return int(micros);
+    }
+
+    int topBit = 63;
+    while (!(micros >> topBit)) {
+        --topBit;
+    }
+    const int shift = topBit - SubBucketBits;
+    return (shift + 1) * SubBucketCount + int(micros >> shift) - SubBucketCount;
+}
+
+quint64 MarathonLatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < 2 * SubBucketCount) {
+        return quint64(index);
+    }
+    const int shift = index / SubBucketCount - 1;
+    const quint64 lower = quint64(index % SubBucketCount + SubBucketCount) << shift;
+    return lower + (quint64(1) << shift) - 1;
+}
+
+void MarathonLatencyHistogram::record(qint64 micros)
+{
+    micros = std::max<qint64>(micros, 0);
+    m_counts[bucketIndex(quint64(micros))].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(quint64(micros), std::memory_order_relaxed);
+
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while (micros > max && !m_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+    }
+}
+
+void MarathonLatencyHistogram::reset()
+{
+    for (auto &count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+qint64 MarathonLatencyHistogram::mean() const
+{
+    const quint64 samples = count();
+    return samples ? qint64(m_sum.load(std::memory_order_relaxed) / samples) : 0;
+}
+
+qint64 MarathonLatencyHistogram::percentile(double percent) const
+{
+    const quint64 samples = count();
+    if (!samples) {
+        return 0;
+    }
+
+    const quint64 target = std::max<quint64>(1, quint64(std::ceil(samples * percent / 100.0)));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::min(qint64(bucketUpperBound(i)), maximum());
+        }
+    }
+    // Counted while we were scanning
+    return maximum();
+}
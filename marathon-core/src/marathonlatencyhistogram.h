@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+/**
+ * @brief Fixed-size latency histogram with HDR-style buckets
+ *
+ * Values are in microseconds. Each power of two is split into 16 linear
+ * sub-buckets, so a reported value is within about 6% of the measured
+ * one, from 1 us up to about two minutes. Recording is a few relaxed
+ * atomic operations and never allocates or locks; any thread may read.
+ */
+class MarathonLatencyHistogram {
+public:
+    static constexpr int SubBucketBits = 4;
+    static constexpr int SubBucketCount = 1 << SubBucketBits;
+    static constexpr int MaxValueBits = 27; // Larger values are clamped
+    static constexpr int BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+    void record(qint64 micros);
+    void reset();
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    qint64 maximum() const { return m_max.load(std::memory_order_relaxed); }
+    qint64 mean() const;
+
+    /**
+     * @brief Value below which percent of the samples fall
+     * @return Upper bound of the bucket holding it, at most maximum()
+     */
+    qint64 percentile(double percent) const;
+
+    // Samples in a bucket, and the largest value it holds
+    quint64 bucketSamples(int index) const { return m_counts[index].load(std::memory_order_relaxed); }
+    static quint64 bucketUpperBound(int index);
+
+private:
+    static int bucketIndex(quint64 micros);
+
+    std::array<std::atomic<quint32>, BucketCount> m_counts{};
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sum{0};
+    std::atomic<qint64> m_max{0};
+};
@@ -21,6 +21,9 @@ Rectangle {
     property real borderRadius: 4
     property real keySpacing: 4
     
+    // MarathonKeyboardIME driving text input, if the app uses it
+    property var ime: null
+    
     // Signals for abstraction
     signal logMessage(string category, string message)
     signal hapticRequested(string intensity)
@@ -304,6 +304,8 @@ Rectangle {
             key.pressed = true  // INSTANT visual change
             longPressTriggered = false
             if (keyboard) keyboard.hapticRequested("light")
+            // Touch-to-key latency runs from here to the IME's key press
+            if (keyboard && keyboard.ime) keyboard.ime.touchBegan()
             
             // Start long-press timer if alternates exist
             if (key.alternateChars.length > 0) {
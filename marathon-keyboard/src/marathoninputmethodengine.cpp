@@ -3,6 +3,8 @@
 #include <QGuiApplication>
 #include <QInputMethod>
 #include <QDebug>
+#include <QInputMethodEvent>
+#include <QInputMethodQueryEvent>
 #include <QKeyEvent>
 
 MarathonInputMethodEngine::MarathonInputMethodEngine(QObject *parent)
@@ -101,31 +103,8 @@ void MarathonInputMethodEngine::commitText(const QString& text)
     
     qDebug() << "[MarathonIME] Committing text:" << text;
     
-    // Qt 6 API: commit() takes no arguments
-    // We need to send key events or use Qt.inputMethod.commit() from QML
-    // For now, simulate typing by sending key events
-    for (const QChar& ch : text) {
-        QKeyEvent* pressEvent = new QKeyEvent(
-            QEvent::KeyPress,
-            0,  // Key code (0 for text input)
-            Qt::NoModifier,
-            QString(ch)
-        );
-        
-        QKeyEvent* releaseEvent = new QKeyEvent(
-            QEvent::KeyRelease,
-            0,
-            Qt::NoModifier,
-            QString(ch)
-        );
-        
-        if (QGuiApplication::focusObject()) {
-            QGuiApplication::sendEvent(QGuiApplication::focusObject(), pressEvent);
-            QGuiApplication::sendEvent(QGuiApplication::focusObject(), releaseEvent);
-        }
-        
-        delete pressEvent;
-        delete releaseEvent;
+    if (!sendCommitString(text, 0)) {
+        sendKeyEvents(text);
     }
     
     // Clear preedit
@@ -197,6 +176,15 @@ void MarathonInputMethodEngine::replacePreedit(const QString& word)
 {
     qDebug() << "[MarathonIME] Replacing preedit with:" << word;
     
+    // The preedit was committed as it was typed: replace it in place
+    if (sendCommitString(word, m_preeditText.length())) {
+        if (!m_preeditText.isEmpty()) {
+            m_preeditText.clear();
+            emit preeditTextChanged();
+        }
+        return;
+    }
+    
     // First, delete the current preedit text
     if (!m_preeditText.isEmpty()) {
         for (int i = 0; i < m_preeditText.length(); ++i) {
@@ -208,6 +196,43 @@ void MarathonInputMethodEngine::replacePreedit(const QString& word)
     commitText(word);
 }
 
+bool MarathonInputMethodEngine::sendCommitString(const QString& text, int replaceLength)
+{
+    QObject* focusObject = QGuiApplication::focusObject();
+    if (!focusObject) {
+        return false;
+    }
+    
+    // Only items with input method support handle commit strings
+    QInputMethodQueryEvent query(Qt::ImEnabled);
+    QGuiApplication::sendEvent(focusObject, &query);
+    if (!query.value(Qt::ImEnabled).toBool()) {
+        return false;
+    }
+    
+    // No preedit; the replaced range ends at the cursor
+    QInputMethodEvent event;
+    event.setCommitString(text, -replaceLength, replaceLength);
+    QGuiApplication::sendEvent(focusObject, &event);
+    return true;
+}
+
+void MarathonInputMethodEngine::sendKeyEvents(const QString& text)
+{
+    QObject* focusObject = QGuiApplication::focusObject();
+    if (!focusObject) {
+        return;
+    }
+    
+    // Key code 0 for text input; sendEvent() does not take ownership
+    for (const QChar& ch : text) {
+        QKeyEvent pressEvent(QEvent::KeyPress, 0, Qt::NoModifier, QString(ch));
+        QKeyEvent releaseEvent(QEvent::KeyRelease, 0, Qt::NoModifier, QString(ch));
+        QGuiApplication::sendEvent(focusObject, &pressEvent);
+        QGuiApplication::sendEvent(focusObject, &releaseEvent);
+    }
+}
+
 QString MarathonInputMethodEngine::getTextBeforeCursor(int length)
 {
     // This would require querying the input item directly
@@ -2,20 +2,44 @@
 #include "marathonkeyboardime.h"
 #include <QDebug>
 #include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
 #include <QTextStream>
 #include <QStandardPaths>
+#include <QVariantList>
 #include <algorithm>
 
+namespace {
+
+const char *const StageNames[] = { "touchToKey", "keyToCommit", "keyToPredictions", "autoCorrect" };
+
+double toMillis(qint64 micros)
+{
+    return micros / 1000.0;
+}
+
+} // namespace
+
 // ========== MarathonKeyboardIME Implementation ==========
 
 MarathonKeyboardIME::MarathonKeyboardIME(QObject *parent)
     : QObject(parent)
     , m_autoCorrectEnabled(true)
     , m_averageLatency(0)
+    , m_touchStartNs(-1)
+    , m_predictionRequestsNs{}
+    , m_predictionRequests(0)
+    , m_predictionAnswers(0)
+    , m_traceNext(0)
+    , m_traceSize(0)
     , m_predictionThread(new QThread(this))
     , m_predictionEngine(new PredictionEngine())
     , m_dictionaryLoader(new DictionaryLoader())
 {
+    m_clock.start();
+    
     // Move prediction engine to background thread
     m_predictionEngine->moveToThread(m_predictionThread);
     m_dictionaryLoader->moveToThread(m_predictionThread);
@@ -23,6 +47,8 @@ MarathonKeyboardIME::MarathonKeyboardIME(QObject *parent)
     // Connect signals
     connect(m_predictionEngine, &PredictionEngine::predictionsReady,
             this, &MarathonKeyboardIME::onPredictionsReady);
+    connect(m_dictionaryLoader, &DictionaryLoader::dictionaryLoaded,
+            m_predictionEngine, &PredictionEngine::setWords);
     
     // Start background thread
     m_predictionThread->start();
@@ -52,8 +78,11 @@ void MarathonKeyboardIME::setAutoCorrectEnabled(bool enabled)
 
 bool MarathonKeyboardIME::processKeyPress(const QString& character)
 {
-    // Start latency timer
-    m_latencyTimer.start();
+    const qint64 startNs = m_clock.nsecsElapsed();
+    if (m_touchStartNs >= 0) {
+        recordLatency(TouchToKey, m_touchStartNs);
+        m_touchStartNs = -1;
+    }
     
     // Update current word immediately (< 0.1ms)
     m_currentWord.append(character);
@@ -61,20 +90,22 @@ bool MarathonKeyboardIME::processKeyPress(const QString& character)
     
     // Commit text immediately for zero perceived latency
     emit commitText(character);
+    recordLatency(KeyToCommit, startNs);
     
     // Trigger async prediction update
-    updatePredictionsAsync();
-    
-    // Record latency
-    qint64 latency = m_latencyTimer.elapsed();
-    updateLatencyMetrics(latency);
+    updatePredictionsAsync(startNs);
     
     return true;
 }
 
+void MarathonKeyboardIME::touchBegan()
+{
+    m_touchStartNs = m_clock.nsecsElapsed();
+}
+
 void MarathonKeyboardIME::processBackspace()
 {
-    m_latencyTimer.start();
+    const qint64 startNs = m_clock.nsecsElapsed();
     
     if (!m_currentWord.isEmpty()) {
         m_currentWord.chop(1);
@@ -82,7 +113,7 @@ void MarathonKeyboardIME::processBackspace()
         
         // Update predictions if word still exists
         if (!m_currentWord.isEmpty()) {
-            updatePredictionsAsync();
+            updatePredictionsAsync(startNs);
         } else {
             m_predictions.clear();
             emit predictionsChanged();
@@ -90,20 +121,20 @@ void MarathonKeyboardIME::processBackspace()
     }
     
     emit commitBackspace();
-    
-    qint64 latency = m_latencyTimer.elapsed();
-    updateLatencyMetrics(latency);
+    recordLatency(KeyToCommit, startNs);
 }
 
 void MarathonKeyboardIME::processSpace()
 {
-    m_latencyTimer.start();
+    const qint64 startNs = m_clock.nsecsElapsed();
     
     if (!m_currentWord.isEmpty()) {
         // Apply auto-correct if enabled
         QString finalWord = m_currentWord;
         if (m_autoCorrectEnabled) {
+            const qint64 correctStartNs = m_clock.nsecsElapsed();
             QString corrected = applyAutoCorrect(m_currentWord);
+            recordLatency(AutoCorrect, correctStartNs);
             if (corrected != m_currentWord) {
                 // Replace current word with corrected version
                 emit replaceWord(m_currentWord, corrected);
@@ -122,13 +153,13 @@ void MarathonKeyboardIME::processSpace()
     }
     
     emit commitText(" ");
-    
-    qint64 latency = m_latencyTimer.elapsed();
-    updateLatencyMetrics(latency);
+    recordLatency(KeyToCommit, startNs);
 }
 
 void MarathonKeyboardIME::processEnter()
 {
+    const qint64 startNs = m_clock.nsecsElapsed();
+    
     if (!m_currentWord.isEmpty()) {
         learnWord(m_currentWord);
         m_currentWord.clear();
@@ -138,6 +169,7 @@ void MarathonKeyboardIME::processEnter()
     }
     
     emit commitText("\n");
+    recordLatency(KeyToCommit, startNs);
 }
 
 void MarathonKeyboardIME::acceptPrediction(const QString& word)
@@ -203,43 +235,124 @@ QVariantMap MarathonKeyboardIME::getPerformanceMetrics() const
     metrics["averageLatency"] = m_averageLatency;
     metrics["currentWord"] = m_currentWord;
     metrics["predictionsCount"] = m_predictions.size();
+    
+    QVariantMap stages;
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const MarathonLatencyHistogram &histogram = m_histograms[stage];
+        QVariantMap entry;
+        entry["count"] = histogram.count();
+        entry["mean"] = toMillis(histogram.mean());
+        entry["p50"] = toMillis(histogram.percentile(50));
+        entry["p95"] = toMillis(histogram.percentile(95));
+        entry["p99"] = toMillis(histogram.percentile(99));
+        entry["max"] = toMillis(histogram.maximum());
+        stages[StageNames[stage]] = entry;
+    }
+    metrics["stages"] = stages;
+    
+    QVariantList trace;
+    for (int i = m_traceSize; i > 0; --i) {
+        const TraceEvent &event = m_trace[(m_traceNext - i + TraceSize) % TraceSize];
+        QVariantMap entry;
+        entry["stage"] = StageNames[event.stage];
+        entry["start"] = toMillis(event.startMicros);
+        entry["duration"] = toMillis(event.durationMicros);
+        trace.append(entry);
+    }
+    metrics["trace"] = trace;
+    
     return metrics;
 }
 
+bool MarathonKeyboardIME::exportLatencyTrace(const QString& path) const
+{
+    // Complete ("X") events, one track per stage
+    QJsonArray events;
+    for (int stage = 0; stage < StageCount; ++stage) {
+        QJsonObject name;
+        name["name"] = "thread_name";
+        name["ph"] = "M";
+        name["pid"] = 1;
+        name["tid"] = stage;
+        name["args"] = QJsonObject{ { "name", StageNames[stage] } };
+        events.append(name);
+    }
+    for (int i = m_traceSize; i > 0; --i) {
+        const TraceEvent &event = m_trace[(m_traceNext - i + TraceSize) % TraceSize];
+        QJsonObject entry;
+        entry["name"] = StageNames[event.stage];
+        entry["ph"] = "X";
+        entry["pid"] = 1;
+        entry["tid"] = int(event.stage);
+        entry["ts"] = double(event.startMicros);
+        entry["dur"] = double(event.durationMicros);
+        events.append(entry);
+    }
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[MarathonKeyboardIME] Cannot write trace" << path;
+        return false;
+    }
+    file.write(QJsonDocument(QJsonObject{ { "traceEvents", events } }).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+void MarathonKeyboardIME::resetPerformanceMetrics()
+{
+    for (MarathonLatencyHistogram &histogram : m_histograms) {
+        histogram.reset();
+    }
+    m_traceNext = 0;
+    m_traceSize = 0;
+    if (m_averageLatency != 0) {
+        m_averageLatency = 0;
+        emit averageLatencyChanged();
+    }
+}
+
 void MarathonKeyboardIME::onPredictionsReady(const QStringList& predictions)
 {
     m_predictions = predictions;
     emit predictionsChanged();
+    
+    // The engine answers every request, in order; a request more than
+    // MaxPendingPredictions back has had its slot reused
+    const quint64 answer = m_predictionAnswers++;
+    if (answer < m_predictionRequests && m_predictionRequests - answer <= MaxPendingPredictions) {
+        recordLatency(KeyToPredictions, m_predictionRequestsNs[answer % MaxPendingPredictions]);
+    }
 }
 
-void MarathonKeyboardIME::updatePredictionsAsync()
+void MarathonKeyboardIME::updatePredictionsAsync(qint64 keyStartNs)
 {
     if (m_currentWord.isEmpty()) {
         return;
     }
     
+    m_predictionRequestsNs[m_predictionRequests++ % MaxPendingPredictions] = keyStartNs;
+    
     // Trigger prediction generation on background thread
     QMetaObject::invokeMethod(m_predictionEngine, "generatePredictions",
                               Qt::QueuedConnection,
                               Q_ARG(QString, m_currentWord));
 }
 
-void MarathonKeyboardIME::updateLatencyMetrics(qint64 latencyMs)
+void MarathonKeyboardIME::recordLatency(LatencyStage stage, qint64 startNs)
 {
-    m_latencySamples.append(latencyMs);
+    const qint64 startMicros = startNs / 1000;
+    const qint64 micros = m_clock.nsecsElapsed() / 1000 - startMicros;
+    m_histograms[stage].record(micros);
     
-    // Keep only last 100 samples
-    if (m_latencySamples.size() > 100) {
-        m_latencySamples.removeFirst();
-    }
+    m_trace[m_traceNext] = TraceEvent{ stage, startMicros, micros };
+    m_traceNext = (m_traceNext + 1) % TraceSize;
+    m_traceSize = std::min(m_traceSize + 1, TraceSize);
     
-    // Calculate average
-    qint64 sum = 0;
-    for (qint64 sample : m_latencySamples) {
-        sum += sample;
+    if (stage != KeyToCommit) {
+        return;
     }
     
-    int newAverage = static_cast<int>(sum / m_latencySamples.size());
+    int newAverage = static_cast<int>(m_histograms[KeyToCommit].mean() / 1000);
     if (newAverage != m_averageLatency) {
         m_averageLatency = newAverage;
         emit averageLatencyChanged();
@@ -266,9 +379,20 @@ QString MarathonKeyboardIME::applyAutoCorrect(const QString& word)
 
 PredictionEngine::PredictionEngine(QObject *parent)
     : QObject(parent)
-    , m_root(new TrieNode())
 {
-    buildTrie();
+    // Placeholder until a dictionary is set
+    QHash<QString, int> commonWords;
+    for (const char *word : { "the", "be", "to", "of", "and", "a", "in", "that", "have",
+                              "I", "it", "for", "not", "on", "with", "he", "as", "you",
+                              "do", "at", "this", "but", "his", "by", "from", "they" }) {
+        commonWords.insert(QString::fromLatin1(word), 100);
+    }
+    buildTrie(commonWords);
+}
+
+void PredictionEngine::setWords(const QHash<QString, int>& frequencies)
+{
+    buildTrie(frequencies);
 }
 
 void PredictionEngine::generatePredictions(const QString& prefix)
@@ -284,52 +408,240 @@ void PredictionEngine::generatePredictions(const QString& prefix)
     emit predictionsReady(predictions);
 }
 
-void PredictionEngine::buildTrie()
+void PredictionEngine::buildTrie(const QHash<QString, int>& frequencies)
 {
-    // Build trie from common words
-    // This is a placeholder - real implementation would load from file
-    QStringList commonWords = {
-        "the", "be", "to", "of", "and", "a", "in", "that", "have",
-        "I", "it", "for", "not", "on", "with", "he", "as", "you",
-        "do", "at", "this", "but", "his", "by", "from", "they"
+    QElapsedTimer timer;
+    timer.start();
+    
+    // Sorted, every node's words form a range, its own word first
+    QStringList words;
+    words.reserve(frequencies.size());
+    for (auto it = frequencies.constBegin(); it != frequencies.constEnd(); ++it) {
+        if (!it.key().isEmpty() && it.key().toUtf8().size() <= MaxWordBytes) {
+            words.append(it.key());
+        }
+    }
+    std::sort(words.begin(), words.end());
+    
+    QVector<quint32> wordFrequency(words.size()); // Per word, while building
+    for (int w = 0; w < words.size(); ++w) {
+        wordFrequency[w] = quint32(std::max(0, frequencies.value(words.at(w))));
+    }
+    auto moreFrequent = [&wordFrequency](quint32 a, quint32 b) {
+        return wordFrequency.at(a) != wordFrequency.at(b) ? wordFrequency.at(a) > wordFrequency.at(b) : a < b;
     };
     
-    for (const QString& word : commonWords) {
-        TrieNode* current = m_root;
-        for (const QChar& ch : word) {
-            if (!current->children.contains(ch)) {
-                current->children[ch] = new TrieNode();
-                current->children[ch]->character = ch;
+    struct Range {
+        int begin;
+        int end;
+        int depth;
+    };
+    
+    QVector<Node> nodes;
+    QVector<Range> ranges; // Per node, while building
+    nodes.append(Node{ 0, 0, 0, 0, 0, 0 });
+    ranges.append(Range{ 0, int(words.size()), 0 });
+    
+    // Breadth-first, so children are appended next to each other
+    for (int i = 0; i < nodes.size(); ++i) {
+        const Range range = ranges.at(i);
+        nodes[i].firstChild = quint32(nodes.size());
+        if (nodes.at(i).leafWords) {
+            continue;
+        }
+        
+        int w = range.begin;
+        if (w < range.end && words.at(w).size() == range.depth) {
+            ++w;
+        }
+        while (w < range.end) {
+            const char16_t character = words.at(w).at(range.depth).unicode();
+            int groupEnd = w + 1;
+            while (groupEnd < range.end && words.at(groupEnd).at(range.depth).unicode() == character) {
+                ++groupEnd;
+            }
+            const quint8 leafWords = groupEnd - w <= LeafWords ? quint8(groupEnd - w) : 0;
+            nodes.append(Node{ 0, quint32(w), 0, character, 0, leafWords });
+            ranges.append(Range{ w, groupEnd, range.depth + 1 });
+            w = groupEnd;
+        }
+    }
+    const int nodeCount = nodes.size();
+    nodes.append(Node{ quint32(nodeCount), 0, 0, 0, 0, 0 });
+    
+    // Leaves rank their own words instead of keeping a list
+    QByteArray leafRanks(words.size(), 0);
+    QVector<quint32> candidates;
+    for (int i = 1; i < nodeCount; ++i) {
+        const Node &node = nodes.at(i);
+        if (!node.leafWords) {
+            continue;
+        }
+        candidates.clear();
+        for (quint32 w = node.firstWord; w < node.firstWord + node.leafWords; ++w) {
+            candidates.append(w);
+        }
+        std::sort(candidates.begin(), candidates.end(), moreFrequent);
+        for (int k = 0; k < candidates.size(); ++k) {
+            leafRanks[int(candidates.at(k))] = char(k);
+        }
+    }
+    
+    // Children come after their parent, so going backwards every
+    // child's list is ready before its parent merges them
+    QVector<quint32> top;
+    for (int i = nodeCount - 1; i >= 0; --i) {
+        Node &node = nodes[i];
+        if (node.leafWords) {
+            continue;
+        }
+        const Range range = ranges.at(i);
+        const bool isWord = range.begin < range.end && words.at(range.begin).size() == range.depth;
+        const quint32 childBegin = node.firstChild;
+        const quint32 childEnd = nodes.at(i + 1).firstChild;
+        
+        if (!isWord && childEnd - childBegin == 1 && !nodes.at(childBegin).leafWords) {
+            node.topBegin = nodes.at(childBegin).topBegin;
+            node.topCount = nodes.at(childBegin).topCount;
+            continue;
+        }
+        
+        candidates.clear();
+        if (isWord) {
+            candidates.append(quint32(range.begin));
+        }
+        for (quint32 child = childBegin; child < childEnd; ++child) {
+            const Node &childNode = nodes.at(child);
+            for (int k = 0; k < childNode.leafWords; ++k) {
+                candidates.append(childNode.firstWord + k);
+            }
+            for (int k = 0; k < childNode.topCount; ++k) {
+                candidates.append(top.at(childNode.topBegin + k));
+            }
+        }
+        
+        const int count = std::min(int(candidates.size()), TopCount);
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), moreFrequent);
+        node.topBegin = quint32(top.size());
+        node.topCount = quint8(count);
+        for (int k = 0; k < count; ++k) {
+            top.append(candidates.at(k));
+        }
+    }
+    ranges = QVector<Range>();
+    
+    // Front coding: each word keeps only what differs from the one
+    // before, restarting in full at every bucket
+    QByteArray encoded;
+    QVector<quint32> buckets;
+    QByteArray previous;
+    for (int w = 0; w < words.size(); ++w) {
+        const QByteArray word = words.at(w).toUtf8();
+        int shared = 0;
+        if (w % WordsPerBucket == 0) {
+            buckets.append(quint32(encoded.size()));
+        } else {
+            const int limit = std::min(word.size(), previous.size());
+            while (shared < limit && word.at(shared) == previous.at(shared)) {
+                ++shared;
             }
-            current = current->children[ch];
         }
-        current->isWord = true;
-        current->frequency = 100; // Default frequency
+        encoded.append(char(shared));
+        encoded.append(char(word.size() - shared));
+        encoded.append(word.constData() + shared, word.size() - shared);
+        previous = word;
     }
+    
+    m_nodes = std::move(nodes);
+    m_top = std::move(top);
+    m_words = std::move(encoded);
+    m_buckets = std::move(buckets);
+    m_leafRanks = std::move(leafRanks);
+    m_nodes.squeeze();
+    m_top.squeeze();
+    m_words.squeeze();
+    m_buckets.squeeze();
+    
+    qDebug() << "[PredictionEngine] Indexed" << words.size() << "words in" << timer.elapsed() << "ms:"
+             << nodeCount << "nodes,"
+             << (m_nodes.size() * sizeof(Node) + m_top.size() * sizeof(quint32) + m_words.size()
+                 + m_buckets.size() * sizeof(quint32) + m_leafRanks.size()) / 1024
+             << "KiB";
 }
 
 QStringList PredictionEngine::searchTrie(const QString& prefix, int maxResults)
 {
     QStringList results;
+    if (m_nodes.isEmpty()) {
+        return results;
+    }
     
-    // Navigate to prefix node
-    TrieNode* current = m_root;
+    // Navigate to prefix node, or to the leaf that would hold it
+    quint32 current = 0;
     for (const QChar& ch : prefix) {
-        if (!current->children.contains(ch)) {
+        if (m_nodes.at(current).leafWords) {
+            break;
+        }
+        const Node *begin = m_nodes.constData() + m_nodes.at(current).firstChild;
+        const Node *end = m_nodes.constData() + m_nodes.at(current + 1).firstChild;
+        const Node *child = std::lower_bound(begin, end, ch.unicode(), [](const Node& node, char16_t character) {
+            return node.character < character;
+        });
+        if (child == end || child->character != ch.unicode()) {
             return results; // Prefix not found
         }
-        current = current->children[ch];
+        current = quint32(child - m_nodes.constData());
     }
     
-    // DFS to find words (simplified - real implementation would use priority queue)
-    // For now, just return if current is a word
-    if (current->isWord) {
-        results.append(prefix);
+    // Best completions were ranked when the trie was built
+    const Node &node = m_nodes.at(current);
+    QVector<QByteArray> words;
+    if (!node.leafWords) {
+        const int count = std::min(int(node.topCount), maxResults);
+        for (int i = 0; i < count; ++i) {
+            readWords(m_top.at(node.topBegin + i), 1, &words);
+        }
+        for (const QByteArray &word : words) {
+            results.append(QString::fromUtf8(word));
+        }
+        return results;
+    }
+    
+    // A leaf's words still have to match the rest of the prefix
+    readWords(node.firstWord, node.leafWords, &words);
+    const QByteArray wanted = prefix.toUtf8();
+    QVector<QPair<quint8, int>> matches; // Rank in the leaf, index in words
+    for (int i = 0; i < words.size(); ++i) {
+        if (words.at(i).startsWith(wanted)) {
+            matches.append(qMakePair(quint8(m_leafRanks.at(int(node.firstWord) + i)), i));
+        }
+    }
+    const int count = std::min(int(matches.size()), maxResults);
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end());
+    for (int i = 0; i < count; ++i) {
+        results.append(QString::fromUtf8(words.at(matches.at(i).second)));
     }
     
     return results;
 }
 
+void PredictionEngine::readWords(quint32 first, int count, QVector<QByteArray> *words) const
+{
+    // Decoding starts over at the bucket holding `first`
+    const char *data = m_words.constData() + m_buckets.at(int(first / WordsPerBucket));
+    QByteArray word;
+    for (quint32 i = first - first % WordsPerBucket; i < first + quint32(count); ++i) {
+        const int shared = quint8(*data++);
+        const int length = quint8(*data++);
+        word.truncate(shared);
+        word.append(data, length);
+        data += length;
+        if (i >= first) {
+            words->append(word);
+        }
+    }
+}
+
 // ========== DictionaryLoader Implementation ==========
 
 DictionaryLoader::DictionaryLoader(QObject *parent)
@@ -345,17 +657,22 @@ void DictionaryLoader::loadDictionary()
     // This is a placeholder - real implementation would load from file
     QStringList commonWords = {
         "the", "be", "to", "of", "and", "a", "in", "that", "have",
-        "I", "it", "for", "not", "on", "with", "he", "as", "you"
+        "I", "it", "for", "not", "on", "with", "he", "as", "you",
+        "do", "at", "this", "but", "his", "by", "from", "they"
     };
     
-    QMutexLocker locker(&m_mutex);
-    for (int i = 0; i < commonWords.size(); ++i) {
-        m_wordFrequencies[commonWords[i]] = 1000 - (i * 10);
-        emit loadProgress((i + 1) * 100 / commonWords.size());
+    QHash<QString, int> frequencies;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < commonWords.size(); ++i) {
+            m_wordFrequencies[commonWords[i]] = 1000 - (i * 10);
+            emit loadProgress((i + 1) * 100 / commonWords.size());
+        }
+        frequencies = m_wordFrequencies;
     }
     
-    qDebug() << "[DictionaryLoader] Loaded" << m_wordFrequencies.size() << "words";
-    emit dictionaryLoaded();
+    qDebug() << "[DictionaryLoader] Loaded" << frequencies.size() << "words";
+    emit dictionaryLoaded(frequencies);
 }
 
 bool DictionaryLoader::hasWord(const QString& word) const
@@ -11,8 +11,11 @@
 #include <QMutex>
 #include <QElapsedTimer>
 #include <QPointF>
+#include <array>
+#include <atomic>
 #include <QVariant>
 #include <QVariantMap>
+#include "marathonlatencyhistogram.h"
 
 // Forward declarations
 class PredictionEngine;
@@ -60,6 +63,14 @@ public:
      */
     Q_INVOKABLE bool processKeyPress(const QString& character);
 
+    /**
+     * @brief Mark the touch that will lead to the next key press
+     * 
+     * Call from the key's press handler; the time until
+     * processKeyPress() is the touch-to-key latency.
+     */
+    Q_INVOKABLE void touchBegan();
+
     /**
      * @brief Process backspace with word tracking
      */
@@ -101,9 +112,24 @@ public:
 
     /**
      * @brief Get performance metrics
+     * 
+     * "stages" maps each stage (touchToKey, keyToCommit, keyToPredictions,
+     * autoCorrect) to {count, mean, p50, p95, p99, max} in milliseconds;
+     * "trace" lists the most recent events as {stage, start, duration}.
      */
     Q_INVOKABLE QVariantMap getPerformanceMetrics() const;
 
+    /**
+     * @brief Write the recent events as a Chrome trace (chrome://tracing, Perfetto)
+     * @return false if the file cannot be written
+     */
+    Q_INVOKABLE bool exportLatencyTrace(const QString& path) const;
+
+    /**
+     * @brief Clear the latency histograms and trace
+     */
+    Q_INVOKABLE void resetPerformanceMetrics();
+
 signals:
     void currentWordChanged();
     void predictionsChanged();
@@ -135,8 +161,27 @@ private slots:
     void onPredictionsReady(const QStringList& predictions);
 
 private:
-    void updatePredictionsAsync();
-    void updateLatencyMetrics(qint64 latencyMs);
+    enum LatencyStage {
+        TouchToKey,
+        KeyToCommit,
+        KeyToPredictions, // Until the predictions are handed to QML
+        AutoCorrect,
+        StageCount
+    };
+    
+    struct TraceEvent {
+        LatencyStage stage;
+        qint64 startMicros;
+        qint64 durationMicros;
+    };
+    
+    static constexpr int TraceSize = 512;
+    // Prediction requests whose key time is kept until answered; the
+    // answer to an older one goes unmeasured
+    static constexpr int MaxPendingPredictions = 64;
+    
+    void updatePredictionsAsync(qint64 keyStartNs);
+    void recordLatency(LatencyStage stage, qint64 startNs);
     QString applyAutoCorrect(const QString& word);
     
     // Current state
@@ -144,10 +189,19 @@ private:
     QStringList m_predictions;
     bool m_autoCorrectEnabled;
     
-    // Performance tracking
+    // Performance tracking, all times from m_clock
     int m_averageLatency;
-    QList<qint64> m_latencySamples;
-    QElapsedTimer m_latencyTimer;
+    QElapsedTimer m_clock;
+    qint64 m_touchStartNs;
+    // Key times of prediction requests, a ring indexed by request number.
+    // The engine answers every request in order.
+    std::array<qint64, MaxPendingPredictions> m_predictionRequestsNs;
+    quint64 m_predictionRequests;
+    quint64 m_predictionAnswers;
+    std::array<MarathonLatencyHistogram, StageCount> m_histograms;
+    std::array<TraceEvent, TraceSize> m_trace; // Ring, written on this object's thread
+    int m_traceNext;
+    int m_traceSize;
     
     // Background processing
     QThread* m_predictionThread;
@@ -165,7 +219,18 @@ private:
 /**
  * @brief Background prediction engine
  * 
- * Runs on separate thread to avoid blocking UI
+ * Runs on separate thread to avoid blocking UI.
+ * 
+ * Words are kept sorted and front-coded (each stores only what differs
+ * from the one before), under a trie stored as one node array. Nodes are
+ * laid out breadth-first, so the children of a node are contiguous and
+ * sorted by character. A node with more than LeafWords words below it
+ * lists the most frequent of them, so a completion is a walk down the
+ * prefix plus a copy of that list, whatever the size of the subtree.
+ * Smaller subtrees are not expanded: their node covers a range of at
+ * most LeafWords words, which a lookup filters by the rest of the
+ * prefix. That leaves about a tenth of the nodes a full trie needs;
+ * 200k words take about 2.5 MB.
  */
 class PredictionEngine : public QObject
 {
@@ -177,25 +242,39 @@ public:
 public slots:
     void generatePredictions(const QString& prefix);
     
+    /**
+     * @brief Replace the word list
+     * @param frequencies Word -> frequency; higher is suggested first
+     */
+    void setWords(const QHash<QString, int>& frequencies);
+    
 signals:
     void predictionsReady(const QStringList& predictions);
 
 private:
-    // Trie or similar fast structure for predictions
-    struct TrieNode {
-        QChar character;
-        int frequency;
-        bool isWord;
-        QHash<QChar, TrieNode*> children;
-        
-        TrieNode() : frequency(0), isWord(false) {}
-        ~TrieNode() { qDeleteAll(children); }
+    static constexpr int TopCount = 5;        // Completions kept per node
+    static constexpr int LeafWords = 16;      // Subtrees this small are not expanded
+    static constexpr int WordsPerBucket = 16; // Front coding restarts this often
+    static constexpr int MaxWordBytes = 255;  // Longer words are left out
+    
+    struct Node {
+        quint32 firstChild; // Children end where the next node's begin
+        quint32 firstWord;  // Leaves: start of their range of words
+        quint32 topBegin;   // Into m_top; shared with the only child when equal
+        char16_t character;
+        quint8 topCount;
+        quint8 leafWords;   // Words in a leaf's range, 0 for expanded nodes
     };
     
-    TrieNode* m_root;
+    QVector<Node> m_nodes;      // Root first, plus an end sentinel
+    QVector<quint32> m_top;     // Word indices, most frequent first
+    QByteArray m_words;         // UTF-8: shared bytes, suffix bytes, suffix
+    QVector<quint32> m_buckets; // Offset of every WordsPerBucket-th word
+    QByteArray m_leafRanks;     // Per word, its frequency order in its leaf
     
-    void buildTrie();
+    void buildTrie(const QHash<QString, int>& frequencies);
     QStringList searchTrie(const QString& prefix, int maxResults = 3);
+    void readWords(quint32 first, int count, QVector<QByteArray> *words) const;
 };
 
 /**
@@ -216,7 +295,7 @@ public:
     Q_INVOKABLE void updateFrequency(const QString& word, int delta = 1);
     
 signals:
-    void dictionaryLoaded();
+    void dictionaryLoaded(const QHash<QString, int>& frequencies);
     void loadProgress(int percent);
 
 private:
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""
+Generate the terminal character width table.
+
+Writes apps/terminal/src/TerminalCharWidthTable.cpp from the Unicode
+database bundled with Python: East Asian Wide/Fullwidth characters take two
+cells, combining marks and format characters take none. Code points up to
+U+1FFFF are stored as a two-stage table of 2-bit entries; the rest is
+handled by range checks in TerminalCharWidth.h.
+
+Usage: scripts/gen-terminal-charwidth.py
+"""
+
+import os
+import unicodedata
+
+BLOCK_BITS = 7
+BLOCK_SIZE = 1 << BLOCK_BITS
+TABLE_LIMIT = 0x20000
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                      '..', 'apps', 'terminal', 'src', 'TerminalCharWidthTable.cpp')
+
+
+def char_width(cp):
+    if cp < 0x20 or 0x7F <= cp < 0xA0:
+        return 1  # Controls never reach the grid
+    if cp == 0x00AD:
+        return 1  # Soft hyphen is visible in terminals
+    if 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF:
+        return 0  # Hangul medial vowels and final consonants
+    ch = chr(cp)
+    if unicodedata.category(ch) in ('Mn', 'Me', 'Cf'):
+        return 0
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    return 1
+
+
+def main():
+    blocks = []
+    block_index = {}
+    stage1 = []
+
+    for start in range(0, TABLE_LIMIT, BLOCK_SIZE):
+        widths = [char_width(cp) for cp in range(start, start + BLOCK_SIZE)]
+        packed = bytes(
+            widths[i] | (widths[i + 1] << 2) | (widths[i + 2] << 4) | (widths[i + 3] << 6)
+            for i in range(0, BLOCK_SIZE, 4))
+        if packed not in block_index:
+            block_index[packed] = len(blocks)
+            blocks.append(packed)
+        stage1.append(block_index[packed])
+
+    assert len(blocks) <= 256
+
+    lines = [
+        '// Generated by scripts/gen-terminal-charwidth.py from Unicode %s. Do not edit.'
+        % unicodedata.unidata_version,
+        '',
+        '#include "TerminalCharWidth.h"',
+        '',
+        'namespace TerminalCharWidth {',
+        '',
+        'const uint8_t stage1[TableLimit >> BlockBits] = {',
+    ]
+    for i in range(0, len(stage1), 16):
+        lines.append('    ' + ', '.join('%d' % v for v in stage1[i:i + 16]) + ',')
+    lines.append('};')
+    lines.append('')
+    lines.append('const uint8_t stage2[][BlockSize / 4] = {')
+    for block in blocks:
+        lines.append('    {')
+        for i in range(0, len(block), 16):
+            lines.append('        ' + ', '.join('0x%02x' % v for v in block[i:i + 16]) + ',')
+        lines.append('    },')
+    lines.append('};')
+    lines.append('')
+    lines.append('} // namespace TerminalCharWidth')
+    lines.append('')
+
+    with open(OUTPUT, 'w') as f:
+        f.write('\n'.join(lines))
+
+    print('%d stage-2 blocks, %d bytes' % (len(blocks), len(stage1) + len(blocks) * BLOCK_SIZE // 4))
+
+
+if __name__ == '__main__':
+    main()
@@ -145,7 +145,9 @@ Rectangle {
             id: predictionLoader
             width: parent.width
             height: active ? Math.round(40 * Constants.scaleFactor) : 0
-            active: keyboard.currentWord.length > 0 && inputContextInstance.shouldShowPredictions
+            // Also shown after a space, with next-word predictions
+            active: (keyboard.currentWord.length > 0 || keyboard.currentPredictions.length > 0)
+                    && inputContextInstance.shouldShowPredictions
             visible: active
             asynchronous: false
             
@@ -322,6 +324,7 @@ Rectangle {
                 keyboard.shifted = true
                 keyboard.currentWord = ""  // Reset word tracking after sentence end
             }
+            Dictionary.endSentence()
         }
         
         // 5. Auto-space after comma (modern keyboard behavior)
@@ -353,6 +356,9 @@ Rectangle {
             } else {
                 updatePredictions()
             }
+        } else {
+            // Next-word predictions no longer follow the cursor
+            keyboard.currentPredictions = []
         }
         
         keyboard.backspace()
@@ -374,6 +380,8 @@ Rectangle {
             keyboard.keyPressed(". ")
             keyboard.shifted = true  // Capitalize next letter
             keyboard.lastSpaceTime = 0  // Reset to avoid triple-tap
+            keyboard.currentPredictions = []
+            Dictionary.endSentence()
             return
         }
         
@@ -407,6 +415,11 @@ Rectangle {
         inputContextInstance.insertText(" ")
         keyboard.keyPressed(" ")
         
+        // Suggest the next word
+        if (inputContextInstance.shouldShowPredictions) {
+            Dictionary.predictNext()
+        }
+        
         // Track space time for double-tap detection
         keyboard.lastSpaceTime = now
     }
@@ -420,6 +433,8 @@ Rectangle {
             Dictionary.learnWord(keyboard.currentWord)
             keyboard.currentWord = ""
         }
+        keyboard.currentPredictions = []
+        Dictionary.endSentence()
         
         // Auto-capitalize after newline - only if context allows
         if (!keyboard.capsLock && inputContextInstance.shouldAutoCapitalize) {
@@ -470,9 +485,12 @@ Rectangle {
         // Learn the word
         Dictionary.learnWord(word)
         
-        // Clear current word and predictions
+        // Clear current word and predictions, then suggest the next word
         keyboard.currentWord = ""
         keyboard.currentPredictions = []
+        if (inputContextInstance.shouldShowPredictions) {
+            Dictionary.predictNext()
+        }
         
         // Auto-capitalize after word completion (if context allows)
         if (!keyboard.capsLock && inputContextInstance.shouldAutoCapitalize) {
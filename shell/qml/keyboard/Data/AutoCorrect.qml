@@ -65,6 +65,15 @@ QtObject {
             return correction
         }
         
+        // Corrections WordEngine found while the word was typed, weighing
+        // typos by how close the keys are; like the fallback below, only
+        // ones within two edits are applied
+        var engineCorrection = Dictionary.correctionFor(word)
+        if (engineCorrection.length > 0) {
+            Logger.info("AutoCorrect", "Correcting '" + word + "' to '" + engineCorrection + "'")
+            return engineCorrection
+        }
+        
         // Check if word exists in dictionary
         if (!Dictionary.hasWord(lowerWord)) {
             // Try to find close matches using edit distance
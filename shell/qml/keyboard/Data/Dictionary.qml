@@ -60,6 +60,12 @@ Item {
     property var cachedPredictions: []
     property string lastPredictionPrefix: ""
     
+    // Corrections for the last word that is not in the dictionary
+    // (updated by WordEngine async, along with its predictions)
+    property string correctedWord: ""
+    property var cachedCorrections: []
+    property bool correctionConfident: false
+    
     // Connect to WordEngine predictions
     Connections {
         target: typeof WordEngine !== 'undefined' ? WordEngine : null
@@ -69,6 +75,11 @@ Item {
                 Logger.info("Dictionary", "Hunspell predictions for '" + prefix + "': " + predictions.join(", "))
             }
         }
+        function onCorrectionsReady(word, corrections, confident) {
+            dictionary.correctedWord = word
+            dictionary.cachedCorrections = corrections
+            dictionary.correctionConfident = confident
+        }
     }
     
     // Get predictions for a given prefix
@@ -132,6 +143,22 @@ Item {
         })
     }
     
+    // Request next-word predictions for after a space. They arrive through
+    // WordEngine.predictionsReady with an empty prefix.
+    function predictNext() {
+        if (typeof WordEngine !== 'undefined' && WordEngine !== null && WordEngine.enabled) {
+            dictionary.cachedPredictions = []
+            WordEngine.requestPredictions("", 3)
+        }
+    }
+    
+    // Mark the end of a sentence, so its last words do not predict the next one
+    function endSentence() {
+        if (typeof WordEngine !== 'undefined' && WordEngine !== null && WordEngine.enabled) {
+            WordEngine.endSentence()
+        }
+    }
+    
     // Learn a new word from user input
     function learnWord(word) {
         if (!word || word.length < 2) {
@@ -159,6 +186,28 @@ Item {
         Logger.info("Dictionary", "Learned word: " + word)
     }
     
+    // Remove a learned word, e.g. one learned by mistake
+    function forgetWord(word) {
+        if (typeof WordEngine !== 'undefined' && WordEngine !== null) {
+            WordEngine.forgetWord(word)
+        }
+        
+        userWords = userWords.filter(function(entry) {
+            return entry.word.toLowerCase() !== word.toLowerCase()
+        })
+        
+        Logger.info("Dictionary", "Forgot word: " + word)
+    }
+    
+    // Best correction WordEngine found for word, or "" if none is known
+    // or it is too far from word to apply without asking
+    function correctionFor(word) {
+        if (word === correctedWord && correctionConfident && cachedCorrections.length > 0) {
+            return cachedCorrections[0]
+        }
+        return ""
+    }
+    
     // Check if a word exists in dictionary
     function hasWord(word) {
         const lowerWord = word.toLowerCase()
@@ -0,0 +1,334 @@
+/*
+ * Marathon Virtual Keyboard - Hunspell Dictionary Reader Implementation
+ */
+
+#include "HunspellDictionary.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QStringConverter>
+#include <QStringList>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Hunspell's default when the .aff file has no SET line
+constexpr char DefaultEncoding[] = "ISO-8859-1";
+
+QByteArray affixEncoding(const QByteArray &aff)
+{
+    // Keywords are ASCII in every encoding Hunspell supports
+    for (const QByteArray &line : aff.split('\n')) {
+        const QByteArray trimmed = line.trimmed();
+        if (trimmed.startsWith("SET ")) {
+            return trimmed.mid(4).trimmed();
+        }
+    }
+    return DefaultEncoding;
+}
+
+QString decode(const QByteArray &data, const QByteArray &encoding)
+{
+    QStringDecoder decoder(encoding.constData());
+    if (!decoder.isValid()) {
+        qWarning() << "[HunspellDictionary] Unsupported encoding" << encoding << "- reading as Latin-1";
+        decoder = QStringDecoder(QStringDecoder::Latin1);
+    }
+    return decoder.decode(data);
+}
+
+inline bool hasFlag(const QVector<quint32> &flags, quint32 flag)
+{
+    return flag && flags.contains(flag);
+}
+
+} // namespace
+
+bool HunspellDictionary::read(const QString &basePath, const WordCallback &callback,
+                              const PartCallback &partCallback)
+{
+    QFile affFile(basePath + ".aff");
+    QFile dicFile(basePath + ".dic");
+    if (!affFile.open(QIODevice::ReadOnly) || !dicFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "[HunspellDictionary] Cannot read" << basePath;
+        return false;
+    }
+
+    m_flagType = FlagType::Char;
+    m_flagAliases.clear();
+    m_groups.clear();
+    m_needAffix = m_onlyInCompound = m_forbidden = 0;
+    m_compoundFlag = m_compoundBegin = m_compoundMiddle = m_compoundEnd = 0;
+    m_compoundMin = 3;
+    m_compoundWordMax = 0;
+
+    const QByteArray aff = affFile.readAll();
+    const QByteArray encoding = affixEncoding(aff);
+    parseAffixes(decode(aff, encoding));
+
+    // First line is the word count; then "word[/FLAGS][<tab>morphology]"
+    const QString dic = decode(dicFile.readAll(), encoding);
+    const QStringList lines = dic.split(QLatin1Char('\n'));
+    for (int i = 1; i < lines.size(); ++i) {
+        QStringView line(lines.at(i));
+        const qsizetype fieldEnd = line.indexOf(QLatin1Char('\t'));
+        if (fieldEnd >= 0) line = line.left(fieldEnd);
+        line = line.trimmed();
+        const qsizetype spaceAt = line.indexOf(QLatin1Char(' '));
+        if (spaceAt >= 0) line = line.left(spaceAt);
+        if (line.isEmpty()) continue;
+
+        const qsizetype slashAt = line.indexOf(QLatin1Char('/'));
+        const QString stem = line.left(slashAt >= 0 ? slashAt : line.size()).toString();
+        if (stem.isEmpty()) continue;
+
+        QVector<quint32> flags;
+        if (slashAt >= 0) {
+            flags = parseFlagsOrAlias(line.mid(slashAt + 1).toString());
+        }
+        expand(stem, flags, callback, partCallback);
+    }
+    return true;
+}
+
+void HunspellDictionary::parseAffixes(const QString &text)
+{
+    bool aliasCountSeen = false;
+
+    for (const QString &rawLine : text.split(QLatin1Char('\n'))) {
+        const QString line = rawLine.simplified();
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#'))) continue;
+
+        const QStringList fields = line.split(QLatin1Char(' '));
+        const QString &key = fields.at(0);
+        if (fields.size() < 2) continue;
+
+        if (key == QLatin1String("FLAG")) {
+            if (fields.at(1) == QLatin1String("long")) {
+                m_flagType = FlagType::Long;
+            } else if (fields.at(1) == QLatin1String("num")) {
+                m_flagType = FlagType::Number;
+            } else {
+                m_flagType = FlagType::Char; // Also "UTF-8": one character each
+            }
+        } else if (key == QLatin1String("AF")) {
+            // The first AF line only gives the table size
+            if (!aliasCountSeen) {
+                aliasCountSeen = true;
+            } else {
+                m_flagAliases.append(fields.at(1));
+            }
+        } else if (key == QLatin1String("NEEDAFFIX")) {
+            m_needAffix = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("ONLYINCOMPOUND")) {
+            m_onlyInCompound = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("FORBIDDENWORD")) {
+            m_forbidden = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("COMPOUNDFLAG")) {
+            m_compoundFlag = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("COMPOUNDBEGIN")) {
+            m_compoundBegin = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("COMPOUNDMIDDLE")) {
+            m_compoundMiddle = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("COMPOUNDEND") || key == QLatin1String("COMPOUNDLAST")) {
+            m_compoundEnd = parseFlags(fields.at(1)).value(0);
+        } else if (key == QLatin1String("COMPOUNDMIN")) {
+            m_compoundMin = std::max(1, fields.at(1).toInt());
+        } else if (key == QLatin1String("COMPOUNDWORDMAX")) {
+            m_compoundWordMax = std::max(0, fields.at(1).toInt());
+        } else if ((key == QLatin1String("PFX") || key == QLatin1String("SFX")) && fields.size() >= 4) {
+            const quint32 flag = parseFlags(fields.at(1)).value(0);
+            if (!flag) continue;
+
+            // "SFX A Y 3" opens a group, its rules follow:
+            // "SFX A strip append condition"
+            auto group = m_groups.find(flag);
+            if (group == m_groups.end()) {
+                AffixGroup header;
+                header.prefix = key == QLatin1String("PFX");
+                header.crossProduct = fields.at(2) == QLatin1String("Y");
+                m_groups.insert(flag, header);
+                continue;
+            }
+
+            Rule rule;
+            rule.strip = fields.at(2) == QLatin1String("0") ? QString() : fields.at(2);
+            QString append = fields.at(3);
+            const qsizetype slashAt = append.indexOf(QLatin1Char('/'));
+            if (slashAt >= 0) {
+                rule.continuation = parseFlagsOrAlias(append.mid(slashAt + 1));
+                append.truncate(slashAt);
+            }
+            rule.append = append == QLatin1String("0") ? QString() : append;
+            rule.condition = parseCondition(fields.size() > 4 ? fields.at(4) : QStringLiteral("."));
+            group->rules.append(rule);
+        }
+    }
+}
+
+QVector<quint32> HunspellDictionary::parseFlags(const QString &flags) const
+{
+    QVector<quint32> result;
+    switch (m_flagType) {
+    case FlagType::Char:
+        for (QChar ch : flags) {
+            result.append(ch.unicode());
+        }
+        break;
+    case FlagType::Long:
+        for (int i = 0; i + 1 < flags.size(); i += 2) {
+            result.append((quint32(flags.at(i).unicode()) << 16) | flags.at(i + 1).unicode());
+        }
+        break;
+    case FlagType::Number:
+        for (const QString &number : flags.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+            bool ok = false;
+            const quint32 flag = number.toUInt(&ok);
+            if (ok && flag) result.append(flag);
+        }
+        break;
+    }
+    return result;
+}
+
+QVector<quint32> HunspellDictionary::parseFlagsOrAlias(const QString &flags) const
+{
+    // With an AF table, flags are written as an index into it
+    bool isAlias = false;
+    const int alias = m_flagAliases.isEmpty() ? 0 : flags.toInt(&isAlias);
+    if (isAlias && alias >= 1 && alias <= m_flagAliases.size()) {
+        return parseFlags(m_flagAliases.at(alias - 1));
+    }
+    return parseFlags(flags);
+}
+
+QVector<HunspellDictionary::ConditionUnit> HunspellDictionary::parseCondition(const QString &condition)
+{
+    QVector<ConditionUnit> units;
+    if (condition == QLatin1String(".")) return units;
+
+    for (int i = 0; i < condition.size(); ++i) {
+        ConditionUnit unit;
+        const QChar ch = condition.at(i);
+        if (ch == QLatin1Char('[')) {
+            const int close = condition.indexOf(QLatin1Char(']'), i + 1);
+            if (close < 0) break;
+            QString set = condition.mid(i + 1, close - i - 1);
+            if (set.startsWith(QLatin1Char('^'))) {
+                unit.negated = true;
+                set.remove(0, 1);
+            }
+            unit.chars = set;
+            i = close;
+        } else if (ch != QLatin1Char('.')) {
+            unit.chars = QString(ch);
+        }
+        units.append(unit);
+    }
+    return units;
+}
+
+bool HunspellDictionary::matches(const Rule &rule, const QString &word, bool prefix)
+{
+    // Some of the word must survive the strip
+    if (word.size() <= rule.strip.size() || word.size() < rule.condition.size()) return false;
+    if (prefix ? !word.startsWith(rule.strip) : !word.endsWith(rule.strip)) return false;
+
+    // Prefix conditions apply to the start of the word, suffix ones to its end
+    const int offset = prefix ? 0 : word.size() - rule.condition.size();
+    for (int i = 0; i < rule.condition.size(); ++i) {
+        const ConditionUnit &unit = rule.condition.at(i);
+        if (!unit.chars.isEmpty() && unit.chars.contains(word.at(offset + i)) == unit.negated) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int HunspellDictionary::compoundPositions(const QVector<quint32> &flags) const
+{
+    int positions = 0;
+    if (hasFlag(flags, m_compoundFlag)) positions |= CompoundBegin | CompoundMiddle | CompoundEnd;
+    if (hasFlag(flags, m_compoundBegin)) positions |= CompoundBegin;
+    if (hasFlag(flags, m_compoundMiddle)) positions |= CompoundMiddle;
+    if (hasFlag(flags, m_compoundEnd)) positions |= CompoundEnd;
+    return positions;
+}
+
+void HunspellDictionary::report(const QString &word, bool stem, const QVector<quint32> &flags, int positions,
+                                const WordCallback &callback, const PartCallback &partCallback) const
+{
+    // flags are the stem's, or those the last affix added
+    if (hasFlag(flags, m_forbidden) || hasFlag(flags, m_needAffix)) return;
+
+    if (!hasFlag(flags, m_onlyInCompound)) {
+        callback(word, stem);
+    }
+
+    positions |= compoundPositions(flags);
+    if (m_compoundWordMax == 2) positions &= ~CompoundMiddle; // Two parts have no middle
+    if (positions && partCallback && word.size() >= m_compoundMin) {
+        partCallback(word, positions);
+    }
+}
+
+void HunspellDictionary::expand(const QString &stem, const QVector<quint32> &flags,
+                                const WordCallback &callback, const PartCallback &partCallback) const
+{
+    if (hasFlag(flags, m_forbidden)) return;
+    report(stem, true, flags, 0, callback, partCallback);
+
+    // Affixes on a compound part go on the outside: a suffix on its last
+    // part, a prefix on its first
+    const int positions = compoundPositions(flags);
+
+    // Suffixed forms that may also take a prefix
+    struct CrossForm {
+        QString text;
+        QVector<quint32> continuation;
+    };
+    QVector<CrossForm> crossForms;
+    for (quint32 flag : flags) {
+        const auto group = m_groups.constFind(flag);
+        if (group == m_groups.constEnd() || group->prefix) continue;
+
+        for (const Rule &rule : group->rules) {
+            if (!matches(rule, stem, false)) continue;
+            const QString form = stem.left(stem.size() - rule.strip.size()) + rule.append;
+            report(form, false, rule.continuation, positions & CompoundEnd, callback, partCallback);
+            if (group->crossProduct) crossForms.append({form, rule.continuation});
+
+            // A suffix's continuation flags may allow a second suffix
+            for (quint32 next : rule.continuation) {
+                const auto nextGroup = m_groups.constFind(next);
+                if (nextGroup == m_groups.constEnd() || nextGroup->prefix) continue;
+                for (const Rule &nextRule : nextGroup->rules) {
+                    if (!matches(nextRule, form, false)) continue;
+                    report(form.left(form.size() - nextRule.strip.size()) + nextRule.append, false,
+                           nextRule.continuation, positions & CompoundEnd, callback, partCallback);
+                }
+            }
+        }
+    }
+
+    for (quint32 flag : flags) {
+        const auto group = m_groups.constFind(flag);
+        if (group == m_groups.constEnd() || !group->prefix) continue;
+
+        for (const Rule &rule : group->rules) {
+            if (!matches(rule, stem, true)) continue;
+            report(rule.append + stem.mid(rule.strip.size()), false, rule.continuation,
+                   positions & CompoundBegin, callback, partCallback);
+            if (!group->crossProduct) continue;
+            for (const CrossForm &form : std::as_const(crossForms)) {
+                if (form.text.size() <= rule.strip.size() || !form.text.startsWith(rule.strip)) continue;
+                // Each affix is the other one the other may need
+                QVector<quint32> continuation = form.continuation + rule.continuation;
+                continuation.removeAll(m_needAffix);
+                report(rule.append + form.text.mid(rule.strip.size()), false, continuation, 0,
+                       callback, partCallback);
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Marathon Virtual Keyboard - Hunspell Dictionary Reader
+ * Expands Hunspell .aff/.dic files into plain word lists
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_HUNSPELLDICTIONARY_H
+#define MARATHON_HUNSPELLDICTIONARY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief Reader for Hunspell dictionaries
+ *
+ * Lists every word a dictionary accepts: each stem of the .dic file and
+ * the forms its prefix and suffix rules derive from it, including
+ * cross products of the two and a second suffix named by a suffix's
+ * continuation flags. This covers the affix subset keyboard dictionaries
+ * use (SET, FLAG, AF, PFX, SFX, NEEDAFFIX, ONLYINCOMPOUND, FORBIDDENWORD).
+ *
+ * Compounds cannot be listed, so the words they are made of are listed
+ * instead, with the places each may take in one (COMPOUNDFLAG,
+ * COMPOUNDBEGIN, COMPOUNDMIDDLE, COMPOUNDEND, COMPOUNDMIN,
+ * COMPOUNDWORDMAX). COMPOUNDRULE and the CHECKCOMPOUND* restrictions are
+ * not read.
+ *
+ * Reading a dictionary takes a while, so its output is meant to be
+ * cached (see WordLexicon) rather than read on every start.
+ */
+class HunspellDictionary
+{
+public:
+    // Places a word may take in a compound
+    enum CompoundPosition {
+        CompoundBegin = 0x1,
+        CompoundMiddle = 0x2,
+        CompoundEnd = 0x4,
+    };
+
+    // Called with every accepted word; `stem` is false for derived forms.
+    // A word may be reported more than once.
+    using WordCallback = std::function<void(const QString &word, bool stem)>;
+    // Called with every word that may be part of a compound, with the
+    // CompoundPosition values it may take. Words listed only in compounds
+    // (ONLYINCOMPOUND) are reported here but not to WordCallback.
+    using PartCallback = std::function<void(const QString &part, int positions)>;
+
+    /**
+     * @brief Read <basePath>.aff and <basePath>.dic
+     * @return false if either file cannot be read
+     */
+    bool read(const QString &basePath, const WordCallback &callback,
+              const PartCallback &partCallback = PartCallback());
+
+private:
+    enum class FlagType { Char, Long, Number };
+
+    // One character position of a rule condition: a set, "." or a literal
+    struct ConditionUnit {
+        QString chars; // Empty for "."
+        bool negated = false;
+    };
+
+    struct Rule {
+        QString strip;
+        QString append;
+        QVector<ConditionUnit> condition;
+        QVector<quint32> continuation; // Flags the derived form carries
+    };
+
+    struct AffixGroup {
+        bool prefix = false;
+        bool crossProduct = false;
+        QVector<Rule> rules;
+    };
+
+    void parseAffixes(const QString &text);
+    QVector<quint32> parseFlags(const QString &flags) const;
+    QVector<quint32> parseFlagsOrAlias(const QString &flags) const;
+    static QVector<ConditionUnit> parseCondition(const QString &condition);
+    static bool matches(const Rule &rule, const QString &word, bool prefix);
+    int compoundPositions(const QVector<quint32> &flags) const;
+    void report(const QString &word, bool stem, const QVector<quint32> &flags, int positions,
+                const WordCallback &callback, const PartCallback &partCallback) const;
+    void expand(const QString &stem, const QVector<quint32> &flags, const WordCallback &callback,
+                const PartCallback &partCallback) const;
+
+    FlagType m_flagType = FlagType::Char;
+    QVector<QString> m_flagAliases; // AF table, 1-based in .dic files
+    QHash<quint32, AffixGroup> m_groups;
+    quint32 m_needAffix = 0;
+    quint32 m_onlyInCompound = 0;
+    quint32 m_forbidden = 0;
+    quint32 m_compoundFlag = 0;
+    quint32 m_compoundBegin = 0;
+    quint32 m_compoundMiddle = 0;
+    quint32 m_compoundEnd = 0;
+    int m_compoundMin = 3; // Shortest part, Hunspell's default
+    int m_compoundWordMax = 0; // Most parts, 0 for any number
+};
+
+#endif // MARATHON_HUNSPELLDICTIONARY_H
@@ -0,0 +1,82 @@
+/*
+ * Marathon Virtual Keyboard - Keyboard Geometry Implementation
+ */
+
+#include "KeyboardGeometry.h"
+
+#include <QChar>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// A substitution is never free, however close the keys
+constexpr int MinSubstitutionCost = 2;
+
+char16_t baseLetter(char16_t unit)
+{
+    // "é" decomposes to "e" + combining accent
+    const QString decomposition = QChar(unit).decomposition();
+    return decomposition.isEmpty() ? unit : decomposition.at(0).toLower().unicode();
+}
+
+} // namespace
+
+KeyboardGeometry KeyboardGeometry::qwerty()
+{
+    // Measured in widths of a top-row key: the top row has ten keys across
+    // the keyboard, the middle row nine stretched across it, and the
+    // bottom row seven between a shift and a backspace key 1.5 wide. Keys
+    // are 45 px high under a 2 px separator, on a keyboard about 360 px
+    // wide in portrait, so rows are 1.3 key widths apart.
+    return KeyboardGeometry({
+                                { QStringLiteral("qwertyuiop"), 0.0, 1.0 },
+                                { QStringLiteral("asdfghjkl"), 0.0, 10.0 / 9.0 },
+                                { QStringLiteral("zxcvbnm"), 1.5, 1.0 },
+                            },
+                            1.3, 1.0);
+}
+
+KeyboardGeometry::KeyboardGeometry(const QVector<Row> &rows, qreal rowPitch, qreal keyPitch)
+{
+    struct Center {
+        qreal x = 0;
+        qreal y = 0;
+        bool placed = false;
+    };
+    Center centers[LetterCount];
+
+    for (int r = 0; r < rows.size(); ++r) {
+        const Row &row = rows.at(r);
+        for (int k = 0; k < row.letters.size(); ++k) {
+            const char16_t unit = row.letters.at(k).toLower().unicode();
+            if (!isLetter(unit)) continue;
+            centers[unit - 'a'] = { row.left + (k + 0.5) * row.keyWidth, r * rowPitch, true };
+        }
+    }
+
+    for (int a = 0; a < LetterCount; ++a) {
+        for (int b = 0; b < LetterCount; ++b) {
+            if (a == b) {
+                m_costs[a][b] = 0;
+            } else if (!centers[a].placed || !centers[b].placed) {
+                m_costs[a][b] = EditCost;
+            } else {
+                const qreal distance = std::hypot(centers[a].x - centers[b].x, centers[a].y - centers[b].y);
+                const int cost = int(std::lround(NeighbourCost * distance / keyPitch));
+                m_costs[a][b] = quint8(std::clamp(cost, MinSubstitutionCost, EditCost));
+            }
+        }
+    }
+}
+
+int KeyboardGeometry::accentedCost(char16_t typed, char16_t intended) const
+{
+    const char16_t typedBase = baseLetter(typed);
+    const char16_t intendedBase = baseLetter(intended);
+    if (typedBase == intendedBase) return AccentCost;
+    if (isLetter(typedBase) && isLetter(intendedBase)) {
+        return std::min(EditCost, m_costs[typedBase - 'a'][intendedBase - 'a'] + AccentCost);
+    }
+    return EditCost;
+}
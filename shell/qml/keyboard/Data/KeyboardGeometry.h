@@ -0,0 +1,72 @@
+/*
+ * Marathon Virtual Keyboard - Keyboard Geometry
+ * Typing error costs from where the keys are
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_KEYBOARDGEOMETRY_H
+#define MARATHON_KEYBOARDGEOMETRY_H
+
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Edit costs for correcting words typed on a touch keyboard
+ *
+ * Hitting a neighbouring key is the most common typo, so substituting a
+ * letter costs less the closer its key is to the one typed. Inserting,
+ * deleting or swapping a letter costs a full edit (EditCost), and so does
+ * substituting one whose key is far away. An accented letter shares the
+ * key of its base letter (it is a long press away) and costs AccentCost.
+ */
+class KeyboardGeometry
+{
+public:
+    static constexpr int EditCost = 8;
+    static constexpr int AccentCost = 1;
+    static constexpr int NeighbourCost = 3;
+
+    // Equally wide letter keys side by side, measured in some unit
+    struct Row {
+        QString letters;
+        qreal left;     // Left edge of the first key
+        qreal keyWidth;
+    };
+
+    /**
+     * @brief Keys laid out like Layouts/QwertyLayout.qml
+     */
+    static KeyboardGeometry qwerty();
+
+    /**
+     * @param rows Top first. Letters on no row cost EditCost.
+     * @param rowPitch Distance between rows
+     * @param keyPitch Distance between neighbouring keys; substituting
+     *        a letter costs NeighbourCost per keyPitch its key is away
+     */
+    KeyboardGeometry(const QVector<Row> &rows, qreal rowPitch, qreal keyPitch);
+
+    /**
+     * @brief Cost of typing `typed` where `intended` was meant
+     *
+     * Both must be lowercase. Cheap for ASCII, which is nearly all of it.
+     */
+    int substitutionCost(char16_t typed, char16_t intended) const
+    {
+        if (typed == intended) return 0;
+        if (isLetter(typed) && isLetter(intended)) return m_costs[typed - 'a'][intended - 'a'];
+        if (typed < 0x80 && intended < 0x80) return EditCost;
+        return accentedCost(typed, intended);
+    }
+
+private:
+    static constexpr int LetterCount = 26;
+
+    static bool isLetter(char16_t unit) { return unit >= 'a' && unit <= 'z'; }
+    int accentedCost(char16_t typed, char16_t intended) const;
+
+    quint8 m_costs[LetterCount][LetterCount];
+};
+
+#endif // MARATHON_KEYBOARDGEOMETRY_H
@@ -0,0 +1,83 @@
+/*
+ * Marathon Virtual Keyboard - Mapped Image Implementation
+ */
+
+#include "MappedImage.h"
+
+#include <algorithm>
+#include <cstring>
+
+MappedImage::MappedImage()
+    : m_data(nullptr)
+    , m_size(0)
+{
+}
+
+MappedImage::~MappedImage()
+{
+    release();
+}
+
+bool MappedImage::open(const QString &path, const char *magic, quint32 version, quint64 stamp,
+                       qint64 headerSize)
+{
+    release();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data && m_size > 0) {
+        // Not mappable (some filesystems); a private copy still works
+        m_buffer = m_file.readAll();
+        m_file.close();
+        m_size = m_buffer.size();
+        m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+    }
+
+    if (!m_data || !check(magic, version, &stamp, headerSize)) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+bool MappedImage::setImage(const QByteArray &image, const char *magic, quint32 version,
+                           qint64 headerSize)
+{
+    release();
+    m_buffer = image;
+    m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+    m_size = m_buffer.size();
+
+    // The stamp was checked by whoever built the image
+    if (!check(magic, version, nullptr, headerSize)) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+void MappedImage::release()
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_buffer.clear();
+    if (m_file.isOpen()) {
+        m_file.close(); // Also unmaps
+    }
+}
+
+bool MappedImage::check(const char *magic, quint32 version, const quint64 *stamp,
+                        qint64 headerSize) const
+{
+    if (m_size < std::max<qint64>(headerSize, sizeof(Header))) return false;
+
+    Header header;
+    std::memcpy(&header, m_data, sizeof(Header));
+    return std::memcmp(header.magic, magic, 4) == 0 && header.version == version
+           && (!stamp || header.stamp == *stamp);
+}
@@ -0,0 +1,66 @@
+/*
+ * Marathon Virtual Keyboard - Mapped Image
+ * Cache image files shared through the page cache
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_MAPPEDIMAGE_H
+#define MARATHON_MAPPEDIMAGE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+/**
+ * @brief A read-only image, memory-mapped from a cache file or held in memory
+ *
+ * Images start with a Header: a magic, a format version and the stamp of
+ * the sources they were built from. Opening one checks those and that the
+ * image is at least as large as the format's full header; the format
+ * checks the rest. A file that cannot be mapped is read into memory.
+ */
+class MappedImage
+{
+public:
+    struct Header {
+        char magic[4];
+        quint32 version;
+        quint64 stamp;
+    };
+
+    MappedImage();
+    ~MappedImage();
+
+    MappedImage(const MappedImage &) = delete;
+    MappedImage &operator=(const MappedImage &) = delete;
+
+    /**
+     * @brief Map an image file
+     * @param headerSize Size of the format's header, Header included
+     * @return false if the file is missing, too small, or has another
+     *         magic, version or stamp
+     */
+    bool open(const QString &path, const char *magic, quint32 version, quint64 stamp,
+              qint64 headerSize);
+
+    /**
+     * @brief Use an image held in memory; its stamp is not checked
+     */
+    bool setImage(const QByteArray &image, const char *magic, quint32 version, qint64 headerSize);
+
+    void release();
+
+    const uchar *data() const { return m_data; }
+    qint64 size() const { return m_size; }
+
+private:
+    bool check(const char *magic, quint32 version, const quint64 *stamp, qint64 headerSize) const;
+
+    QFile m_file; // Kept open while mapped
+    QByteArray m_buffer; // Backing store when not mapped
+    const uchar *m_data;
+    qint64 m_size;
+};
+
+#endif // MARATHON_MAPPEDIMAGE_H
@@ -0,0 +1,425 @@
+/*
+ * Marathon Virtual Keyboard - N-gram Model Implementation
+ */
+
+#include "NGramModel.h"
+
+#include <QDebug>
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr quint32 MaxWordId = (1u << 24) - 1;
+
+quint32 entryWord(quint32 entry)
+{
+    return entry >> 8;
+}
+
+int entryLevel(quint32 entry)
+{
+    return int(entry & 0xFF);
+}
+
+bool lessIgnoringCase(const QString &a, const QString &b)
+{
+    return QString::compare(a, b, Qt::CaseInsensitive) < 0;
+}
+
+// One context's followers (word id, count) as entries, most likely first
+void appendEntries(QVector<quint32> *entries, const QVector<QPair<quint32, quint32>> &followers, int steps)
+{
+    quint64 total = 0;
+    for (const auto &follower : followers) total += follower.second;
+
+    const int begin = entries->size();
+    for (const auto &follower : followers) {
+        const double p = double(follower.second) / double(total);
+        const int level = std::clamp(int(std::lround(-std::log2(p) * steps)), 0, 255);
+        entries->append((follower.first << 8) | quint32(level));
+    }
+    // Level is in the low byte: sort by it, ties in word order
+    std::sort(entries->begin() + begin, entries->end(), [](quint32 a, quint32 b) {
+        return std::make_pair(entryLevel(a), a) < std::make_pair(entryLevel(b), b);
+    });
+}
+
+template<typename T>
+void appendArray(QByteArray *image, const T *data, qsizetype count)
+{
+    image->append(reinterpret_cast<const char *>(data), count * qsizetype(sizeof(T)));
+}
+
+} // namespace
+
+NGramModel::NGramModel()
+    : m_vocabularySize(0)
+    , m_wordOffsets(nullptr)
+    , m_text(nullptr)
+    , m_bigramBegin(nullptr)
+    , m_bigrams(nullptr)
+    , m_trigramContextCount(0)
+    , m_trigramContexts(nullptr)
+    , m_trigrams(nullptr)
+{
+}
+
+NGramModel::~NGramModel()
+{
+    clear();
+}
+
+void NGramModel::clear()
+{
+    m_vocabularySize = 0;
+    m_wordOffsets = nullptr;
+    m_text = nullptr;
+    m_bigramBegin = nullptr;
+    m_bigrams = nullptr;
+    m_trigramContextCount = 0;
+    m_trigramContexts = nullptr;
+    m_trigrams = nullptr;
+    m_learned.clear();
+    m_image.release();
+}
+
+NGramModel::Counts NGramModel::count(const QVector<QStringList> &sentences)
+{
+    Counts counts;
+    for (const QStringList &sentence : sentences) {
+        for (int i = 1; i < sentence.size(); ++i) {
+            counts[sentence.mid(i - 1, 2)]++;
+            if (i >= 2) counts[sentence.mid(i - 2, 3)]++;
+        }
+    }
+    return counts;
+}
+
+QByteArray NGramModel::build(const QVector<QStringList> &sentences, quint64 stamp)
+{
+    return build(count(sentences), stamp);
+}
+
+QByteArray NGramModel::build(const Counts &counts, quint64 stamp)
+{
+    // One id per word ignoring case, spelled as most often written
+    QHash<QString, QPair<QString, quint32>> spelling;
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        for (const QString &word : it.key()) {
+            QPair<QString, quint32> &best = spelling[word.toCaseFolded()];
+            if (it.value() > best.second || (it.value() == best.second && word < best.first)) {
+                best = qMakePair(word, it.value());
+            }
+        }
+    }
+    QStringList vocabulary;
+    vocabulary.reserve(spelling.size());
+    for (const auto &best : std::as_const(spelling)) {
+        vocabulary.append(best.first);
+    }
+    std::sort(vocabulary.begin(), vocabulary.end(), lessIgnoringCase);
+    if (vocabulary.size() > qsizetype(MaxWordId)) {
+        qWarning() << "[NGramModel] Vocabulary too large, dropping" << vocabulary.size() - MaxWordId << "words";
+        vocabulary.resize(MaxWordId);
+    }
+
+    QHash<QString, quint32> ids;
+    for (int i = 0; i < vocabulary.size(); ++i) {
+        ids.insert(vocabulary.at(i).toCaseFolded(), quint32(i));
+    }
+
+    // Case variants of a sequence add up
+    using Bigram = std::tuple<quint32, quint32>;
+    using Trigram = std::tuple<quint32, quint32, quint32>;
+    std::map<Bigram, quint32> bigramCounts;
+    std::map<Trigram, quint32> trigramCounts;
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        const QStringList &words = it.key();
+        if (words.size() != 2 && words.size() != 3) continue;
+        quint32 sequence[3];
+        bool known = true;
+        for (int i = 0; i < words.size() && known; ++i) {
+            const auto id = ids.constFind(words.at(i).toCaseFolded());
+            known = id != ids.constEnd();
+            if (known) sequence[i] = *id;
+        }
+        if (!known) continue;
+        if (words.size() == 2) {
+            bigramCounts[Bigram(sequence[0], sequence[1])] += it.value();
+        } else {
+            trigramCounts[Trigram(sequence[0], sequence[1], sequence[2])] += it.value();
+        }
+    }
+
+    // Maps iterate in key order, so each context's followers are adjacent
+    QVector<quint32> bigrams;
+    QVector<quint32> bigramBegin(vocabulary.size() + 1, 0);
+    for (auto it = bigramCounts.cbegin(); it != bigramCounts.cend();) {
+        const quint32 first = std::get<0>(it->first);
+        QVector<QPair<quint32, quint32>> followers;
+        for (; it != bigramCounts.cend() && std::get<0>(it->first) == first; ++it) {
+            followers.append(qMakePair(std::get<1>(it->first), it->second));
+        }
+        bigramBegin[first + 1] = followers.size();
+        appendEntries(&bigrams, followers, QuantSteps);
+    }
+    for (int i = 0; i < vocabulary.size(); ++i) {
+        bigramBegin[i + 1] += bigramBegin[i]; // Counts to offsets
+    }
+
+    QVector<quint32> trigrams;
+    QVector<TrigramContext> trigramContexts;
+    for (auto it = trigramCounts.cbegin(); it != trigramCounts.cend();) {
+        const quint32 first = std::get<0>(it->first);
+        const quint32 second = std::get<1>(it->first);
+        QVector<QPair<quint32, quint32>> followers;
+        for (; it != trigramCounts.cend() && std::get<0>(it->first) == first
+               && std::get<1>(it->first) == second; ++it) {
+            followers.append(qMakePair(std::get<2>(it->first), it->second));
+        }
+        trigramContexts.append({ first, second, quint32(trigrams.size()) });
+        appendEntries(&trigrams, followers, QuantSteps);
+    }
+    const quint32 trigramContextCount = trigramContexts.size();
+    trigramContexts.append({ 0, 0, quint32(trigrams.size()) });
+
+    QVector<quint32> wordOffsets;
+    QVector<char16_t> text;
+    wordOffsets.reserve(vocabulary.size() + 1);
+    for (const QString &word : std::as_const(vocabulary)) {
+        wordOffsets.append(text.size());
+        text.append(reinterpret_cast<const char16_t *>(word.constData()), word.size());
+    }
+    wordOffsets.append(text.size());
+    if (text.size() % 2) text.append(0); // Keeps what follows 4-byte aligned
+
+    Header header;
+    std::memcpy(header.magic, "MNGR", 4);
+    header.version = Version;
+    header.stamp = stamp;
+    header.vocabularySize = vocabulary.size();
+    header.textSize = text.size();
+    header.bigramCount = bigrams.size();
+    header.trigramContextCount = trigramContextCount;
+    header.trigramCount = trigrams.size();
+    header.reserved = 0;
+
+    QByteArray image;
+    appendArray(&image, &header, 1);
+    appendArray(&image, wordOffsets.constData(), wordOffsets.size());
+    appendArray(&image, text.constData(), text.size());
+    appendArray(&image, bigramBegin.constData(), bigramBegin.size());
+    appendArray(&image, bigrams.constData(), bigrams.size());
+    appendArray(&image, trigramContexts.constData(), trigramContexts.size());
+    appendArray(&image, trigrams.constData(), trigrams.size());
+    return image;
+}
+
+bool NGramModel::load(const QString &path, quint64 stamp)
+{
+    clear();
+    if (!m_image.open(path, "MNGR", Version, stamp, sizeof(Header))
+        || !attach(m_image.data(), m_image.size())) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool NGramModel::setImage(const QByteArray &image)
+{
+    clear();
+    if (!m_image.setImage(image, "MNGR", Version, sizeof(Header))
+        || !attach(m_image.data(), m_image.size())) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool NGramModel::attach(const uchar *data, qint64 size)
+{
+    // MappedImage checked the magic, version, stamp and header size
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (header.textSize % 2 || header.vocabularySize > MaxWordId) {
+        return false;
+    }
+
+    const qint64 expected = qint64(sizeof(Header))
+        + (qint64(header.vocabularySize) + 1) * 4 // Word offsets
+        + qint64(header.textSize) * 2
+        + (qint64(header.vocabularySize) + 1) * 4 // Bigram ranges
+        + qint64(header.bigramCount) * 4
+        + (qint64(header.trigramContextCount) + 1) * qint64(sizeof(TrigramContext))
+        + qint64(header.trigramCount) * 4;
+    if (expected > size) return false;
+
+    const uchar *p = data + sizeof(Header);
+    auto take = [&p](qint64 bytes) {
+        const uchar *section = p;
+        p += bytes;
+        return section;
+    };
+    const quint32 *wordOffsets = reinterpret_cast<const quint32 *>(take((qint64(header.vocabularySize) + 1) * 4));
+    const char16_t *text = reinterpret_cast<const char16_t *>(take(qint64(header.textSize) * 2));
+    const quint32 *bigramBegin = reinterpret_cast<const quint32 *>(take((qint64(header.vocabularySize) + 1) * 4));
+    const quint32 *bigrams = reinterpret_cast<const quint32 *>(take(qint64(header.bigramCount) * 4));
+    const TrigramContext *trigramContexts = reinterpret_cast<const TrigramContext *>(
+        take((qint64(header.trigramContextCount) + 1) * qint64(sizeof(TrigramContext))));
+    const quint32 *trigrams = reinterpret_cast<const quint32 *>(take(qint64(header.trigramCount) * 4));
+
+    // A damaged cache must not send lookups out of bounds
+    bool valid = wordOffsets[0] == 0 && bigramBegin[0] == 0 && trigramContexts[0].begin == 0
+        && wordOffsets[header.vocabularySize] <= header.textSize
+        && bigramBegin[header.vocabularySize] == header.bigramCount
+        && trigramContexts[header.trigramContextCount].begin == header.trigramCount;
+    for (quint32 i = 0; valid && i < header.vocabularySize; ++i) {
+        valid = wordOffsets[i] <= wordOffsets[i + 1] && bigramBegin[i] <= bigramBegin[i + 1];
+    }
+    for (quint32 i = 0; valid && i < header.trigramContextCount; ++i) {
+        valid = trigramContexts[i].begin <= trigramContexts[i + 1].begin
+            && trigramContexts[i].first < header.vocabularySize
+            && trigramContexts[i].second < header.vocabularySize;
+    }
+    for (quint32 i = 0; valid && i < header.bigramCount; ++i) {
+        valid = entryWord(bigrams[i]) < header.vocabularySize;
+    }
+    for (quint32 i = 0; valid && i < header.trigramCount; ++i) {
+        valid = entryWord(trigrams[i]) < header.vocabularySize;
+    }
+    if (!valid) {
+        qWarning() << "[NGramModel] Corrupt model image";
+        return false;
+    }
+
+    m_vocabularySize = header.vocabularySize;
+    m_wordOffsets = wordOffsets;
+    m_text = text;
+    m_bigramBegin = bigramBegin;
+    m_bigrams = bigrams;
+    m_trigramContextCount = header.trigramContextCount;
+    m_trigramContexts = trigramContexts;
+    m_trigrams = trigrams;
+    return true;
+}
+
+QStringView NGramModel::word(quint32 id) const
+{
+    return QStringView(m_text + m_wordOffsets[id], qsizetype(m_wordOffsets[id + 1] - m_wordOffsets[id]));
+}
+
+int NGramModel::wordId(QStringView word) const
+{
+    int low = 0;
+    int high = int(m_vocabularySize);
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const int order = this->word(middle).compare(word, Qt::CaseInsensitive);
+        if (order == 0) return middle;
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+void NGramModel::learn(const QStringList &context, const QString &word)
+{
+    if (word.isEmpty()) return;
+
+    for (int length = 1; length <= 2 && length <= context.size(); ++length) {
+        m_learned[contextKey(context, length)][word]++;
+    }
+}
+
+QString NGramModel::contextKey(const QStringList &context, int length)
+{
+    return context.mid(context.size() - length).join(QLatin1Char('\n')).toCaseFolded();
+}
+
+void NGramModel::addCandidate(const QString &word, double probability, QVector<Candidate> *candidates)
+{
+    for (Candidate &candidate : *candidates) {
+        if (QString::compare(candidate.word, word, Qt::CaseInsensitive) == 0) {
+            candidate.probability = std::max(candidate.probability, probability);
+            return;
+        }
+    }
+    candidates->append({ word, probability });
+}
+
+void NGramModel::collect(const quint32 *begin, const quint32 *end, double weight, const QString &prefix,
+                         int limit, QVector<Candidate> *candidates) const
+{
+    // Entries are sorted most likely first, so stop after `limit` matches
+    for (const quint32 *entry = begin; entry != end && limit > 0; ++entry) {
+        const QStringView text = word(entryWord(*entry));
+        if (text.startsWith(prefix, Qt::CaseInsensitive)) {
+            const double probability = std::exp2(-double(entryLevel(*entry)) / QuantSteps);
+            addCandidate(text.toString(), weight * probability, candidates);
+            limit--;
+        }
+    }
+}
+
+QStringList NGramModel::predict(const QStringList &context, const QString &prefix, int maxResults) const
+{
+    QStringList results;
+    if (context.isEmpty() || maxResults <= 0) return results;
+
+    QVector<Candidate> candidates;
+
+    // Trigrams, then bigrams backed off by a constant weight
+    for (int length = 2; length >= 1; --length) {
+        if (context.size() < length) continue;
+        const double weight = length == 2 ? 1.0 : Backoff;
+
+        if (isValid()) {
+            const int second = wordId(context.last());
+            const int first = length == 2 ? wordId(context.at(context.size() - 2)) : -1;
+            if (length == 1 && second >= 0) {
+                collect(m_bigrams + m_bigramBegin[second], m_bigrams + m_bigramBegin[second + 1],
+                        weight, prefix, maxResults, &candidates);
+            } else if (length == 2 && first >= 0 && second >= 0) {
+                const TrigramContext *end = m_trigramContexts + m_trigramContextCount;
+                const TrigramContext *found = std::lower_bound(
+                    m_trigramContexts, end, std::make_pair(quint32(first), quint32(second)),
+                    [](const TrigramContext &c, const std::pair<quint32, quint32> &key) {
+                        return std::make_pair(c.first, c.second) < key;
+                    });
+                if (found != end && found->first == quint32(first) && found->second == quint32(second)) {
+                    collect(m_trigrams + found->begin, m_trigrams + (found + 1)->begin,
+                            weight, prefix, maxResults, &candidates);
+                }
+            }
+        }
+
+        const auto learned = m_learned.constFind(contextKey(context, length));
+        if (learned != m_learned.constEnd()) {
+            int total = 0;
+            for (int count : *learned) total += count;
+            for (auto it = learned->constBegin(); it != learned->constEnd(); ++it) {
+                if (it.key().startsWith(prefix, Qt::CaseInsensitive)) {
+                    addCandidate(it.key(), weight * it.value() / total, &candidates);
+                }
+            }
+        }
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.probability > b.probability;
+    });
+    for (int i = 0; i < candidates.size() && i < maxResults; ++i) {
+        results.append(candidates.at(i).word);
+    }
+    return results;
+}
@@ -0,0 +1,134 @@
+/*
+ * Marathon Virtual Keyboard - N-gram Model
+ * Next-word prediction from bigram and trigram statistics
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_NGRAMMODEL_H
+#define MARATHON_NGRAMMODEL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "MappedImage.h"
+
+/**
+ * @brief Bigram/trigram language model answering top-k next-word queries
+ *
+ * The model is an image with no pointers, built once from sentences,
+ * written to a cache file and memory-mapped on later loads. Words are
+ * numbered in case-insensitive order; for each context (one or two
+ * words) the following words are stored as 32-bit entries, a 24-bit word
+ * id and an 8-bit quantized log probability, sorted most likely first.
+ * Top-k is then a prefix of the context's list.
+ *
+ * Counts learned after the image was built are kept in a small overlay
+ * until the next rebuild. Contexts are matched ignoring case; words come
+ * out as they were most often written.
+ */
+class NGramModel
+{
+public:
+    NGramModel();
+    ~NGramModel();
+
+    NGramModel(const NGramModel &) = delete;
+    NGramModel &operator=(const NGramModel &) = delete;
+
+    // Occurrences of two- and three-word sequences, as written
+    using Counts = QHash<QStringList, quint32>;
+
+    /**
+     * @brief Count the sequences of sentences
+     * @param sentences Words in the order they were written
+     */
+    static Counts count(const QVector<QStringList> &sentences);
+
+    /**
+     * @brief Serialize n-gram counts into a model image
+     * @param stamp Identifies the sources, checked again by load()
+     */
+    static QByteArray build(const Counts &counts, quint64 stamp);
+    static QByteArray build(const QVector<QStringList> &sentences, quint64 stamp);
+
+    /**
+     * @brief Map a model image file
+     * @return false if the file is missing, corrupt or has another stamp
+     */
+    bool load(const QString &path, quint64 stamp);
+
+    /**
+     * @brief Use an image held in memory (e.g. when no cache is writable)
+     */
+    bool setImage(const QByteArray &image);
+
+    void clear();
+    bool isValid() const { return m_wordOffsets != nullptr; }
+    int vocabularySize() const { return int(m_vocabularySize); }
+
+    /**
+     * @brief Count word as following context (its last two words matter)
+     */
+    void learn(const QStringList &context, const QString &word);
+
+    /**
+     * @brief Most likely words after context starting with prefix
+     * @param prefix Filter, ignoring case; empty for any word
+     * @return Up to maxResults words, best first
+     */
+    QStringList predict(const QStringList &context, const QString &prefix, int maxResults) const;
+
+private:
+    struct Header {
+        char magic[4];
+        quint32 version;
+        quint64 stamp;
+        quint32 vocabularySize;
+        quint32 textSize; // UTF-16 code units, padded to an even count
+        quint32 bigramCount;
+        quint32 trigramContextCount;
+        quint32 trigramCount;
+        quint32 reserved;
+    };
+
+    struct TrigramContext {
+        quint32 first;
+        quint32 second;
+        quint32 begin; // Into the trigram entries; ends where the next begins
+    };
+
+    struct Candidate {
+        QString word;
+        double probability;
+    };
+
+    static constexpr quint32 Version = 1;
+    static constexpr int QuantSteps = 16; // Per halving of probability
+    static constexpr double Backoff = 0.4; // Weight of bigrams next to trigrams
+
+    bool attach(const uchar *data, qint64 size);
+    QStringView word(quint32 id) const;
+    int wordId(QStringView word) const;
+    void collect(const quint32 *begin, const quint32 *end, double weight, const QString &prefix,
+                 int limit, QVector<Candidate> *candidates) const;
+    static void addCandidate(const QString &word, double probability, QVector<Candidate> *candidates);
+    static QString contextKey(const QStringList &context, int length);
+
+    MappedImage m_image;
+    quint32 m_vocabularySize;
+    const quint32 *m_wordOffsets; // vocabularySize + 1 offsets into m_text
+    const char16_t *m_text;
+    const quint32 *m_bigramBegin; // vocabularySize + 1 offsets into m_bigrams
+    const quint32 *m_bigrams;
+    quint32 m_trigramContextCount;
+    const TrigramContext *m_trigramContexts; // Plus an end sentinel
+    const quint32 *m_trigrams;
+
+    // Learned since the image was built: context key -> word -> count
+    QHash<QString, QHash<QString, int>> m_learned;
+};
+
+#endif // MARATHON_NGRAMMODEL_H
@@ -0,0 +1,346 @@
+/*
+ * Marathon Virtual Keyboard - User Dictionary Implementation
+ */
+
+#include "UserDictionary.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
+
+namespace {
+
+// Before every record: payload length, then its CRC-16
+constexpr int RecordHeaderSize = 6;
+constexpr int JournalHeaderSize = 8;
+
+} // namespace
+
+UserDictionary::UserDictionary(const QString &basePath)
+    : m_basePath(basePath)
+    , m_changeCount(0)
+    , m_foldedSequence(0)
+    , m_sequence(1)
+    , m_journalBytes(0)
+{
+}
+
+QString UserDictionary::journalPath(const QString &basePath, quint64 sequence)
+{
+    return basePath + ".journal." + QString::number(sequence);
+}
+
+QList<quint64> UserDictionary::journalSequences(const QString &basePath)
+{
+    const QFileInfo base(basePath);
+    const QString prefix = base.fileName() + ".journal.";
+
+    QList<quint64> sequences;
+    const QStringList names = base.dir().entryList({ prefix + "*" }, QDir::Files);
+    for (const QString &name : names) {
+        bool ok = false;
+        const quint64 sequence = name.mid(prefix.size()).toULongLong(&ok);
+        if (ok) sequences.append(sequence);
+    }
+    std::sort(sequences.begin(), sequences.end());
+    return sequences;
+}
+
+void UserDictionary::load(const QString &legacyPath)
+{
+    m_words.clear();
+    m_sequences.clear();
+    m_changeCount = 0;
+    m_foldedSequence = 0;
+    m_journalBytes = 0;
+    m_pending.clear();
+    m_files.clear();
+    m_journal.close();
+
+    QDir().mkpath(QFileInfo(m_basePath).absolutePath());
+
+    const bool haveSnapshot = readSnapshot();
+    const QList<quint64> sequences = journalSequences(m_basePath);
+
+    if (!haveSnapshot && sequences.isEmpty() && QFile::exists(legacyPath)) {
+        importLegacy(legacyPath);
+        Compaction compaction;
+        compaction.basePath = m_basePath;
+        compaction.words = m_words;
+        compaction.sequences = m_sequences;
+        if (compact(compaction)) {
+            m_files.append(snapshotPath(m_basePath));
+        }
+    }
+
+    quint64 lastSequence = m_foldedSequence;
+    bool lastReadable = true;
+    for (quint64 sequence : sequences) {
+        if (sequence <= m_foldedSequence) {
+            // Folded by a compaction that stopped before deleting it
+            QFile::remove(journalPath(m_basePath, sequence));
+        } else {
+            lastReadable = replayJournal(sequence);
+            lastSequence = sequence;
+        }
+    }
+
+    // Keep appending to the newest journal. One that cannot be read would
+    // hide whatever is appended to it, so start the next one instead; the
+    // unreadable one is deleted by the next compaction.
+    m_sequence = std::max(lastReadable ? lastSequence : lastSequence + 1, m_foldedSequence + 1);
+
+    qDebug() << "[UserDictionary] Loaded" << m_words.size() << "words and" << m_sequences.size()
+             << "sequences," << m_journalBytes << "journal bytes";
+}
+
+bool UserDictionary::readSnapshot()
+{
+    QFile file(snapshotPath(m_basePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint64 folded = 0;
+    Words words;
+    NGramModel::Counts sequences;
+    stream >> magic >> version >> folded >> words >> sequences;
+    if (stream.status() != QDataStream::Ok || magic != SnapshotMagic || version != Version) {
+        qWarning() << "[UserDictionary] Ignoring unreadable snapshot" << file.fileName();
+        return false;
+    }
+
+    m_words = std::move(words);
+    m_sequences = std::move(sequences);
+    m_foldedSequence = folded;
+    m_files.append(file.fileName());
+    return true;
+}
+
+bool UserDictionary::replayJournal(quint64 sequence)
+{
+    QFile file(journalPath(m_basePath, sequence));
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    if (data.size() < JournalHeaderSize || qFromLittleEndian<quint32>(data.constData()) != JournalMagic
+        || qFromLittleEndian<quint32>(data.constData() + 4) != Version) {
+        qWarning() << "[UserDictionary] Ignoring unreadable journal" << file.fileName();
+        return false;
+    }
+
+    qsizetype pos = JournalHeaderSize;
+    while (pos + RecordHeaderSize <= data.size()) {
+        const quint32 length = qFromLittleEndian<quint32>(data.constData() + pos);
+        const quint16 checksum = qFromLittleEndian<quint16>(data.constData() + pos + 4);
+        if (length > quint32(data.size() - pos - RecordHeaderSize)) break;
+        const QByteArray payload = data.mid(pos + RecordHeaderSize, length);
+        if (qChecksum(payload) != checksum) break;
+
+        QDataStream stream(payload);
+        stream.setVersion(QDataStream::Qt_6_0);
+        quint8 type = 0;
+        QString word;
+        QStringList context;
+        qint32 delta = 0;
+        stream >> type >> word >> context >> delta;
+        if (stream.status() == QDataStream::Ok) {
+            apply(EventType(type), word, context, delta);
+        }
+        pos += RecordHeaderSize + length;
+    }
+
+    // Drop a record torn by a crash, so that appends after it stay readable
+    if (pos < data.size()) {
+        qWarning() << "[UserDictionary] Truncating journal" << file.fileName() << "at" << pos << "of" << data.size();
+        file.resize(pos);
+    }
+
+    m_journalBytes += pos;
+    m_files.append(file.fileName());
+    return true;
+}
+
+void UserDictionary::importLegacy(const QString &path)
+{
+    // One word per line, in the order written, a blank line after each sentence
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+
+    QTextStream stream(&file);
+    QStringList context;
+    while (!stream.atEnd()) {
+        const QString word = stream.readLine().trimmed();
+        if (word.isEmpty()) {
+            context.clear();
+            continue;
+        }
+        apply(Learn, word, context, 0);
+        context.append(word);
+        if (context.size() > 2) context.removeFirst();
+    }
+
+    qDebug() << "[UserDictionary] Imported" << m_words.size() << "words from" << path;
+}
+
+void UserDictionary::learn(const QString &word, const QStringList &context)
+{
+    record(Learn, word, context.mid(std::max<qsizetype>(0, context.size() - 2)), 0);
+}
+
+void UserDictionary::forget(const QString &word)
+{
+    record(Forget, word, QStringList(), 0);
+}
+
+void UserDictionary::adjustFrequency(const QString &word, int delta)
+{
+    record(Frequency, word, QStringList(), delta);
+}
+
+void UserDictionary::apply(EventType type, const QString &word, const QStringList &context, int delta)
+{
+    switch (type) {
+    case Learn:
+        m_words[word]++;
+        if (context.size() >= 1) m_sequences[{ context.last(), word }]++;
+        if (context.size() >= 2) m_sequences[{ context.at(context.size() - 2), context.last(), word }]++;
+        break;
+    case Forget:
+        m_words.remove(word);
+        for (auto it = m_sequences.begin(); it != m_sequences.end();) {
+            it = it.key().contains(word) ? m_sequences.erase(it) : std::next(it);
+        }
+        break;
+    case Frequency: {
+        const qint64 count = qint64(m_words.value(word)) + delta;
+        if (count > 0) {
+            m_words.insert(word, quint32(std::min<qint64>(count, std::numeric_limits<quint32>::max())));
+        } else {
+            m_words.remove(word);
+        }
+        break;
+    }
+    }
+}
+
+void UserDictionary::record(EventType type, const QString &word, const QStringList &context, int delta)
+{
+    apply(type, word, context, delta);
+    m_changeCount++;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << quint8(type) << word << context << qint32(delta);
+
+    char header[RecordHeaderSize];
+    qToLittleEndian<quint32>(quint32(payload.size()), header);
+    qToLittleEndian<quint16>(qChecksum(payload), header + 4);
+    m_pending.append(header, RecordHeaderSize);
+    m_pending.append(payload);
+}
+
+bool UserDictionary::openJournal()
+{
+    m_journal.setFileName(journalPath(m_basePath, m_sequence));
+    if (!m_journal.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "[UserDictionary] Cannot open journal" << m_journal.fileName();
+        return false;
+    }
+    if (m_journal.size() == 0) {
+        char header[JournalHeaderSize];
+        qToLittleEndian<quint32>(JournalMagic, header);
+        qToLittleEndian<quint32>(Version, header + 4);
+        m_journal.write(header, JournalHeaderSize);
+    }
+    return true;
+}
+
+bool UserDictionary::commit()
+{
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+    if (!m_journal.isOpen() && !openJournal()) {
+        return false;
+    }
+
+    const qint64 size = m_journal.size();
+    if (m_journal.write(m_pending) != m_pending.size() || !m_journal.flush()
+        || ::fsync(m_journal.handle()) != 0) {
+        qWarning() << "[UserDictionary] Cannot write journal" << m_journal.fileName();
+        // Retried whole next time, so none of it may stay behind
+        m_journal.resize(size);
+        m_journal.close();
+        return false;
+    }
+
+    m_journalBytes += m_pending.size();
+    m_pending.clear();
+    return true;
+}
+
+bool UserDictionary::needsCompaction() const
+{
+    return m_journalBytes + m_pending.size() >= CompactionThreshold;
+}
+
+bool UserDictionary::startCompaction(Compaction *compaction)
+{
+    // The snapshot will hold every event so far, so none may be left to
+    // write to the next journal
+    if (!commit()) {
+        return false;
+    }
+
+    compaction->basePath = m_basePath;
+    compaction->foldedSequence = m_sequence;
+    compaction->words = m_words; // Implicitly shared until changed
+    compaction->sequences = m_sequences;
+
+    m_journal.close();
+    m_foldedSequence = m_sequence;
+    m_sequence++;
+    m_journalBytes = 0;
+    return true;
+}
+
+bool UserDictionary::compact(const Compaction &compaction)
+{
+    QSaveFile file(snapshotPath(compaction.basePath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "[UserDictionary] Cannot write snapshot" << file.fileName();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << SnapshotMagic << Version << compaction.foldedSequence << compaction.words << compaction.sequences;
+    if (stream.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "[UserDictionary] Cannot write snapshot" << file.fileName();
+        return false;
+    }
+
+    for (quint64 sequence : journalSequences(compaction.basePath)) {
+        if (sequence <= compaction.foldedSequence) {
+            QFile::remove(journalPath(compaction.basePath, sequence));
+        }
+    }
+    return true;
+}
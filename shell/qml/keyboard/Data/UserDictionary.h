@@ -0,0 +1,138 @@
+/*
+ * Marathon Virtual Keyboard - User Dictionary
+ * Learned words kept as a snapshot plus an append-only journal
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_USERDICTIONARY_H
+#define MARATHON_USERDICTIONARY_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include "NGramModel.h"
+
+/**
+ * @brief Words the user taught the keyboard, and the order they came in
+ *
+ * Changes are recorded as events (learn, forget, frequency) appended to
+ * a binary journal. Events are buffered and written together by
+ * commit(), which the owner calls at most every few seconds, so a burst
+ * of typing costs one write and one fsync. Each record carries its
+ * length and checksum; a record torn by a crash is ignored on replay.
+ *
+ * The journal is folded into a deduplicated snapshot from time to time:
+ * startCompaction() moves on to a new journal file, and compact() then
+ * writes the snapshot and deletes the journals it covers, on any thread.
+ * Loading reads the snapshot, one entry per distinct word or sequence,
+ * and replays only the journals written since.
+ *
+ * Only one process should write a dictionary at a time.
+ */
+class UserDictionary
+{
+public:
+    // Distinct words as written -> times learned
+    using Words = QHash<QString, quint32>;
+
+    // Everything a compaction needs, detached from the dictionary
+    struct Compaction {
+        QString basePath;
+        quint64 foldedSequence = 0; // Journals up to this one are covered
+        Words words;
+        NGramModel::Counts sequences;
+    };
+
+    /**
+     * @param basePath Files are <basePath>.snapshot and <basePath>.journal.<n>
+     */
+    explicit UserDictionary(const QString &basePath);
+
+    /**
+     * @brief Read the snapshot and replay the journals
+     * @param legacyPath Plain text word list, imported when nothing else exists
+     */
+    void load(const QString &legacyPath);
+
+    const Words &words() const { return m_words; }
+    const NGramModel::Counts &sequences() const { return m_sequences; }
+
+    // Files the current state was loaded from
+    QStringList files() const { return m_files; }
+    // Changes since load(), so that caches built from a changed state
+    // do not pass for ones built from the files
+    quint64 changeCount() const { return m_changeCount; }
+
+    /**
+     * @brief Count word, as following context (its last two words)
+     */
+    void learn(const QString &word, const QStringList &context);
+    void forget(const QString &word);
+    void adjustFrequency(const QString &word, int delta);
+
+    bool hasPendingEvents() const { return !m_pending.isEmpty(); }
+
+    /**
+     * @brief Append the pending events to the journal and sync it
+     * @return false if they could not be written; they stay pending
+     */
+    bool commit();
+
+    // True once the journals are large enough to be worth folding
+    bool needsCompaction() const;
+
+    /**
+     * @brief Commit, then continue in a new journal
+     * @param compaction Set to what compact() needs to fold everything so far
+     * @return false if the pending events could not be committed
+     */
+    bool startCompaction(Compaction *compaction);
+
+    /**
+     * @brief Write the snapshot and delete the journals it covers
+     *
+     * Touches no file the dictionary still writes, so it can run on
+     * another thread while the dictionary is used.
+     */
+    static bool compact(const Compaction &compaction);
+
+private:
+    enum EventType : quint8 {
+        Learn = 1,
+        Forget = 2,
+        Frequency = 3
+    };
+
+    static constexpr quint32 JournalMagic = 0x4a44554d;  // "MUDJ"
+    static constexpr quint32 SnapshotMagic = 0x5344554d; // "MUDS"
+    static constexpr quint32 Version = 1;
+    static constexpr qint64 CompactionThreshold = 64 * 1024; // Journal bytes
+
+    static QString snapshotPath(const QString &basePath) { return basePath + ".snapshot"; }
+    static QString journalPath(const QString &basePath, quint64 sequence);
+    static QList<quint64> journalSequences(const QString &basePath); // Ascending
+
+    bool readSnapshot();
+    bool replayJournal(quint64 sequence);
+    void importLegacy(const QString &path);
+    bool openJournal();
+
+    void apply(EventType type, const QString &word, const QStringList &context, int delta);
+    void record(EventType type, const QString &word, const QStringList &context, int delta);
+
+    QString m_basePath;
+    Words m_words;
+    NGramModel::Counts m_sequences;
+    quint64 m_changeCount;
+    quint64 m_foldedSequence; // Covered by the snapshot
+    quint64 m_sequence;       // Journal being written
+    qint64 m_journalBytes;    // Since the snapshot
+    QFile m_journal;
+    QByteArray m_pending;     // Framed records not written yet
+    QStringList m_files;
+};
+
+#endif // MARATHON_USERDICTIONARY_H
@@ -4,43 +4,133 @@
  */
 
 #include "WordEngine.h"
-
-#ifdef HAVE_HUNSPELL
-#include <hunspell/hunspell.hxx>
-#else
-// Stub implementation if Hunspell is not available
-class Hunspell
-{
-public:
-    Hunspell(const char *, const char *, const char * = nullptr) : encoding("UTF-8") {}
-    int add_dic (const char *, const char * = nullptr) { return 0; }
-    char *get_dic_encoding() { return encoding.data(); }
-    bool spell(const std::string&, int* = nullptr, std::string* = nullptr) { return true; }
-    std::vector<std::string> suggest(const std::string&) { return std::vector<std::string>(); }
-    int add(const std::string&) { return 0; }
-private:
-    QByteArray encoding;
-};
-#endif
+#include "HunspellDictionary.h"
+#include "marathonlatencyhistogram.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextStream>
-#include <QStringConverter>
 #include <QStandardPaths>
 #include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QVariantList>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
 
 // ======================
 // WordEngine::Private
 // ======================
 
+namespace {
+
+double toMs(qint64 us)
+{
+    return us / 1000.0;
+}
+
+QString cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+         + "/marathon-os/keyboard";
+}
+
+// Identifies the state of files by path, size and modification time
+quint64 fileStamp(const QStringList &paths, const QByteArray &salt)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        hash.addData(path.toUtf8());
+        hash.addData(QByteArray::number(info.exists() ? info.size() : -1));
+        hash.addData(QByteArray::number(info.exists() ? info.lastModified().toMSecsSinceEpoch() : 0));
+    }
+    hash.addData(salt);
+    return qFromLittleEndian<quint64>(hash.result().constData());
+}
+
+// How long to wait for another process building the same cache
+constexpr int CacheLockTimeoutMs = 30000;
+
+// Most parts a compound is split into, and most candidates for each
+constexpr int MaxCompoundParts = 4;
+constexpr int MaxPartMatches = 16;
+
+// Whether word splits into compound parts that may each stand where they
+// do, the first of them being part number `part`
+bool isCompound(const WordLexicon &parts, QStringView word, int part)
+{
+    int lengths[MaxPartMatches];
+    int positions[MaxPartMatches];
+    const int count = parts.prefixesOf(word, lengths, positions, MaxPartMatches);
+    
+    // Longest first, the likelier split
+    for (int i = count; i-- > 0;) {
+        if (lengths[i] == word.size()) {
+            if (part > 0 && (positions[i] & HunspellDictionary::CompoundEnd))
+                return true;
+            continue;
+        }
+        const int position = part == 0 ? HunspellDictionary::CompoundBegin : HunspellDictionary::CompoundMiddle;
+        if ((positions[i] & position) && part + 2 <= MaxCompoundParts
+            && isCompound(parts, word.mid(lengths[i]), part + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Maps the cache file at path into index, building it first if it is
+// missing or stale. Mapped read-only, a cache is held in memory once
+// however many processes use it; the lock lets the first of them build
+// it while the others wait and map the result. Returns false if the
+// image could only be kept in this process.
+template <typename Index, typename Build>
+bool loadSharedCache(Index &index, const QString &path, quint64 stamp, Build build)
+{
+    if (index.load(path, stamp))
+        return true;
+    
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QLockFile lock(path + ".lock");
+    const bool locked = lock.tryLock(CacheLockTimeoutMs);
+    if (locked && index.load(path, stamp))
+        return true;
+    
+    const QByteArray image = build();
+    if (locked) {
+        QSaveFile cache(path);
+        if (cache.open(QIODevice::WriteOnly) && cache.write(image) == image.size() && cache.commit()
+            && index.load(path, stamp)) {
+            return true;
+        }
+    }
+    index.setImage(image);
+    return false;
+}
+
+} // namespace
+
 class WordEngine::Private
 {
 public:
     bool enabled = false;
     QString language = "en_US";
     QSet<QString> ignoredWords;
+    
+    // Newest request, the only one whose answer is delivered
+    quint64 generation = 0;
+    qint64 requestedAt = 0;  // clock.nsecsElapsed()
+    QElapsedTimer clock;
+    MarathonLatencyHistogram latency;
+    quint64 superseded = 0;  // Requests replaced before being answered
+    bool answered = true;
 };
 
 // ======================
@@ -54,6 +144,7 @@ WordEngine::WordEngine(QObject *parent)
     , m_worker(nullptr)
 {
     qDebug() << "[WordEngine] Initializing...";
+    d->clock.start();
     initializeWorker();
 }
 
@@ -61,6 +152,8 @@ WordEngine::~WordEngine()
 {
     qDebug() << "[WordEngine] Shutting down worker thread...";
     if (m_workerThread && m_workerThread->isRunning()) {
+        // Learned words wait up to a few seconds to be written
+        QMetaObject::invokeMethod(m_worker, "flushUserDictionary", Qt::BlockingQueuedConnection);
         m_workerThread->quit();
         if (!m_workerThread->wait(3000)) {
             qWarning() << "[WordEngine] Worker thread did not finish in time, terminating...";
@@ -77,8 +170,10 @@ void WordEngine::initializeWorker()
     m_worker->moveToThread(m_workerThread);
     
     // Connect signals
-    connect(m_worker, &WordEngineWorker::predictionsReady,
-            this, &WordEngine::predictionsReady);
+    connect(m_worker, &WordEngineWorker::predictionsComputed,
+            this, &WordEngine::onPredictionsComputed);
+    connect(m_worker, &WordEngineWorker::correctionsComputed,
+            this, &WordEngine::onCorrectionsComputed);
     connect(m_worker, &WordEngineWorker::errorOccurred,
             this, &WordEngine::errorOccurred);
     
@@ -100,7 +195,7 @@ void WordEngine::setEnabled(bool on)
     d->enabled = on;
     
     if (on) {
-        // Initialize Hunspell on worker thread
+        // Load the dictionary on the worker thread
         QMetaObject::invokeMethod(m_worker, "setLanguage", Qt::QueuedConnection,
                                   Q_ARG(QString, d->language));
     }
@@ -140,25 +235,89 @@ bool WordEngine::spell(const QString &word)
     if (!d->enabled)
         return true;
     
-    if (d->ignoredWords.contains(word))
+    if (word.isEmpty() || d->ignoredWords.contains(word))
         return true;
     
-    // For now, use simple dictionary check
-    // TODO: Add sync Hunspell check if needed
-    return word.length() > 0;
+    // Never waits for the worker, even while it loads a dictionary
+    const auto snapshot = m_worker->spellSnapshot();
+    return !snapshot || snapshot->contains(word);
 }
 
 void WordEngine::requestPredictions(const QString &prefix, int maxResults)
 {
-    if (!d->enabled || prefix.isEmpty()) {
+    if (!d->answered)
+        d->superseded++;
+    
+    if (!d->enabled) {
+        d->generation = m_worker->cancelPredictions();
+        d->answered = true;
         emit predictionsReady(prefix, QStringList());
         return;
     }
     
-    // Invoke worker asynchronously
-    QMetaObject::invokeMethod(m_worker, "computePredictions", Qt::QueuedConnection,
-                              Q_ARG(QString, prefix),
-                              Q_ARG(int, maxResults));
+    // Keystrokes faster than the worker collapse into one request
+    d->generation = m_worker->postPredictionRequest(prefix, maxResults);
+    d->requestedAt = d->clock.nsecsElapsed();
+    d->answered = false;
+}
+
+void WordEngine::onPredictionsComputed(quint64 generation, const QString &prefix,
+                                       const QStringList &predictions)
+{
+    // Answers can cross a newer request in the event queue
+    if (generation != d->generation || d->answered)
+        return;
+    
+    d->answered = true;
+    d->latency.record((d->clock.nsecsElapsed() - d->requestedAt) / 1000);
+    emit predictionsReady(prefix, predictions);
+}
+
+void WordEngine::onCorrectionsComputed(quint64 generation, const QString &word,
+                                       const QStringList &corrections, bool confident)
+{
+    if (generation != d->generation)
+        return;
+    
+    // Ignored words spell as correct, so nothing should correct them
+    if (d->ignoredWords.contains(word)) {
+        emit correctionsReady(word, QStringList(), false);
+        return;
+    }
+    
+    emit correctionsReady(word, corrections, confident);
+}
+
+QVariantMap WordEngine::predictionLatency() const
+{
+    const MarathonLatencyHistogram &h = d->latency;
+    
+    QVariantList buckets;
+    for (int bucket = 0; bucket < MarathonLatencyHistogram::BucketCount; ++bucket) {
+        const quint64 samples = h.bucketSamples(bucket);
+        if (samples == 0)
+            continue;
+        buckets.append(QVariantMap {
+            { "limit", toMs(qint64(MarathonLatencyHistogram::bucketUpperBound(bucket))) },
+            { "count", samples },
+        });
+    }
+    
+    return QVariantMap {
+        { "count", h.count() },
+        { "superseded", d->superseded },
+        { "p50", toMs(h.percentile(50)) },
+        { "p95", toMs(h.percentile(95)) },
+        { "p99", toMs(h.percentile(99)) },
+        { "max", toMs(h.maximum()) },
+        { "buckets", buckets },
+    };
+}
+
+void WordEngine::resetPredictionLatency()
+{
+    d->latency.reset();
+    d->superseded = 0;
 }
 
 void WordEngine::learnWord(const QString &word)
@@ -171,6 +330,27 @@ void WordEngine::learnWord(const QString &word)
                               Q_ARG(QString, word));
 }
 
+void WordEngine::endSentence()
+{
+    if (!d->enabled)
+        return;
+    
+    QMetaObject::invokeMethod(m_worker, "endSentence", Qt::QueuedConnection);
+}
+
+void WordEngine::forgetWord(const QString &word)
+{
+    qDebug() << "[WordEngine] Forgetting word:" << word;
+    QMetaObject::invokeMethod(m_worker, "forgetWord", Qt::QueuedConnection,
+                              Q_ARG(QString, word));
+}
+
+void WordEngine::adjustWordFrequency(const QString &word, int delta)
+{
+    QMetaObject::invokeMethod(m_worker, "adjustWordFrequency", Qt::QueuedConnection,
+                              Q_ARG(QString, word), Q_ARG(int, delta));
+}
+
 void WordEngine::ignoreWord(const QString &word)
 {
     d->ignoredWords.insert(word);
@@ -204,20 +384,25 @@ QString WordEngine::dictionaryPath()
 
 WordEngineWorker::WordEngineWorker(QObject *parent)
     : QObject(parent)
-    , m_hunspell(nullptr)
-    , m_encoding("UTF-8")
     , m_language("en_US")
+    , m_userDictionaryLoaded(false)
+    , m_commitScheduled(false)
+    , m_ngramsLoaded(false)
+    , m_keys(KeyboardGeometry::qwerty())
+    , m_requestMaxResults(0)
+    , m_requestScheduled(false)
+    , m_requestPending(false)
+    , m_generation(0)
 {
-    m_userDictionaryPath = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
-                         + "/marathon-os/keyboard_user_dictionary.txt";
-    qDebug() << "[WordEngineWorker] User dictionary:" << m_userDictionaryPath;
+    const QString base = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
+                       + "/marathon-os/keyboard_user_dictionary";
+    m_userDictionary = std::make_unique<UserDictionary>(base);
+    m_legacyDictionaryPath = base + ".txt";
+    qDebug() << "[WordEngineWorker] User dictionary:" << base;
 }
 
 WordEngineWorker::~WordEngineWorker()
 {
-    QMutexLocker locker(&m_mutex);
-    delete m_hunspell;
-    m_hunspell = nullptr;
 }
 
 void WordEngineWorker::setLanguage(const QString &language)
@@ -226,28 +411,27 @@ void WordEngineWorker::setLanguage(const QString &language)
     
     qDebug() << "[WordEngineWorker] Setting language to:" << language;
     m_language = language;
+    m_context.clear();
     
     if (!loadDictionary(language)) {
+        m_lexicon.reset();
+        m_compoundParts.reset();
+        publishSpellSnapshot();
         emit errorOccurred(QString("Failed to load dictionary for %1").arg(language));
     } else {
-        loadUserDictionary();
+        loadLexicon();
     }
 }
 
 bool WordEngineWorker::loadDictionary(const QString &language)
 {
-    // Clean up existing
-    if (m_hunspell) {
-        delete m_hunspell;
-        m_hunspell = nullptr;
-    }
-    
     QString dictPath = findDictionaryPath(language);
     if (dictPath.isEmpty()) {
         qWarning() << "[WordEngineWorker] No dictionary found for" << language;
         return false;
     }
     
+    m_dictionaryPath = dictPath;
     QString affFile = dictPath + ".aff";
     QString dicFile = dictPath + ".dic";
     
@@ -256,16 +440,8 @@ bool WordEngineWorker::loadDictionary(const QString &language)
         return false;
     }
     
-    qDebug() << "[WordEngineWorker] Loading dictionary:" << affFile << dicFile;
-    
-    m_hunspell = new Hunspell(affFile.toUtf8().constData(),
-                             dicFile.toUtf8().constData());
-    
-    // Get dictionary encoding (usually UTF-8)
-    m_encoding = QString::fromLatin1(m_hunspell->get_dic_encoding());
-    qDebug() << "[WordEngineWorker] Dictionary encoding:" << m_encoding;
-    
-    qDebug() << "[WordEngineWorker] Dictionary loaded successfully";
+    // Only read when the lexicon cache is out of date
+    qDebug() << "[WordEngineWorker] Using dictionary:" << dictPath;
     return true;
 }
 
@@ -299,82 +475,472 @@ QString WordEngineWorker::findDictionaryPath(const QString &language)
     return QString();
 }
 
-void WordEngineWorker::loadUserDictionary()
+void WordEngineWorker::ensureUserDictionary()
+{
+    if (m_userDictionaryLoaded)
+        return;
+    m_userDictionaryLoaded = true;
+    m_userDictionary->load(m_legacyDictionaryPath);
+}
+
+quint64 WordEngineWorker::userDictionaryStamp(const QByteArray &salt) const
+{
+    // Learning changes the state before it reaches the files
+    return fileStamp(m_userDictionary->files(), salt + ':' + QByteArray::number(m_userDictionary->changeCount()));
+}
+
+QVector<WordLexicon::Word> WordEngineWorker::readUserWords() const
+{
+    QVector<WordLexicon::Word> words;
+    
+    const UserDictionary::Words &counts = m_userDictionary->words();
+    words.reserve(counts.size());
+    for (auto it = counts.constBegin(); it != counts.constEnd(); ++it) {
+        WordLexicon::Word word;
+        word.text = it.key();
+        word.rank = UserRank + int(std::min<quint32>(it.value(), MaxUserCount));
+        words.append(word);
+    }
+    
+    return words;
+}
+
+void WordEngineWorker::reloadUserLexicon()
+{
+    // Includes everything learned so far, so the overlay starts over
+    m_userLexicon = loadCachedLexicon("user", userDictionaryStamp("user:" + QByteArray::number(UserRank)),
+                                      [this]() { return readUserWords(); });
+    m_learnedWords.clear();
+    m_learnedSpellings.clear();
+    publishSpellSnapshot();
+}
+
+quint64 WordEngineWorker::lexiconStamp() const
+{
+    // Rebuilt when the word list or the affix rules change
+    return fileStamp({ m_dictionaryPath + ".aff", m_dictionaryPath + ".dic" },
+                     "affixes,compounds:" + QByteArray::number(DictionaryRank) + ':' + QByteArray::number(DerivedRank));
+}
+
+void WordEngineWorker::readDictionary(QVector<WordLexicon::Word> *words,
+                                      QVector<WordLexicon::Word> *compoundParts) const
+{
+    // Lowercased: a capitalized noun is lowercase inside a compound
+    QHash<QString, int> positions;
+    
+    // Stems and every form their affix rules derive
+    HunspellDictionary dictionary;
+    dictionary.read(m_dictionaryPath, [words](const QString &text, bool stem) {
+        WordLexicon::Word word;
+        word.text = text;
+        word.rank = std::max(1, (stem ? DictionaryRank : DerivedRank) - int(text.size()));
+        words->append(word);
+    }, [&positions](const QString &part, int where) {
+        positions[part.toLower()] |= where;
+    });
+    
+    compoundParts->reserve(positions.size());
+    for (auto it = positions.constBegin(); it != positions.constEnd(); ++it) {
+        WordLexicon::Word part;
+        part.text = it.key();
+        part.rank = quint16(it.value());
+        compoundParts->append(part);
+    }
+}
+
+bool WordEngineWorker::SpellSnapshot::contains(const QString &word) const
+{
+    if (lexicon && lexicon->contains(word))
+        return true;
+    if (userLexicon && userLexicon->contains(word))
+        return true;
+    if (learnedWords.isEmpty() && !compoundParts)
+        return false;
+    
+    const QString folded = word.toLower();
+    for (const auto &set : learnedWords) {
+        if (set->contains(folded))
+            return true;
+    }
+    // Compounds are never listed whole, only their parts
+    return compoundParts && isCompound(*compoundParts, folded, 0);
+}
+
+void WordEngineWorker::publishSpellSnapshot()
+{
+    std::shared_ptr<SpellSnapshot> snapshot;
+    if (m_lexicon) {
+        snapshot = std::make_shared<SpellSnapshot>();
+        snapshot->lexicon = m_lexicon;
+        snapshot->userLexicon = m_userLexicon;
+        snapshot->learnedWords = m_learnedSpellings;
+        snapshot->compoundParts = m_compoundParts;
+    }
+    // Readers holding the old snapshot keep it alive until they are done
+    std::atomic_store(&m_spellSnapshot, std::shared_ptr<const SpellSnapshot>(std::move(snapshot)));
+}
+
+void WordEngineWorker::addLearnedSpelling(const QString &word)
+{
+    const QString folded = word.toLower();
+    for (const auto &set : std::as_const(m_learnedSpellings)) {
+        if (set->contains(folded))
+            return;
+    }
+    
+    // Sets merge like the digits of a binary counter: the new word joins
+    // the smallest sets, and the rest are shared with earlier snapshots.
+    // Each word is copied O(log n) times and a lookup checks O(log n) sets.
+    QSet<QString> merged{ folded };
+    while (!m_learnedSpellings.isEmpty() && m_learnedSpellings.last()->size() <= merged.size()) {
+        merged.unite(*m_learnedSpellings.takeLast());
+    }
+    m_learnedSpellings.append(std::make_shared<const QSet<QString>>(std::move(merged)));
+}
+
+std::shared_ptr<const WordLexicon> WordEngineWorker::loadCachedLexicon(
+    const QString &name, quint64 stamp, const std::function<QVector<WordLexicon::Word>()> &readWords) const
+{
+    auto lexicon = std::make_shared<WordLexicon>();
+    const QString cachePath = cacheDirectory() + "/" + name + ".lexicon";
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    if (!loadSharedCache(*lexicon, cachePath, stamp, [&]() { return WordLexicon::build(readWords(), stamp); })) {
+        qWarning() << "[WordEngineWorker] Cannot write lexicon cache" << cachePath << "- keeping it in memory";
+    }
+    qDebug() << "[WordEngineWorker] Loaded lexicon" << name << ":" << lexicon->wordCount() << "words in"
+             << timer.elapsed() << "ms";
+    return lexicon;
+}
+
+void WordEngineWorker::loadLexicon()
+{
+    // Keyed by the dictionary files only, so learning words never
+    // invalidates it; switching back to a language just maps it again
+    const QString name = QFileInfo(m_dictionaryPath).fileName();
+    // Both caches come from one pass over the dictionary, made only when
+    // one of them has to be built
+    QVector<WordLexicon::Word> words;
+    QVector<WordLexicon::Word> compoundParts;
+    bool read = false;
+    auto readOnce = [&]() {
+        if (!read) {
+            readDictionary(&words, &compoundParts);
+            read = true;
+        }
+    };
+    m_lexicon = loadCachedLexicon(name, lexiconStamp(), [&]() { readOnce(); return words; });
+    m_compoundParts = loadCachedLexicon(name + ".compound", lexiconStamp(),
+                                        [&]() { readOnce(); return compoundParts; });
+    if (m_compoundParts->wordCount() == 0)
+        m_compoundParts.reset();  // Most languages have no compounds
+    
+    // User words are the same in every language
+    if (!m_userLexicon) {
+        ensureUserDictionary();
+        reloadUserLexicon();
+    } else {
+        publishSpellSnapshot();
+    }
+}
+
+void WordEngineWorker::ensureNGramModel()
+{
+    // Loaded on first use rather than with the dictionary, so it never
+    // delays startup
+    if (m_ngramsLoaded)
+        return;
+    m_ngramsLoaded = true;
+    
+    ensureUserDictionary();
+    const QString cachePath = cacheDirectory() + "/user.ngram";
+    const quint64 stamp = userDictionaryStamp("ngram");
+    
+    QElapsedTimer timer;
+    timer.start();
+    
+    if (!loadSharedCache(m_ngrams, cachePath, stamp, [&]() { return NGramModel::build(m_userDictionary->sequences(), stamp); })) {
+        qWarning() << "[WordEngineWorker] Cannot write n-gram cache" << cachePath << "- keeping it in memory";
+    }
+    qDebug() << "[WordEngineWorker] Loaded n-gram model:" << m_ngrams.vocabularySize() << "words in"
+             << timer.elapsed() << "ms";
+}
+
+void WordEngineWorker::scheduleCommit()
 {
-    if (!m_hunspell)
+    // Group commit: everything learned within the interval is written
+    // and synced at once
+    if (m_commitScheduled)
         return;
+    m_commitScheduled = true;
+    QTimer::singleShot(CommitIntervalMs, this, &WordEngineWorker::commitUserDictionary);
+}
+
+void WordEngineWorker::commitUserDictionary()
+{
+    QMutexLocker locker(&m_mutex);
+    m_commitScheduled = false;
     
-    QFile file(m_userDictionaryPath);
-    if (!file.exists() || !file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!m_userDictionary->commit()) {
+        scheduleCommit();
         return;
     }
     
-    QTextStream stream(&file);
-    int count = 0;
-    while (!stream.atEnd()) {
-        QString word = stream.readLine().trimmed();
-        if (!word.isEmpty()) {
-            m_hunspell->add(word.toStdString());
-            count++;
+    if (!m_userDictionary->needsCompaction() || (m_compactor && m_compactor->isRunning()))
+        return;
+    
+    // Folding the journal into a snapshot reads and writes every word;
+    // learning goes on in a new journal meanwhile
+    UserDictionary::Compaction compaction;
+    if (!m_userDictionary->startCompaction(&compaction))
+        return;
+    m_compactor = QThread::create([compaction]() {
+        QElapsedTimer timer;
+        timer.start();
+        if (UserDictionary::compact(compaction)) {
+            qDebug() << "[WordEngineWorker] Compacted user dictionary:" << compaction.words.size() << "words in"
+                     << timer.elapsed() << "ms";
         }
+    });
+    connect(m_compactor, &QThread::finished, m_compactor, &QObject::deleteLater);
+    m_compactor->start(QThread::LowPriority);
+}
+
+void WordEngineWorker::flushUserDictionary()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    if (m_userDictionaryLoaded)
+        m_userDictionary->commit();
+    if (m_compactor)
+        m_compactor->wait();
+}
+
+quint64 WordEngineWorker::postPredictionRequest(const QString &prefix, int maxResults)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_requestPrefix = prefix;
+    m_requestMaxResults = maxResults;
+    m_requestPending = true;
+    const quint64 generation = ++m_generation;
+    
+    // One queued call drains the slot, however many requests replaced it
+    if (!m_requestScheduled) {
+        m_requestScheduled = true;
+        QMetaObject::invokeMethod(this, &WordEngineWorker::processPredictionRequest,
+                                  Qt::QueuedConnection);
+    }
+    return generation;
+}
+
+quint64 WordEngineWorker::cancelPredictions()
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_requestPending = false;
+    return ++m_generation;
+}
+
+void WordEngineWorker::processPredictionRequest()
+{
+    QString prefix;
+    int maxResults;
+    quint64 generation;
+    {
+        QMutexLocker locker(&m_requestMutex);
+        m_requestScheduled = false;
+        if (!m_requestPending)
+            return;  // Cancelled
+        m_requestPending = false;
+        prefix = m_requestPrefix;
+        maxResults = m_requestMaxResults;
+        generation = m_generation.load();
     }
     
-    qDebug() << "[WordEngineWorker] Loaded" << count << "words from user dictionary";
+    computePredictions(prefix, maxResults, generation);
 }
 
-void WordEngineWorker::computePredictions(const QString &prefix, int maxResults)
+void WordEngineWorker::computePredictions(const QString &prefix, int maxResults, quint64 generation)
 {
     QMutexLocker locker(&m_mutex);
     
-    if (!m_hunspell || prefix.isEmpty()) {
-        emit predictionsReady(prefix, QStringList());
+    // May have waited behind a dictionary load
+    if (isSuperseded(generation))
         return;
+    
+    if (maxResults <= 0) {
+        emit predictionsComputed(generation, prefix, QStringList());
+        return;
+    }
+    
+    // Words likely to follow the previous ones come first. An empty
+    // prefix asks for the next word only.
+    ensureNGramModel();
+    QStringList candidates = m_ngrams.predict(m_context, prefix, maxResults);
+    
+    if (!prefix.isEmpty()) {
+        // Words learned this session outrank the lexicon like user words do
+        QList<QPair<int, QString>> learned;
+        for (auto it = m_learnedWords.constBegin(); it != m_learnedWords.constEnd(); ++it) {
+            if (it.key().startsWith(prefix, Qt::CaseInsensitive)) {
+                learned.append(qMakePair(it.value(), it.key()));
+            }
+        }
+        std::sort(learned.begin(), learned.end(), [](const auto &a, const auto &b) {
+            return a.first > b.first;
+        });
+        
+        for (const auto &entry : learned) {
+            candidates.append(entry.second);
+        }
+        // User words outrank every dictionary word
+        if (m_userLexicon) {
+            candidates += m_userLexicon->complete(prefix, maxResults);
+        }
+        // A few spare ones, in case lowercasing folds some together
+        if (m_lexicon) {
+            candidates += m_lexicon->complete(prefix, maxResults * 2);
+        }
     }
     
-    // Get suggestions from Hunspell
-    auto suggestions = m_hunspell->suggest(prefix.toStdString());
+    if (isSuperseded(generation))
+        return;
     
     // Determine if prefix is lowercase for case normalization
-    bool isLowercase = prefix[0].isLower();
+    bool isLowercase = !prefix.isEmpty() && prefix[0].isLower();
     
     QStringList results;
-    for (const auto &s : suggestions) {
+    for (QString word : std::as_const(candidates)) {
         if (results.size() >= maxResults)
             break;
         
-        QString word = QString::fromStdString(s);
-        // Only include words that start with the prefix
-        if (word.toLower().startsWith(prefix.toLower())) {
-            // Normalize case to match user input (Maliit behavior)
-            if (isLowercase) {
-                word = word.toLower();
-            }
+        // Normalize case to match user input (Maliit behavior)
+        if (isLowercase) {
+            word = word.toLower();
+        }
+        if (!results.contains(word)) {
             results.append(word);
         }
     }
     
-    emit predictionsReady(prefix, results);
+    emit predictionsComputed(generation, prefix, results);
+    
+    // Checked after the predictions are out, so they never wait for it
+    if (prefix.isEmpty() || isSuperseded(generation))
+        return;
+    const auto snapshot = spellSnapshot();
+    if (!snapshot || snapshot->contains(prefix))
+        return;
+    
+    bool confident = false;
+    const QStringList corrections = computeCorrections(prefix, maxResults, &confident);
+    if (!isSuperseded(generation))
+        emit correctionsComputed(generation, prefix, corrections, confident);
+}
+
+QStringList WordEngineWorker::computeCorrections(const QString &word, int maxResults,
+                                                 bool *confident) const
+{
+    *confident = false;
+    
+    // One edit for up to three letters, two up to six, then three
+    const int maxEdits = std::min(MaxCorrectionEdits, (int(word.size()) + 2) / 3);
+    const int rankPerCost = RankPerEdit / KeyboardGeometry::EditCost;
+    
+    QVector<WordLexicon::Correction> candidates;
+    for (const auto &lexicon : { m_userLexicon, m_lexicon }) {
+        if (lexicon)
+            candidates += lexicon->correct(word, m_keys, maxEdits, rankPerCost, maxResults);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) {
+        return a.score > b.score;
+    });
+    
+    // Match the case the word was typed in
+    const bool isLowercase = word.at(0).isLower();
+    const bool isCapitalized = word.at(0).isUpper();
+    
+    QStringList results;
+    for (const WordLexicon::Correction &candidate : std::as_const(candidates)) {
+        if (results.size() >= maxResults)
+            break;
+        
+        QString text = candidate.text;
+        if (isLowercase) {
+            text = text.toLower();
+        } else if (isCapitalized) {
+            text[0] = text.at(0).toUpper();
+        }
+        if (text.compare(word, Qt::CaseInsensitive) != 0 && !results.contains(text)) {
+            if (results.isEmpty())
+                *confident = candidate.cost <= MaxConfidentCost;
+            results.append(text);
+        }
+    }
+    
+    return results;
 }
 
 void WordEngineWorker::addWord(const QString &word)
 {
     QMutexLocker locker(&m_mutex);
     
-    if (!m_hunspell || word.length() < 2)
+    if (word.length() < 2)
         return;
     
-    // Add to Hunspell
-    m_hunspell->add(word.toStdString());
+    // Completes and spells until the lexicon is rebuilt
+    m_learnedWords[word]++;
+    addLearnedSpelling(word);
+    publishSpellSnapshot();
+    
+    // Count it after the previous words. The model must be loaded first,
+    // or the word would be counted again when it is built.
+    ensureNGramModel();
+    m_ngrams.learn(m_context, word);
+    m_userDictionary->learn(word, m_context);
+    scheduleCommit();
+    m_context.append(word);
+    if (m_context.size() > 2)
+        m_context.removeFirst();
+    
+    qDebug() << "[WordEngineWorker] Added word to user dictionary:" << word;
+}
+
+void WordEngineWorker::endSentence()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    m_context.clear();
+}
+
+void WordEngineWorker::forgetWord(const QString &word)
+{
+    QMutexLocker locker(&m_mutex);
     
-    // Save to user dictionary
-    QFile file(m_userDictionaryPath);
-    QDir().mkpath(QFileInfo(file).absolutePath());
+    ensureUserDictionary();
+    m_userDictionary->forget(word);
+    scheduleCommit();
+    m_context.removeAll(word);
     
-    if (file.open(QIODevice::Append | QIODevice::Text)) {
-        QTextStream stream(&file);
-        stream << word << '\n';
-        stream.flush();
-        qDebug() << "[WordEngineWorker] Added word to user dictionary:" << word;
+    // Both caches counted the word; rebuild them without it
+    reloadUserLexicon();
+    if (m_ngramsLoaded) {
+        m_ngramsLoaded = false;
+        ensureNGramModel();
     }
 }
 
+void WordEngineWorker::adjustWordFrequency(const QString &word, int delta)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    if (delta == 0)
+        return;
+    
+    ensureUserDictionary();
+    m_userDictionary->adjustFrequency(word, delta);
+    scheduleCommit();
+    reloadUserLexicon();
+}
+
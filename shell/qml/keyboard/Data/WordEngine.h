@@ -1,5 +1,5 @@
 /*
- * Marathon Virtual Keyboard - Word Engine (Hunspell-based)
+ * Marathon Virtual Keyboard - Word Engine (Hunspell dictionaries)
  * Adapted from Maliit Plugins spellchecker
  * 
  * Original Copyright (C) 2011 Nokia Corporation and/or its subsidiary(-ies).
@@ -10,20 +10,32 @@
 #define MARATHON_WORDENGINE_H
 
 #include <QObject>
+#include <QPointer>
 #include <QString>
 #include <QStringList>
 #include <QThread>
 #include <QMutex>
+#include <QHash>
+#include <QSet>
+#include <QVariantMap>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "KeyboardGeometry.h"
+#include "NGramModel.h"
+#include "UserDictionary.h"
+#include "WordLexicon.h"
 
-class Hunspell;
-class QTextCodec;
 class WordEngineWorker;
 
 /**
  * @brief Main word engine for spell-checking and predictions
  * 
- * Thread-safe wrapper around Hunspell for the Marathon keyboard.
- * Predictions run on a background thread to avoid blocking the UI.
+ * Spell-checking, predictions and typo corrections from Hunspell
+ * dictionaries for the Marathon keyboard. A dictionary is read once into
+ * a lexicon cache that later starts and language switches only
+ * memory-map. Predictions and corrections run on a background thread to
+ * avoid blocking the UI.
  */
 class WordEngine : public QObject
 {
@@ -41,21 +53,39 @@ public:
     QString language() const;
     void setLanguage(const QString &lang);
 
-    // Synchronous spell-checking (fast enough for UI thread)
+    // Synchronous spell-checking (lock-free, fast enough for every keystroke)
     Q_INVOKABLE bool hasWord(const QString &word);
     Q_INVOKABLE bool spell(const QString &word);
     
-    // Asynchronous prediction (runs on worker thread)
+    // Asynchronous prediction (runs on worker thread). A request replaces
+    // any that has not been answered yet; only the newest is answered.
+    // An empty prefix asks for the word most likely to come next. A
+    // prefix that is not a word is also answered with correctionsReady.
     Q_INVOKABLE void requestPredictions(const QString &prefix, int maxResults = 3);
     
+    // Request-to-predictionsReady latency, in milliseconds:
+    // { count, superseded, p50, p95, p99, max, buckets: [{ limit, count }] }
+    Q_INVOKABLE QVariantMap predictionLatency() const;
+    Q_INVOKABLE void resetPredictionLatency();
+    
     // User dictionary management
+    // Learned words also train next-word prediction, in the order they are
+    // learned; endSentence() keeps a sentence from predicting the next one
     Q_INVOKABLE void learnWord(const QString &word);
+    Q_INVOKABLE void endSentence();
     Q_INVOKABLE void ignoreWord(const QString &word);
+    // Removes a learned word, and every sequence it was learned in
+    Q_INVOKABLE void forgetWord(const QString &word);
+    // Ranks a learned word as if learned delta more (or fewer) times
+    Q_INVOKABLE void adjustWordFrequency(const QString &word, int delta);
 
 signals:
     void enabledChanged();
     void languageChanged();
     void predictionsReady(QString prefix, QStringList predictions);
+    // Words the user may have meant by word, best first; empty if none.
+    // confident when the first is close enough to apply without asking.
+    void correctionsReady(QString word, QStringList corrections, bool confident);
     void errorOccurred(QString message);
 
 private:
@@ -67,6 +97,10 @@ private:
     
     static QString dictionaryPath();
     void initializeWorker();
+    void onPredictionsComputed(quint64 generation, const QString &prefix,
+                               const QStringList &predictions);
+    void onCorrectionsComputed(quint64 generation, const QString &word,
+                               const QStringList &corrections, bool confident);
 };
 
 /**
@@ -80,24 +114,128 @@ public:
     explicit WordEngineWorker(QObject *parent = nullptr);
     ~WordEngineWorker() override;
 
+    // Words spell() accepts. Replaced whole, never modified, when the
+    // dictionary or the user words change, so any thread can read it.
+    struct SpellSnapshot {
+        std::shared_ptr<const WordLexicon> lexicon;
+        std::shared_ptr<const WordLexicon> userLexicon;
+        // Lowercased words learned since userLexicon was built, in sets
+        // shared with the snapshots before and after this one
+        QVector<std::shared_ptr<const QSet<QString>>> learnedWords;
+        // Lowercased words compounds are made of, ranked by the places
+        // they may take (HunspellDictionary::CompoundPosition); nullptr
+        // if the dictionary has no compounds
+        std::shared_ptr<const WordLexicon> compoundParts;
+        
+        bool contains(const QString &word) const;
+    };
+    
+    // Thread-safe; nullptr until a dictionary is loaded
+    std::shared_ptr<const SpellSnapshot> spellSnapshot() const
+    {
+        return std::atomic_load(&m_spellSnapshot);
+    }
+    
+    // Thread-safe. Replaces the pending prediction request and abandons
+    // the one being computed, if any. Returns the request's generation.
+    quint64 postPredictionRequest(const QString &prefix, int maxResults);
+    // Thread-safe. Abandons pending and in-flight requests.
+    quint64 cancelPredictions();
+
 public slots:
     void setLanguage(const QString &language);
-    void computePredictions(const QString &prefix, int maxResults);
     void addWord(const QString &word);
+    void endSentence();
+    void forgetWord(const QString &word);
+    void adjustWordFrequency(const QString &word, int delta);
+    // Writes what was learned and waits for a running compaction
+    void flushUserDictionary();
 
 signals:
-    void predictionsReady(QString prefix, QStringList predictions);
+    void predictionsComputed(quint64 generation, QString prefix, QStringList predictions);
+    void correctionsComputed(quint64 generation, QString word, QStringList corrections,
+                             bool confident);
     void errorOccurred(QString message);
 
+private slots:
+    void processPredictionRequest();
+    void commitUserDictionary();
+
 private:
-    Hunspell *m_hunspell;
-    QString m_encoding;  // Dictionary encoding (usually "UTF-8")
-    QString m_userDictionaryPath;
+    // The .dic format carries no frequencies: dictionary words rank by
+    // length (short words are the common ones), forms derived by affix
+    // rules below every stem, learned words above all by how often they
+    // were learned
+    static constexpr int DictionaryRank = 1000;
+    static constexpr int DerivedRank = 500;
+    static constexpr int UserRank = 2000;
+    static constexpr int MaxUserCount = 1000;
+    // Longest a learned word waits to be synced to disk
+    static constexpr int CommitIntervalMs = 5000;
+    // Corrections are at most this many edits away, fewer for short
+    // words, and give up this much rank per full edit
+    static constexpr int MaxCorrectionEdits = 3;
+    static constexpr int RankPerEdit = 1500;
+    // Farthest a correction may be to be applied without asking
+    static constexpr int MaxConfidentCost = 2 * KeyboardGeometry::EditCost;
+
+    QString m_dictionaryPath;  // Without .aff/.dic
     QString m_language;
     QMutex m_mutex;
 
+    // Learned words and their sequences, read on first use
+    std::unique_ptr<UserDictionary> m_userDictionary;
+    QString m_legacyDictionaryPath;  // Plain text list of earlier versions
+    bool m_userDictionaryLoaded;
+    bool m_commitScheduled;
+    QPointer<QThread> m_compactor;
+
+    // Completion indexes over the dictionary and the user dictionary,
+    // mapped from cache files every process using the keyboard shares,
+    // plus this process's overlay of words learned since. Shared with spell
+    // snapshots, so a loaded lexicon is never modified; a new one replaces it.
+    std::shared_ptr<const WordLexicon> m_lexicon;
+    std::shared_ptr<const WordLexicon> m_compoundParts;  // Spelling only
+    std::shared_ptr<const WordLexicon> m_userLexicon;
+    QHash<QString, int> m_learnedWords;
+    QVector<std::shared_ptr<const QSet<QString>>> m_learnedSpellings;  // Largest first
+    std::shared_ptr<const SpellSnapshot> m_spellSnapshot;  // Atomic access only
+
+    // Next-word model over the user's own text, and the words just learned
+    NGramModel m_ngrams;
+    bool m_ngramsLoaded;
+    QStringList m_context;  // Last two words of the current sentence
+
+    // Typo costs for corrections
+    KeyboardGeometry m_keys;
+
+    // Latest-wins request slot. Each request bumps the generation; work
+    // for an older generation is dropped as soon as it is noticed.
+    QMutex m_requestMutex;
+    QString m_requestPrefix;
+    int m_requestMaxResults;
+    bool m_requestScheduled;
+    bool m_requestPending;
+    std::atomic<quint64> m_generation;
+
+    bool isSuperseded(quint64 generation) const { return m_generation.load() != generation; }
+    void computePredictions(const QString &prefix, int maxResults, quint64 generation);
+    QStringList computeCorrections(const QString &word, int maxResults, bool *confident) const;
     bool loadDictionary(const QString &language);
-    void loadUserDictionary();
+    void ensureUserDictionary();
+    quint64 userDictionaryStamp(const QByteArray &salt) const;
+    QVector<WordLexicon::Word> readUserWords() const;
+    void reloadUserLexicon();
+    void loadLexicon();
+    std::shared_ptr<const WordLexicon> loadCachedLexicon(
+        const QString &name, quint64 stamp,
+        const std::function<QVector<WordLexicon::Word>()> &readWords) const;
+    void publishSpellSnapshot();
+    void addLearnedSpelling(const QString &word);
+    void readDictionary(QVector<WordLexicon::Word> *words, QVector<WordLexicon::Word> *compoundParts) const;
+    quint64 lexiconStamp() const;
+    void ensureNGramModel();
+    void scheduleCommit();
     QString findDictionaryPath(const QString &language);
 };
 
@@ -0,0 +1,487 @@
+/*
+ * Marathon Virtual Keyboard - Word Lexicon Implementation
+ */
+
+#include "WordLexicon.h"
+#include "KeyboardGeometry.h"
+
+#include <QDebug>
+#include <QVarLengthArray>
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+namespace {
+
+// Case variants of a prefix followed at once ("ab", "Ab", "AB", ...)
+constexpr int MaxPrefixVariants = 8;
+
+// Longer words are not corrected; nobody mistypes them into another word
+constexpr int MaxCorrectionLength = 32;
+
+// Edit table cells outside the band the search computes
+constexpr quint8 Unreachable = 0xff;
+
+inline char16_t foldCase(char16_t unit)
+{
+    if (unit < 0x80) return (unit >= 'A' && unit <= 'Z') ? unit + ('a' - 'A') : unit;
+    return QChar(unit).toLower().unicode();
+}
+
+// Cheapest edits on the keyboard from typed to word (both folded)
+int editCost(const char16_t *typed, int n, const char16_t *word, int m, const KeyboardGeometry &keys)
+{
+    int table[MaxCorrectionLength * 2 + 1][MaxCorrectionLength + 1];
+    for (int j = 0; j <= n; ++j) {
+        table[0][j] = j * KeyboardGeometry::EditCost;
+    }
+    for (int d = 1; d <= m; ++d) {
+        table[d][0] = d * KeyboardGeometry::EditCost;
+        for (int j = 1; j <= n; ++j) {
+            int cost = table[d - 1][j - 1] + keys.substitutionCost(typed[j - 1], word[d - 1]);
+            cost = std::min(cost, table[d - 1][j] + KeyboardGeometry::EditCost);
+            cost = std::min(cost, table[d][j - 1] + KeyboardGeometry::EditCost);
+            if (d >= 2 && j >= 2 && word[d - 1] == typed[j - 2] && word[d - 2] == typed[j - 1]) {
+                cost = std::min(cost, table[d - 2][j - 2] + KeyboardGeometry::EditCost);
+            }
+            table[d][j] = cost;
+        }
+    }
+    return table[m][n];
+}
+
+} // namespace
+
+WordLexicon::WordLexicon()
+    : m_nodes(nullptr)
+    , m_nodeCount(0)
+    , m_wordCount(0)
+{
+}
+
+WordLexicon::~WordLexicon()
+{
+    clear();
+}
+
+void WordLexicon::clear()
+{
+    m_nodes = nullptr;
+    m_nodeCount = 0;
+    m_wordCount = 0;
+    m_image.release();
+}
+
+QByteArray WordLexicon::build(QVector<Word> words, quint64 stamp)
+{
+    words.erase(std::remove_if(words.begin(), words.end(),
+                               [](const Word &word) { return word.text.isEmpty(); }),
+                words.end());
+    // Code unit order, so a word sorts before every word it prefixes
+    std::sort(words.begin(), words.end(), [](const Word &a, const Word &b) {
+        return a.text < b.text;
+    });
+
+    QVector<Node> nodes;
+    nodes.append(Node{0, 0, 0, 0, 0});
+
+    // A node's children are appended together, so they are contiguous.
+    // Nodes are expanded depth-first, which keeps each subtree close to
+    // its root for searches that walk it (see correct()).
+    struct Pending {
+        int node;
+        int begin;
+        int end;
+        int depth;
+    };
+    QVector<Pending> stack;
+    QVector<Pending> children;
+    stack.append({0, 0, int(words.size()), 0});
+
+    quint32 wordCount = 0;
+    while (!stack.isEmpty()) {
+        const Pending pending = stack.takeLast();
+
+        int i = pending.begin;
+        while (i < pending.end && words.at(i).text.size() == pending.depth) {
+            const quint16 rank = std::max<quint16>(1, words.at(i).rank);
+            nodes[pending.node].wordRank = std::max(nodes[pending.node].wordRank, rank);
+            ++i;
+        }
+        if (nodes[pending.node].wordRank) wordCount++;
+
+        nodes[pending.node].firstChild = nodes.size();
+        while (i < pending.end) {
+            const char16_t unit = words.at(i).text.at(pending.depth).unicode();
+            int j = i + 1;
+            while (j < pending.end && words.at(j).text.at(pending.depth).unicode() == unit) {
+                ++j;
+            }
+            nodes.append(Node{0, unit, 0, 0, 0});
+            nodes[pending.node].childCount++;
+            children.append({int(nodes.size()) - 1, i, j, pending.depth + 1});
+            i = j;
+        }
+        // First child on top
+        for (int c = children.size() - 1; c >= 0; --c) {
+            stack.append(children.at(c));
+        }
+        children.clear();
+    }
+
+    // Children always follow their parent, so one backward pass suffices
+    for (int n = nodes.size() - 1; n >= 0; --n) {
+        Node &node = nodes[n];
+        node.bestRank = node.wordRank;
+        for (quint32 c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            node.bestRank = std::max(node.bestRank, nodes.at(c).bestRank);
+        }
+    }
+
+    Header header;
+    std::memcpy(header.magic, "MWLX", 4);
+    header.version = Version;
+    header.stamp = stamp;
+    header.nodeCount = nodes.size();
+    header.wordCount = wordCount;
+
+    QByteArray image;
+    image.reserve(sizeof(Header) + nodes.size() * sizeof(Node));
+    image.append(reinterpret_cast<const char *>(&header), sizeof(Header));
+    image.append(reinterpret_cast<const char *>(nodes.constData()), nodes.size() * sizeof(Node));
+    return image;
+}
+
+bool WordLexicon::load(const QString &path, quint64 stamp)
+{
+    clear();
+    if (!m_image.open(path, "MWLX", Version, stamp, sizeof(Header))
+        || !attach(m_image.data(), m_image.size())) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool WordLexicon::setImage(const QByteArray &image)
+{
+    clear();
+    if (!m_image.setImage(image, "MWLX", Version, sizeof(Header))
+        || !attach(m_image.data(), m_image.size())) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool WordLexicon::attach(const uchar *data, qint64 size)
+{
+    // MappedImage checked the magic, version, stamp and header size
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (header.nodeCount == 0
+        || qint64(sizeof(Header)) + qint64(header.nodeCount) * qint64(sizeof(Node)) > size) {
+        return false;
+    }
+
+    // A damaged cache must not send lookups out of bounds
+    const Node *nodes = reinterpret_cast<const Node *>(data + sizeof(Header));
+    for (quint32 n = 0; n < header.nodeCount; ++n) {
+        if (quint64(nodes[n].firstChild) + nodes[n].childCount > header.nodeCount) {
+            qWarning() << "[WordLexicon] Corrupt lexicon image";
+            return false;
+        }
+    }
+
+    m_nodes = nodes;
+    m_nodeCount = header.nodeCount;
+    m_wordCount = int(header.wordCount);
+    return true;
+}
+
+const WordLexicon::Node *WordLexicon::child(const Node *node, char16_t unit) const
+{
+    const Node *begin = m_nodes + node->firstChild;
+    const Node *end = begin + node->childCount;
+    const Node *found = std::lower_bound(begin, end, unit, [](const Node &n, char16_t u) {
+        return n.unit < u;
+    });
+    return (found != end && found->unit == unit) ? found : nullptr;
+}
+
+const WordLexicon::Node *WordLexicon::find(const QString &word, Casing casing) const
+{
+    const Node *node = m_nodes;
+    for (int i = 0; i < word.size() && node; ++i) {
+        QChar ch = word.at(i);
+        if (casing == Casing::Lower || (casing == Casing::Capitalized && i > 0)) {
+            ch = ch.toLower();
+        } else if (casing == Casing::Capitalized) {
+            ch = ch.toUpper();
+        }
+        node = child(node, ch.unicode());
+    }
+    return node;
+}
+
+int WordLexicon::rank(const QString &word) const
+{
+    if (!m_nodes || word.isEmpty()) return 0;
+
+    const Node *node = find(word, Casing::AsWritten);
+    return node ? node->wordRank : 0;
+}
+
+bool WordLexicon::contains(const QString &word) const
+{
+    if (!m_nodes || word.isEmpty()) return false;
+
+    auto isWord = [this, &word](Casing casing) {
+        const Node *node = find(word, casing);
+        return node && node->wordRank;
+    };
+
+    if (isWord(Casing::AsWritten)) return true;
+    if (!word.at(0).isUpper()) return false;
+
+    bool hasLower = false;
+    bool hasUpper = false;
+    for (int i = 1; i < word.size(); ++i) {
+        hasLower |= word.at(i).isLower();
+        hasUpper |= word.at(i).isUpper();
+    }
+    if (hasLower && hasUpper) return false; // Mixed case only as written
+
+    // Capitalized or all caps may be a lowercase word; all caps may also
+    // be a capitalized one
+    return isWord(Casing::Lower) || (hasUpper && isWord(Casing::Capitalized));
+}
+
+int WordLexicon::prefixesOf(QStringView text, int *lengths, int *ranks, int maxMatches) const
+{
+    if (!m_nodes) return 0;
+
+    int count = 0;
+    const Node *node = m_nodes;
+    for (int i = 0; i < text.size() && count < maxMatches; ++i) {
+        node = child(node, text.at(i).unicode());
+        if (!node) break;
+        if (node->wordRank) {
+            lengths[count] = i + 1;
+            ranks[count] = node->wordRank;
+            ++count;
+        }
+    }
+    return count;
+}
+
+QStringList WordLexicon::complete(const QString &prefix, int maxResults) const
+{
+    QStringList results;
+    if (!m_nodes || maxResults <= 0) return results;
+
+    // Nodes spelling the prefix, each with the prefix as stored
+    struct Variant {
+        const Node *node;
+        QString text;
+    };
+    QVarLengthArray<Variant, MaxPrefixVariants> variants;
+    variants.append({m_nodes, QString()});
+
+    for (QChar ch : prefix) {
+        QVarLengthArray<Variant, MaxPrefixVariants> next;
+        const char16_t units[] = { ch.toLower().unicode(), ch.toUpper().unicode(), ch.unicode() };
+        for (const Variant &variant : variants) {
+            for (int u = 0; u < 3; ++u) {
+                if ((u > 0 && units[u] == units[0]) || (u > 1 && units[u] == units[1])) continue;
+                const Node *node = child(variant.node, units[u]);
+                if (node && next.size() < MaxPrefixVariants) {
+                    next.append({node, variant.text + QChar(units[u])});
+                }
+            }
+        }
+        if (next.isEmpty()) return results;
+        variants = next;
+    }
+
+    // Best-first over the subtrees below the prefix. A node's bestRank
+    // bounds every word under it, so words come out in rank order.
+    struct Item {
+        const Node *node;
+        int parent; // Item index, or -1 - variant index
+    };
+    struct Candidate {
+        int rank;
+        bool word; // The word ending at the item, rather than its subtree
+        int item;
+
+        bool operator<(const Candidate &other) const {
+            // Priority queue pops the largest: higher rank, then words,
+            // then items found earlier (shorter)
+            if (rank != other.rank) return rank < other.rank;
+            if (word != other.word) return !word;
+            return item > other.item;
+        }
+    };
+
+    std::vector<Item> items;
+    items.reserve(128);
+    std::priority_queue<Candidate> queue;
+    for (int v = 0; v < variants.size(); ++v) {
+        items.push_back({variants[v].node, -1 - v});
+        queue.push({variants[v].node->bestRank, false, int(items.size()) - 1});
+    }
+
+    while (!queue.empty() && results.size() < maxResults) {
+        const Candidate candidate = queue.top();
+        queue.pop();
+        const Item item = items[candidate.item];
+
+        if (candidate.word) {
+            QString suffix;
+            int index = candidate.item;
+            while (items[index].parent >= 0) {
+                suffix.prepend(QChar(items[index].node->unit));
+                index = items[index].parent;
+            }
+            results.append(variants[-1 - items[index].parent].text + suffix);
+            continue;
+        }
+
+        if (item.node->wordRank) {
+            queue.push({item.node->wordRank, true, candidate.item});
+        }
+        const Node *child = m_nodes + item.node->firstChild;
+        for (int c = 0; c < item.node->childCount; ++c, ++child) {
+            items.push_back({child, candidate.item});
+            queue.push({child->bestRank, false, int(items.size()) - 1});
+        }
+    }
+
+    return results;
+}
+
+QVector<WordLexicon::Correction> WordLexicon::correct(const QString &word, const KeyboardGeometry &keys,
+                                                      int maxEdits, int rankPerCost, int maxResults) const
+{
+    QVector<Correction> results;
+    const int n = word.size();
+    if (!m_nodes || n == 0 || n > MaxCorrectionLength || maxEdits < 0 || maxResults <= 0) return results;
+    maxEdits = std::min(maxEdits, n);
+
+    char16_t typed[MaxCorrectionLength];
+    for (int j = 0; j < n; ++j) {
+        typed[j] = foldCase(word.at(j).unicode());
+    }
+
+    // Row d of the edit table counts the edits turning each typed prefix
+    // into the d letters on the current path. Only cells with
+    // |d - j| <= maxEdits can be in reach, so only that band is computed;
+    // the cells around it keep Unreachable. A node's row overwrites its
+    // previous sibling's, which is done with.
+    const int maxDepth = n + maxEdits;
+    const int stride = n + 1;
+    std::vector<quint8> rows(size_t(maxDepth + 1) * stride, Unreachable);
+    for (int j = 0; j <= std::min(n, maxEdits); ++j) {
+        rows[j] = quint8(j);
+    }
+    char16_t spelled[MaxCorrectionLength * 2]; // As stored
+    char16_t folded[MaxCorrectionLength * 2];
+
+    // Words within reach, scored by the keyboard cost of their edits; a
+    // min-heap on score once full
+    struct Kept {
+        int score;
+        int cost;
+        int rank;
+        QString text;
+    };
+    std::vector<Kept> kept;
+    kept.reserve(maxResults);
+    auto better = [](const Kept &a, const Kept &b) { return a.score > b.score; };
+
+    struct Frame {
+        quint32 node;
+        int depth;
+    };
+    std::vector<Frame> stack;
+    stack.reserve(256);
+    // The first letter is rarely mistyped by more than a key, and at
+    // depth 1 every branch is within reach: this drops most of the trie.
+    // It may also be swapped with the second.
+    for (quint32 c = m_nodes->firstChild + m_nodes->childCount; c-- > m_nodes->firstChild;) {
+        const char16_t unit = foldCase(m_nodes[c].unit);
+        if (keys.substitutionCost(typed[0], unit) <= KeyboardGeometry::NeighbourCost
+            || (n > 1 && unit == typed[1])) {
+            stack.push_back({c, 1});
+        }
+    }
+
+    while (!stack.empty()) {
+        const Frame frame = stack.back();
+        stack.pop_back();
+        const Node &node = m_nodes[frame.node];
+        const int d = frame.depth;
+
+        // No word below scores more than the subtree's best rank
+        if (int(kept.size()) == maxResults && node.bestRank <= kept.front().score) continue;
+
+        const char16_t unit = foldCase(node.unit);
+        spelled[d - 1] = node.unit;
+        folded[d - 1] = unit;
+
+        const quint8 *prev = rows.data() + size_t(d - 1) * stride;
+        quint8 *row = rows.data() + size_t(d) * stride;
+        const int lo = std::max(0, d - maxEdits);
+        const int hi = std::min(n, d + maxEdits);
+
+        int rowMin = Unreachable;
+        if (lo == 0) {
+            row[0] = quint8(d);
+            rowMin = d;
+        }
+        for (int j = std::max(1, lo); j <= hi; ++j) {
+            int edits = std::min(prev[j - 1] + (typed[j - 1] != unit ? 1 : 0), prev[j] + 1);
+            edits = std::min(edits, row[j - 1] + 1);
+            if (d >= 2 && j >= 2 && unit == typed[j - 2] && folded[d - 2] == typed[j - 1]) {
+                edits = std::min(edits, rows[size_t(d - 2) * stride + j - 2] + 1);
+            }
+            row[j] = quint8(std::min<int>(edits, Unreachable));
+            rowMin = std::min(rowMin, edits);
+        }
+
+        // Every word below takes at least as many edits as the row's best cell
+        if (rowMin > maxEdits) continue;
+
+        if (node.wordRank && row[n] <= maxEdits) {
+            const int cost = editCost(typed, n, folded, d, keys);
+            const int score = node.wordRank - cost * rankPerCost;
+            if (int(kept.size()) < maxResults || score > kept.front().score) {
+                if (int(kept.size()) == maxResults) {
+                    std::pop_heap(kept.begin(), kept.end(), better);
+                    kept.pop_back();
+                }
+                kept.push_back({score, cost, node.wordRank,
+                                QString(reinterpret_cast<const QChar *>(spelled), d)});
+                std::push_heap(kept.begin(), kept.end(), better);
+            }
+        }
+
+        if (d < maxDepth) {
+            for (quint32 c = node.firstChild + node.childCount; c-- > node.firstChild;) {
+                stack.push_back({c, d + 1});
+            }
+        }
+    }
+
+    std::sort(kept.begin(), kept.end(), [](const Kept &a, const Kept &b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.cost < b.cost;
+    });
+    results.reserve(int(kept.size()));
+    for (const Kept &k : kept) {
+        results.append({k.text, k.cost, k.rank, k.score});
+    }
+    return results;
+}
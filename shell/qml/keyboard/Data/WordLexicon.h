@@ -0,0 +1,151 @@
+/*
+ * Marathon Virtual Keyboard - Word Lexicon
+ * Compact, memory-mapped completion index
+ *
+ * Copyright (C) 2025 Marathon OS
+ */
+
+#ifndef MARATHON_WORDLEXICON_H
+#define MARATHON_WORDLEXICON_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "MappedImage.h"
+
+class KeyboardGeometry;
+
+/**
+ * @brief Read-only word list answering top-k prefix queries
+ *
+ * The lexicon is a trie flattened into one array of fixed-size nodes.
+ * Each node's children are contiguous and sorted by UTF-16 code unit.
+ * Every node stores the rank of the word ending there and the best rank
+ * anywhere below it, so completions are found best first and a query
+ * only touches the nodes along the prefix and on the paths to the words
+ * it returns.
+ *
+ * The image has no pointers and is position independent: it is built
+ * once, written to a cache file and memory-mapped on later loads. Ranks
+ * prevent suffix sharing (a DAWG would merge words of different rank),
+ * which is why this is a plain trie.
+ */
+class WordLexicon
+{
+public:
+    struct Word {
+        QString text;
+        quint16 rank = 0; // Higher is more likely, 0 is not allowed
+    };
+
+    struct Correction {
+        QString text;
+        int cost = 0; // Of the edits, in KeyboardGeometry units
+        int rank = 0;
+        int score = 0; // rank - cost * rankPerCost
+    };
+
+    WordLexicon();
+    ~WordLexicon();
+
+    WordLexicon(const WordLexicon &) = delete;
+    WordLexicon &operator=(const WordLexicon &) = delete;
+
+    /**
+     * @brief Serialize words into a lexicon image
+     * @param words Words in any order; duplicates keep their best rank
+     * @param stamp Identifies the sources, checked again by load()
+     */
+    static QByteArray build(QVector<Word> words, quint64 stamp);
+
+    /**
+     * @brief Map a lexicon image file
+     * @return false if the file is missing, corrupt or has another stamp
+     */
+    bool load(const QString &path, quint64 stamp);
+
+    /**
+     * @brief Use an image held in memory (e.g. when no cache is writable)
+     */
+    bool setImage(const QByteArray &image);
+
+    void clear();
+    bool isValid() const { return m_nodes != nullptr; }
+    int wordCount() const { return m_wordCount; }
+
+    /**
+     * @brief Best-ranked words starting with prefix, ignoring case
+     * @return Up to maxResults words, as stored, best first
+     */
+    QStringList complete(const QString &prefix, int maxResults) const;
+
+    /**
+     * @brief Words that word may be a typo of, ignoring case
+     *
+     * Walks the trie with a Levenshtein automaton (with transpositions)
+     * bounded to maxEdits, computing only the diagonal band of the edit
+     * table within reach and dropping every subtree the band has left.
+     * Words within maxEdits are scored by rank less the cost of their
+     * edits on the keyboard; subtrees whose best rank cannot beat the
+     * results so far are skipped. The first letter must be the one typed,
+     * on a neighbouring key, or swapped with the second.
+     *
+     * @param rankPerCost Rank a word gives up per unit of edit cost
+     * @return Up to maxResults words, as stored, best score first
+     */
+    QVector<Correction> correct(const QString &word, const KeyboardGeometry &keys, int maxEdits,
+                                int rankPerCost, int maxResults) const;
+
+    /**
+     * @brief Rank of the exact word (case-sensitive), 0 if absent
+     */
+    int rank(const QString &word) const;
+
+    /**
+     * @brief Whether the word is spelled right, allowing the case
+     * variants a spell checker allows: "Hello" and "HELLO" for "hello",
+     * "LONDON" for "London", but not "london"
+     */
+    bool contains(const QString &word) const;
+
+    /**
+     * @brief Stored words text starts with (case-sensitive), shortest first
+     *
+     * Writes the length and rank of each to lengths and ranks.
+     * @return How many were found, at most maxMatches
+     */
+    int prefixesOf(QStringView text, int *lengths, int *ranks, int maxMatches) const;
+
+private:
+    struct Node {
+        quint32 firstChild; // Index of the first child
+        quint16 unit; // UTF-16 code unit on the edge into this node
+        quint16 childCount;
+        quint16 wordRank; // Rank of the word ending here, 0 = none
+        quint16 bestRank; // Best wordRank in this subtree
+    };
+
+    struct Header {
+        char magic[4];
+        quint32 version;
+        quint64 stamp;
+        quint32 nodeCount;
+        quint32 wordCount;
+    };
+
+    static constexpr quint32 Version = 1;
+
+    enum class Casing { AsWritten, Lower, Capitalized };
+
+    bool attach(const uchar *data, qint64 size);
+    const Node *child(const Node *node, char16_t unit) const;
+    const Node *find(const QString &word, Casing casing) const;
+
+    MappedImage m_image;
+    const Node *m_nodes;
+    quint32 m_nodeCount;
+    int m_wordCount;
+};
+
+#endif // MARATHON_WORDLEXICON_H
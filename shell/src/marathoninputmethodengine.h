@@ -53,7 +53,9 @@ public:
      * @param text The text to commit
      * 
      * This is the primary method for inserting text from the keyboard.
-     * It uses Qt.inputMethod to commit text properly.
+     * The whole string goes in one QInputMethodEvent, so the field lays
+     * out once however long it is. Items that do not take input method
+     * events get key events instead.
      */
     Q_INVOKABLE void commitText(const QString& text);
     
@@ -73,7 +75,8 @@ public:
      * @brief Replace the current preedit text with a new word
      * @param word The new word to commit
      * 
-     * Used for accepting predictions/autocorrections.
+     * Used for accepting predictions/autocorrections. The preedit is
+     * deleted and the word inserted by the same event.
      */
     Q_INVOKABLE void replacePreedit(const QString& word);
     
@@ -139,6 +142,14 @@ private:
     void connectToInputMethod();
     void disconnectFromInputMethod();
     
+    /**
+     * @brief Commit through a QInputMethodEvent
+     * @param replaceLength Characters before the cursor to replace
+     * @return false if the focused item does not accept input method events
+     */
+    bool sendCommitString(const QString& text, int replaceLength);
+    void sendKeyEvents(const QString& text);
+    
     bool m_active;
     QString m_preeditText;
     QInputMethod* m_inputMethod;
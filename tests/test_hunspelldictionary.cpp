@@ -0,0 +1,253 @@
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include "../shell/qml/keyboard/Data/HunspellDictionary.h"
+
+class TestHunspellDictionary : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void testSuffixConditions();
+    void testCrossProduct();
+    void testNeedAffixAndForbidden();
+    void testLongFlagsAndAliases();
+    void testNumericFlags();
+    void testContinuationClasses();
+    void testCompoundParts();
+    void testEncoding();
+    void testMissingFiles();
+
+private:
+    QTemporaryDir *tempDir;
+    QSet<QString> words;
+    QSet<QString> stems;
+    QHash<QString, int> parts;
+
+    QString writeDictionary(const QString &name, const QByteArray &aff, const QByteArray &dic);
+    bool read(const QString &basePath);
+};
+
+void TestHunspellDictionary::initTestCase()
+{
+    tempDir = new QTemporaryDir();
+    QVERIFY(tempDir->isValid());
+}
+
+void TestHunspellDictionary::cleanupTestCase()
+{
+    delete tempDir;
+}
+
+QString TestHunspellDictionary::writeDictionary(const QString &name, const QByteArray &aff, const QByteArray &dic)
+{
+    const QString basePath = tempDir->path() + "/" + name;
+
+    QFile affFile(basePath + ".aff");
+    if (affFile.open(QIODevice::WriteOnly)) affFile.write(aff);
+    affFile.close();
+
+    QFile dicFile(basePath + ".dic");
+    if (dicFile.open(QIODevice::WriteOnly)) dicFile.write(dic);
+    dicFile.close();
+
+    return basePath;
+}
+
+bool TestHunspellDictionary::read(const QString &basePath)
+{
+    words.clear();
+    stems.clear();
+    parts.clear();
+
+    HunspellDictionary dictionary;
+    return dictionary.read(basePath, [this](const QString &word, bool stem) {
+        words.insert(word);
+        if (stem) stems.insert(word);
+    }, [this](const QString &part, int positions) {
+        parts[part] |= positions;
+    });
+}
+
+void TestHunspellDictionary::testSuffixConditions()
+{
+    const QString basePath = writeDictionary("suffixes",
+        "SET UTF-8\n"
+        "SFX S Y 3\n"
+        "SFX S y ies [^aeiou]y\n"
+        "SFX S 0 s [aeiou]y\n"
+        "SFX S 0 s [^y]\n",
+        "4\n"
+        "try/S\n"
+        "play/S\n"
+        "cat/S\tpo:noun\n"
+        "dog/S st:dog\n");
+    QVERIFY(read(basePath));
+
+    QCOMPARE(words, (QSet<QString>{ "try", "tries", "play", "plays", "cat", "cats", "dog", "dogs" }));
+    QCOMPARE(stems, (QSet<QString>{ "try", "play", "cat", "dog" }));
+}
+
+void TestHunspellDictionary::testCrossProduct()
+{
+    const QString basePath = writeDictionary("cross",
+        "SFX S Y 1\n"
+        "SFX S 0 s .\n"
+        "SFX D N 1\n"
+        "SFX D 0 ed .\n"
+        "PFX U Y 1\n"
+        "PFX U 0 un .\n",
+        "2\n"
+        "lock/SU\n"
+        "jump/DU\n");
+    QVERIFY(read(basePath));
+
+    // Only suffixes that allow it combine with the prefix
+    QCOMPARE(words, (QSet<QString>{ "lock", "locks", "unlock", "unlocks",
+                                    "jump", "jumped", "unjump" }));
+}
+
+void TestHunspellDictionary::testNeedAffixAndForbidden()
+{
+    const QString basePath = writeDictionary("flags",
+        "NEEDAFFIX X\n"
+        "FORBIDDENWORD F\n"
+        "ONLYINCOMPOUND C\n"
+        "SFX S Y 1\n"
+        "SFX S 0 s .\n",
+        "4\n"
+        "walk/XS\n"
+        "bad/FS\n"
+        "part/C\n"
+        "word\n");
+    QVERIFY(read(basePath));
+
+    QCOMPARE(words, (QSet<QString>{ "walks", "word" }));
+    QCOMPARE(stems, QSet<QString>{ "word" });
+}
+
+void TestHunspellDictionary::testLongFlagsAndAliases()
+{
+    const QString basePath = writeDictionary("long",
+        "FLAG long\n"
+        "AF 2\n"
+        "AF Sx\n"
+        "AF SxUn\n"
+        "SFX Sx Y 1\n"
+        "SFX Sx 0 s .\n"
+        "PFX Un Y 1\n"
+        "PFX Un 0 re .\n",
+        "3\n"
+        "load/2\n"
+        "word/1\n"
+        "play/SxUn\n");
+    QVERIFY(read(basePath));
+
+    QCOMPARE(words, (QSet<QString>{ "load", "loads", "reload", "reloads", "word", "words",
+                                    "play", "plays", "replay", "replays" }));
+}
+
+void TestHunspellDictionary::testNumericFlags()
+{
+    const QString basePath = writeDictionary("numeric",
+        "FLAG num\n"
+        "SFX 101 Y 1\n"
+        "SFX 101 0 ing .\n"
+        "SFX 7 Y 1\n"
+        "SFX 7 0 er .\n",
+        "2\n"
+        "walk/101,7\n"
+        "talk/7\n");
+    QVERIFY(read(basePath));
+
+    QCOMPARE(words, (QSet<QString>{ "walk", "walking", "walker", "talk", "talker" }));
+}
+
+void TestHunspellDictionary::testContinuationClasses()
+{
+    const QString basePath = writeDictionary("continuation",
+        "NEEDAFFIX X\n"
+        "SFX A Y 1\n"
+        "SFX A 0 ation/B .\n"
+        "SFX B Y 1\n"
+        "SFX B 0 al .\n"
+        "SFX C Y 1\n"
+        "SFX C 0 ung/XD .\n"
+        "SFX D Y 1\n"
+        "SFX D 0 s .\n"
+        "PFX P Y 1\n"
+        "PFX P 0 re .\n",
+        "2\n"
+        "form/AP\n"
+        "leit/C\n");
+    QVERIFY(read(basePath));
+
+    // A suffix's flags allow a second suffix; NEEDAFFIX there means the
+    // first one never stands alone
+    QCOMPARE(words, (QSet<QString>{ "form", "formation", "formational", "reform", "reformation",
+                                    "leit", "leitungs" }));
+    QVERIFY(parts.isEmpty());
+}
+
+void TestHunspellDictionary::testCompoundParts()
+{
+    const QString basePath = writeDictionary("compound",
+        "COMPOUNDBEGIN B\n"
+        "COMPOUNDEND E\n"
+        "COMPOUNDFLAG Y\n"
+        "ONLYINCOMPOUND O\n"
+        "COMPOUNDMIN 3\n"
+        "SFX S Y 1\n"
+        "SFX S 0 s/BO .\n",
+        "3\n"
+        "arbeit/SE\n"
+        "amt/Y\n"
+        "zu/Y\n");
+    QVERIFY(read(basePath));
+
+    // "arbeits" only begins compounds; a suffixed part may still end one.
+    // "zu" is shorter than COMPOUNDMIN.
+    QCOMPARE(words, (QSet<QString>{ "arbeit", "amt", "zu" }));
+    const int anywhere = HunspellDictionary::CompoundBegin | HunspellDictionary::CompoundMiddle
+                         | HunspellDictionary::CompoundEnd;
+    QCOMPARE(parts, (QHash<QString, int>{
+        { "arbeit", HunspellDictionary::CompoundEnd },
+        { "arbeits", HunspellDictionary::CompoundBegin | HunspellDictionary::CompoundEnd },
+        { "amt", anywhere },
+    }));
+
+    // Compounds of two parts have no middle
+    QVERIFY(read(writeDictionary("twoparts", "COMPOUNDFLAG Y\nCOMPOUNDWORDMAX 2\n", "1\nhaus/Y\n")));
+    QCOMPARE(parts, (QHash<QString, int>{
+        { "haus", HunspellDictionary::CompoundBegin | HunspellDictionary::CompoundEnd },
+    }));
+}
+
+void TestHunspellDictionary::testEncoding()
+{
+    // Both files are in the encoding SET names, Latin-1 here
+    const QString basePath = writeDictionary("latin1",
+        "SET ISO8859-1\n"
+        "SFX S Y 1\n"
+        "SFX S 0 s .\n",
+        "2\n"
+        "caf\xe9/S\n"
+        "na\xefve\n");
+    QVERIFY(read(basePath));
+
+    QCOMPARE(words, (QSet<QString>{ QString::fromUtf8("café"), QString::fromUtf8("cafés"),
+                                    QString::fromUtf8("naïve") }));
+}
+
+void TestHunspellDictionary::testMissingFiles()
+{
+    QVERIFY(!read(tempDir->path() + "/missing"));
+    QVERIFY(words.isEmpty());
+}
+
+QTEST_MAIN(TestHunspellDictionary)
+#include "test_hunspelldictionary.moc"
@@ -0,0 +1,110 @@
+#include <QTest>
+#include <QByteArray>
+#include <QVector>
+#include "../apps/terminal/src/TerminalParser.h"
+
+class TestTerminalParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSubParams();
+    void testExtendedColor_data();
+    void testExtendedColor();
+
+private:
+    // The SGR colors in a sequence, with the parameter each one ends on
+    struct Color {
+        int param;
+        uint32_t color;
+        bool indexed;
+        int last;
+    };
+
+    class Recorder : public TerminalParser::Handler {
+    public:
+        QVector<int> params;
+        QVector<bool> subParams;
+        QVector<Color> colors;
+
+        void print(const char *, int) override {}
+        void execute(uint8_t) override {}
+        void escDispatch(const TerminalParser &, char) override {}
+        void oscDispatch(const QByteArray &) override {}
+        void csiDispatch(const TerminalParser &parser, char final) override
+        {
+            if (final != 'm') return;
+            for (int i = 0; i < parser.paramCount(); ++i) {
+                params.append(parser.param(i));
+                subParams.append(parser.isSubParam(i));
+            }
+            for (int i = 0; i < parser.paramCount(); ++i) {
+                const int param = parser.param(i);
+                if (parser.isSubParam(i) || (param != 38 && param != 48)) continue;
+                Color color{ param, 0, false, 0 };
+                if (!parser.extendedColor(&i, &color.color, &color.indexed)) color.param = -param;
+                color.last = i;
+                colors.append(color);
+            }
+        }
+    };
+};
+
+void TestTerminalParser::testSubParams()
+{
+    Recorder recorder;
+    TerminalParser parser(&recorder);
+    const QByteArray input = "\x1b[1;4:3;38:2::10:20:30m";
+    parser.parse(input.constData(), input.size());
+
+    QCOMPARE(recorder.params, (QVector<int>{ 1, 4, 3, 38, 2, 0, 10, 20, 30 }));
+    QCOMPARE(recorder.subParams, (QVector<bool>{ false, false, true, false, true, true, true, true, true }));
+
+    // Sub-parameters do not carry over to the next sequence
+    recorder.params.clear();
+    recorder.subParams.clear();
+    parser.parse("\x1b[1;2m", 6);
+    QCOMPARE(recorder.subParams, (QVector<bool>{ false, false }));
+}
+
+void TestTerminalParser::testExtendedColor_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    // Per color: the SGR it belongs to (negated when rejected), the color,
+    // whether it is a palette index, and the last parameter it took
+    QTest::addColumn<QVector<int>>("expected");
+
+    QTest::newRow("palette") << QByteArray("\x1b[38;5;196m") << QVector<int>{ 38, 196, 1, 2 };
+    QTest::newRow("direct") << QByteArray("\x1b[48;2;1;2;3m") << QVector<int>{ 48, int(0xFF010203), 0, 4 };
+    QTest::newRow("clamped") << QByteArray("\x1b[38;2;300;0;255m") << QVector<int>{ 38, int(0xFFFF00FF), 0, 4 };
+    QTest::newRow("palette colon") << QByteArray("\x1b[38:5:21m") << QVector<int>{ 38, 21, 1, 2 };
+    QTest::newRow("direct colon") << QByteArray("\x1b[38:2:10:20:30m") << QVector<int>{ 38, int(0xFF0A141E), 0, 4 };
+    QTest::newRow("color space") << QByteArray("\x1b[38:2::10:20:30m") << QVector<int>{ 38, int(0xFF0A141E), 0, 5 };
+    QTest::newRow("both") << QByteArray("\x1b[1;38;5;1;48:2:0:0:255;7m")
+                          << QVector<int>{ 38, 1, 1, 3, 48, int(0xFF0000FF), 0, 8 };
+    // A short ':' form takes only its own sub-parameters, a short ';' form
+    // the rest of the sequence
+    QTest::newRow("short colon") << QByteArray("\x1b[38:2:1:2;48;5;9m")
+                                 << QVector<int>{ -38, 0, 0, 3, 48, 9, 1, 6 };
+    QTest::newRow("short") << QByteArray("\x1b[38;2;1;2m") << QVector<int>{ -38, 0, 0, 3 };
+    QTest::newRow("unknown kind") << QByteArray("\x1b[48;3;1;1;38;5;1m") << QVector<int>{ -48, 0, 0, 6 };
+}
+
+void TestTerminalParser::testExtendedColor()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(QVector<int>, expected);
+
+    Recorder recorder;
+    TerminalParser parser(&recorder);
+    parser.parse(input.constData(), input.size());
+
+    QVector<int> found;
+    for (const Color &color : std::as_const(recorder.colors)) {
+        found += { color.param, color.param > 0 ? int(color.color) : 0, color.indexed, color.last };
+    }
+    QCOMPARE(found, expected);
+}
+
+QTEST_MAIN(TestTerminalParser)
+#include "test_terminalparser.moc"
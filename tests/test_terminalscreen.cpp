@@ -0,0 +1,98 @@
+#include <QTest>
+#include "../apps/terminal/src/TerminalFrame.h"
+#include "../apps/terminal/src/TerminalScreen.h"
+#include "../apps/terminal/src/TerminalScrollback.h"
+
+class TestTerminalScreen : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testReflowKeepsStyledBlanks();
+    void testReflowDropsDefaultBlanks();
+    void testHistoryOffset();
+};
+
+void TestTerminalScreen::testReflowKeepsStyledBlanks()
+{
+    TerminalScreen screen;
+    screen.resize(10, 3);
+
+    // "ab" and a blank run erased in a background color, as a status bar
+    // or a prompt with a colored background leaves it
+    const uint32_t blue = 0xFF0000FF;
+    screen.setBgColor(blue);
+    screen.putRun("ab", 2);
+    screen.clearLine(0);
+    screen.resetStyle();
+    screen.newLine();
+    screen.setCursorX(0);
+
+    // The blanks are part of the line, so it wraps onto a second row
+    screen.resize(5, 3);
+    QCOMPARE(screen.cursorY(), 2);
+    QVERIFY(screen.rowFlags(0) & TerminalScreen::RowWrapped);
+    QCOMPARE(screen.cell(0, 0).codePoint, uint32_t('a'));
+    for (int x = 0; x < 5; ++x) {
+        QCOMPARE(screen.cell(x, 1).codePoint, uint32_t(0));
+        QCOMPARE(screen.style(screen.cell(x, 1).style).bgColor, blue);
+    }
+
+    // And come back whole when the screen is widened again
+    screen.resize(10, 3);
+    QCOMPARE(screen.cursorY(), 1);
+    QCOMPARE(int(screen.rowFlags(0)), 0);
+    for (int x = 2; x < 10; ++x) {
+        QCOMPARE(screen.style(screen.cell(x, 0).style).bgColor, blue);
+    }
+}
+
+void TestTerminalScreen::testReflowDropsDefaultBlanks()
+{
+    TerminalScreen screen;
+    screen.resize(10, 3);
+
+    // Default blanks after the text are not carried into the new width
+    screen.putRun("abc", 3);
+    screen.newLine();
+    screen.setCursorX(0);
+
+    screen.resize(5, 3);
+    QCOMPARE(screen.cursorY(), 1);
+    QCOMPARE(int(screen.rowFlags(0)), 0);
+    QCOMPARE(screen.cell(2, 0).codePoint, uint32_t('c'));
+    QVERIFY(screen.cell(0, 1) == TerminalCell());
+}
+
+void TestTerminalScreen::testHistoryOffset()
+{
+    TerminalScreen screen;
+    screen.resize(10, 3);
+    screen.setScrollbackLimits(2, 1 << 20);
+
+    // Each row scrolled off the top moves the screen down one absolute row
+    for (int i = 0; i < 5; ++i) {
+        screen.putRun(QByteArray::number(i).constData(), 1);
+        screen.newLine();
+        screen.setCursorX(0);
+    }
+    QCOMPARE(screen.historyOffset(), qint64(3));
+
+    TerminalFrame frame;
+    screen.snapshot(&frame);
+    QCOMPARE(frame.historyOffset, qint64(3));
+    QCOMPARE(frame.cell(0, 0).codePoint, uint32_t('3'));
+
+    // Rows dropped past the line limit keep their numbers, so the first
+    // row of a search snapshot is not row 0
+    qint64 firstRow = 0;
+    const TerminalScrollback snapshot = screen.searchSnapshot(&firstRow);
+    QCOMPARE(screen.historyCount(), 2);
+    QCOMPARE(firstRow, qint64(1));
+    int width = 0;
+    QCOMPARE(snapshot.row(0, &width)[0].codePoint, uint32_t('1'));
+    QCOMPARE(snapshot.row(2, &width)[0].codePoint, uint32_t('3'));
+}
+
+QTEST_MAIN(TestTerminalScreen)
+#include "test_terminalscreen.moc"
@@ -0,0 +1,240 @@
+#include <QTest>
+#include <QByteArray>
+#include <QVector>
+#include "../apps/terminal/src/TerminalScrollback.h"
+
+class TestTerminalScrollback : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRoundTrip();
+    void testSoftWrappedRows();
+    void testTakeLast();
+    void testLineLimit();
+    void testReleaseOldestBlock();
+    void testSearchCandidates();
+
+private:
+    // Enough lines for several blocks to leave the uncompressed hot set
+    static constexpr int LineCount = 6 * TerminalScrollback::LinesPerBlock + 100;
+
+    static QVector<TerminalCell> makeLine(int i);
+    // What push() keeps of makeLine(i): trailing default blanks are implied
+    static QVector<TerminalCell> storedLine(int i);
+    static QVector<TerminalCell> lineAt(const TerminalScrollback &scrollback, int index, uint8_t *rowFlags = nullptr);
+    static void fill(TerminalScrollback &scrollback, int first, int count);
+};
+
+QVector<TerminalCell> TestTerminalScrollback::makeLine(int i)
+{
+    QVector<TerminalCell> cells;
+    auto put = [&cells](char32_t codePoint, uint16_t style, uint16_t flags = 0) {
+        TerminalCell cell;
+        cell.codePoint = codePoint;
+        cell.style = style;
+        cell.flags = flags;
+        cells.append(cell);
+    };
+
+    const QByteArray text = "line " + QByteArray::number(i);
+    for (char ch : text) put(char32_t(ch), 0);
+    put(0, 0); // An empty cell inside the line
+
+    // Style runs, then text of every UTF-8 length and wide glyphs
+    for (int k = 0; k < i % 23; ++k) put(char32_t('a' + k), uint16_t(1 + i % 5));
+    put(U'é', 2);
+    if (i % 3 == 0) {
+        put(U'中', 3, TerminalCell::WideChar);
+        put(0, 3, TerminalCell::WideContinuation);
+    }
+    if (i % 7 == 0) {
+        put(U'\U0001F600', 0, TerminalCell::WideChar);
+        put(0, 0, TerminalCell::WideContinuation);
+    }
+    put(char32_t('z'), 4);
+
+    // A styled blank is kept, default blanks after it are not
+    if (i % 2) put(0, 5);
+    for (int k = 0; k < i % 4; ++k) put(0, 0);
+    return cells;
+}
+
+QVector<TerminalCell> TestTerminalScrollback::storedLine(int i)
+{
+    QVector<TerminalCell> cells = makeLine(i);
+    while (!cells.isEmpty() && cells.last().codePoint == 0 && cells.last().style == 0
+           && !(cells.last().flags & TerminalCell::WideContinuation)) {
+        cells.removeLast();
+    }
+    return cells;
+}
+
+QVector<TerminalCell> TestTerminalScrollback::lineAt(const TerminalScrollback &scrollback, int index, uint8_t *rowFlags)
+{
+    int width = 0;
+    const TerminalCell *cells = scrollback.line(index, &width, rowFlags);
+    return cells ? QVector<TerminalCell>(cells, cells + width) : QVector<TerminalCell>();
+}
+
+void TestTerminalScrollback::fill(TerminalScrollback &scrollback, int first, int count)
+{
+    for (int i = first; i < first + count; ++i) {
+        const QVector<TerminalCell> cells = makeLine(i);
+        scrollback.push(cells.constData(), cells.size(), 0);
+    }
+}
+
+void TestTerminalScrollback::testRoundTrip()
+{
+    TerminalScrollback scrollback;
+    fill(scrollback, 0, LineCount);
+    QCOMPARE(scrollback.lineCount(), LineCount);
+    QVERIFY(scrollback.blockCount() > 3);
+
+    // Front to back, back to front, and jumping between blocks, so that
+    // lines are decoded from cold blocks as well as from the line cache
+    for (int i = 0; i < LineCount; ++i) {
+        uint8_t flags = 0xff;
+        QVERIFY2(lineAt(scrollback, i, &flags) == storedLine(i), qPrintable(QString::number(i)));
+        QCOMPARE(int(flags), 0);
+    }
+    for (int i = LineCount - 1; i >= 0; --i) {
+        QVERIFY2(lineAt(scrollback, i) == storedLine(i), qPrintable(QString::number(i)));
+    }
+    for (int k = 0; k < LineCount; ++k) {
+        const int i = int((qint64(k) * 977) % LineCount);
+        QVERIFY2(lineAt(scrollback, i) == storedLine(i), qPrintable(QString::number(i)));
+    }
+}
+
+void TestTerminalScrollback::testSoftWrappedRows()
+{
+    TerminalScrollback scrollback;
+    scrollback.setWidth(10);
+
+    // One logical line arriving as three screen rows of ten cells
+    const QVector<TerminalCell> text = storedLine(42);
+    QVERIFY(text.size() > 20);
+    const QVector<TerminalCell> first = text.mid(0, 10);
+    const QVector<TerminalCell> second = text.mid(10, 10);
+    const QVector<TerminalCell> rest = text.mid(20);
+    scrollback.push(first.constData(), first.size(), TerminalScreen::RowWrapped);
+    scrollback.push(second.constData(), second.size(), TerminalScreen::RowWrapped);
+    QCOMPARE(scrollback.lineCount(), 1);
+    scrollback.push(rest.constData(), rest.size(), 0);
+    fill(scrollback, 0, LineCount);
+
+    QCOMPARE(scrollback.lineCount(), LineCount + 1);
+    QVERIFY(lineAt(scrollback, 0) == text);
+
+    // Rows are rewrapped to the current width, wide glyphs never split
+    const int rows = TerminalScrollback::wrap(text.constData(), text.size(), 10);
+    int expectedRows = rows;
+    for (int i = 0; i < LineCount; ++i) {
+        const QVector<TerminalCell> line = storedLine(i);
+        expectedRows += TerminalScrollback::wrap(line.constData(), line.size(), 10);
+    }
+    QCOMPARE(scrollback.rowCount(), expectedRows);
+
+    QVector<TerminalCell> joined;
+    for (int row = 0; row < rows; ++row) {
+        int width = 0;
+        uint8_t flags = 0;
+        const TerminalCell *cells = scrollback.row(row, &width, &flags);
+        QVERIFY(width <= 10);
+        QCOMPARE(int(flags), row + 1 < rows ? int(TerminalScreen::RowWrapped) : 0);
+        joined += QVector<TerminalCell>(cells, cells + width);
+    }
+    QVERIFY(joined == text);
+    QCOMPARE(scrollback.firstRow(1), rows);
+
+    scrollback.setWidth(7);
+    QCOMPARE(scrollback.firstRow(1), TerminalScrollback::wrap(text.constData(), text.size(), 7));
+}
+
+void TestTerminalScrollback::testTakeLast()
+{
+    TerminalScrollback scrollback;
+    fill(scrollback, 0, LineCount);
+
+    // Pulls lines back out of every block, compressed ones included
+    for (int i = LineCount - 1; i >= 0; --i) {
+        QVector<TerminalCell> cells;
+        uint8_t flags = 0xff;
+        QVERIFY(scrollback.takeLast(&cells, &flags));
+        QVERIFY2(cells == storedLine(i), qPrintable(QString::number(i)));
+        QCOMPARE(int(flags), 0);
+        QCOMPARE(scrollback.lineCount(), i);
+    }
+
+    QVector<TerminalCell> cells;
+    uint8_t flags = 0;
+    QVERIFY(!scrollback.takeLast(&cells, &flags));
+    QCOMPARE(scrollback.blockCount(), 0);
+
+    // Still usable afterwards
+    fill(scrollback, 7, 3);
+    QVERIFY(lineAt(scrollback, 2) == storedLine(9));
+}
+
+void TestTerminalScrollback::testLineLimit()
+{
+    TerminalScrollback scrollback;
+    scrollback.setLineLimit(1000);
+    fill(scrollback, 0, LineCount);
+
+    QCOMPARE(scrollback.lineCount(), 1000);
+    for (int i = 0; i < 1000; ++i) {
+        QVERIFY2(lineAt(scrollback, i) == storedLine(LineCount - 1000 + i), qPrintable(QString::number(i)));
+    }
+}
+
+void TestTerminalScrollback::testReleaseOldestBlock()
+{
+    TerminalScrollback scrollback;
+    fill(scrollback, 0, LineCount);
+    const qint64 usage = scrollback.memoryUsage();
+
+    QVERIFY(scrollback.releaseOldestBlock());
+    QCOMPARE(scrollback.lineCount(), LineCount - TerminalScrollback::LinesPerBlock);
+    QVERIFY(scrollback.memoryUsage() < usage);
+    QVERIFY(lineAt(scrollback, 0) == storedLine(TerminalScrollback::LinesPerBlock));
+    QVERIFY(lineAt(scrollback, scrollback.lineCount() - 1) == storedLine(LineCount - 1));
+
+    // The newest block is never released
+    while (scrollback.releaseOldestBlock()) {
+    }
+    QCOMPARE(scrollback.blockCount(), 1);
+    QCOMPARE(scrollback.lineCount(), LineCount % TerminalScrollback::LinesPerBlock);
+    QVERIFY(lineAt(scrollback, 0) == storedLine(LineCount - LineCount % TerminalScrollback::LinesPerBlock));
+}
+
+void TestTerminalScrollback::testSearchCandidates()
+{
+    TerminalScrollback scrollback;
+    fill(scrollback, 0, LineCount);
+
+    // Each line's number, preceded by a space, is found in a range that
+    // holds it, whether its block is compressed or not
+    for (int i = 0; i < LineCount; i += 37) {
+        QVector<char32_t> needle{ U' ' };
+        for (char ch : QByteArray::number(i)) needle.append(char32_t(ch));
+
+        bool covered = false;
+        for (const QPair<int, int> &range : scrollback.candidateLines(needle)) {
+            covered = covered || (i >= range.first && i < range.first + range.second);
+        }
+        QVERIFY2(covered, qPrintable(QString::number(i)));
+    }
+
+    // Case-folded, like the search itself
+    const QVector<char32_t> upper{ U'L', U'I', U'N', U'E' };
+    QVector<char32_t> folded;
+    for (char32_t codePoint : upper) folded.append(TerminalScrollback::foldCase(codePoint));
+    QVERIFY(folded == (QVector<char32_t>{ U'l', U'i', U'n', U'e' }));
+    QVERIFY(!scrollback.candidateLines(folded).isEmpty());
+}
+
+QTEST_MAIN(TestTerminalScrollback)
+#include "test_terminalscrollback.moc"
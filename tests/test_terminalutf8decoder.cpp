@@ -0,0 +1,193 @@
+#include <QTest>
+#include <QByteArray>
+#include <QRandomGenerator>
+#include <QVector>
+#include "../apps/terminal/src/TerminalUtf8Decoder.h"
+
+class TestTerminalUtf8Decoder : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testValidSequences();
+    void testMalformedSequences_data();
+    void testMalformedSequences();
+    void testEverySplitPoint();
+    void testRandomChunks();
+    void testPendingInput();
+    void testAsciiPrefix();
+
+private:
+    static QByteArray encode(const QVector<char32_t> &codePoints);
+    // Decodes `data` in chunks of the given sizes, the last one taking the rest
+    static QVector<char32_t> decode(const QByteArray &data, const QVector<int> &chunks = {});
+    static QVector<char32_t> randomText(QRandomGenerator &random, int length);
+};
+
+QByteArray TestTerminalUtf8Decoder::encode(const QVector<char32_t> &codePoints)
+{
+    QByteArray out;
+    for (char32_t cp : codePoints) {
+        if (cp < 0x80) {
+            out.append(char(cp));
+        } else if (cp < 0x800) {
+            out.append(char(0xC0 | (cp >> 6)));
+            out.append(char(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.append(char(0xE0 | (cp >> 12)));
+            out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+            out.append(char(0x80 | (cp & 0x3F)));
+        } else {
+            out.append(char(0xF0 | (cp >> 18)));
+            out.append(char(0x80 | ((cp >> 12) & 0x3F)));
+            out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+            out.append(char(0x80 | (cp & 0x3F)));
+        }
+    }
+    return out;
+}
+
+QVector<char32_t> TestTerminalUtf8Decoder::decode(const QByteArray &data, const QVector<int> &chunks)
+{
+    TerminalUtf8Decoder decoder;
+    QVector<char32_t> out;
+    int at = 0;
+    for (int k = 0; at < data.size(); ++k) {
+        const int length = k < chunks.size() ? std::min(chunks.at(k), int(data.size()) - at) : int(data.size()) - at;
+        QVector<char32_t> buffer(length + 1);
+        const int count = decoder.decode(data.constData() + at, length, buffer.data());
+        out += buffer.mid(0, count);
+        at += length;
+    }
+    return out;
+}
+
+QVector<char32_t> TestTerminalUtf8Decoder::randomText(QRandomGenerator &random, int length)
+{
+    // Mostly ASCII, like terminal output, with every sequence length mixed in
+    QVector<char32_t> text;
+    while (text.size() < length) {
+        const int kind = random.bounded(10);
+        char32_t cp;
+        if (kind < 6) {
+            cp = char32_t(random.bounded(0x20, 0x7F));
+        } else if (kind < 7) {
+            cp = char32_t(random.bounded(0x80, 0x800));
+        } else if (kind < 9) {
+            cp = char32_t(random.bounded(0x800, 0x10000));
+            if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        } else {
+            cp = char32_t(random.bounded(0x10000, 0x110000));
+        }
+        text.append(cp);
+    }
+    return text;
+}
+
+void TestTerminalUtf8Decoder::testValidSequences()
+{
+    // The boundaries of every sequence length
+    const QVector<char32_t> text = { 0x00, 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFD,
+                                     0xFFFF, 0x10000, 0x1F600, 0x10FFFF, U'a' };
+    QCOMPARE(encode(text).size(), 1 + 1 + 2 + 2 + 3 + 3 + 3 + 3 + 3 + 4 + 4 + 4 + 1);
+    QVERIFY(decode(encode(text)) == text);
+}
+
+void TestTerminalUtf8Decoder::testMalformedSequences_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<QVector<char32_t>>("expected");
+
+    // Each maximal invalid subpart becomes one U+FFFD
+    const char32_t r = TerminalUtf8Decoder::ReplacementCharacter;
+    QTest::newRow("stray continuation") << QByteArray("a\x80" "b") << QVector<char32_t>{ U'a', r, U'b' };
+    QTest::newRow("truncated") << QByteArray("\xE2\x82" "A") << QVector<char32_t>{ r, U'A' };
+    QTest::newRow("truncated twice") << QByteArray("\xF0\x9F\x98\xE2\x82\xAC") << QVector<char32_t>{ r, 0x20AC };
+    QTest::newRow("overlong two") << QByteArray("\xC0\xAF") << QVector<char32_t>{ r, r };
+    QTest::newRow("overlong three") << QByteArray("\xE0\x80\xAF") << QVector<char32_t>{ r, r, r };
+    QTest::newRow("overlong four") << QByteArray("\xF0\x80\x80\xAF") << QVector<char32_t>{ r, r, r, r };
+    QTest::newRow("surrogate") << QByteArray("\xED\xA0\x80") << QVector<char32_t>{ r, r, r };
+    QTest::newRow("past max") << QByteArray("\xF4\x90\x80\x80") << QVector<char32_t>{ r, r, r, r };
+    QTest::newRow("invalid lead") << QByteArray("\xF5\xFF" "z") << QVector<char32_t>{ r, r, U'z' };
+}
+
+void TestTerminalUtf8Decoder::testMalformedSequences()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(QVector<char32_t>, expected);
+
+    QVERIFY(decode(input) == expected);
+
+    // Byte by byte, as a slow PTY would deliver it
+    QVERIFY(decode(input, QVector<int>(input.size(), 1)) == expected);
+}
+
+void TestTerminalUtf8Decoder::testEverySplitPoint()
+{
+    // Every sequence length, plus malformed input, around a 16-byte block
+    const QByteArray data = encode({ U'x', 0xE9, 0x4E2D, 0x1F600, U'y' }) + "0123456789abcdef"
+                            + QByteArray("\xE2\x82" "-\xF0\x9F\x98\x80\xC3");
+    const QVector<char32_t> whole = decode(data);
+
+    for (int first = 0; first <= data.size(); ++first) {
+        QVERIFY2(decode(data, { first }) == whole, qPrintable(QString::number(first)));
+        for (int second = 0; first + second <= data.size(); ++second) {
+            QVERIFY2(decode(data, { first, second }) == whole,
+                     qPrintable(QString::number(first) + "+" + QString::number(second)));
+        }
+    }
+}
+
+void TestTerminalUtf8Decoder::testRandomChunks()
+{
+    QRandomGenerator random(5);
+    const QVector<char32_t> text = randomText(random, 20000);
+    const QByteArray data = encode(text);
+
+    for (int round = 0; round < 20; ++round) {
+        QVector<int> chunks;
+        for (int total = 0; total < data.size();) {
+            chunks.append(1 + random.bounded(round < 10 ? 8 : 64));
+            total += chunks.last();
+        }
+        QVERIFY2(decode(data, chunks) == text, qPrintable(QString::number(round)));
+    }
+}
+
+void TestTerminalUtf8Decoder::testPendingInput()
+{
+    TerminalUtf8Decoder decoder;
+    char32_t out[8];
+
+    // The first bytes of a sequence are held, not replaced
+    QCOMPARE(decoder.decode("\xF0\x9F", 2, out), 0);
+    QVERIFY(decoder.hasPendingInput());
+    QCOMPARE(decoder.decode("\x98", 1, out), 0);
+    QCOMPARE(decoder.decode("\x80" "!", 2, out), 2);
+    QCOMPARE(out[0], char32_t(0x1F600));
+    QCOMPARE(out[1], char32_t(U'!'));
+    QVERIFY(!decoder.hasPendingInput());
+
+    // An escape sequence cuts the partial sequence off
+    QCOMPARE(decoder.decode("\xE2\x82", 2, out), 0);
+    QVERIFY(decoder.interrupt());
+    QVERIFY(!decoder.hasPendingInput());
+    QVERIFY(!decoder.interrupt());
+    QCOMPARE(decoder.decode("\xAC" "a", 2, out), 2);
+    QCOMPARE(out[0], TerminalUtf8Decoder::ReplacementCharacter);
+    QCOMPARE(out[1], char32_t(U'a'));
+}
+
+void TestTerminalUtf8Decoder::testAsciiPrefix()
+{
+    QByteArray data(100, 'a');
+    QCOMPARE(TerminalUtf8Decoder::asciiPrefix(data.constData(), data.size()), 100);
+    for (int at : { 0, 1, 15, 16, 17, 31, 32, 63, 99 }) {
+        QByteArray marked = data;
+        marked[at] = char(0xC3);
+        QCOMPARE(TerminalUtf8Decoder::asciiPrefix(marked.constData(), marked.size()), at);
+    }
+}
+
+QTEST_MAIN(TestTerminalUtf8Decoder)
+#include "test_terminalutf8decoder.moc"
@@ -0,0 +1,258 @@
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include "../shell/qml/keyboard/Data/UserDictionary.h"
+
+class TestUserDictionary : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void testReplay();
+    void testTornTail();
+    void testCorruptRecord();
+    void testCorruptJournalHeader();
+    void testForget();
+    void testCompaction();
+    void testLegacyImport();
+
+private:
+    QTemporaryDir *tempDir;
+    QString basePath;
+    QString legacyPath;
+
+    QString journalPath(int sequence) const;
+};
+
+void TestUserDictionary::init()
+{
+    tempDir = new QTemporaryDir();
+    QVERIFY(tempDir->isValid());
+
+    basePath = tempDir->path() + "/user";
+    legacyPath = tempDir->path() + "/user_words.txt";
+}
+
+void TestUserDictionary::cleanup()
+{
+    delete tempDir;
+}
+
+QString TestUserDictionary::journalPath(int sequence) const
+{
+    return basePath + ".journal." + QString::number(sequence);
+}
+
+void TestUserDictionary::testReplay()
+{
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    dictionary.learn("hello", {});
+    dictionary.learn("world", { "hello" });
+    dictionary.learn("again", { "hello", "world" });
+    dictionary.learn("hello", {});
+    dictionary.adjustFrequency("world", 4);
+    QVERIFY(dictionary.commit());
+    QVERIFY(!dictionary.hasPendingEvents());
+
+    UserDictionary reloaded(basePath);
+    reloaded.load(legacyPath);
+    QCOMPARE(reloaded.words(), dictionary.words());
+    QCOMPARE(reloaded.sequences(), dictionary.sequences());
+    QCOMPARE(reloaded.words().value("hello"), 2u);
+    QCOMPARE(reloaded.words().value("world"), 5u);
+    QCOMPARE(reloaded.sequences().value({ "hello", "world" }), 1u);
+    QCOMPARE(reloaded.sequences().value({ "hello", "world", "again" }), 1u);
+    QCOMPARE(reloaded.files(), QStringList{ journalPath(1) });
+}
+
+void TestUserDictionary::testTornTail()
+{
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        dictionary.learn("hello", {});
+        dictionary.learn("world", { "hello" });
+        QVERIFY(dictionary.commit());
+    }
+
+    // A record cut short by a crash: its header promises more than follows
+    QFile journal(journalPath(1));
+    const qint64 committedSize = journal.size();
+    QVERIFY(journal.open(QIODevice::Append));
+    journal.write(QByteArray::fromHex("40000000abcd") + QByteArray(10, 'x'));
+    journal.close();
+
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    QCOMPARE(dictionary.words().size(), 2);
+    QCOMPARE(QFileInfo(journalPath(1)).size(), committedSize);
+
+    // Appends after the torn record stay readable
+    dictionary.learn("again", {});
+    QVERIFY(dictionary.commit());
+
+    UserDictionary reloaded(basePath);
+    reloaded.load(legacyPath);
+    QCOMPARE(reloaded.words().size(), 3);
+    QVERIFY(reloaded.words().contains("again"));
+}
+
+void TestUserDictionary::testCorruptRecord()
+{
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        dictionary.learn("hello", {});
+        QVERIFY(dictionary.commit());
+        dictionary.learn("world", {});
+        QVERIFY(dictionary.commit());
+    }
+
+    // Damage the last byte of the last record, so its checksum fails
+    QFile journal(journalPath(1));
+    QVERIFY(journal.open(QIODevice::ReadWrite));
+    QByteArray data = journal.readAll();
+    data[data.size() - 1] = char(data.at(data.size() - 1) ^ 0x5a);
+    QVERIFY(journal.seek(0));
+    journal.write(data);
+    journal.close();
+
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    QCOMPARE(dictionary.words().keys(), QStringList{ "hello" });
+}
+
+void TestUserDictionary::testCorruptJournalHeader()
+{
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        dictionary.learn("hello", {});
+        QVERIFY(dictionary.commit());
+    }
+
+    // A newest journal whose header was lost, here cut short
+    QFile journal(journalPath(1));
+    QVERIFY(journal.resize(3));
+
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        QVERIFY(dictionary.words().isEmpty());
+
+        // Words learned now go to a new journal, not after the bad header
+        dictionary.learn("world", {});
+        QVERIFY(dictionary.commit());
+        QCOMPARE(QFileInfo(journalPath(1)).size(), qint64(3));
+        QVERIFY(QFile::exists(journalPath(2)));
+    }
+
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    QCOMPARE(dictionary.words().keys(), QStringList{ "world" });
+    QCOMPARE(dictionary.files(), QStringList{ journalPath(2) });
+
+    // The next compaction removes the unreadable journal
+    UserDictionary::Compaction compaction;
+    QVERIFY(dictionary.startCompaction(&compaction));
+    QVERIFY(UserDictionary::compact(compaction));
+    QVERIFY(!QFile::exists(journalPath(1)));
+}
+
+void TestUserDictionary::testForget()
+{
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        dictionary.learn("hello", {});
+        dictionary.learn("world", { "hello" });
+        dictionary.learn("again", { "hello", "world" });
+        dictionary.forget("world");
+        QVERIFY(dictionary.commit());
+    }
+
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    QVERIFY(!dictionary.words().contains("world"));
+    QVERIFY(dictionary.words().contains("again"));
+    QVERIFY(dictionary.sequences().isEmpty());
+}
+
+void TestUserDictionary::testCompaction()
+{
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    for (int i = 0; i < 100; ++i) {
+        dictionary.learn("word" + QString::number(i % 10), { "word" + QString::number((i + 9) % 10) });
+    }
+
+    // Uncommitted events are committed first, so the snapshot has them
+    UserDictionary::Compaction compaction;
+    QVERIFY(dictionary.startCompaction(&compaction));
+    QCOMPARE(compaction.foldedSequence, quint64(1));
+    QCOMPARE(compaction.words, dictionary.words());
+
+    // Events after the start go to the next journal
+    dictionary.learn("later", { "word9" });
+    QVERIFY(dictionary.commit());
+    QVERIFY(QFile::exists(journalPath(2)));
+
+    QVERIFY(UserDictionary::compact(compaction));
+    QVERIFY(QFile::exists(basePath + ".snapshot"));
+    QVERIFY(!QFile::exists(journalPath(1)));
+    QVERIFY(QFile::exists(journalPath(2)));
+
+    UserDictionary reloaded(basePath);
+    reloaded.load(legacyPath);
+    QCOMPARE(reloaded.words(), dictionary.words());
+    QCOMPARE(reloaded.sequences(), dictionary.sequences());
+    QCOMPARE(reloaded.words().value("word3"), 10u);
+    QCOMPARE(reloaded.files(), (QStringList{ basePath + ".snapshot", journalPath(2) }));
+
+    // A journal the snapshot covers, left by a compaction that stopped
+    // before deleting it, is not replayed again
+    QFile stale(journalPath(1));
+    QVERIFY(QFile::copy(journalPath(2), journalPath(1)));
+    UserDictionary again(basePath);
+    again.load(legacyPath);
+    QCOMPARE(again.words(), dictionary.words());
+    QVERIFY(!stale.exists());
+}
+
+void TestUserDictionary::testLegacyImport()
+{
+    QFile legacy(legacyPath);
+    QVERIFY(legacy.open(QIODevice::WriteOnly | QIODevice::Text));
+    legacy.write("hello\nworld\nagain\n\nhello\nthere\n");
+    legacy.close();
+
+    {
+        UserDictionary dictionary(basePath);
+        dictionary.load(legacyPath);
+        QCOMPARE(dictionary.words().size(), 4);
+        QCOMPARE(dictionary.words().value("hello"), 2u);
+        QCOMPARE(dictionary.sequences().value({ "hello", "world", "again" }), 1u);
+        QCOMPARE(dictionary.sequences().value({ "hello", "there" }), 1u);
+        // A blank line ends the sentence
+        QVERIFY(!dictionary.sequences().contains({ "again", "hello" }));
+        QVERIFY(QFile::exists(basePath + ".snapshot"));
+    }
+
+    // Once imported, the legacy file is not read again
+    QVERIFY(legacy.open(QIODevice::Append | QIODevice::Text));
+    legacy.write("extra\n");
+    legacy.close();
+
+    UserDictionary dictionary(basePath);
+    dictionary.load(legacyPath);
+    QCOMPARE(dictionary.words().size(), 4);
+    QVERIFY(!dictionary.words().contains("extra"));
+}
+
+QTEST_MAIN(TestUserDictionary)
+#include "test_userdictionary.moc"
@@ -0,0 +1,219 @@
+#include <QTest>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QSet>
+#include <algorithm>
+#include "../shell/qml/keyboard/Data/KeyboardGeometry.h"
+#include "../shell/qml/keyboard/Data/WordLexicon.h"
+
+class TestWordLexicon : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testComplete();
+    void testFirstLetter();
+    void testPrefixesOf();
+    void testCorrectMatchesBruteForce();
+    void testCorrectRanksBestFirst();
+
+private:
+    WordLexicon lexicon;
+    QVector<WordLexicon::Word> words;
+    QStringList queries;
+
+    static int editCount(const QString &typed, const QString &word);
+    static int editCost(const QString &typed, const QString &word, const KeyboardGeometry &keys);
+    static bool firstLetterAllowed(const QString &typed, const QString &word, const KeyboardGeometry &keys);
+    // Every word correct() may return for typed, with its cost
+    QMap<QString, int> bruteForce(const QString &typed, const KeyboardGeometry &keys, int maxEdits) const;
+};
+
+void TestWordLexicon::initTestCase()
+{
+    // Pronounceable words, so that many lie within a few edits of each other
+    const QStringList onsets = { "b", "c", "d", "f", "g", "h", "l", "m", "n", "p", "r", "s",
+                                 "t", "st", "tr", "br", "ch", "sh", "th", "w", "qu", "pl", "" };
+    const QStringList nuclei = { "a", "e", "i", "o", "u", "ea", "ou", "ai", "ee", "io" };
+    const QStringList codas = { "", "n", "r", "s", "t", "nd", "st", "ng", "ll", "ck", "m", "x" };
+
+    QRandomGenerator random(7);
+    QSet<QString> seen;
+    while (seen.size() < 5000) {
+        QString word;
+        const int syllables = 1 + random.bounded(3);
+        for (int i = 0; i < syllables; ++i) {
+            word += onsets.at(random.bounded(int(onsets.size())));
+            word += nuclei.at(random.bounded(int(nuclei.size())));
+            if (random.bounded(2)) word += codas.at(random.bounded(int(codas.size())));
+        }
+        if (word.size() < 2 || seen.contains(word)) continue;
+        seen.insert(word);
+        words.append({ word, quint16(1 + random.bounded(1000)) });
+    }
+    QVERIFY(lexicon.setImage(WordLexicon::build(words, 1)));
+    QCOMPARE(lexicon.wordCount(), int(words.size()));
+
+    // Typos of known words: a wrong letter, then maybe one dropped or added
+    for (int i = 0; i < 200; ++i) {
+        QString query = words.at(random.bounded(int(words.size()))).text;
+        query[random.bounded(int(query.size()))] = QChar(u'a' + random.bounded(26));
+        if (random.bounded(2) && query.size() > 3) query.remove(random.bounded(int(query.size())), 1);
+        if (random.bounded(3) == 0) query.insert(random.bounded(int(query.size())), QChar(u'a' + random.bounded(26)));
+        queries.append(query);
+    }
+}
+
+int TestWordLexicon::editCount(const QString &typed, const QString &word)
+{
+    // Levenshtein distance, counting a swap of neighbours as one edit
+    QVector<QVector<int>> d(word.size() + 1, QVector<int>(typed.size() + 1));
+    for (int j = 0; j <= typed.size(); ++j) d[0][j] = j;
+    for (int i = 1; i <= word.size(); ++i) {
+        d[i][0] = i;
+        for (int j = 1; j <= typed.size(); ++j) {
+            int best = d[i - 1][j - 1] + (typed.at(j - 1) != word.at(i - 1));
+            best = std::min({ best, d[i - 1][j] + 1, d[i][j - 1] + 1 });
+            if (i >= 2 && j >= 2 && word.at(i - 1) == typed.at(j - 2) && word.at(i - 2) == typed.at(j - 1))
+                best = std::min(best, d[i - 2][j - 2] + 1);
+            d[i][j] = best;
+        }
+    }
+    return d[word.size()][typed.size()];
+}
+
+int TestWordLexicon::editCost(const QString &typed, const QString &word, const KeyboardGeometry &keys)
+{
+    // The same, weighing substitutions by how far the keys are apart
+    const int edit = KeyboardGeometry::EditCost;
+    QVector<QVector<int>> d(word.size() + 1, QVector<int>(typed.size() + 1));
+    for (int j = 0; j <= typed.size(); ++j) d[0][j] = j * edit;
+    for (int i = 1; i <= word.size(); ++i) {
+        d[i][0] = i * edit;
+        for (int j = 1; j <= typed.size(); ++j) {
+            int best = d[i - 1][j - 1] + keys.substitutionCost(typed.at(j - 1).unicode(), word.at(i - 1).unicode());
+            best = std::min({ best, d[i - 1][j] + edit, d[i][j - 1] + edit });
+            if (i >= 2 && j >= 2 && word.at(i - 1) == typed.at(j - 2) && word.at(i - 2) == typed.at(j - 1))
+                best = std::min(best, d[i - 2][j - 2] + edit);
+            d[i][j] = best;
+        }
+    }
+    return d[word.size()][typed.size()];
+}
+
+bool TestWordLexicon::firstLetterAllowed(const QString &typed, const QString &word, const KeyboardGeometry &keys)
+{
+    return keys.substitutionCost(typed.at(0).unicode(), word.at(0).unicode()) <= KeyboardGeometry::NeighbourCost
+           || (typed.size() > 1 && word.at(0) == typed.at(1));
+}
+
+QMap<QString, int> TestWordLexicon::bruteForce(const QString &typed, const KeyboardGeometry &keys, int maxEdits) const
+{
+    QMap<QString, int> expected;
+    for (const WordLexicon::Word &word : words) {
+        if (firstLetterAllowed(typed, word.text, keys) && editCount(typed, word.text) <= maxEdits)
+            expected.insert(word.text, editCost(typed, word.text, keys));
+    }
+    return expected;
+}
+
+void TestWordLexicon::testComplete()
+{
+    QVector<WordLexicon::Word> matching;
+    for (const WordLexicon::Word &word : std::as_const(words)) {
+        if (word.text.startsWith("th")) matching.append(word);
+    }
+    std::stable_sort(matching.begin(), matching.end(), [](const auto &a, const auto &b) {
+        return a.rank > b.rank;
+    });
+
+    const QStringList completions = lexicon.complete("th", 5);
+    QCOMPARE(completions.size(), 5);
+    for (int i = 0; i < completions.size(); ++i) {
+        QVERIFY(completions.at(i).startsWith("th"));
+        QCOMPARE(lexicon.rank(completions.at(i)), int(matching.at(i).rank));
+    }
+    QVERIFY(lexicon.complete("zzz", 5).isEmpty());
+}
+
+void TestWordLexicon::testFirstLetter()
+{
+    WordLexicon small;
+    QVERIFY(small.setImage(WordLexicon::build({ { "cat", 10 }, { "bat", 10 }, { "act", 10 } }, 1)));
+    const KeyboardGeometry keys = KeyboardGeometry::qwerty();
+
+    // x is next to c but not to b, and "act" is two edits away
+    QStringList found;
+    for (const WordLexicon::Correction &correction : small.correct("xat", keys, 1, 1, 10))
+        found.append(correction.text);
+    QCOMPARE(found, QStringList{ "cat" });
+
+    found.clear();
+    for (const WordLexicon::Correction &correction : small.correct("cta", keys, 1, 1, 10))
+        found.append(correction.text);
+    QVERIFY(found.contains("cat"));
+    QVERIFY(!found.contains("act"));
+}
+
+void TestWordLexicon::testPrefixesOf()
+{
+    WordLexicon small;
+    QVERIFY(small.setImage(WordLexicon::build({ { "haus", 5 }, { "haust", 4 }, { "haustür", 3 }, { "tür", 7 } }, 1)));
+
+    int lengths[4];
+    int ranks[4];
+    QCOMPARE(small.prefixesOf(u"haustürrahmen", lengths, ranks, 4), 3);
+    QCOMPARE(lengths[0], 4);
+    QCOMPARE(lengths[1], 5);
+    QCOMPARE(lengths[2], 7);
+    QCOMPARE(ranks[0], 5);
+    QCOMPARE(ranks[2], 3);
+
+    QCOMPARE(small.prefixesOf(u"haustürrahmen", lengths, ranks, 2), 2);
+    QCOMPARE(small.prefixesOf(u"Haus", lengths, ranks, 4), 0);
+    QCOMPARE(small.prefixesOf(u"hau", lengths, ranks, 4), 0);
+}
+
+void TestWordLexicon::testCorrectMatchesBruteForce()
+{
+    const KeyboardGeometry keys = KeyboardGeometry::qwerty();
+
+    for (int maxEdits = 1; maxEdits <= 2; ++maxEdits) {
+        for (const QString &query : std::as_const(queries)) {
+            QMap<QString, int> found;
+            for (const WordLexicon::Correction &correction : lexicon.correct(query, keys, maxEdits, 10, 1000000)) {
+                QVERIFY2(!found.contains(correction.text), qPrintable(query + " " + correction.text));
+                found.insert(correction.text, correction.cost);
+            }
+            QVERIFY2(found == bruteForce(query, keys, maxEdits),
+                     qPrintable(query + " within " + QString::number(maxEdits)));
+        }
+    }
+}
+
+void TestWordLexicon::testCorrectRanksBestFirst()
+{
+    const KeyboardGeometry keys = KeyboardGeometry::qwerty();
+    const int rankPerCost = 10;
+
+    for (const QString &query : std::as_const(queries)) {
+        const QMap<QString, int> expected = bruteForce(query, keys, 2);
+        QVector<int> scores;
+        for (auto it = expected.constBegin(); it != expected.constEnd(); ++it)
+            scores.append(lexicon.rank(it.key()) - it.value() * rankPerCost);
+        std::sort(scores.begin(), scores.end(), std::greater<int>());
+
+        const QVector<WordLexicon::Correction> best = lexicon.correct(query, keys, 2, rankPerCost, 5);
+        QCOMPARE(best.size(), std::min(5, int(scores.size())));
+        for (int i = 0; i < best.size(); ++i) {
+            const WordLexicon::Correction &correction = best.at(i);
+            QCOMPARE(correction.cost, expected.value(correction.text, -1));
+            QCOMPARE(correction.rank, lexicon.rank(correction.text));
+            QCOMPARE(correction.score, scores.at(i));
+        }
+    }
+}
+
+QTEST_MAIN(TestWordLexicon)
+#include "test_wordlexicon.moc"